@@ -11,6 +11,8 @@
 #include "glib_util.h"
 #include "gps_linearize.h"
 #include "lcm_util.h"
+#include "occ_grid.h"
+#include "lcm_shm.h"
 #include "minheap.h"
 #include "ppm.h"
 #include "ptr_circular.h"
@@ -19,6 +21,7 @@
 #include "set.h"
 #include "signal_pipe.h"
 #include "ssocket.h"
+#include "tcp_server.h"
 #include "tictoc.h"
 #include "timespec.h"
 #include "timestamp.h"
@@ -26,6 +29,8 @@
 #include "color_util.h"
 #include "rand_util.h"
 #include "ringbuf.h"
+#include "sync.h"
+#include "trace.h"
 
 #include <lcmtypes/bot_core_image_t.h>
 #include <lcmtypes/bot_core_image_sync_t.h>
@@ -3,6 +3,8 @@
 #include <math.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "fasttrig.h"
 #include "small_linalg.h"
@@ -618,3 +620,297 @@ bot_camtrans_scale_image (BotCamTrans *self,
         self->inv_matx[3*i+1] *= inv_scale_factor;
     }
 }
+
+// Point cloud projection
+//
+// The lookup table samples the mapping from normalized image coordinates
+// (x/z, y/z) to distorted pixel coordinates on a regular grid, with a node
+// every PROJECTOR_LUT_STEP pixels or so, and is interpolated bilinearly.
+//
+// The z-buffer packs the depth of the nearest point at each pixel, as float
+// bits (which order like the floats, for positive floats), with the index
+// of the point, into one 64 bit word.  Threads update it with an atomic
+// compare-and-swap, so the nearest point wins regardless of the order in
+// which the points are projected.
+
+#define PROJECTOR_LUT_STEP 4
+#define PROJECTOR_LUT_MARGIN 2
+#define PROJECTOR_CHUNK 1024
+#define PROJECTOR_MIN_POINTS_PER_THREAD 32768
+#define PROJECTOR_MAX_THREADS 64
+#define ZBUF_EMPTY UINT64_MAX
+
+struct _BotCamTransProjector {
+    const BotCamTrans *camtrans;
+    int width;
+    int height;
+    int num_threads;
+
+    int lut_w;
+    int lut_h;
+    float lut_x0;
+    float lut_y0;
+    float lut_inv_step_x;
+    float lut_inv_step_y;
+    float *lut_u;
+    float *lut_v;
+
+    uint64_t *zbuf;
+};
+
+typedef struct {
+    BotCamTransProjector *proj;
+    float rot[9];
+    float trans[3];
+    float min_depth;
+    float max_depth;
+    const float *points;
+    int start;
+    int end;
+} ProjectorJob;
+
+BotCamTransProjector *
+bot_camtrans_projector_new (const BotCamTrans *camtrans, int num_threads)
+{
+    int width = (int) camtrans->width;
+    int height = (int) camtrans->height;
+    if (width <= 0 || height <= 0)
+        return NULL;
+
+    // find the normalized coordinates that can land in the image
+    double xmin = INFINITY, xmax = -INFINITY;
+    double ymin = INFINITY, ymax = -INFINITY;
+    for (int v = 0; v <= height; v += PROJECTOR_LUT_STEP) {
+        for (int u = 0; u <= width; u += PROJECTOR_LUT_STEP) {
+            double ray[3] = { NAN, NAN, NAN };
+            if (0 != bot_camtrans_unproject_pixel (camtrans, u - 0.5, v - 0.5,
+                                                   ray) ||
+                !(ray[2] > CAMERA_EPSILON))
+                continue;
+            double nx = ray[0] / ray[2];
+            double ny = ray[1] / ray[2];
+            if (!isfinite (nx) || !isfinite (ny))
+                continue;
+            xmin = fmin (xmin, nx);
+            xmax = fmax (xmax, nx);
+            ymin = fmin (ymin, ny);
+            ymax = fmax (ymax, ny);
+        }
+    }
+    if (!(xmax > xmin) || !(ymax > ymin)) {
+        ERR ("can't sample the distortion model of camera %s\n",
+             camtrans->name ? camtrans->name : "");
+        return NULL;
+    }
+
+    BotCamTransProjector *proj =
+        (BotCamTransProjector *) calloc (1, sizeof (BotCamTransProjector));
+    proj->camtrans = camtrans;
+    proj->width = width;
+    proj->height = height;
+
+    if (num_threads <= 0)
+        num_threads = sysconf (_SC_NPROCESSORS_ONLN);
+    if (num_threads < 1)
+        num_threads = 1;
+    if (num_threads > PROJECTOR_MAX_THREADS)
+        num_threads = PROJECTOR_MAX_THREADS;
+    proj->num_threads = num_threads;
+
+    // nodes every PROJECTOR_LUT_STEP pixels, plus a margin on each side
+    int nodes_x = width / PROJECTOR_LUT_STEP + 1;
+    int nodes_y = height / PROJECTOR_LUT_STEP + 1;
+    double step_x = (xmax - xmin) / (nodes_x - 1);
+    double step_y = (ymax - ymin) / (nodes_y - 1);
+    proj->lut_w = nodes_x + 2 * PROJECTOR_LUT_MARGIN;
+    proj->lut_h = nodes_y + 2 * PROJECTOR_LUT_MARGIN;
+    proj->lut_x0 = xmin - PROJECTOR_LUT_MARGIN * step_x;
+    proj->lut_y0 = ymin - PROJECTOR_LUT_MARGIN * step_y;
+    proj->lut_inv_step_x = 1 / step_x;
+    proj->lut_inv_step_y = 1 / step_y;
+
+    int lut_size = proj->lut_w * proj->lut_h;
+    proj->lut_u = (float *) malloc (lut_size * sizeof (float));
+    proj->lut_v = (float *) malloc (lut_size * sizeof (float));
+    for (int j = 0; j < proj->lut_h; j++) {
+        for (int i = 0; i < proj->lut_w; i++) {
+            double p[3] = { proj->lut_x0 + i * step_x,
+                            proj->lut_y0 + j * step_y, 1 };
+            double im[3];
+            int k = j * proj->lut_w + i;
+            if (0 == bot_camtrans_project_point (camtrans, p, im)) {
+                proj->lut_u[k] = im[0];
+                proj->lut_v[k] = im[1];
+            } else {
+                // NaN fails the bounds checks of any point interpolated
+                // from this node
+                proj->lut_u[k] = NAN;
+                proj->lut_v[k] = NAN;
+            }
+        }
+    }
+
+    proj->zbuf = (uint64_t *) malloc ((size_t) width * height * sizeof (uint64_t));
+    return proj;
+}
+
+void
+bot_camtrans_projector_destroy (BotCamTransProjector *proj)
+{
+    free (proj->lut_u);
+    free (proj->lut_v);
+    free (proj->zbuf);
+    free (proj);
+}
+
+static void
+projector_run_job (ProjectorJob *job)
+{
+    BotCamTransProjector *proj = job->proj;
+    const float *R = job->rot;
+    const float *t = job->trans;
+    const float lut_x0 = proj->lut_x0;
+    const float lut_y0 = proj->lut_y0;
+    const float inv_sx = proj->lut_inv_step_x;
+    const float inv_sy = proj->lut_inv_step_y;
+    const float gx_max = proj->lut_w - 1;
+    const float gy_max = proj->lut_h - 1;
+    const int lut_w = proj->lut_w;
+    const float max_u = proj->width - 0.5f;
+    const float max_v = proj->height - 0.5f;
+
+    float gx[PROJECTOR_CHUNK];
+    float gy[PROJECTOR_CHUNK];
+    float z[PROJECTOR_CHUNK];
+
+    for (int start = job->start; start < job->end; start += PROJECTOR_CHUNK) {
+        int n = job->end - start;
+        if (n > PROJECTOR_CHUNK)
+            n = PROJECTOR_CHUNK;
+        const float *p = job->points + 3 * (size_t) start;
+
+        // transform and normalize.  Kept free of branches, so that the
+        // compiler can vectorize it.
+        for (int k = 0; k < n; k++) {
+            float px = p[3*k], py = p[3*k+1], pz = p[3*k+2];
+            float cx = R[0]*px + R[1]*py + R[2]*pz + t[0];
+            float cy = R[3]*px + R[4]*py + R[5]*pz + t[1];
+            float cz = R[6]*px + R[7]*py + R[8]*pz + t[2];
+            float inv_z = 1.0f / cz;
+            z[k] = cz;
+            gx[k] = (cx * inv_z - lut_x0) * inv_sx;
+            gy[k] = (cy * inv_z - lut_y0) * inv_sy;
+        }
+
+        for (int k = 0; k < n; k++) {
+            if (!(z[k] >= job->min_depth && z[k] <= job->max_depth) ||
+                !(gx[k] >= 0 && gx[k] < gx_max &&
+                  gy[k] >= 0 && gy[k] < gy_max))
+                continue;
+
+            int i = (int) gx[k];
+            int j = (int) gy[k];
+            float fx = gx[k] - i;
+            float fy = gy[k] - j;
+            int n00 = j * lut_w + i;
+            float w00 = (1 - fx) * (1 - fy), w10 = fx * (1 - fy);
+            float w01 = (1 - fx) * fy, w11 = fx * fy;
+            float u = w00 * proj->lut_u[n00] + w10 * proj->lut_u[n00 + 1] +
+                w01 * proj->lut_u[n00 + lut_w] + w11 * proj->lut_u[n00 + lut_w + 1];
+            float v = w00 * proj->lut_v[n00] + w10 * proj->lut_v[n00 + 1] +
+                w01 * proj->lut_v[n00 + lut_w] + w11 * proj->lut_v[n00 + lut_w + 1];
+            if (!(u >= -0.5f && u < max_u && v >= -0.5f && v < max_v))
+                continue;
+
+            int col = (int) (u + 0.5f);
+            int row = (int) (v + 0.5f);
+            union { float f; uint32_t u; } depth = { z[k] };
+            uint64_t packed = ((uint64_t) depth.u << 32) |
+                (uint32_t) (start + k);
+            uint64_t *cell = &proj->zbuf[(size_t) row * proj->width + col];
+            uint64_t cur = __atomic_load_n (cell, __ATOMIC_RELAXED);
+            while (packed < cur &&
+                   !__atomic_compare_exchange_n (cell, &cur, packed, 1,
+                                                 __ATOMIC_RELAXED,
+                                                 __ATOMIC_RELAXED))
+                ;
+        }
+    }
+}
+
+static void *
+projector_thread (void *user)
+{
+    projector_run_job ((ProjectorJob *) user);
+    return NULL;
+}
+
+int
+bot_camtrans_projector_project_depth (BotCamTransProjector *proj,
+                                      const BotTrans *points_to_camera,
+                                      const float *points,
+                                      int num_points,
+                                      double min_depth,
+                                      double max_depth,
+                                      float *depth_image,
+                                      int32_t *index_image)
+{
+    size_t num_pixels = (size_t) proj->width * proj->height;
+    memset (proj->zbuf, 0xff, num_pixels * sizeof (uint64_t));
+
+    double rot[9];
+    bot_trans_get_rot_mat_3x3 (points_to_camera, rot);
+
+    ProjectorJob job;
+    job.proj = proj;
+    for (int i = 0; i < 9; i++)
+        job.rot[i] = rot[i];
+    for (int i = 0; i < 3; i++)
+        job.trans[i] = points_to_camera->trans_vec[i];
+    job.min_depth = fmax (min_depth, CAMERA_EPSILON);
+    job.max_depth = max_depth > 0 ? max_depth : INFINITY;
+    job.points = points;
+
+    int num_threads = num_points / PROJECTOR_MIN_POINTS_PER_THREAD;
+    if (num_threads > proj->num_threads)
+        num_threads = proj->num_threads;
+    if (num_threads < 1)
+        num_threads = 1;
+
+    ProjectorJob jobs[PROJECTOR_MAX_THREADS];
+    pthread_t threads[PROJECTOR_MAX_THREADS];
+    int started[PROJECTOR_MAX_THREADS];
+    for (int i = 0; i < num_threads; i++) {
+        jobs[i] = job;
+        jobs[i].start = (int64_t) num_points * i / num_threads;
+        jobs[i].end = (int64_t) num_points * (i + 1) / num_threads;
+    }
+    // the calling thread takes the first job
+    for (int i = 1; i < num_threads; i++)
+        started[i] = 0 == pthread_create (&threads[i], NULL, projector_thread,
+                                          &jobs[i]);
+    projector_run_job (&jobs[0]);
+    for (int i = 1; i < num_threads; i++) {
+        if (started[i])
+            pthread_join (threads[i], NULL);
+        else
+            projector_run_job (&jobs[i]);
+    }
+
+    int count = 0;
+    for (size_t i = 0; i < num_pixels; i++) {
+        uint64_t packed = proj->zbuf[i];
+        if (packed == ZBUF_EMPTY) {
+            depth_image[i] = 0;
+            if (index_image)
+                index_image[i] = -1;
+            continue;
+        }
+        union { uint32_t u; float f; } depth = { packed >> 32 };
+        depth_image[i] = depth.f;
+        if (index_image)
+            index_image[i] = (int32_t) (packed & 0xffffffff);
+        count++;
+    }
+    return count;
+}
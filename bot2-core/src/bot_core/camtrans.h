@@ -11,6 +11,9 @@
  * @{
  */
 
+#include <stdint.h>
+#include "trans.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -191,6 +194,60 @@ extern "C" {
      */
     void bot_camtrans_scale_image (BotCamTrans *self, const double scale_factor);
 
+    /**
+     * BotCamTransProjector:
+     *
+     * Projects point clouds (e.g., lidar returns) into a camera image, to
+     * make a depth image and an index image, with z-buffering.  The camera's
+     * distortion model is sampled once into a lookup table, so projecting a
+     * point costs a rigid transform, a division, and a bilinear lookup.
+     * Points are transformed and projected in chunks, in several threads.
+     *
+     * A projector keeps a reference to its BotCamTrans, and must be
+     * recreated if the camera is rescaled with bot_camtrans_scale_image().
+     * One projector can't be used from several threads at once.
+     */
+    typedef struct _BotCamTransProjector BotCamTransProjector;
+
+    /**
+     * bot_camtrans_projector_new:
+     * @num_threads: number of threads to project with, or 0 to use one per
+     *               CPU.
+     *
+     * Returns: a new projector, or NULL if the distortion model of @camtrans
+     * can't be sampled.
+     */
+    BotCamTransProjector *
+    bot_camtrans_projector_new (const BotCamTrans *camtrans, int num_threads);
+
+    void bot_camtrans_projector_destroy (BotCamTransProjector *projector);
+
+    /**
+     * bot_camtrans_projector_project_depth:
+     * @points_to_camera: pose of the point cloud's frame in the camera frame
+     *                    (z forward), e.g., from bot_frames_get_trans().
+     * @points: @num_points x, y, z triples.
+     * @min_depth: points closer to the camera than this are ignored.
+     * @max_depth: points farther than this are ignored, or 0 for no limit.
+     * @depth_image: output, image width x height depths along the optical
+     *               axis, row major.  0 where no point projects.
+     * @index_image: output, image width x height indices into @points of the
+     *               nearest point at each pixel, or -1.  May be NULL.
+     *
+     * Projects each point into the pixel that contains it, and keeps the
+     * nearest point at each pixel.
+     *
+     * Returns: the number of pixels that have a point.
+     */
+    int bot_camtrans_projector_project_depth (BotCamTransProjector *projector,
+                                              const BotTrans *points_to_camera,
+                                              const float *points,
+                                              int num_points,
+                                              double min_depth,
+                                              double max_depth,
+                                              float *depth_image,
+                                              int32_t *index_image);
+
     /**
      * @}
      */
@@ -62,7 +62,7 @@ BotCTransPath * bot_ctrans_get_new_path(BotCTrans * ctrans,
  *
  * Returns: 1 on success, 0 on failure
  */
-int bot_ctrans_path_to_trans(const BotCTransPath * path,
+int bot_ctrans_path_to_trans(BotCTransPath * path,
         int64_t utime, BotTrans *result);
 
 /**
@@ -70,7 +70,7 @@ int bot_ctrans_path_to_trans(const BotCTransPath * path,
  *
  * Returns: 1 on success, 0 on failure
  */
-int bot_ctrans_path_to_trans_latest(const BotCTransPath * path,
+int bot_ctrans_path_to_trans_latest(BotCTransPath * path,
         BotTrans *result);
 
 /**
@@ -78,7 +78,7 @@ int bot_ctrans_path_to_trans_latest(const BotCTransPath * path,
  *
  * Returns: 1 on success, 0 on failure
  */
-int bot_ctrans_path_latest_timestamp(const BotCTransPath * path,
+int bot_ctrans_path_latest_timestamp(BotCTransPath * path,
         int64_t *timestamp);
 
 /**
@@ -86,7 +86,7 @@ int bot_ctrans_path_latest_timestamp(const BotCTransPath * path,
  *
  * Returns: 1 if a transformation is available for this path, 0 if not.
  */
-int bot_ctrans_path_have_trans(const BotCTransPath *path);
+int bot_ctrans_path_have_trans(BotCTransPath *path);
 
 typedef struct _BotCTransFrame BotCTransFrame;
 struct _BotCTransFrame
@@ -102,11 +102,17 @@ typedef struct {
 
 struct _BotCTransLink
 {
+    BotCTrans *ctrans;
     BotCTransFrame *frame_from;
     BotCTransFrame *frame_to;
     char * id;
     int history_maxlen;
 
+    // links that have been updated exactly once (e.g., with an initial
+    // transform from a config file) are static, and get folded into a single
+    // transformation when they are consecutive in a path
+    int64_t n_updates;
+
     BotTrans static_trans;
     BotCircular * trans_history;
 };
@@ -161,6 +167,8 @@ bot_ctrans_frame_get_id(const BotCTransFrame *frame)
     return frame->id;
 }
 
+static void _invalidate_folds(BotCTrans *ctrans);
+
 // =========== link ==========
 
 static inline char * 
@@ -187,10 +195,12 @@ _make_link_id2(const char * frame_a_id, const char * frame_b_id,
 }
 
 static BotCTransLink *
-_link_new(BotCTransFrame *frame_from, BotCTransFrame *frame_to,
-        int history_maxlen)
+_link_new(BotCTrans *ctrans, BotCTransFrame *frame_from, 
+        BotCTransFrame *frame_to, int history_maxlen)
 {
     BotCTransLink *link = g_slice_new(BotCTransLink);
+    link->ctrans = ctrans;
+    link->n_updates = 0;
     link->frame_from = frame_from;
     link->frame_to = frame_to;
     link->id = _make_link_id(frame_from->id, frame_to->id);
@@ -239,6 +249,17 @@ bot_ctrans_link_update(BotCTransLink * link, const BotTrans *transformation,
     }
 
     bot_circular_push_head(link->trans_history, &ttrans);
+
+    // the link just became static, or stopped being static
+    link->n_updates++;
+    if(link->n_updates <= 2)
+        _invalidate_folds(link->ctrans);
+}
+
+static inline gboolean
+_link_is_static(const BotCTransLink *link)
+{
+    return link->n_updates == 1;
 }
 
 static gboolean
@@ -333,8 +354,18 @@ struct _BotCTrans
     GHashTable * links;
 
     GHashTable * path_cache;
+
+    // incremented whenever a link becomes static or stops being static.
+    // Paths refold their static links when this changes.
+    int64_t fold_generation;
 };
 
+static void
+_invalidate_folds(BotCTrans *ctrans)
+{
+    ctrans->fold_generation++;
+}
+
 BotCTrans * 
 bot_ctrans_new(void)
 {
@@ -345,6 +376,7 @@ bot_ctrans_new(void)
             NULL, (GDestroyNotify)_link_destroy);
     ctrans->path_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
             free, (GDestroyNotify)bot_ctrans_path_destroy);
+    ctrans->fold_generation = 0;
     return ctrans;
 }
 
@@ -426,7 +458,8 @@ bot_ctrans_link_frames(BotCTrans * ctrans,
         history_maxlen = 1;
     }
 
-    BotCTransLink *link = _link_new(from_frame, to_frame, history_maxlen);
+    BotCTransLink *link = _link_new(ctrans, from_frame, to_frame, 
+            history_maxlen);
     g_hash_table_insert(ctrans->links, link->id, link);
     _frame_add_link(from_frame, link);
     _frame_add_link(to_frame, link);
@@ -496,19 +529,40 @@ bot_ctrans_get_trans_latest_timestamp(BotCTrans *ctrans,
 
 // ========= path ==========
 
+/*
+ * A path is evaluated as a sequence of segments.  A segment is either a
+ * single dynamic link, which is interpolated at evaluation time, or a run of
+ * consecutive static links, which is composed once when the path is folded.
+ */
+typedef struct {
+    BotCTransLink *link;    // NULL for a folded run of static links
+    int invert;
+    BotTrans trans;         // composed static links
+    int64_t utime;          // most recent timestamp of the static links
+} PathSegment;
+
 struct _BotCTransPath {
     int nlinks;
     BotCTransLink ** links;
     int *invert;
+
+    BotCTrans *ctrans;
+    int64_t fold_generation;
+    int nsegments;
+    PathSegment *segments;
 };
 
 static BotCTransPath * 
-_path_new(int nlinks)
+_path_new(BotCTrans *ctrans, int nlinks)
 {
     BotCTransPath * path = g_slice_new(BotCTransPath);
     path->nlinks = nlinks;
     path->links = g_slice_alloc0(nlinks*sizeof(BotCTransLink*));
     path->invert = g_slice_alloc0(nlinks*sizeof(int));
+    path->ctrans = ctrans;
+    path->fold_generation = ctrans->fold_generation - 1;
+    path->nsegments = 0;
+    path->segments = g_slice_alloc0(MAX(nlinks, 1)*sizeof(PathSegment));
     return path;
 }
 
@@ -517,9 +571,48 @@ bot_ctrans_path_destroy(BotCTransPath * path)
 {
     g_slice_free1(path->nlinks*sizeof(BotCTransLink*), path->links);
     g_slice_free1(path->nlinks*sizeof(int), path->invert);
+    g_slice_free1(MAX(path->nlinks, 1)*sizeof(PathSegment), path->segments);
     g_slice_free(BotCTransPath, path);
 }
 
+static void
+_path_fold(BotCTransPath *path)
+{
+    if(path->fold_generation == path->ctrans->fold_generation)
+        return;
+
+    path->nsegments = 0;
+    PathSegment *run = NULL;
+    for(int lind=0; lind<path->nlinks; lind++) {
+        BotCTransLink *link = path->links[lind];
+        if(!_link_is_static(link)) {
+            PathSegment *seg = &path->segments[path->nsegments++];
+            seg->link = link;
+            seg->invert = path->invert[lind];
+            run = NULL;
+            continue;
+        }
+
+        TimestampedTrans *ttrans = bot_circular_peek_nth(link->trans_history, 0);
+        BotTrans temp_trans = ttrans->trans;
+        if(path->invert[lind]) {
+            bot_trans_invert(&temp_trans);
+        }
+        if(!run) {
+            run = &path->segments[path->nsegments++];
+            run->link = NULL;
+            run->invert = 0;
+            run->trans = temp_trans;
+            run->utime = ttrans->utime;
+        } else {
+            bot_trans_apply_trans(&run->trans, &temp_trans);
+            if(ttrans->utime > run->utime)
+                run->utime = ttrans->utime;
+        }
+    }
+    path->fold_generation = path->ctrans->fold_generation;
+}
+
 const char * 
 bot_ctrans_path_get_frame_from(BotCTransPath *path)
 {
@@ -682,7 +775,7 @@ bot_ctrans_get_new_path(BotCTrans * ctrans,
         nlinks++;
     }
 
-    BotCTransPath *path = _path_new(nlinks);
+    BotCTransPath *path = _path_new(ctrans, nlinks);
     node = to_node;
     int nind = nlinks - 1;
     while(node && node->frame != from_frame) {
@@ -703,18 +796,23 @@ bot_ctrans_get_new_path(BotCTrans * ctrans,
 }
         
 int
-bot_ctrans_path_to_trans(const BotCTransPath * path,
+bot_ctrans_path_to_trans(BotCTransPath * path,
         int64_t utime, BotTrans *result)
 {
+    _path_fold(path);
     bot_trans_set_identity(result);
     BotTrans temp_trans;
-    for(int lind=0; lind<path->nlinks; lind++) {
-        BotCTransLink *link = path->links[lind];
-        int have_trans = _link_get_trans_interp(link, utime, &temp_trans);
+    for(int sind=0; sind<path->nsegments; sind++) {
+        PathSegment *seg = &path->segments[sind];
+        if(!seg->link) {
+            bot_trans_apply_trans(result, &seg->trans);
+            continue;
+        }
+        int have_trans = _link_get_trans_interp(seg->link, utime, &temp_trans);
         if(!have_trans) {
             return 0;
         }
-        if(path->invert[lind]) {
+        if(seg->invert) {
             bot_trans_invert(&temp_trans);
         }
         bot_trans_apply_trans(result, &temp_trans);
@@ -723,17 +821,22 @@ bot_ctrans_path_to_trans(const BotCTransPath * path,
 }
 
 int
-bot_ctrans_path_to_trans_latest(const BotCTransPath * path, BotTrans *result)
+bot_ctrans_path_to_trans_latest(BotCTransPath * path, BotTrans *result)
 {
+    _path_fold(path);
     bot_trans_set_identity(result);
     BotTrans temp_trans;
-    for(int lind=0; lind<path->nlinks; lind++) {
-        BotCTransLink *link = path->links[lind];
-        int have_trans = _link_get_trans_latest(link, &temp_trans);
+    for(int sind=0; sind<path->nsegments; sind++) {
+        PathSegment *seg = &path->segments[sind];
+        if(!seg->link) {
+            bot_trans_apply_trans(result, &seg->trans);
+            continue;
+        }
+        int have_trans = _link_get_trans_latest(seg->link, &temp_trans);
         if(!have_trans) {
             return 0;
         }
-        if(path->invert[lind]) {
+        if(seg->invert) {
             bot_trans_invert(&temp_trans);
         }
         bot_trans_apply_trans(result, &temp_trans);
@@ -742,20 +845,20 @@ bot_ctrans_path_to_trans_latest(const BotCTransPath * path, BotTrans *result)
 }
 
 int 
-bot_ctrans_path_latest_timestamp(const BotCTransPath * path,
+bot_ctrans_path_latest_timestamp(BotCTransPath * path,
         int64_t *timestamp)
 {
+    _path_fold(path);
     int64_t result = 0;
-    for(int lind=0; lind<path->nlinks; lind++) {
-        BotCTransLink *link = path->links[lind];
-        int64_t link_timestamp;
-        int have_trans = bot_ctrans_link_get_nth_trans(link, 0, NULL, 
-                &link_timestamp);
-        if(!have_trans) {
+    for(int sind=0; sind<path->nsegments; sind++) {
+        PathSegment *seg = &path->segments[sind];
+        int64_t seg_timestamp = seg->utime;
+        if(seg->link && !bot_ctrans_link_get_nth_trans(seg->link, 0, NULL, 
+                    &seg_timestamp)) {
             return 0;
         }
-        if(0 == lind || link_timestamp > result)
-            result = link_timestamp;
+        if(0 == sind || seg_timestamp > result)
+            result = seg_timestamp;
     }
     assert(timestamp);
     *timestamp = result;
@@ -763,16 +866,37 @@ bot_ctrans_path_latest_timestamp(const BotCTransPath * path,
 }
 
 int 
-bot_ctrans_path_have_trans(const BotCTransPath *path)
+bot_ctrans_path_have_trans(BotCTransPath *path)
 {
-    for(int lind=0; lind<path->nlinks; lind++) {
-        if(!_link_have_trans(path->links[lind])) {
+    _path_fold(path);
+    for(int sind=0; sind<path->nsegments; sind++) {
+        PathSegment *seg = &path->segments[sind];
+        if(seg->link && !_link_have_trans(seg->link)) {
             return 0;
         }
     }
     return 1;
 }
 
+int
+bot_ctrans_write_dot(BotCTrans *ctrans, FILE *fp)
+{
+    if(fprintf(fp, "digraph ctrans {\n") < 0)
+        return -1;
+    GList *links = bot_g_hash_table_get_vals(ctrans->links);
+    for(GList *iter=links; iter; iter=iter->next) {
+        BotCTransLink *link = iter->data;
+        fprintf(fp, "  \"%s\" -> \"%s\" [label=\"%d\"%s];\n", 
+                link->frame_from->id, link->frame_to->id, 
+                bot_circular_size(link->trans_history),
+                _link_is_static(link) ? ", style=dashed" : "");
+    }
+    g_list_free(links);
+    if(fprintf(fp, "}\n") < 0)
+        return -1;
+    return 0;
+}
+
 void bot_ctrans_path_dump(const BotCTransPath *path);
 void
 bot_ctrans_path_dump(const BotCTransPath *path) 
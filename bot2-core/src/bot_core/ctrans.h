@@ -1,6 +1,7 @@
 #ifndef __bot_ctrans_h__
 #define __bot_ctrans_h__
 
+#include <stdio.h>
 #include <stdint.h>
 
 #include "trans.h"
@@ -20,6 +21,12 @@
  * graph.  The path is then traversed from source to target, and the rigid body
  * transformations are composed together to form a single transformation.
  *
+ * Links that have been updated exactly once, such as links that only have
+ * an initial transformation, are treated as static.  Consecutive static links
+ * in a path are composed once and cached, so that only the time-varying
+ * links of a path are interpolated when the path is evaluated.  The cached
+ * composition is recomputed if one of the static links is updated again.
+ *
  * Linking: `pkg-config --libs bot2-core`
  *
  * @{
@@ -185,6 +192,17 @@ int bot_ctrans_link_get_nth_trans(BotCTransLink * link,
 const char * bot_ctrans_link_get_from_frame(BotCTransLink *link);
 const char * bot_ctrans_link_get_to_frame(BotCTransLink *link);
 
+/**
+ * bot_ctrans_write_dot:
+ *
+ * Writes the coordinate frame graph to @fp in Graphviz dot format.  Each link
+ * is labeled with the number of transformations stored for it, and static
+ * links are drawn dashed.
+ *
+ * Returns: 0 on success, -1 on failure
+ */
+int bot_ctrans_write_dot(BotCTrans *ctrans, FILE *fp);
+
 /**
  * @}
  */
@@ -0,0 +1,1045 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include <glib.h>
+
+#include "timestamp.h"
+#include "lcm_shm.h"
+
+#define dbg(args...) fprintf(stderr, args)
+#undef dbg
+#define dbg(args...)
+
+#define SHM_MAGIC   0x4c534d31
+#define SHM_VERSION 2
+
+#define SHM_NAME_PREFIX "/bot_lcm_shm."
+#define SHM_MAX_CHANNEL_LEN 255
+
+#define DEFAULT_NUM_SLOTS 16
+#define MIN_SLOT_SIZE 65536
+
+// maximum number of subscribers handling the message in a slot at once
+#define SHM_MAX_READERS 16
+
+// how often subscribers look for new segments
+#define CHECK_INTERVAL_USEC 250000
+
+// how long a subscriber waits for the second copy of a message that is
+// delivered both through shared memory and through the network
+#define MIRROR_WINDOW_USEC 1000000
+#define MAX_PENDING_COPIES 1024
+
+// slot sequence numbers that don't correspond to a message
+#define SLOT_WRITING UINT64_MAX
+#define SLOT_EMPTY   (UINT64_MAX - 1)
+
+// slot flags
+#define SLOT_MIRRORED 1   // the message was also published on the network
+
+#define ALIGN64(x) (((x) + 63) & ~((uint64_t) 63))
+
+// Segment layout: a _shm_header_t, followed by num_slots slots.  Each slot is
+// a _slot_header_t, followed by slot_size bytes of message data.
+typedef struct {
+    volatile uint32_t magic;
+    uint32_t version;
+    uint32_t num_slots;
+    uint32_t reserved;
+    uint64_t slot_size;
+    char channel[SHM_MAX_CHANNEL_LEN + 1];
+
+    // serializes publishers of the channel
+    pthread_mutex_t publish_mutex;
+
+    // time of the last message that was also published on the network.
+    // Subscribers only look for duplicate network copies after that.
+    volatile int64_t mirror_utime;
+
+    // set when the segment is replaced by a larger one, or the publisher
+    // goes away.  Subscribers detach from retired segments.
+    volatile int32_t retired;
+
+    // incremented after each message, for subscribers to futex-wait on
+    volatile uint32_t futex;
+    volatile int32_t waiters;
+
+    // sequence number of the next message to be published
+    volatile uint64_t write_seq;
+} _shm_header_t;
+
+typedef struct {
+    // sequence number of the message in this slot, SLOT_WRITING while the
+    // publisher is writing to it, or SLOT_EMPTY
+    volatile uint64_t seq;
+    // pids of the subscribers currently handling the message in this slot,
+    // or 0.  The publisher does not overwrite a slot that is being read by a
+    // live process.
+    volatile int32_t reader_pids[SHM_MAX_READERS];
+    uint32_t datalen;
+    uint32_t flags;
+    int64_t utime;
+    // hash of the message, to recognize its network copy
+    uint64_t hash;
+} _slot_header_t;
+
+// identifies a message that was delivered through one transport, and whose
+// copy on the other transport must not be delivered again
+typedef struct {
+    uint64_t hash;
+    uint32_t datalen;
+    int64_t utime;
+} _msg_copy_t;
+
+typedef struct {
+    char *name;
+    void *base;
+    size_t size;
+    _shm_header_t *hdr;
+} _segment_t;
+
+// a retired segment whose remaining messages haven't been dispatched yet
+typedef struct {
+    _segment_t *seg;
+    uint64_t next_seq;
+} _retired_segment_t;
+
+struct _BotLcmShm {
+    lcm_t *lcm;
+    GMutex *mutex;
+    int32_t pid;
+
+    int num_slots;
+    int network_mirror;
+
+    // channel name -> _segment_t, for channels published by this instance
+    GHashTable *publish_segments;
+
+    GList *subscriptions;
+
+    // the notify threads of the subscriptions write a byte to this pipe when
+    // there are new messages
+    int notify_fds[2];
+    volatile gint notify_pending;
+};
+
+struct _BotLcmShmSubscription {
+    BotLcmShm *shm;
+    char *channel;
+    lcm_msg_handler_t handler;
+    void *user;
+    lcm_subscription_t *lcm_sub;
+
+    // protected by shm->mutex.  A subscription that is unsubscribed while
+    // its messages are being dispatched is freed once the dispatch returns.
+    int dispatching;
+    int unsubscribed;
+
+    // protects the fields below.  Only the notify thread changes seg, and
+    // only the dispatching thread closes retired segments.
+    GMutex *mutex;
+    _segment_t *seg;
+    uint64_t next_seq;
+    int64_t dropped;
+
+    // _retired_segment_t, oldest first
+    GQueue *retired;
+
+    // mirrored messages delivered from shared memory whose network copy
+    // hasn't arrived yet, and network messages delivered before their shared
+    // memory copy was dispatched.  Oldest first.
+    GQueue *shm_copies;
+    GQueue *net_copies;
+
+    GThread *thread;
+    volatile gint quit;
+};
+
+#ifdef __linux__
+static void
+_futex_wait (volatile uint32_t *addr, uint32_t val, int64_t timeout_usec)
+{
+    struct timespec ts;
+    ts.tv_sec = timeout_usec / 1000000;
+    ts.tv_nsec = (timeout_usec % 1000000) * 1000;
+    syscall (SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+static void
+_futex_wake (volatile uint32_t *addr)
+{
+    syscall (SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+#else
+// no futexes.  Subscribers poll.
+static void
+_futex_wait (volatile uint32_t *addr, uint32_t val, int64_t timeout_usec)
+{
+    if (__atomic_load_n (addr, __ATOMIC_SEQ_CST) == val)
+        usleep (1000);
+}
+
+static void
+_futex_wake (volatile uint32_t *addr)
+{
+}
+#endif
+
+static int
+_pid_alive (int pid)
+{
+    return pid > 0 && (0 == kill (pid, 0) || errno == EPERM);
+}
+
+// 64-bit FNV-1a, a word at a time
+static uint64_t
+_message_hash (const void *data, unsigned int datalen)
+{
+    const uint8_t *p = (const uint8_t *) data;
+    uint64_t h = 0xcbf29ce484222325ULL ^ datalen;
+    unsigned int i = 0;
+    for (; i + 8 <= datalen; i += 8) {
+        uint64_t w;
+        memcpy (&w, p + i, 8);
+        h = (h ^ w) * 0x100000001b3ULL;
+    }
+    for (; i < datalen; i++)
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+// if @copies has a copy of the message, removes it and returns 1
+static int
+_take_copy (GQueue *copies, uint64_t hash, unsigned int datalen, int64_t now)
+{
+    _msg_copy_t *copy;
+    while ((copy = (_msg_copy_t *) g_queue_peek_head (copies)) &&
+            now - copy->utime > MIRROR_WINDOW_USEC)
+        g_slice_free (_msg_copy_t, g_queue_pop_head (copies));
+
+    for (GList *link = copies->head; link; link = link->next) {
+        copy = (_msg_copy_t *) link->data;
+        if (copy->hash == hash && copy->datalen == datalen) {
+            g_queue_delete_link (copies, link);
+            g_slice_free (_msg_copy_t, copy);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void
+_add_copy (GQueue *copies, uint64_t hash, unsigned int datalen, int64_t now)
+{
+    if (g_queue_get_length (copies) >= MAX_PENDING_COPIES)
+        g_slice_free (_msg_copy_t, g_queue_pop_head (copies));
+    _msg_copy_t *copy = g_slice_new (_msg_copy_t);
+    copy->hash = hash;
+    copy->datalen = datalen;
+    copy->utime = now;
+    g_queue_push_tail (copies, copy);
+}
+
+static void
+_clear_copies (GQueue *copies)
+{
+    _msg_copy_t *copy;
+    while ((copy = (_msg_copy_t *) g_queue_pop_head (copies)))
+        g_slice_free (_msg_copy_t, copy);
+}
+
+static char *
+_segment_name (const char *channel)
+{
+    // shm names can't contain slashes.  Collisions between channels that
+    // only differ in sanitized characters are caught by comparing the channel
+    // name stored in the segment.
+    char *name = g_strdup_printf ("%s%s", SHM_NAME_PREFIX, channel);
+    for (char *p = name + 1; *p; p++) {
+        if (*p == '/')
+            *p = '_';
+    }
+    return name;
+}
+
+static size_t
+_slot_stride (uint64_t slot_size)
+{
+    return ALIGN64 (sizeof (_slot_header_t)) + ALIGN64 (slot_size);
+}
+
+static size_t
+_segment_size (uint32_t num_slots, uint64_t slot_size)
+{
+    return ALIGN64 (sizeof (_shm_header_t)) + num_slots * _slot_stride (slot_size);
+}
+
+static _slot_header_t *
+_segment_slot (_segment_t *seg, uint64_t seq)
+{
+    uint64_t index = seq % seg->hdr->num_slots;
+    return (_slot_header_t *) ((uint8_t *) seg->base +
+            ALIGN64 (sizeof (_shm_header_t)) +
+            index * _slot_stride (seg->hdr->slot_size));
+}
+
+static uint8_t *
+_slot_data (_slot_header_t *slot)
+{
+    return (uint8_t *) slot + ALIGN64 (sizeof (_slot_header_t));
+}
+
+// registers @pid as a reader of @slot.  Returns the index of its entry, or -1
+// if too many subscribers are reading the slot.
+static int
+_slot_claim (_slot_header_t *slot, int32_t pid)
+{
+    for (int i = 0; i < SHM_MAX_READERS; i++) {
+        if (__atomic_load_n (&slot->reader_pids[i], __ATOMIC_RELAXED))
+            continue;
+        int32_t expected = 0;
+        if (__atomic_compare_exchange_n (&slot->reader_pids[i], &expected,
+                    pid, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            return i;
+    }
+    return -1;
+}
+
+static void
+_slot_release (_slot_header_t *slot, int index)
+{
+    __atomic_store_n (&slot->reader_pids[index], 0, __ATOMIC_SEQ_CST);
+}
+
+// returns 1 if a live subscriber is reading @slot.  Entries left behind by
+// subscribers that died while reading are cleared.
+static int
+_slot_in_use (_slot_header_t *slot)
+{
+    for (int i = 0; i < SHM_MAX_READERS; i++) {
+        int32_t pid = __atomic_load_n (&slot->reader_pids[i], __ATOMIC_SEQ_CST);
+        if (!pid)
+            continue;
+        if (_pid_alive (pid))
+            return 1;
+        __atomic_compare_exchange_n (&slot->reader_pids[i], &pid, 0, 0,
+                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }
+    return 0;
+}
+
+static void
+_segment_close (_segment_t *seg)
+{
+    munmap (seg->base, seg->size);
+    g_free (seg->name);
+    free (seg);
+}
+
+static _segment_t *
+_segment_map (const char *channel, int fd, size_t size)
+{
+    void *base = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close (fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    _segment_t *seg = (_segment_t *) calloc (1, sizeof (_segment_t));
+    seg->name = _segment_name (channel);
+    seg->base = base;
+    seg->size = size;
+    seg->hdr = (_shm_header_t *) base;
+    return seg;
+}
+
+static _segment_t *
+_segment_create (const char *channel, int num_slots, uint64_t slot_size)
+{
+    char *name = _segment_name (channel);
+    int fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL, 0666);
+    g_free (name);
+    if (fd < 0)
+        return NULL;
+
+    size_t size = _segment_size (num_slots, slot_size);
+    if (0 != ftruncate (fd, size)) {
+        perror ("bot_lcm_shm: ftruncate");
+        close (fd);
+        name = _segment_name (channel);
+        shm_unlink (name);
+        g_free (name);
+        return NULL;
+    }
+
+    _segment_t *seg = _segment_map (channel, fd, size);
+    if (!seg) {
+        name = _segment_name (channel);
+        shm_unlink (name);
+        g_free (name);
+        return NULL;
+    }
+
+    _shm_header_t *hdr = seg->hdr;
+    hdr->version = SHM_VERSION;
+    hdr->num_slots = num_slots;
+    hdr->slot_size = slot_size;
+    strncpy (hdr->channel, channel, SHM_MAX_CHANNEL_LEN);
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init (&attr);
+    pthread_mutexattr_setpshared (&attr, PTHREAD_PROCESS_SHARED);
+#ifdef __linux__
+    // don't deadlock if a publisher dies while holding the mutex
+    pthread_mutexattr_setrobust (&attr, PTHREAD_MUTEX_ROBUST);
+#endif
+    pthread_mutex_init (&hdr->publish_mutex, &attr);
+    pthread_mutexattr_destroy (&attr);
+
+    for (int i = 0; i < num_slots; i++)
+        _segment_slot (seg, i)->seq = SLOT_EMPTY;
+
+    // the segment is ready once the magic number is set
+    __atomic_store_n (&hdr->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+
+    dbg ("bot_lcm_shm: created %s (%d x %"PRIu64" bytes)\n", seg->name,
+            num_slots, slot_size);
+    return seg;
+}
+
+static _segment_t *
+_segment_open (const char *channel)
+{
+    char *name = _segment_name (channel);
+    int fd = shm_open (name, O_RDWR, 0);
+    g_free (name);
+    if (fd < 0)
+        return NULL;
+
+    // the segment may still be being created
+    struct stat st;
+    if (0 != fstat (fd, &st) || st.st_size < ALIGN64 (sizeof (_shm_header_t))) {
+        close (fd);
+        return NULL;
+    }
+
+    _segment_t *seg = _segment_map (channel, fd, st.st_size);
+    if (!seg)
+        return NULL;
+
+    _shm_header_t *hdr = seg->hdr;
+    if (__atomic_load_n (&hdr->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC ||
+        hdr->version != SHM_VERSION ||
+        strncmp (hdr->channel, channel, SHM_MAX_CHANNEL_LEN) ||
+        _segment_size (hdr->num_slots, hdr->slot_size) > seg->size) {
+        _segment_close (seg);
+        return NULL;
+    }
+    return seg;
+}
+
+static void
+_segment_retire (_segment_t *seg)
+{
+    // wake up subscribers so that they detach immediately
+    __atomic_store_n (&seg->hdr->retired, 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch (&seg->hdr->futex, 1, __ATOMIC_SEQ_CST);
+    _futex_wake (&seg->hdr->futex);
+    shm_unlink (seg->name);
+}
+
+static int
+_segment_lock (_segment_t *seg)
+{
+    int status = pthread_mutex_lock (&seg->hdr->publish_mutex);
+#ifdef __linux__
+    if (status == EOWNERDEAD) {
+        // the previous owner died.  Slots it was writing are left marked as
+        // SLOT_WRITING, which subscribers skip.
+        pthread_mutex_consistent (&seg->hdr->publish_mutex);
+        status = 0;
+    }
+#endif
+    return status;
+}
+
+static uint64_t
+_next_pow2 (uint64_t v)
+{
+    uint64_t result = 1;
+    while (result < v)
+        result <<= 1;
+    return result;
+}
+
+// Returns a segment for publishing messages of size @datalen on @channel,
+// creating or replacing the segment as needed.
+static _segment_t *
+_get_publish_segment (BotLcmShm *shm, const char *channel,
+        unsigned int datalen)
+{
+    _segment_t *seg = (_segment_t *) g_hash_table_lookup (
+            shm->publish_segments, channel);
+    if (seg && !seg->hdr->retired && datalen <= seg->hdr->slot_size)
+        return seg;
+
+    if (seg) {
+        if (!seg->hdr->retired)
+            _segment_retire (seg);
+        g_hash_table_remove (shm->publish_segments, channel);
+        _segment_close (seg);
+        seg = NULL;
+    }
+
+    uint64_t slot_size = MAX (MIN_SLOT_SIZE, _next_pow2 (datalen));
+
+    // another process may be publishing on the same channel, or be creating
+    // the segment at the same time as us.
+    for (int tries = 0; tries < 3 && !seg; tries++) {
+        seg = _segment_open (channel);
+        if (seg && (seg->hdr->retired || datalen > seg->hdr->slot_size)) {
+            if (!seg->hdr->retired) {
+                slot_size = MAX (slot_size, seg->hdr->slot_size);
+                _segment_retire (seg);
+            }
+            _segment_close (seg);
+            seg = NULL;
+        }
+        if (!seg)
+            seg = _segment_create (channel, shm->num_slots, slot_size);
+    }
+
+    if (seg)
+        g_hash_table_insert (shm->publish_segments, g_strdup (channel), seg);
+    return seg;
+}
+
+static int
+_publish_shm (BotLcmShm *shm, const char *channel, const void *data,
+        unsigned int datalen, int mirror, uint64_t hash)
+{
+    _segment_t *seg = _get_publish_segment (shm, channel, datalen);
+    if (!seg)
+        return -1;
+
+    _shm_header_t *hdr = seg->hdr;
+    if (0 != _segment_lock (seg))
+        return -1;
+
+    uint64_t seq = hdr->write_seq;
+    int written = 0;
+    for (uint32_t tries = 0; tries < hdr->num_slots && !written; tries++) {
+        _slot_header_t *slot = _segment_slot (seg, seq);
+        uint64_t prev_seq = slot->seq;
+
+        __atomic_store_n (&slot->seq, SLOT_WRITING, __ATOMIC_SEQ_CST);
+        if (_slot_in_use (slot)) {
+            // a subscriber is still handling the message in this slot.  Leave
+            // it alone, and leave a hole in the sequence for this message.
+            __atomic_store_n (&slot->seq, prev_seq, __ATOMIC_SEQ_CST);
+            seq++;
+            continue;
+        }
+
+        memcpy (_slot_data (slot), data, datalen);
+        slot->datalen = datalen;
+        slot->flags = mirror ? SLOT_MIRRORED : 0;
+        slot->hash = hash;
+        slot->utime = bot_timestamp_now ();
+        if (mirror)
+            hdr->mirror_utime = slot->utime;
+        __atomic_store_n (&slot->seq, seq, __ATOMIC_RELEASE);
+        seq++;
+        written = 1;
+    }
+    if (written)
+        __atomic_store_n (&hdr->write_seq, seq, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock (&hdr->publish_mutex);
+
+    if (!written)
+        return -1;
+
+    __atomic_add_fetch (&hdr->futex, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n (&hdr->waiters, __ATOMIC_SEQ_CST))
+        _futex_wake (&hdr->futex);
+    return 0;
+}
+
+int
+bot_lcm_shm_publish (BotLcmShm *shm, const char *channel,
+        const void *data, unsigned int datalen)
+{
+    if (strlen (channel) > SHM_MAX_CHANNEL_LEN)
+        return lcm_publish (shm->lcm, channel, data, datalen);
+
+    g_mutex_lock (shm->mutex);
+    int mirror = shm->network_mirror;
+    g_mutex_unlock (shm->mutex);
+
+    // subscribers use the hash to recognize the network copy
+    uint64_t hash = mirror ? _message_hash (data, datalen) : 0;
+
+    g_mutex_lock (shm->mutex);
+    int status = _publish_shm (shm, channel, data, datalen, mirror, hash);
+    g_mutex_unlock (shm->mutex);
+
+    if (status != 0)
+        dbg ("bot_lcm_shm: shared memory publish on %s failed\n", channel);
+
+    if (mirror) {
+        if (0 != lcm_publish (shm->lcm, channel, data, datalen))
+            status = -1;
+    }
+    return status;
+}
+
+static void
+_notify (BotLcmShm *shm)
+{
+    if (g_atomic_int_compare_and_exchange (&shm->notify_pending, 0, 1)) {
+        char c = 0;
+        int ignored = write (shm->notify_fds[1], &c, 1);
+        (void) ignored;
+    }
+}
+
+// Attaches to the channel's segment if it exists and we aren't already
+// attached to it, and detaches from retired segments.  Returns 1 if attached
+// to a segment.
+static int
+_subscription_check_segment (BotLcmShmSubscription *sub)
+{
+    _segment_t *seg = sub->seg;
+    if (seg && !seg->hdr->retired)
+        return 1;
+
+    _segment_t *new_seg = _segment_open (sub->channel);
+    if (new_seg && new_seg->hdr->retired) {
+        _segment_close (new_seg);
+        new_seg = NULL;
+    }
+    if (!seg && !new_seg)
+        return 0;
+
+    g_mutex_lock (sub->mutex);
+    if (seg) {
+        // keep the retired segment until its remaining messages have been
+        // dispatched
+        _retired_segment_t *old = g_slice_new (_retired_segment_t);
+        old->seg = seg;
+        old->next_seq = sub->next_seq;
+        g_queue_push_tail (sub->retired, old);
+    }
+    sub->seg = new_seg;
+    if (new_seg && seg) {
+        // the segment replaces the one we were reading, so all its messages
+        // are new to us
+        sub->next_seq = 0;
+    } else if (new_seg) {
+        // the messages already in the segment were published before we
+        // subscribed, or were delivered to us through the network
+        sub->next_seq = __atomic_load_n (&new_seg->hdr->write_seq,
+                __ATOMIC_ACQUIRE);
+    }
+    g_mutex_unlock (sub->mutex);
+
+    dbg ("bot_lcm_shm: %s %s\n", new_seg ? "attached to" : "detached from",
+            new_seg ? new_seg->name : seg->name);
+    return new_seg != NULL;
+}
+
+static void *
+_subscription_thread (void *user_data)
+{
+    BotLcmShmSubscription *sub = (BotLcmShmSubscription *) user_data;
+    _segment_t *notified_seg = sub->seg;
+    uint64_t notified_seq = sub->next_seq;
+    int64_t next_check_utime = bot_timestamp_now () + CHECK_INTERVAL_USEC;
+
+    while (!g_atomic_int_get (&sub->quit)) {
+        int64_t now = bot_timestamp_now ();
+        if (now >= next_check_utime) {
+            _subscription_check_segment (sub);
+            next_check_utime = now + CHECK_INTERVAL_USEC;
+        }
+
+        _segment_t *seg = sub->seg;
+        if (!seg) {
+            // let the application drain a segment that was just retired
+            if (notified_seg) {
+                notified_seg = NULL;
+                _notify (sub->shm);
+            }
+            g_usleep (CHECK_INTERVAL_USEC);
+            continue;
+        }
+
+        _shm_header_t *hdr = seg->hdr;
+        uint32_t futex = __atomic_load_n (&hdr->futex, __ATOMIC_SEQ_CST);
+        uint64_t write_seq = __atomic_load_n (&hdr->write_seq,
+                __ATOMIC_SEQ_CST);
+
+        if (hdr->retired) {
+            next_check_utime = 0;
+            continue;
+        }
+
+        if (seg != notified_seg || write_seq != notified_seq) {
+            notified_seg = seg;
+            notified_seq = write_seq;
+            _notify (sub->shm);
+            continue;
+        }
+
+        __atomic_add_fetch (&hdr->waiters, 1, __ATOMIC_SEQ_CST);
+        _futex_wait (&hdr->futex, futex, CHECK_INTERVAL_USEC);
+        __atomic_sub_fetch (&hdr->waiters, 1, __ATOMIC_SEQ_CST);
+    }
+    return NULL;
+}
+
+static void
+_on_network_message (const lcm_recv_buf_t *rbuf, const char *channel,
+        void *user_data)
+{
+    BotLcmShmSubscription *sub = (BotLcmShmSubscription *) user_data;
+
+    // only messages from a local publisher that recently mirrored a message
+    // can have a shared memory copy
+    int64_t now = bot_timestamp_now ();
+    g_mutex_lock (sub->mutex);
+    int mirrored = sub->seg &&
+        now - sub->seg->hdr->mirror_utime <= MIRROR_WINDOW_USEC;
+    g_mutex_unlock (sub->mutex);
+
+    if (mirrored) {
+        uint64_t hash = _message_hash (rbuf->data, rbuf->data_size);
+
+        g_mutex_lock (sub->mutex);
+        int delivered = _take_copy (sub->shm_copies, hash, rbuf->data_size,
+                now);
+        if (!delivered)
+            _add_copy (sub->net_copies, hash, rbuf->data_size, now);
+        g_mutex_unlock (sub->mutex);
+
+        // this message was already delivered through shared memory
+        if (delivered)
+            return;
+    }
+
+    sub->handler (rbuf, channel, sub->user);
+}
+
+// dispatches the messages of the retired segments, then those of the
+// current segment.  sub->mutex is released while the handler runs, so that
+// it can call bot_lcm_shm_get_dropped() or unsubscribe.  The slot being
+// handled stays claimed, so the publisher doesn't overwrite it.
+static int
+_subscription_dispatch (BotLcmShmSubscription *sub)
+{
+    int count = 0;
+    // messages published while dispatching are left for the next call
+    _segment_t *limit_seg = NULL;
+    uint64_t limit_seq = 0;
+
+    g_mutex_lock (sub->mutex);
+    while (!g_atomic_int_get (&sub->quit)) {
+        _retired_segment_t *old =
+            (_retired_segment_t *) g_queue_peek_head (sub->retired);
+        _segment_t *seg = old ? old->seg : sub->seg;
+        uint64_t *next_seq = old ? &old->next_seq : &sub->next_seq;
+        if (!seg)
+            break;
+
+        _shm_header_t *hdr = seg->hdr;
+        if (seg != limit_seg) {
+            limit_seg = seg;
+            limit_seq = __atomic_load_n (&hdr->write_seq, __ATOMIC_ACQUIRE);
+        }
+        uint64_t write_seq = limit_seq;
+        if (*next_seq >= write_seq) {
+            if (!old)
+                break;
+            g_queue_pop_head (sub->retired);
+            _segment_close (old->seg);
+            g_slice_free (_retired_segment_t, old);
+            limit_seg = NULL;
+            continue;
+        }
+
+        // skip messages that have already been overwritten
+        if (write_seq > *next_seq + hdr->num_slots) {
+            sub->dropped += write_seq - hdr->num_slots - *next_seq;
+            *next_seq = write_seq - hdr->num_slots;
+        }
+
+        uint64_t seq = (*next_seq)++;
+        _slot_header_t *slot = _segment_slot (seg, seq);
+
+        int reader = _slot_claim (slot, sub->shm->pid);
+        if (reader < 0) {
+            sub->dropped++;
+            continue;
+        }
+
+        // the publisher briefly marks a slot as SLOT_WRITING while checking
+        // whether it is being read
+        uint64_t slot_seq = __atomic_load_n (&slot->seq, __ATOMIC_SEQ_CST);
+        for (int spins = 0; slot_seq == SLOT_WRITING && spins < 100; spins++) {
+            sched_yield ();
+            slot_seq = __atomic_load_n (&slot->seq, __ATOMIC_SEQ_CST);
+        }
+
+        if (slot_seq == seq) {
+            int deliver = 1;
+            if (slot->flags & SLOT_MIRRORED) {
+                int64_t now = bot_timestamp_now ();
+                // the network copy may have been handled first
+                if (_take_copy (sub->net_copies, slot->hash, slot->datalen,
+                            now))
+                    deliver = 0;
+                else
+                    _add_copy (sub->shm_copies, slot->hash, slot->datalen,
+                            now);
+            }
+            if (deliver) {
+                lcm_recv_buf_t rbuf;
+                rbuf.data = _slot_data (slot);
+                rbuf.data_size = slot->datalen;
+                rbuf.recv_utime = slot->utime;
+                rbuf.lcm = sub->shm->lcm;
+                g_mutex_unlock (sub->mutex);
+                sub->handler (&rbuf, sub->channel, sub->user);
+                g_mutex_lock (sub->mutex);
+                count++;
+            }
+        } else if (slot_seq != SLOT_EMPTY &&
+                (slot_seq == SLOT_WRITING || slot_seq > seq)) {
+            // overwritten while we were catching up
+            sub->dropped++;
+        }
+        // otherwise, the publisher skipped this sequence number
+
+        _slot_release (slot, reader);
+    }
+    g_mutex_unlock (sub->mutex);
+    return count;
+}
+
+static void
+_subscription_free (BotLcmShmSubscription *sub)
+{
+    _retired_segment_t *old;
+    while ((old = (_retired_segment_t *) g_queue_pop_head (sub->retired))) {
+        _segment_close (old->seg);
+        g_slice_free (_retired_segment_t, old);
+    }
+    g_queue_free (sub->retired);
+    if (sub->seg)
+        _segment_close (sub->seg);
+    _clear_copies (sub->shm_copies);
+    _clear_copies (sub->net_copies);
+    g_queue_free (sub->shm_copies);
+    g_queue_free (sub->net_copies);
+    g_mutex_free (sub->mutex);
+    g_free (sub->channel);
+    g_slice_free (BotLcmShmSubscription, sub);
+}
+
+BotLcmShm *
+bot_lcm_shm_new (lcm_t *lcm)
+{
+    if (!g_thread_supported ())
+        g_thread_init (NULL);
+
+    BotLcmShm *shm = g_slice_new0 (BotLcmShm);
+    if (0 != pipe (shm->notify_fds)) {
+        perror ("bot_lcm_shm");
+        g_slice_free (BotLcmShm, shm);
+        return NULL;
+    }
+    for (int i = 0; i < 2; i++) {
+        int flags = fcntl (shm->notify_fds[i], F_GETFL);
+        fcntl (shm->notify_fds[i], F_SETFL, flags | O_NONBLOCK);
+    }
+
+    shm->lcm = lcm;
+    shm->mutex = g_mutex_new ();
+    shm->pid = getpid ();
+    shm->num_slots = DEFAULT_NUM_SLOTS;
+    shm->network_mirror = 0;
+    shm->publish_segments = g_hash_table_new_full (g_str_hash, g_str_equal,
+            g_free, NULL);
+    return shm;
+}
+
+void
+bot_lcm_shm_destroy (BotLcmShm *shm)
+{
+    while (shm->subscriptions)
+        bot_lcm_shm_unsubscribe (shm,
+                (BotLcmShmSubscription *) shm->subscriptions->data);
+
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init (&iter, shm->publish_segments);
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+        _segment_t *seg = (_segment_t *) value;
+        _segment_retire (seg);
+        _segment_close (seg);
+    }
+    g_hash_table_destroy (shm->publish_segments);
+
+    close (shm->notify_fds[0]);
+    close (shm->notify_fds[1]);
+    g_mutex_free (shm->mutex);
+    g_slice_free (BotLcmShm, shm);
+}
+
+void
+bot_lcm_shm_set_slots (BotLcmShm *shm, int num_slots)
+{
+    g_mutex_lock (shm->mutex);
+    shm->num_slots = MAX (2, num_slots);
+    g_mutex_unlock (shm->mutex);
+}
+
+void
+bot_lcm_shm_set_network_mirror (BotLcmShm *shm, int enabled)
+{
+    g_mutex_lock (shm->mutex);
+    shm->network_mirror = enabled ? 1 : 0;
+    g_mutex_unlock (shm->mutex);
+}
+
+BotLcmShmSubscription *
+bot_lcm_shm_subscribe (BotLcmShm *shm, const char *channel,
+        lcm_msg_handler_t handler, void *user)
+{
+    BotLcmShmSubscription *sub = g_slice_new0 (BotLcmShmSubscription);
+    sub->shm = shm;
+    sub->channel = g_strdup (channel);
+    sub->handler = handler;
+    sub->user = user;
+    sub->mutex = g_mutex_new ();
+    sub->shm_copies = g_queue_new ();
+    sub->net_copies = g_queue_new ();
+    sub->retired = g_queue_new ();
+
+    if (strlen (channel) <= SHM_MAX_CHANNEL_LEN)
+        _subscription_check_segment (sub);
+
+    char *regex = g_regex_escape_string (channel, -1);
+    sub->lcm_sub = lcm_subscribe (shm->lcm, regex, _on_network_message, sub);
+    g_free (regex);
+    if (!sub->lcm_sub) {
+        _subscription_free (sub);
+        return NULL;
+    }
+
+    if (strlen (channel) <= SHM_MAX_CHANNEL_LEN)
+        sub->thread = g_thread_create (_subscription_thread, sub, TRUE, NULL);
+
+    g_mutex_lock (shm->mutex);
+    shm->subscriptions = g_list_append (shm->subscriptions, sub);
+    g_mutex_unlock (shm->mutex);
+    return sub;
+}
+
+int
+bot_lcm_shm_unsubscribe (BotLcmShm *shm, BotLcmShmSubscription *sub)
+{
+    g_mutex_lock (shm->mutex);
+    GList *link = g_list_find (shm->subscriptions, sub);
+    if (link)
+        shm->subscriptions = g_list_delete_link (shm->subscriptions, link);
+    g_mutex_unlock (shm->mutex);
+    if (!link)
+        return -1;
+
+    g_atomic_int_set (&sub->quit, 1);
+    if (sub->thread)
+        g_thread_join (sub->thread);
+
+    lcm_unsubscribe (shm->lcm, sub->lcm_sub);
+
+    // a handler of the subscription may be unsubscribing it
+    g_mutex_lock (shm->mutex);
+    int dispatching = sub->dispatching;
+    sub->unsubscribed = 1;
+    g_mutex_unlock (shm->mutex);
+    if (!dispatching)
+        _subscription_free (sub);
+    return 0;
+}
+
+int64_t
+bot_lcm_shm_get_dropped (BotLcmShmSubscription *sub)
+{
+    g_mutex_lock (sub->mutex);
+    int64_t dropped = sub->dropped;
+    g_mutex_unlock (sub->mutex);
+    return dropped;
+}
+
+int
+bot_lcm_shm_get_fileno (BotLcmShm *shm)
+{
+    return shm->notify_fds[0];
+}
+
+int
+bot_lcm_shm_handle (BotLcmShm *shm)
+{
+    char buf[64];
+    while (read (shm->notify_fds[0], buf, sizeof (buf)) > 0);
+
+    // clear the flag before dispatching, so that messages published from
+    // now on generate a new notification
+    g_atomic_int_set (&shm->notify_pending, 0);
+
+    g_mutex_lock (shm->mutex);
+    GList *subs = g_list_copy (shm->subscriptions);
+    g_mutex_unlock (shm->mutex);
+
+    int count = 0;
+    for (GList *iter = subs; iter; iter = iter->next) {
+        BotLcmShmSubscription *sub = (BotLcmShmSubscription *) iter->data;
+
+        // skip subscriptions removed by the handlers of the previous ones
+        g_mutex_lock (shm->mutex);
+        int subscribed = NULL != g_list_find (shm->subscriptions, sub);
+        if (subscribed)
+            sub->dispatching++;
+        g_mutex_unlock (shm->mutex);
+        if (!subscribed)
+            continue;
+
+        count += _subscription_dispatch (sub);
+
+        g_mutex_lock (shm->mutex);
+        int free_sub = --sub->dispatching == 0 && sub->unsubscribed;
+        g_mutex_unlock (shm->mutex);
+        if (free_sub)
+            _subscription_free (sub);
+    }
+    g_list_free (subs);
+    return count;
+}
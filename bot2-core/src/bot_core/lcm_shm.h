@@ -0,0 +1,148 @@
+#ifndef __bot_lcm_shm_h__
+#define __bot_lcm_shm_h__
+
+/**
+ * @defgroup BotCoreLcmShm LcmShm
+ * @ingroup BotCoreIO
+ * @brief Shared memory transport for LCM messages between processes on the
+ * same host
+ * @include: bot_core/bot_core.h
+ *
+ * BotLcmShm passes LCM messages between processes on the same host through a
+ * per-channel ring of message slots in a POSIX shared memory segment, instead
+ * of through the network stack.  Publishers copy each message once, into a
+ * slot.  Subscribers are handed a pointer directly into the slot, so large
+ * messages (images, point clouds) are never copied on the receiving side.
+ * Subscribers are woken up with a futex when a new message is published.
+ *
+ * Segments are created by the first publisher of a channel, and are sized to
+ * fit the largest message published so far.  Subscribers attach to a segment
+ * as soon as it appears.
+ *
+ * By default, messages published through shared memory never go through the
+ * network stack.  Publishers with remote subscribers enable mirroring with
+ * bot_lcm_shm_set_network_mirror(), so that every message is also published
+ * with lcm_publish().  Mirrored messages are tagged with a hash of their
+ * contents, and a subscriber that receives a message through both transports
+ * only delivers the first copy.  Subscribers also subscribe with
+ * lcm_subscribe(), so that messages from remote publishers and from plain
+ * lcm_publish() callers are delivered too.  Only the network copies of
+ * mirrored messages are hashed.
+ *
+ * Shared memory messages are dispatched from bot_lcm_shm_handle(), which
+ * should be called whenever the file descriptor returned by
+ * bot_lcm_shm_get_fileno() becomes readable (e.g., from a GLib IO watch).
+ * Network messages are dispatched by lcm_handle() as usual.
+ *
+ * Linking: `pkg-config --libs bot2-core`
+ * @{
+ */
+
+#include <stdint.h>
+#include <lcm/lcm.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _BotLcmShm BotLcmShm;
+typedef struct _BotLcmShmSubscription BotLcmShmSubscription;
+
+/**
+ * bot_lcm_shm_new:
+ * @lcm: LCM instance used to reach remote processes.
+ *
+ * Returns: a newly allocated BotLcmShm.
+ */
+BotLcmShm *bot_lcm_shm_new (lcm_t *lcm);
+
+/**
+ * bot_lcm_shm_destroy:
+ *
+ * Unsubscribes all subscriptions and releases the segments of the channels
+ * published by this instance.
+ */
+void bot_lcm_shm_destroy (BotLcmShm *shm);
+
+/**
+ * bot_lcm_shm_set_slots:
+ * @num_slots: number of messages kept in each segment created from now on.
+ * Default is 16.
+ *
+ * A subscriber that falls more than @num_slots messages behind a publisher
+ * skips the oldest messages.
+ */
+void bot_lcm_shm_set_slots (BotLcmShm *shm, int num_slots);
+
+/**
+ * bot_lcm_shm_set_network_mirror:
+ * @enabled: if non-zero, messages published through @shm are also published
+ * on the network for remote subscribers.  Default is 0.
+ */
+void bot_lcm_shm_set_network_mirror (BotLcmShm *shm, int enabled);
+
+/**
+ * bot_lcm_shm_publish:
+ *
+ * Publishes a message to same-host subscribers through shared memory and,
+ * if network mirroring is enabled, to remote subscribers through LCM.
+ *
+ * Returns: 0 on success, -1 on failure.
+ */
+int bot_lcm_shm_publish (BotLcmShm *shm, const char *channel,
+        const void *data, unsigned int datalen);
+
+/**
+ * bot_lcm_shm_subscribe:
+ * @channel: the channel name.  Unlike lcm_subscribe(), this is not a regular
+ * expression.
+ * @handler: the message handler.  rbuf->data points into shared memory and
+ * is only valid until the handler returns.
+ *
+ * Returns: the subscription, or %NULL on failure.
+ */
+BotLcmShmSubscription *bot_lcm_shm_subscribe (BotLcmShm *shm,
+        const char *channel, lcm_msg_handler_t handler, void *user);
+
+/**
+ * bot_lcm_shm_unsubscribe:
+ *
+ * Can be called from within a message handler, including one of @sub.
+ */
+int bot_lcm_shm_unsubscribe (BotLcmShm *shm, BotLcmShmSubscription *sub);
+
+/**
+ * bot_lcm_shm_get_dropped:
+ *
+ * Returns: the number of shared memory messages that @sub missed because it
+ * fell too far behind the publisher.
+ */
+int64_t bot_lcm_shm_get_dropped (BotLcmShmSubscription *sub);
+
+/**
+ * bot_lcm_shm_get_fileno:
+ *
+ * Returns: a file descriptor that becomes readable when shared memory
+ * messages are waiting to be handled.
+ */
+int bot_lcm_shm_get_fileno (BotLcmShm *shm);
+
+/**
+ * bot_lcm_shm_handle:
+ *
+ * Dispatches all shared memory messages waiting to be handled.  Does not
+ * block.
+ *
+ * Returns: the number of messages dispatched.
+ */
+int bot_lcm_shm_handle (BotLcmShm *shm);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif
@@ -0,0 +1,475 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <glib.h>
+
+#include <lcmtypes/bot_core_image_t.h>
+
+#include "occ_grid.h"
+
+typedef struct {
+    // sines and cosines of the beam angles, in the sensor frame, for the
+    // last scan geometry seen
+    int ntrig;
+    float trig_rad0;
+    float trig_radstep;
+    float *cos_t;
+    float *sin_t;
+
+    // beam endpoints, in cells relative to the grid origin
+    float *ex;
+    float *ey;
+    uint8_t *valid;
+    uint8_t *hit;
+    int capacity;
+} _scratch_t;
+
+struct _BotOccGrid {
+    int size;
+    int mask;
+    double resolution;
+
+    // global coordinates of the cell at the corner of the grid with the
+    // smallest coordinates.  The cell (ix, iy) is stored at
+    // (ix & mask) + (iy & mask) * size.
+    int origin_ix;
+    int origin_iy;
+    float *cells;
+
+    float hit;
+    float miss;
+    float min;
+    float max;
+    double min_range;
+    double max_range;
+
+    int num_threads;
+    _scratch_t *scratch;
+
+    uint8_t *image_buf;
+};
+
+typedef struct {
+    BotOccGrid *grid;
+    const bot_core_planar_lidar_t * const *scans;
+    const BotTrans *poses;
+    int num_scans;
+    volatile int next;
+} _batch_t;
+
+typedef struct {
+    _batch_t *batch;
+    _scratch_t *scratch;
+} _worker_t;
+
+static void
+_scratch_reserve (_scratch_t *s, int n)
+{
+    if (n <= s->capacity)
+        return;
+    s->capacity = n;
+    s->cos_t = g_renew (float, s->cos_t, n);
+    s->sin_t = g_renew (float, s->sin_t, n);
+    s->ex = g_renew (float, s->ex, n);
+    s->ey = g_renew (float, s->ey, n);
+    s->valid = g_renew (uint8_t, s->valid, n);
+    s->hit = g_renew (uint8_t, s->hit, n);
+    s->ntrig = 0;
+}
+
+static void
+_scratch_free (_scratch_t *s)
+{
+    g_free (s->cos_t);
+    g_free (s->sin_t);
+    g_free (s->ex);
+    g_free (s->ey);
+    g_free (s->valid);
+    g_free (s->hit);
+}
+
+static inline void
+_update_cell (float *cell, float delta, float lo, float hi)
+{
+    float v = *cell + delta;
+    *cell = v < lo ? lo : (v > hi ? hi : v);
+}
+
+// same as _update_cell, for cells that other threads may be updating
+static inline void
+_update_cell_atomic (float *cell, float delta, float lo, float hi)
+{
+    union { float f; uint32_t u; } cur, next;
+    cur.u = __atomic_load_n ((uint32_t *) cell, __ATOMIC_RELAXED);
+    do {
+        float v = cur.f + delta;
+        next.f = v < lo ? lo : (v > hi ? hi : v);
+        if (next.u == cur.u)
+            return;
+    } while (!__atomic_compare_exchange_n ((uint32_t *) cell, &cur.u, next.u,
+                1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static inline void
+_update (BotOccGrid *grid, int ix, int iy, float delta, int atomic)
+{
+    // ix, iy are relative to the origin
+    if ((unsigned) ix >= (unsigned) grid->size ||
+            (unsigned) iy >= (unsigned) grid->size)
+        return;
+    float *cell = &grid->cells[((ix + grid->origin_ix) & grid->mask) +
+        ((iy + grid->origin_iy) & grid->mask) * grid->size];
+    if (atomic)
+        _update_cell_atomic (cell, delta, grid->min, grid->max);
+    else
+        _update_cell (cell, delta, grid->min, grid->max);
+}
+
+// Visits the cells from (sx, sy) to (ex, ey), in cells relative to the
+// origin, marking all but the last one as free.
+static void
+_cast_ray (BotOccGrid *grid, float sx, float sy, float ex, float ey,
+        int hit, int atomic)
+{
+    int ix = (int) floorf (sx);
+    int iy = (int) floorf (sy);
+    int end_ix = (int) floorf (ex);
+    int end_iy = (int) floorf (ey);
+    float dx = ex - sx;
+    float dy = ey - sy;
+    int step_x = dx >= 0 ? 1 : -1;
+    int step_y = dy >= 0 ? 1 : -1;
+
+    // distance along the ray, as a fraction of its length, between two cell
+    // boundaries, and to the next cell boundary
+    float t_delta_x = dx != 0 ? fabsf (1 / dx) : INFINITY;
+    float t_delta_y = dy != 0 ? fabsf (1 / dy) : INFINITY;
+    float t_max_x = dx == 0 ? INFINITY :
+        (dx > 0 ? ix + 1 - sx : sx - ix) * t_delta_x;
+    float t_max_y = dy == 0 ? INFINITY :
+        (dy > 0 ? iy + 1 - sy : sy - iy) * t_delta_y;
+
+    int n = abs (end_ix - ix) + abs (end_iy - iy);
+    for (int i = 0; i < n; i++) {
+        _update (grid, ix, iy, grid->miss, atomic);
+        // never step past the last cell, whatever the rounding
+        if (ix == end_ix || (iy != end_iy && t_max_y < t_max_x)) {
+            iy += step_y;
+            t_max_y += t_delta_y;
+        } else {
+            ix += step_x;
+            t_max_x += t_delta_x;
+        }
+    }
+    _update (grid, ix, iy, hit ? grid->hit : grid->miss, atomic);
+}
+
+static void
+_insert_scan (BotOccGrid *grid, _scratch_t *s,
+        const bot_core_planar_lidar_t *scan, const BotTrans *pose, int atomic)
+{
+    int n = scan->nranges;
+    if (n <= 0)
+        return;
+    _scratch_reserve (s, n);
+
+    if (s->ntrig != n || s->trig_rad0 != scan->rad0 ||
+            s->trig_radstep != scan->radstep) {
+        for (int i = 0; i < n; i++) {
+            double theta = scan->rad0 + i * (double) scan->radstep;
+            s->cos_t[i] = cos (theta);
+            s->sin_t[i] = sin (theta);
+        }
+        s->ntrig = n;
+        s->trig_rad0 = scan->rad0;
+        s->trig_radstep = scan->radstep;
+    }
+
+    double rot[9];
+    bot_trans_get_rot_mat_3x3 (pose, rot);
+    double inv_res = 1 / grid->resolution;
+
+    // the sensor position, and the beam directions projected on the ground,
+    // in cells
+    float sx = pose->trans_vec[0] * inv_res - grid->origin_ix;
+    float sy = pose->trans_vec[1] * inv_res - grid->origin_iy;
+    float r00 = rot[0] * inv_res, r01 = rot[1] * inv_res;
+    float r10 = rot[3] * inv_res, r11 = rot[4] * inv_res;
+    float min_range = grid->min_range;
+    float max_range = grid->max_range;
+
+    const float *ranges = scan->ranges;
+    const float *cos_t = s->cos_t;
+    const float *sin_t = s->sin_t;
+    float *ex = s->ex;
+    float *ey = s->ey;
+    uint8_t *valid = s->valid;
+    uint8_t *hit = s->hit;
+
+    // no branches, so that this vectorizes.  NaN ranges are invalid.
+    for (int i = 0; i < n; i++) {
+        float r = ranges[i];
+        int h = r <= max_range;
+        float rr = h ? r : max_range;
+        valid[i] = r >= min_range;
+        hit[i] = h;
+        ex[i] = sx + rr * (r00 * cos_t[i] + r01 * sin_t[i]);
+        ey[i] = sy + rr * (r10 * cos_t[i] + r11 * sin_t[i]);
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (valid[i])
+            _cast_ray (grid, sx, sy, ex[i], ey[i], hit[i], atomic);
+    }
+}
+
+static gpointer
+_batch_thread (gpointer user)
+{
+    _worker_t *w = (_worker_t *) user;
+    _batch_t *batch = w->batch;
+    while (1) {
+        int i = __atomic_fetch_add (&batch->next, 1, __ATOMIC_RELAXED);
+        if (i >= batch->num_scans)
+            break;
+        _insert_scan (batch->grid, w->scratch, batch->scans[i],
+                &batch->poses[i], 1);
+    }
+    return NULL;
+}
+
+BotOccGrid *
+bot_occ_grid_new (int size, double resolution, int num_threads)
+{
+    BotOccGrid *grid = g_slice_new0 (BotOccGrid);
+    grid->size = 1;
+    while (grid->size < size)
+        grid->size <<= 1;
+    grid->mask = grid->size - 1;
+    grid->resolution = resolution;
+    grid->cells = g_new0 (float, grid->size * grid->size);
+
+    grid->hit = 0.85;
+    grid->miss = -0.4;
+    grid->min = -2;
+    grid->max = 3.5;
+    grid->min_range = 0.1;
+    grid->max_range = 30;
+
+    grid->num_threads = num_threads > 0 ? num_threads : 1;
+    grid->scratch = g_new0 (_scratch_t, grid->num_threads);
+    if (grid->num_threads > 1 && !g_thread_supported ())
+        g_thread_init (NULL);
+
+    grid->origin_ix = -grid->size / 2;
+    grid->origin_iy = -grid->size / 2;
+    return grid;
+}
+
+void
+bot_occ_grid_destroy (BotOccGrid *grid)
+{
+    for (int t = 0; t < grid->num_threads; t++)
+        _scratch_free (&grid->scratch[t]);
+    g_free (grid->scratch);
+    g_free (grid->cells);
+    g_free (grid->image_buf);
+    g_slice_free (BotOccGrid, grid);
+}
+
+void
+bot_occ_grid_set_log_odds (BotOccGrid *grid, float hit, float miss,
+        float min, float max)
+{
+    grid->hit = hit;
+    grid->miss = miss;
+    grid->min = min;
+    grid->max = max;
+}
+
+void
+bot_occ_grid_set_range_limits (BotOccGrid *grid, double min_range,
+        double max_range)
+{
+    grid->min_range = min_range;
+    grid->max_range = max_range;
+}
+
+void
+bot_occ_grid_clear (BotOccGrid *grid)
+{
+    memset (grid->cells, 0, grid->size * grid->size * sizeof (float));
+}
+
+void
+bot_occ_grid_recenter (BotOccGrid *grid, const double xy[2])
+{
+    int size = grid->size;
+    int ox = (int) floor (xy[0] / grid->resolution) - size / 2;
+    int oy = (int) floor (xy[1] / grid->resolution) - size / 2;
+    int dx = ox - grid->origin_ix;
+    int dy = oy - grid->origin_iy;
+    if (!dx && !dy)
+        return;
+
+    if (abs (dx) >= size || abs (dy) >= size) {
+        bot_occ_grid_clear (grid);
+    } else {
+        // the columns and rows that leave the grid are stored where the ones
+        // that enter it go
+        int c0 = dx > 0 ? grid->origin_ix : grid->origin_ix + size + dx;
+        for (int c = c0; c < c0 + abs (dx); c++) {
+            float *cell = &grid->cells[c & grid->mask];
+            for (int r = 0; r < size; r++)
+                cell[r * size] = 0;
+        }
+        int r0 = dy > 0 ? grid->origin_iy : grid->origin_iy + size + dy;
+        for (int r = r0; r < r0 + abs (dy); r++)
+            memset (&grid->cells[(r & grid->mask) * size], 0,
+                    size * sizeof (float));
+    }
+    grid->origin_ix = ox;
+    grid->origin_iy = oy;
+}
+
+void
+bot_occ_grid_add_scan (BotOccGrid *grid,
+        const bot_core_planar_lidar_t *scan, const BotTrans *sensor_to_local)
+{
+    _insert_scan (grid, &grid->scratch[0], scan, sensor_to_local, 0);
+}
+
+void
+bot_occ_grid_add_scans (BotOccGrid *grid,
+        const bot_core_planar_lidar_t * const *scans,
+        const BotTrans *sensor_to_local, int num_scans)
+{
+    int num_threads = MIN (grid->num_threads, num_scans);
+    if (num_threads <= 1) {
+        for (int i = 0; i < num_scans; i++)
+            _insert_scan (grid, &grid->scratch[0], scans[i],
+                    &sensor_to_local[i], 0);
+        return;
+    }
+
+    _batch_t batch = {
+        .grid = grid,
+        .scans = scans,
+        .poses = sensor_to_local,
+        .num_scans = num_scans,
+        .next = 0
+    };
+    _worker_t workers[num_threads];
+    GThread *threads[num_threads];
+    for (int t = 0; t < num_threads; t++) {
+        workers[t].batch = &batch;
+        workers[t].scratch = &grid->scratch[t];
+    }
+    // the scans are handed out one at a time, so this thread takes over
+    // the work of any thread that fails to start
+    for (int t = 1; t < num_threads; t++)
+        threads[t] = g_thread_create (_batch_thread, &workers[t], TRUE, NULL);
+    _batch_thread (&workers[0]);
+    for (int t = 1; t < num_threads; t++) {
+        if (threads[t])
+            g_thread_join (threads[t]);
+    }
+}
+
+float
+bot_occ_grid_get_log_odds (BotOccGrid *grid, const double xy[2])
+{
+    int ix = (int) floor (xy[0] / grid->resolution) - grid->origin_ix;
+    int iy = (int) floor (xy[1] / grid->resolution) - grid->origin_iy;
+    if ((unsigned) ix >= (unsigned) grid->size ||
+            (unsigned) iy >= (unsigned) grid->size)
+        return 0;
+    return grid->cells[((ix + grid->origin_ix) & grid->mask) +
+        ((iy + grid->origin_iy) & grid->mask) * grid->size];
+}
+
+double
+bot_occ_grid_get_prob (BotOccGrid *grid, const double xy[2])
+{
+    return 1 / (1 + exp (-bot_occ_grid_get_log_odds (grid, xy)));
+}
+
+void
+bot_occ_grid_get_bounds (BotOccGrid *grid, double xy0[2], double xy1[2])
+{
+    xy0[0] = grid->origin_ix * grid->resolution;
+    xy0[1] = grid->origin_iy * grid->resolution;
+    xy1[0] = (grid->origin_ix + grid->size) * grid->resolution;
+    xy1[1] = (grid->origin_iy + grid->size) * grid->resolution;
+}
+
+int
+bot_occ_grid_get_size (BotOccGrid *grid)
+{
+    return grid->size;
+}
+
+double
+bot_occ_grid_get_resolution (BotOccGrid *grid)
+{
+    return grid->resolution;
+}
+
+static void
+_gray_row (const float *cells, uint8_t *dst, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] = (uint8_t) (255 / (1 + expf (cells[i])));
+}
+
+void
+bot_occ_grid_get_gray (BotOccGrid *grid, uint8_t *dst, int stride)
+{
+    int size = grid->size;
+    int c0 = grid->origin_ix & grid->mask;
+    for (int r = 0; r < size; r++) {
+        const float *row =
+            &grid->cells[((grid->origin_iy + r) & grid->mask) * size];
+        uint8_t *out = dst + r * stride;
+        // each row is rotated by c0 cells
+        _gray_row (row + c0, out, size - c0);
+        _gray_row (row, out + size - c0, c0);
+    }
+}
+
+int
+bot_occ_grid_publish (BotOccGrid *grid, lcm_t *lcm, const char *channel,
+        int64_t utime)
+{
+    int size = grid->size;
+    if (!grid->image_buf)
+        grid->image_buf = g_new (uint8_t, size * size);
+    bot_occ_grid_get_gray (grid, grid->image_buf, size);
+
+    double xy0[2], xy1[2];
+    bot_occ_grid_get_bounds (grid, xy0, xy1);
+    char values[3][32];
+    snprintf (values[0], sizeof (values[0]), "%.17g", xy0[0]);
+    snprintf (values[1], sizeof (values[1]), "%.17g", xy0[1]);
+    snprintf (values[2], sizeof (values[2]), "%.17g", grid->resolution);
+    bot_core_image_metadata_t metadata[3] = {
+        { .key = "x0", .n = strlen (values[0]), .value = (uint8_t *) values[0] },
+        { .key = "y0", .n = strlen (values[1]), .value = (uint8_t *) values[1] },
+        { .key = "resolution", .n = strlen (values[2]),
+            .value = (uint8_t *) values[2] }
+    };
+
+    bot_core_image_t msg;
+    msg.utime = utime;
+    msg.width = size;
+    msg.height = size;
+    msg.row_stride = size;
+    msg.pixelformat = BOT_CORE_IMAGE_T_PIXEL_FORMAT_GRAY;
+    msg.size = size * size;
+    msg.data = grid->image_buf;
+    msg.nmetadata = 3;
+    msg.metadata = metadata;
+    return bot_core_image_t_publish (lcm, channel, &msg) ? -1 : 0;
+}
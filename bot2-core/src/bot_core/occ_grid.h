@@ -0,0 +1,183 @@
+#ifndef __bot_occ_grid_h__
+#define __bot_occ_grid_h__
+
+/**
+ * @defgroup BotCoreOccGrid Occupancy grid
+ * @ingroup BotCoreDataStructures
+ * @brief Rolling 2D occupancy grid built from planar lidar scans
+ * @include: bot_core/bot_core.h
+ *
+ * BotOccGrid is a square grid of log-odds occupancy values that stays
+ * centered on the robot.  Moving the grid with bot_occ_grid_recenter() does
+ * not copy any cells: cells are stored toroidally, indexed by their global
+ * cell coordinates modulo the grid size, and only the rows and columns that
+ * leave the grid are cleared.
+ *
+ * Each beam of a scan decreases the log-odds of the cells it passes through,
+ * and increases the log-odds of the cell it ends in, unless it is beyond the
+ * maximum range.  The beam endpoints of a scan are computed in a single pass
+ * that the compiler can vectorize, and the cells of each beam are then
+ * visited with an incremental traversal (Amanatides and Woo) instead of
+ * Bresenham's algorithm.  bot_occ_grid_add_scans() inserts several scans on
+ * several threads.
+ *
+ * The poses of the scans are passed as BotTrans, e.g., from
+ * bot_frames_get_trans_with_utime() for the laser and local frames, with the
+ * utime of the scan.
+ *
+ * The grid can be published as a bot_core_image_t with
+ * bot_occ_grid_publish(), and drawn by the occupancy grid renderer of
+ * bot2-vis.
+ *
+ * Linking: `pkg-config --libs bot2-core`
+ * @{
+ */
+
+#include <stdint.h>
+#include <lcm/lcm.h>
+#include <lcmtypes/bot_core_planar_lidar_t.h>
+
+#include "trans.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _BotOccGrid BotOccGrid;
+
+/**
+ * bot_occ_grid_new:
+ * @size: number of cells along each side.  Rounded up to a power of two.
+ * @resolution: size of a cell, in meters.
+ * @num_threads: number of threads used by bot_occ_grid_add_scans().
+ *
+ * Creates an empty grid, with all cells at log-odds 0 (unknown), centered
+ * on the origin.
+ *
+ * Returns: a newly allocated BotOccGrid.
+ */
+BotOccGrid *bot_occ_grid_new (int size, double resolution, int num_threads);
+
+void bot_occ_grid_destroy (BotOccGrid *grid);
+
+/**
+ * bot_occ_grid_set_log_odds:
+ * @hit: added to the cell a beam ends in.  Defaults to 0.85.
+ * @miss: added to the cells a beam passes through.  Should be negative.
+ *        Defaults to -0.4.
+ * @min: lower clamping bound.  Defaults to -2.
+ * @max: upper clamping bound.  Defaults to 3.5.
+ */
+void bot_occ_grid_set_log_odds (BotOccGrid *grid, float hit, float miss,
+        float min, float max);
+
+/**
+ * bot_occ_grid_set_range_limits:
+ *
+ * Beams shorter than @min_range are ignored.  Beams longer than @max_range
+ * are shortened to @max_range, and only clear the cells they pass through.
+ * Defaults to 0.1 and 30 meters.
+ */
+void bot_occ_grid_set_range_limits (BotOccGrid *grid, double min_range,
+        double max_range);
+
+/**
+ * bot_occ_grid_recenter:
+ * @xy: new center of the grid, in the local frame.
+ *
+ * Moves the grid.  Cells that leave the grid are forgotten, and the cells
+ * that enter it are unknown.
+ */
+void bot_occ_grid_recenter (BotOccGrid *grid, const double xy[2]);
+
+/**
+ * bot_occ_grid_clear:
+ *
+ * Resets all cells to unknown.
+ */
+void bot_occ_grid_clear (BotOccGrid *grid);
+
+/**
+ * bot_occ_grid_add_scan:
+ * @sensor_to_local: pose of the laser scanner in the local frame of the
+ *                   grid.
+ *
+ * Inserts a scan.  The parts of the beams outside the grid are ignored.
+ */
+void bot_occ_grid_add_scan (BotOccGrid *grid,
+        const bot_core_planar_lidar_t *scan, const BotTrans *sensor_to_local);
+
+/**
+ * bot_occ_grid_add_scans:
+ * @sensor_to_local: the pose of each scan.
+ *
+ * Inserts several scans, spread over the threads of the grid.  The result is
+ * the same as inserting them one by one, up to the clamping of the
+ * log-odds.
+ */
+void bot_occ_grid_add_scans (BotOccGrid *grid,
+        const bot_core_planar_lidar_t * const *scans,
+        const BotTrans *sensor_to_local, int num_scans);
+
+/**
+ * bot_occ_grid_get_log_odds:
+ * @xy: a point in the local frame.
+ *
+ * Returns: the log-odds of the cell containing @xy, or 0 (unknown) if @xy is
+ * outside the grid.
+ */
+float bot_occ_grid_get_log_odds (BotOccGrid *grid, const double xy[2]);
+
+/**
+ * bot_occ_grid_get_prob:
+ *
+ * Returns: the probability that the cell containing @xy is occupied.
+ */
+double bot_occ_grid_get_prob (BotOccGrid *grid, const double xy[2]);
+
+/**
+ * bot_occ_grid_get_bounds:
+ * @xy0: set to the corner of the grid with the smallest coordinates.
+ * @xy1: set to the opposite corner.
+ */
+void bot_occ_grid_get_bounds (BotOccGrid *grid, double xy0[2],
+        double xy1[2]);
+
+int bot_occ_grid_get_size (BotOccGrid *grid);
+
+double bot_occ_grid_get_resolution (BotOccGrid *grid);
+
+/**
+ * bot_occ_grid_get_gray:
+ * @dst: buffer for size rows of size pixels.
+ * @stride: number of bytes between the start of two rows of @dst.
+ *
+ * Renders the grid as an 8-bit grayscale image, with occupied cells dark,
+ * free cells light, and unknown cells 127.  The first row is the row of cells
+ * with the smallest y coordinate, and the first pixel of each row is the cell
+ * with the smallest x coordinate.
+ */
+void bot_occ_grid_get_gray (BotOccGrid *grid, uint8_t *dst, int stride);
+
+/**
+ * bot_occ_grid_publish:
+ *
+ * Publishes the grid as a grayscale bot_core_image_t, as rendered by
+ * bot_occ_grid_get_gray().  The image metadata holds the coordinates of the
+ * grid corner with the smallest coordinates in "x0" and "y0", and the cell
+ * size in "resolution", as text.
+ *
+ * Returns: 0 on success, -1 on failure.
+ */
+int bot_occ_grid_publish (BotOccGrid *grid, lcm_t *lcm, const char *channel,
+        int64_t utime);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
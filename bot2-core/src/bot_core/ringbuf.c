@@ -1,5 +1,7 @@
 #include <unistd.h>
 #include <string.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -39,6 +41,7 @@ void bot_ringbuf_destroy(BotRingBuf * cbuf)
   //destroy
   if (cbuf->buf!=NULL)
     free(cbuf->buf);
+  free(cbuf->read_buf);
   free(cbuf);
 }
 
@@ -119,6 +122,10 @@ int bot_ringbuf_available(BotRingBuf * cbuf) {
         return cbuf->numBytes;
 }
 
+int bot_ringbuf_space(BotRingBuf * cbuf) {
+        return cbuf->maxSize - cbuf->numBytes;
+}
+
 int bot_ringbuf_fill_from_fd(BotRingBuf * cbuf, int fd, int numBytes)
 {
   if (numBytes < 0) {
@@ -155,6 +162,98 @@ int bot_ringbuf_fill_from_fd(BotRingBuf * cbuf, int fd, int numBytes)
   return bytes_written;
 }
 
+int bot_ringbuf_fill_from_fd_nonblock(BotRingBuf * cbuf, int fd)
+{
+  int space = cbuf->maxSize - cbuf->numBytes;
+  if (space == 0)
+    return 0;
+
+  //the free space is at most two contiguous pieces: up to the wrap around
+  //point, and from the start of the buffer
+  struct iovec iov[2];
+  int first = MIN(cbuf->maxSize - cbuf->writeOffset, space);
+  iov[0].iov_base = cbuf->buf + cbuf->writeOffset;
+  iov[0].iov_len = first;
+  iov[1].iov_base = cbuf->buf;
+  iov[1].iov_len = space - first;
+
+  int num_read = readv(fd, iov, iov[1].iov_len ? 2 : 1);
+  if (num_read <= 0)
+    return num_read;
+
+  //move writePtr
+  cbuf->numBytes += num_read;
+  cbuf->writeOffset = (cbuf->writeOffset + num_read) % cbuf->maxSize;
+  return num_read;
+}
+
+int bot_ringbuf_drain_to_fd(BotRingBuf * cbuf, int fd, int numBytes)
+{
+  if (numBytes < 0 || numBytes > cbuf->numBytes)
+    numBytes = cbuf->numBytes;
+  if (numBytes == 0)
+    return 0;
+
+  struct iovec iov[2];
+  int first = MIN(cbuf->maxSize - cbuf->readOffset, numBytes);
+  iov[0].iov_base = cbuf->buf + cbuf->readOffset;
+  iov[0].iov_len = first;
+  iov[1].iov_base = cbuf->buf;
+  iov[1].iov_len = numBytes - first;
+
+  int num_written = writev(fd, iov, iov[1].iov_len ? 2 : 1);
+  if (num_written > 0)
+    bot_ringbuf_flush(cbuf, num_written);
+  return num_written;
+}
+
+int bot_ringbuf_drain_to_socket(BotRingBuf * cbuf, int fd, int numBytes)
+{
+  if (numBytes < 0 || numBytes > cbuf->numBytes)
+    numBytes = cbuf->numBytes;
+  if (numBytes == 0)
+    return 0;
+
+  struct iovec iov[2];
+  int first = MIN(cbuf->maxSize - cbuf->readOffset, numBytes);
+  iov[0].iov_base = cbuf->buf + cbuf->readOffset;
+  iov[0].iov_len = first;
+  iov[1].iov_base = cbuf->buf;
+  iov[1].iov_len = numBytes - first;
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = iov[1].iov_len ? 2 : 1;
+
+#ifdef MSG_NOSIGNAL
+  int num_written = sendmsg(fd, &msg, MSG_NOSIGNAL);
+#else
+  int num_written = sendmsg(fd, &msg, 0);
+#endif
+  if (num_written > 0)
+    bot_ringbuf_flush(cbuf, num_written);
+  return num_written;
+}
+
+int bot_ringbuf_resize(BotRingBuf * cbuf, int size)
+{
+  if (size < cbuf->numBytes) {
+    fprintf(stderr, "ERROR: can't resize ringbuf to %d bytes, it contains %d\n", size, cbuf->numBytes);
+    return -1;
+  }
+  uint8_t * buf = (uint8_t *) malloc(size * sizeof(uint8_t));
+  int numBytes = cbuf->numBytes;
+  bot_ringbuf_peek(cbuf, numBytes, buf);
+  free(cbuf->buf);
+  cbuf->buf = buf;
+  cbuf->maxSize = size;
+  cbuf->readOffset = 0;
+  cbuf->numBytes = numBytes;
+  cbuf->writeOffset = numBytes % size;
+  return 0;
+}
+
 const uint8_t * bot_ringbuf_peek_buf(BotRingBuf * cbuf, int numBytes)
 {
   if (numBytes > cbuf->maxSize) {
@@ -35,6 +35,18 @@ BotRingBuf * bot_ringbuf_create(int size);
  */
 void bot_ringbuf_destroy(BotRingBuf * cbuf);
 
+/*
+ * Like bot_ringbuf_drain_to_fd, but fd must be a socket.  Sends with
+ * MSG_NOSIGNAL, so a closed peer yields EPIPE instead of SIGPIPE.
+ */
+int bot_ringbuf_drain_to_socket(BotRingBuf * cbuf, int fd, int numBytes);
+
+/*
+ * Change the allocated size of the buffer to size bytes, keeping its contents.
+ * Returns 0 on success, or -1 if the contents don't fit in size bytes.
+ */
+int bot_ringbuf_resize(BotRingBuf * cbuf, int size);
+
 /*
  * Copy numBytes from the head of the buffer, and move read pointers
  */
@@ -54,6 +66,22 @@ int bot_ringbuf_write(BotRingBuf * cbuf, int numBytes, uint8_t * buf);
 int bot_ringbuf_fill_from_fd(BotRingBuf * cbuf, int fd, int numBytes);
 
 
+/*
+ * Read as many bytes as are available from a non-blocking fd, up to the free
+ * space in the buffer.  Unlike bot_ringbuf_fill_from_fd(), short reads are
+ * expected.
+ * Returns the number of bytes read, 0 at end of file, or -1 on error (check
+ * errno for EAGAIN)
+ */
+int bot_ringbuf_fill_from_fd_nonblock(BotRingBuf * cbuf, int fd);
+
+/*
+ * Write up to numBytes from the head of the buffer to fd (all of the data if
+ * numBytes<0), and flush the bytes that were written
+ * Returns the number of bytes written, or -1 on error (check errno)
+ */
+int bot_ringbuf_drain_to_fd(BotRingBuf * cbuf, int fd, int numBytes);
+
 /*
  * Copy numBytes from the head of the buffer, but DON'T move read pointers
  */
@@ -75,6 +103,11 @@ int bot_ringbuf_flush(BotRingBuf * cbuf, int numBytes);
  */
 int bot_ringbuf_available(BotRingBuf * cbuf);
 
+/*
+ * Get the number of bytes that can be written before the buffer is full
+ */
+int bot_ringbuf_space(BotRingBuf * cbuf);
+
 
 #ifdef __cplusplus
 }
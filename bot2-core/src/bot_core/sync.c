@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "timestamp.h"
+#include "sync.h"
+
+// a message this much older than the last set of its channel means that the
+// clock went back, e.g., because a log is being replayed from the start
+#define RESET_USEC 1000000
+
+typedef struct {
+    int64_t utime;
+    int64_t recv_utime;
+    int datalen;
+    uint8_t data[];
+} _msg_t;
+
+typedef struct {
+    BotSync *sync;
+    int index;
+    char *channel;
+    BotSyncUtimeFunc utime_func;
+    void *utime_user;
+    lcm_subscription_t *lcm_sub;
+
+    // queued messages, ordered by utime, oldest at the head
+    GQueue *queue;
+
+    int have_last_matched;
+    int64_t last_matched_utime;
+
+    BotSyncChannelStats stats;
+} _channel_t;
+
+struct _BotSync {
+    lcm_t *lcm;
+    BotSyncPolicy policy;
+    int64_t max_skew_usec;
+    int queue_size;
+    BotSyncHandler handler;
+    void *user;
+
+    GPtrArray *channels;
+
+    // scratch space for matching, one entry per channel
+    GList **candidates;
+    BotSyncMsg *set;
+
+    int64_t sets;
+    double total_latency_usec;
+    int64_t max_latency_usec;
+    double total_skew_usec;
+    int64_t max_skew_seen_usec;
+};
+
+static void
+_msg_free (_msg_t *msg)
+{
+    g_free (msg);
+}
+
+static void
+_channel_clear (_channel_t *chan)
+{
+    _msg_t *msg;
+    while ((msg = g_queue_pop_head (chan->queue)))
+        _msg_free (msg);
+    chan->have_last_matched = 0;
+}
+
+static void
+_drop_head (_channel_t *chan)
+{
+    _msg_free (g_queue_pop_head (chan->queue));
+    chan->stats.dropped++;
+}
+
+static void
+_handle_set (BotSync *sync)
+{
+    int n = sync->channels->len;
+    int64_t now = bot_timestamp_now ();
+    int64_t min_utime = INT64_MAX, max_utime = INT64_MIN;
+    int64_t first_recv_utime = INT64_MAX;
+
+    for (int c = 0; c < n; c++) {
+        _channel_t *chan = g_ptr_array_index (sync->channels, c);
+        _msg_t *msg = sync->candidates[c]->data;
+        sync->set[c].channel = chan->channel;
+        sync->set[c].utime = msg->utime;
+        sync->set[c].recv_utime = msg->recv_utime;
+        sync->set[c].data = msg->data;
+        sync->set[c].datalen = msg->datalen;
+        if (msg->utime < min_utime)
+            min_utime = msg->utime;
+        if (msg->utime > max_utime)
+            max_utime = msg->utime;
+        if (msg->recv_utime < first_recv_utime)
+            first_recv_utime = msg->recv_utime;
+    }
+
+    int64_t latency = now - first_recv_utime;
+    int64_t skew = max_utime - min_utime;
+    sync->sets++;
+    sync->total_latency_usec += latency;
+    sync->total_skew_usec += skew;
+    if (latency > sync->max_latency_usec)
+        sync->max_latency_usec = latency;
+    if (skew > sync->max_skew_seen_usec)
+        sync->max_skew_seen_usec = skew;
+
+    if (sync->handler)
+        sync->handler (sync, sync->set, n, sync->user);
+
+    // remove the set, and everything older
+    for (int c = 0; c < n; c++) {
+        _channel_t *chan = g_ptr_array_index (sync->channels, c);
+        _msg_t *matched = sync->candidates[c]->data;
+        while (g_queue_peek_head (chan->queue) != matched)
+            _drop_head (chan);
+        chan->stats.matched++;
+        chan->have_last_matched = 1;
+        chan->last_matched_utime = matched->utime;
+        _msg_free (g_queue_pop_head (chan->queue));
+    }
+}
+
+static void
+_match (BotSync *sync)
+{
+    int n = sync->channels->len;
+    int64_t max_skew = sync->policy == BOT_SYNC_EXACT ? 0 : sync->max_skew_usec;
+
+    while (n > 0) {
+        // the newest of the oldest queued messages.  Every future set has a
+        // message at least this new.
+        int64_t target = INT64_MIN;
+        int pivot = -1;
+        for (int c = 0; c < n; c++) {
+            _channel_t *chan = g_ptr_array_index (sync->channels, c);
+            _msg_t *head = g_queue_peek_head (chan->queue);
+            if (!head)
+                return;
+            if (head->utime > target) {
+                target = head->utime;
+                pivot = c;
+            }
+        }
+
+        // so messages older than this can never be part of a set
+        for (int c = 0; c < n; c++) {
+            _channel_t *chan = g_ptr_array_index (sync->channels, c);
+            _msg_t *head;
+            while ((head = g_queue_peek_head (chan->queue)) &&
+                    head->utime < target - max_skew)
+                _drop_head (chan);
+            if (!head)
+                return;
+        }
+
+        // on each channel, the message closest to the target
+        for (int c = 0; c < n; c++) {
+            _channel_t *chan = g_ptr_array_index (sync->channels, c);
+            GList *best = chan->queue->head;
+            for (GList *link = best->next; link; link = link->next) {
+                _msg_t *msg = link->data;
+                _msg_t *best_msg = best->data;
+                if (llabs (msg->utime - target) >= llabs (best_msg->utime - target))
+                    break;
+                best = link;
+            }
+            // a newer message could still be closer
+            if (!best->next && ((_msg_t *) best->data)->utime < target)
+                return;
+            sync->candidates[c] = best;
+        }
+
+        int64_t min_utime = INT64_MAX, max_utime = INT64_MIN;
+        for (int c = 0; c < n; c++) {
+            _msg_t *msg = sync->candidates[c]->data;
+            if (msg->utime < min_utime)
+                min_utime = msg->utime;
+            if (msg->utime > max_utime)
+                max_utime = msg->utime;
+        }
+
+        if (max_utime - min_utime <= max_skew)
+            _handle_set (sync);
+        else
+            _drop_head (g_ptr_array_index (sync->channels, pivot));
+    }
+}
+
+void
+bot_sync_push (BotSync *sync, int index, int64_t utime,
+        int64_t recv_utime, const void *data, int datalen)
+{
+    if (index < 0 || index >= sync->channels->len)
+        return;
+    _channel_t *chan = g_ptr_array_index (sync->channels, index);
+    chan->stats.received++;
+
+    if (chan->have_last_matched && utime <= chan->last_matched_utime) {
+        if (utime < chan->last_matched_utime - RESET_USEC) {
+            for (int c = 0; c < sync->channels->len; c++)
+                _channel_clear (g_ptr_array_index (sync->channels, c));
+        } else {
+            // too late to be part of a set
+            chan->stats.dropped++;
+            return;
+        }
+    }
+
+    _msg_t *msg = (_msg_t *) g_malloc (sizeof (_msg_t) + datalen);
+    msg->utime = utime;
+    msg->recv_utime = recv_utime;
+    msg->datalen = datalen;
+    memcpy (msg->data, data, datalen);
+
+    // messages usually arrive in order, so search from the tail
+    GList *link = chan->queue->tail;
+    while (link && ((_msg_t *) link->data)->utime > utime)
+        link = link->prev;
+    if (link)
+        g_queue_insert_after (chan->queue, link, msg);
+    else
+        g_queue_push_head (chan->queue, msg);
+
+    while (g_queue_get_length (chan->queue) > (guint) sync->queue_size)
+        _drop_head (chan);
+
+    _match (sync);
+}
+
+static void
+_on_message (const lcm_recv_buf_t *rbuf, const char *channel, void *user)
+{
+    _channel_t *chan = (_channel_t *) user;
+    int64_t utime = chan->utime_func (rbuf->data, rbuf->data_size,
+            chan->utime_user);
+    if (utime < 0) {
+        chan->stats.received++;
+        chan->stats.dropped++;
+        return;
+    }
+    bot_sync_push (chan->sync, chan->index, utime, rbuf->recv_utime,
+            rbuf->data, rbuf->data_size);
+}
+
+int64_t
+bot_sync_utime_first_field (const void *data, int datalen, void *user)
+{
+    // 8 byte fingerprint, then a big-endian int64_t
+    if (datalen < 16)
+        return -1;
+    const uint8_t *p = (const uint8_t *) data + 8;
+    int64_t utime = 0;
+    for (int i = 0; i < 8; i++)
+        utime = (utime << 8) | p[i];
+    return utime;
+}
+
+BotSync *
+bot_sync_new (lcm_t *lcm, BotSyncPolicy policy, int64_t max_skew_usec,
+        int queue_size, BotSyncHandler handler, void *user)
+{
+    BotSync *sync = g_slice_new0 (BotSync);
+    sync->lcm = lcm;
+    sync->policy = policy;
+    sync->max_skew_usec = max_skew_usec;
+    sync->queue_size = queue_size > 0 ? queue_size : 1;
+    sync->handler = handler;
+    sync->user = user;
+    sync->channels = g_ptr_array_new ();
+    return sync;
+}
+
+void
+bot_sync_destroy (BotSync *sync)
+{
+    for (int c = 0; c < sync->channels->len; c++) {
+        _channel_t *chan = g_ptr_array_index (sync->channels, c);
+        if (chan->lcm_sub)
+            lcm_unsubscribe (sync->lcm, chan->lcm_sub);
+        _channel_clear (chan);
+        g_queue_free (chan->queue);
+        g_free (chan->channel);
+        g_slice_free (_channel_t, chan);
+    }
+    g_ptr_array_free (sync->channels, TRUE);
+    g_free (sync->candidates);
+    g_free (sync->set);
+    g_slice_free (BotSync, sync);
+}
+
+int
+bot_sync_add_channel (BotSync *sync, const char *channel,
+        BotSyncUtimeFunc utime_func, void *utime_user)
+{
+    _channel_t *chan = g_slice_new0 (_channel_t);
+    chan->sync = sync;
+    chan->index = sync->channels->len;
+    chan->channel = g_strdup (channel);
+    chan->utime_func = utime_func ? utime_func : bot_sync_utime_first_field;
+    chan->utime_user = utime_user;
+    chan->queue = g_queue_new ();
+
+    if (sync->lcm) {
+        char *regex = g_regex_escape_string (channel, -1);
+        chan->lcm_sub = lcm_subscribe (sync->lcm, regex, _on_message, chan);
+        g_free (regex);
+        if (!chan->lcm_sub) {
+            g_queue_free (chan->queue);
+            g_free (chan->channel);
+            g_slice_free (_channel_t, chan);
+            return -1;
+        }
+    }
+
+    g_ptr_array_add (sync->channels, chan);
+    sync->candidates = g_renew (GList *, sync->candidates,
+            sync->channels->len);
+    sync->set = g_renew (BotSyncMsg, sync->set, sync->channels->len);
+    return chan->index;
+}
+
+void
+bot_sync_get_stats (BotSync *sync, BotSyncStats *stats)
+{
+    stats->sets = sync->sets;
+    stats->mean_latency_usec = sync->sets ?
+        sync->total_latency_usec / sync->sets : 0;
+    stats->max_latency_usec = sync->max_latency_usec;
+    stats->mean_skew_usec = sync->sets ?
+        sync->total_skew_usec / sync->sets : 0;
+    stats->max_skew_usec = sync->max_skew_seen_usec;
+}
+
+int
+bot_sync_get_channel_stats (BotSync *sync, int index,
+        BotSyncChannelStats *stats)
+{
+    if (index < 0 || index >= sync->channels->len)
+        return -1;
+    _channel_t *chan = g_ptr_array_index (sync->channels, index);
+    *stats = chan->stats;
+    stats->queued = g_queue_get_length (chan->queue);
+    return 0;
+}
+
+void
+bot_sync_reset_stats (BotSync *sync)
+{
+    sync->sets = 0;
+    sync->total_latency_usec = 0;
+    sync->max_latency_usec = 0;
+    sync->total_skew_usec = 0;
+    sync->max_skew_seen_usec = 0;
+    for (int c = 0; c < sync->channels->len; c++) {
+        _channel_t *chan = g_ptr_array_index (sync->channels, c);
+        memset (&chan->stats, 0, sizeof (chan->stats));
+    }
+}
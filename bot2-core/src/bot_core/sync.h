@@ -0,0 +1,173 @@
+#ifndef __bot_sync_h__
+#define __bot_sync_h__
+
+/**
+ * @defgroup BotCoreSync Sync
+ * @ingroup BotCoreIO
+ * @brief Time synchronization of messages from several LCM channels
+ * @include: bot_core/bot_core.h
+ *
+ * BotSync subscribes to several channels (e.g., a camera, a lidar, and the
+ * pose), and calls a handler with one message from each channel whenever it
+ * finds a set of messages with matching utimes.  Each channel has a bounded
+ * queue of recent messages, ordered by utime.
+ *
+ * Two policies are available:
+ *
+ * - #BOT_SYNC_EXACT: the messages of a set have exactly the same utime,
+ *   e.g., because they were all computed from the same input.
+ *
+ * - #BOT_SYNC_APPROXIMATE: the utimes of the messages of a set differ by at
+ *   most max_skew_usec.  Among the candidates, the messages closest in time
+ *   to the newest of the oldest queued messages are chosen, as soon as
+ *   newer messages can't give a closer match.
+ *
+ * Once a set is handled, its messages and all older messages are removed
+ * from the queues.  Older messages are counted as dropped.
+ *
+ * Messages are copied once, when they are received, and handed to the
+ * handler undecoded.  The utime of each message is read with a
+ * #BotSyncUtimeFunc.  The default, bot_sync_utime_first_field(), works for
+ * any LCM type whose first field is an int64_t utime, which includes all of
+ * the bot_core sensor types.
+ *
+ * Linking: `pkg-config --libs bot2-core`
+ * @{
+ */
+
+#include <stdint.h>
+#include <lcm/lcm.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _BotSync BotSync;
+
+typedef enum {
+    BOT_SYNC_EXACT,
+    BOT_SYNC_APPROXIMATE
+} BotSyncPolicy;
+
+/**
+ * BotSyncMsg:
+ *
+ * A received message.  The data is owned by the BotSync, and is only valid
+ * during the call to the #BotSyncHandler.
+ */
+typedef struct _BotSyncMsg {
+    const char *channel;
+    int64_t utime;
+    int64_t recv_utime;
+    const void *data;
+    int datalen;
+} BotSyncMsg;
+
+/**
+ * BotSyncHandler:
+ * @msgs: one message per channel, in the order the channels were added.
+ */
+typedef void (*BotSyncHandler) (BotSync *sync, const BotSyncMsg *msgs,
+        int num_msgs, void *user);
+
+/**
+ * BotSyncUtimeFunc:
+ *
+ * Returns: the utime of the encoded message in @data, or -1 if it can't be
+ * decoded.
+ */
+typedef int64_t (*BotSyncUtimeFunc) (const void *data, int datalen,
+        void *user);
+
+typedef struct _BotSyncChannelStats {
+    int64_t received;
+    int64_t matched;
+    // skipped because no match was found, the queue was full, or they
+    // arrived too late
+    int64_t dropped;
+    int queued;
+} BotSyncChannelStats;
+
+typedef struct _BotSyncStats {
+    int64_t sets;
+    // time from when the first message of a set was received to when the
+    // set was handled
+    double mean_latency_usec;
+    int64_t max_latency_usec;
+    // difference between the newest and oldest utime in a set
+    double mean_skew_usec;
+    int64_t max_skew_usec;
+} BotSyncStats;
+
+/**
+ * bot_sync_new:
+ * @lcm: LCM instance used to subscribe to the channels, or NULL to only
+ *       pass messages in with bot_sync_push().
+ * @max_skew_usec: for #BOT_SYNC_APPROXIMATE, the largest allowed difference
+ *                 between the utimes of the messages of a set.
+ * @queue_size: number of messages queued per channel.  Once a queue is
+ *              full, its oldest messages are dropped.
+ *
+ * Returns: a newly allocated BotSync.
+ */
+BotSync *bot_sync_new (lcm_t *lcm, BotSyncPolicy policy,
+        int64_t max_skew_usec, int queue_size, BotSyncHandler handler,
+        void *user);
+
+/**
+ * bot_sync_destroy:
+ *
+ * Unsubscribes from all channels, and frees the queued messages.
+ */
+void bot_sync_destroy (BotSync *sync);
+
+/**
+ * bot_sync_add_channel:
+ * @utime_func: reads the utime of the messages, or NULL for
+ *              bot_sync_utime_first_field().
+ *
+ * Adds a channel to synchronize, and subscribes to it if the BotSync has an
+ * LCM instance.  Channels should be added before any messages are received.
+ *
+ * Returns: the index of the channel in the sets passed to the handler, or
+ * -1 on failure.
+ */
+int bot_sync_add_channel (BotSync *sync, const char *channel,
+        BotSyncUtimeFunc utime_func, void *utime_user);
+
+/**
+ * bot_sync_push:
+ * @index: channel index returned by bot_sync_add_channel().
+ * @recv_utime: when the message was received.
+ *
+ * Queues a message, copying @data, and calls the handler for any sets that
+ * are now complete.  Called automatically for subscribed channels.
+ */
+void bot_sync_push (BotSync *sync, int index, int64_t utime,
+        int64_t recv_utime, const void *data, int datalen);
+
+/**
+ * bot_sync_utime_first_field:
+ *
+ * Returns: the first field of an encoded LCM message (after the
+ * fingerprint), if it is an int64_t utime.
+ */
+int64_t bot_sync_utime_first_field (const void *data, int datalen,
+        void *user);
+
+void bot_sync_get_stats (BotSync *sync, BotSyncStats *stats);
+
+int bot_sync_get_channel_stats (BotSync *sync, int index,
+        BotSyncChannelStats *stats);
+
+void bot_sync_reset_stats (BotSync *sync);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,645 @@
+#ifdef __linux__
+// accept4
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+#include <glib.h>
+
+#include "tcp_server.h"
+
+#define dbg(args...) fprintf(stderr, args)
+#undef dbg
+#define dbg(args...)
+
+#define DEFAULT_RECV_QUEUE_SIZE (256 * 1024)
+#define DEFAULT_SEND_QUEUE_SIZE (1024 * 1024)
+#define DEFAULT_MAX_RECV_QUEUE_SIZE (64 * 1024 * 1024)
+
+// maximum number of events handled per epoll_wait
+#define MAX_EVENTS 64
+
+struct _BotTcpConn {
+    BotTcpServer *server;
+    int fd;
+    BotRingBuf *recv_queue;
+    BotRingBuf *send_queue;
+
+    // edge-triggered readiness that has not been used up yet, i.e., the
+    // last read or write did not return EAGAIN
+    int readable;
+    int writable;
+
+    // on_backpressure was called with blocked = 1
+    int blocked;
+    // the receive queue is full, and the socket may have more data
+    int stalled;
+    // close once the send queue is empty
+    int closing;
+    int closed;
+
+    void *user;
+};
+
+struct _BotTcpServer {
+    int listen_fd;
+    int epoll_fd;
+    // in the epoll set.  Made readable when a stalled connection has room in
+    // its receive queue again.
+    int wake_fd;
+    int port;
+
+    BotTcpOptions options;
+    BotTcpServerHandlers handlers;
+    void *user;
+
+    // BotTcpConn * -> BotTcpConn *
+    GHashTable *conns;
+    // connections with a full receive queue
+    GList *stalled;
+    // closed connections, freed at the end of bot_tcp_server_dispatch
+    GList *dead;
+};
+
+void
+bot_tcp_options_init (BotTcpOptions *options)
+{
+    memset (options, 0, sizeof (BotTcpOptions));
+    options->nodelay = 1;
+    options->keepalive_idle = 30;
+    options->keepalive_interval = 10;
+    options->keepalive_count = 3;
+    options->recv_queue_size = DEFAULT_RECV_QUEUE_SIZE;
+    options->send_queue_size = DEFAULT_SEND_QUEUE_SIZE;
+    options->max_recv_queue_size = DEFAULT_MAX_RECV_QUEUE_SIZE;
+    options->send_high_water = DEFAULT_SEND_QUEUE_SIZE / 4 * 3;
+    options->send_low_water = DEFAULT_SEND_QUEUE_SIZE / 4;
+}
+
+static int
+_setsockopt_int (int fd, int level, int name, int value, const char *what)
+{
+    if (0 == setsockopt (fd, level, name, &value, sizeof (value)))
+        return 0;
+    fprintf (stderr, "BotTcpServer: could not set %s: %s\n", what,
+            strerror (errno));
+    return -1;
+}
+
+int
+bot_tcp_set_options (int fd, const BotTcpOptions *options)
+{
+    int status = 0;
+    if (options->nodelay)
+        status |= _setsockopt_int (fd, IPPROTO_TCP, TCP_NODELAY, 1,
+                "TCP_NODELAY");
+    if (options->sndbuf > 0)
+        status |= _setsockopt_int (fd, SOL_SOCKET, SO_SNDBUF,
+                options->sndbuf, "SO_SNDBUF");
+    if (options->rcvbuf > 0)
+        status |= _setsockopt_int (fd, SOL_SOCKET, SO_RCVBUF,
+                options->rcvbuf, "SO_RCVBUF");
+    if (options->keepalive_idle > 0) {
+        status |= _setsockopt_int (fd, SOL_SOCKET, SO_KEEPALIVE, 1,
+                "SO_KEEPALIVE");
+#ifdef TCP_KEEPIDLE
+        status |= _setsockopt_int (fd, IPPROTO_TCP, TCP_KEEPIDLE,
+                options->keepalive_idle, "TCP_KEEPIDLE");
+        status |= _setsockopt_int (fd, IPPROTO_TCP, TCP_KEEPINTVL,
+                options->keepalive_interval, "TCP_KEEPINTVL");
+        status |= _setsockopt_int (fd, IPPROTO_TCP, TCP_KEEPCNT,
+                options->keepalive_count, "TCP_KEEPCNT");
+#endif
+    }
+    return status ? -1 : 0;
+}
+
+#ifdef __linux__
+
+static void
+_conn_close (BotTcpConn *conn)
+{
+    if (conn->closed)
+        return;
+    BotTcpServer *server = conn->server;
+    dbg ("BotTcpServer: closing connection %d\n", conn->fd);
+
+    conn->closed = 1;
+    epoll_ctl (server->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close (conn->fd);
+    g_hash_table_remove (server->conns, conn);
+    if (conn->stalled)
+        server->stalled = g_list_remove (server->stalled, conn);
+
+    if (server->handlers.on_close)
+        server->handlers.on_close (server, conn, server->user);
+    server->dead = g_list_prepend (server->dead, conn);
+}
+
+static void
+_conn_free (BotTcpConn *conn)
+{
+    bot_ringbuf_destroy (conn->recv_queue);
+    bot_ringbuf_destroy (conn->send_queue);
+    g_slice_free (BotTcpConn, conn);
+}
+
+// writes as much of the send queue as the socket accepts
+static void
+_conn_flush (BotTcpConn *conn)
+{
+    BotTcpServer *server = conn->server;
+    while (conn->writable && bot_ringbuf_available (conn->send_queue) > 0) {
+        int n = bot_ringbuf_drain_to_socket (conn->send_queue, conn->fd, -1);
+        if (n >= 0)
+            continue;
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            conn->writable = 0;
+            break;
+        }
+        dbg ("BotTcpServer: write failed: %s\n", strerror (errno));
+        _conn_close (conn);
+        return;
+    }
+
+    int queued = bot_ringbuf_available (conn->send_queue);
+    if (conn->blocked && queued <= server->options.send_low_water) {
+        conn->blocked = 0;
+        if (server->handlers.on_backpressure)
+            server->handlers.on_backpressure (server, conn, 0, server->user);
+    }
+    if (conn->closing && !conn->closed &&
+            0 == bot_ringbuf_available (conn->send_queue))
+        _conn_close (conn);
+}
+
+// on_data left a full receive queue untouched, so the message at its head
+// doesn't fit.  Grows the queue up to max_recv_queue_size.  Returns 0 if the
+// queue grew, 1 if growing is disabled, or -1 if the connection was closed
+// because the message can never fit.
+static int
+_conn_grow_recv_queue (BotTcpConn *conn)
+{
+    BotTcpServer *server = conn->server;
+    int max_size = server->options.max_recv_queue_size;
+    if (max_size <= server->options.recv_queue_size)
+        return 1;
+    int size = bot_ringbuf_available (conn->recv_queue);
+    if (size >= max_size) {
+        fprintf (stderr, "BotTcpServer: closing connection, its message "
+                "doesn't fit in a %d byte receive queue\n", size);
+        _conn_close (conn);
+        return -1;
+    }
+    bot_ringbuf_resize (conn->recv_queue,
+            size > max_size / 2 ? max_size : size * 2);
+    return 0;
+}
+
+// reads from the socket until it would block or the receive queue is full,
+// handing the data to on_data as it arrives
+static void
+_conn_read (BotTcpConn *conn)
+{
+    BotTcpServer *server = conn->server;
+    while (1) {
+        int got_data = 0;
+        int eof = 0;
+        while (conn->readable && bot_ringbuf_space (conn->recv_queue) > 0) {
+            int n = bot_ringbuf_fill_from_fd_nonblock (conn->recv_queue,
+                    conn->fd);
+            if (n > 0) {
+                got_data = 1;
+                continue;
+            }
+            if (n == 0) {
+                eof = 1;
+                break;
+            }
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                conn->readable = 0;
+                break;
+            }
+            dbg ("BotTcpServer: read failed: %s\n", strerror (errno));
+            _conn_close (conn);
+            return;
+        }
+
+        int queued = bot_ringbuf_available (conn->recv_queue);
+        if (got_data && server->handlers.on_data)
+            server->handlers.on_data (server, conn, conn->recv_queue,
+                    server->user);
+        if (conn->closed)
+            return;
+        if (eof) {
+            _conn_close (conn);
+            return;
+        }
+        if (!conn->readable)
+            return;
+
+        if (got_data && 0 == bot_ringbuf_space (conn->recv_queue) &&
+                queued == bot_ringbuf_available (conn->recv_queue)) {
+            int status = _conn_grow_recv_queue (conn);
+            if (status < 0)
+                return;
+            if (status == 0)
+                continue;
+        }
+
+        if (!got_data || 0 == bot_ringbuf_space (conn->recv_queue)) {
+            // the handler is not keeping up.  Stop reading, so that TCP
+            // flow control pushes back on the sender, and retry once there
+            // is room in the queue.
+            if (!conn->stalled) {
+                conn->stalled = 1;
+                server->stalled = g_list_append (server->stalled, conn);
+            }
+            return;
+        }
+    }
+}
+
+// makes the epoll fd readable, so that bot_tcp_server_dispatch() runs
+static void
+_server_wake (BotTcpServer *server)
+{
+    uint64_t one = 1;
+    if (write (server->wake_fd, &one, sizeof (one)) < 0 && errno != EAGAIN)
+        perror ("BotTcpServer: eventfd write");
+}
+
+// returns 1 if a stalled connection has room in its receive queue again
+static int
+_have_resumable (BotTcpServer *server)
+{
+    for (GList *iter = server->stalled; iter; iter = iter->next) {
+        BotTcpConn *conn = (BotTcpConn *) iter->data;
+        if (bot_ringbuf_space (conn->recv_queue) > 0)
+            return 1;
+    }
+    return 0;
+}
+
+// resumes reading from the connections that stopped because their receive
+// queue was full, if there is room now
+static void
+_retry_stalled (BotTcpServer *server)
+{
+    GList *stalled = g_list_copy (server->stalled);
+    for (GList *iter = stalled; iter; iter = iter->next) {
+        BotTcpConn *conn = (BotTcpConn *) iter->data;
+        if (conn->closed || !conn->stalled ||
+                0 == bot_ringbuf_space (conn->recv_queue))
+            continue;
+        conn->stalled = 0;
+        server->stalled = g_list_remove (server->stalled, conn);
+        _conn_read (conn);
+    }
+    g_list_free (stalled);
+}
+
+static BotTcpConn *
+_conn_new (BotTcpServer *server, int fd)
+{
+    BotTcpConn *conn = g_slice_new0 (BotTcpConn);
+    conn->server = server;
+    conn->fd = fd;
+    conn->recv_queue = bot_ringbuf_create (server->options.recv_queue_size);
+    conn->send_queue = bot_ringbuf_create (server->options.send_queue_size);
+
+    int flags = fcntl (fd, F_GETFL);
+    fcntl (fd, F_SETFL, flags | O_NONBLOCK);
+    bot_tcp_set_options (fd, &server->options);
+
+    struct epoll_event ev;
+    memset (&ev, 0, sizeof (ev));
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = conn;
+    if (0 != epoll_ctl (server->epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+        perror ("BotTcpServer: epoll_ctl");
+        close (fd);
+        _conn_free (conn);
+        return NULL;
+    }
+    g_hash_table_insert (server->conns, conn, conn);
+    return conn;
+}
+
+static void
+_accept_connections (BotTcpServer *server)
+{
+    // edge-triggered: accept until there are no more pending connections
+    while (1) {
+        int fd = accept4 (server->listen_fd, NULL, NULL,
+                SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                perror ("BotTcpServer: accept");
+            return;
+        }
+        BotTcpConn *conn = _conn_new (server, fd);
+        if (!conn)
+            continue;
+        dbg ("BotTcpServer: new connection %d\n", fd);
+        // the socket is writable as soon as it is connected
+        conn->writable = 1;
+        if (server->handlers.on_connect &&
+                0 != server->handlers.on_connect (server, conn, server->user))
+            _conn_close (conn);
+    }
+}
+
+BotTcpServer *
+bot_tcp_server_new (int port, int localhost_only,
+        const BotTcpOptions *options, const BotTcpServerHandlers *handlers,
+        void *user)
+{
+    BotTcpServer *server = g_slice_new0 (BotTcpServer);
+    if (options)
+        server->options = *options;
+    else
+        bot_tcp_options_init (&server->options);
+    BotTcpOptions *opts = &server->options;
+    if (opts->send_high_water <= 0 || opts->send_high_water > opts->send_queue_size)
+        opts->send_high_water = opts->send_queue_size / 4 * 3;
+    if (opts->send_low_water < 0 || opts->send_low_water >= opts->send_high_water)
+        opts->send_low_water = opts->send_high_water / 3;
+    server->handlers = *handlers;
+    server->user = user;
+
+    server->listen_fd = socket (AF_INET,
+            SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server->listen_fd < 0) {
+        perror ("BotTcpServer: socket");
+        g_slice_free (BotTcpServer, server);
+        return NULL;
+    }
+    // avoid address already in use errors
+    _setsockopt_int (server->listen_fd, SOL_SOCKET, SO_REUSEADDR, 1,
+            "SO_REUSEADDR");
+
+    struct sockaddr_in sa;
+    memset (&sa, 0, sizeof (sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons (port);
+    sa.sin_addr.s_addr = htonl (localhost_only ? INADDR_LOOPBACK : INADDR_ANY);
+    socklen_t salen = sizeof (sa);
+    if (0 != bind (server->listen_fd, (struct sockaddr *) &sa, sizeof (sa)) ||
+            0 != listen (server->listen_fd, SOMAXCONN) ||
+            0 != getsockname (server->listen_fd, (struct sockaddr *) &sa,
+                &salen)) {
+        fprintf (stderr, "BotTcpServer: could not listen on port %d: %s\n",
+                port, strerror (errno));
+        close (server->listen_fd);
+        g_slice_free (BotTcpServer, server);
+        return NULL;
+    }
+    server->port = ntohs (sa.sin_port);
+
+    server->epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+    if (server->epoll_fd < 0) {
+        perror ("BotTcpServer: epoll_create1");
+        close (server->listen_fd);
+        g_slice_free (BotTcpServer, server);
+        return NULL;
+    }
+    struct epoll_event ev;
+    memset (&ev, 0, sizeof (ev));
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL;
+    epoll_ctl (server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &ev);
+
+    server->wake_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (server->wake_fd < 0) {
+        perror ("BotTcpServer: eventfd");
+        close (server->epoll_fd);
+        close (server->listen_fd);
+        g_slice_free (BotTcpServer, server);
+        return NULL;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = server;
+    epoll_ctl (server->epoll_fd, EPOLL_CTL_ADD, server->wake_fd, &ev);
+
+    server->conns = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+    return server;
+}
+
+void
+bot_tcp_server_destroy (BotTcpServer *server)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init (&iter, server->conns);
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+        BotTcpConn *conn = (BotTcpConn *) value;
+        close (conn->fd);
+        _conn_free (conn);
+    }
+    g_hash_table_destroy (server->conns);
+    g_list_free (server->stalled);
+    for (GList *iter = server->dead; iter; iter = iter->next)
+        _conn_free ((BotTcpConn *) iter->data);
+    g_list_free (server->dead);
+
+    close (server->wake_fd);
+    close (server->epoll_fd);
+    close (server->listen_fd);
+    g_slice_free (BotTcpServer, server);
+}
+
+int
+bot_tcp_server_get_port (BotTcpServer *server)
+{
+    return server->port;
+}
+
+int
+bot_tcp_server_get_fileno (BotTcpServer *server)
+{
+    return server->epoll_fd;
+}
+
+int
+bot_tcp_server_get_num_connections (BotTcpServer *server)
+{
+    return g_hash_table_size (server->conns);
+}
+
+BotTcpConn *
+bot_tcp_server_add_connection (BotTcpServer *server, int fd)
+{
+    return _conn_new (server, fd);
+}
+
+int
+bot_tcp_server_dispatch (BotTcpServer *server, int timeout_ms)
+{
+    _retry_stalled (server);
+
+    struct epoll_event events[MAX_EVENTS];
+    int n = epoll_wait (server->epoll_fd, events, MAX_EVENTS, timeout_ms);
+    if (n < 0) {
+        if (errno == EINTR)
+            return 0;
+        perror ("BotTcpServer: epoll_wait");
+        return -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.ptr == server) {
+            uint64_t count;
+            if (read (server->wake_fd, &count, sizeof (count)) < 0 &&
+                    errno != EAGAIN)
+                perror ("BotTcpServer: eventfd read");
+            _retry_stalled (server);
+            continue;
+        }
+        BotTcpConn *conn = (BotTcpConn *) events[i].data.ptr;
+        if (!conn) {
+            _accept_connections (server);
+            continue;
+        }
+        if (conn->closed)
+            continue;
+
+        uint32_t ev = events[i].events;
+        // errors and hangups are reported by read()
+        if (ev & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            conn->readable = 1;
+        if (ev & EPOLLOUT)
+            conn->writable = 1;
+
+        if (conn->writable)
+            _conn_flush (conn);
+        if (conn->readable && !conn->closed && !conn->stalled)
+            _conn_read (conn);
+    }
+
+    for (GList *iter = server->dead; iter; iter = iter->next)
+        _conn_free ((BotTcpConn *) iter->data);
+    g_list_free (server->dead);
+    server->dead = NULL;
+
+    // a handler made room in the queue of another connection.  Make sure
+    // that we get called again even if the sockets have no new events.
+    if (_have_resumable (server))
+        _server_wake (server);
+    return n;
+}
+
+void
+bot_tcp_conn_recv_consumed (BotTcpConn *conn)
+{
+    if (conn->stalled && !conn->closed &&
+            bot_ringbuf_space (conn->recv_queue) > 0)
+        _server_wake (conn->server);
+}
+
+int
+bot_tcp_conn_send (BotTcpConn *conn, const void *data, int len)
+{
+    if (conn->closed || conn->closing)
+        return -1;
+    if (len > bot_ringbuf_space (conn->send_queue))
+        return -1;
+    bot_ringbuf_write (conn->send_queue, len, (uint8_t *) data);
+
+    _conn_flush (conn);
+    if (conn->closed)
+        return -1;
+
+    BotTcpServer *server = conn->server;
+    if (!conn->blocked && bot_ringbuf_available (conn->send_queue) >=
+            server->options.send_high_water) {
+        conn->blocked = 1;
+        if (server->handlers.on_backpressure)
+            server->handlers.on_backpressure (server, conn, 1, server->user);
+    }
+    return 0;
+}
+
+void
+bot_tcp_conn_close (BotTcpConn *conn, int flush)
+{
+    if (conn->closed)
+        return;
+    if (flush && bot_ringbuf_available (conn->send_queue) > 0) {
+        conn->closing = 1;
+        return;
+    }
+    _conn_close (conn);
+}
+
+#else
+
+BotTcpServer *
+bot_tcp_server_new (int port, int localhost_only,
+        const BotTcpOptions *options, const BotTcpServerHandlers *handlers,
+        void *user)
+{
+    fprintf (stderr, "BotTcpServer: not supported on this platform\n");
+    return NULL;
+}
+
+void bot_tcp_server_destroy (BotTcpServer *server) { }
+int bot_tcp_server_get_port (BotTcpServer *server) { return -1; }
+int bot_tcp_server_get_fileno (BotTcpServer *server) { return -1; }
+int bot_tcp_server_get_num_connections (BotTcpServer *server) { return 0; }
+BotTcpConn *bot_tcp_server_add_connection (BotTcpServer *server, int fd)
+{ return NULL; }
+int bot_tcp_server_dispatch (BotTcpServer *server, int timeout_ms)
+{ return -1; }
+int bot_tcp_conn_send (BotTcpConn *conn, const void *data, int len)
+{ return -1; }
+void bot_tcp_conn_close (BotTcpConn *conn, int flush) { }
+void bot_tcp_conn_recv_consumed (BotTcpConn *conn) { }
+
+#endif
+
+int
+bot_tcp_conn_get_send_queued (BotTcpConn *conn)
+{
+    return bot_ringbuf_available (conn->send_queue);
+}
+
+int
+bot_tcp_conn_get_fileno (BotTcpConn *conn)
+{
+    return conn->fd;
+}
+
+void
+bot_tcp_conn_set_user (BotTcpConn *conn, void *user)
+{
+    conn->user = user;
+}
+
+void *
+bot_tcp_conn_get_user (BotTcpConn *conn)
+{
+    return conn->user;
+}
@@ -0,0 +1,235 @@
+#ifndef __bot_tcp_server_h__
+#define __bot_tcp_server_h__
+
+/**
+ * @defgroup BotCoreTcpServer TcpServer
+ * @ingroup BotCoreIO
+ * @brief Single-threaded server for many TCP connections
+ * @include: bot_core/bot_core.h
+ *
+ * BotTcpServer accepts TCP connections and services all of them from one
+ * thread with edge-triggered epoll and non-blocking sockets.  Each
+ * connection has a receive queue and a send queue, both BotRingBufs:
+ *
+ * - incoming data is read into the receive queue, and the on_data handler is
+ *   called to consume it (e.g., with bot_ringbuf_peek_buf() and
+ *   bot_ringbuf_flush()).  Data left in the queue is kept for the next call,
+ *   so handlers only need to consume complete messages.  When the receive
+ *   queue is full, the server stops reading from that connection until the
+ *   handler consumes some of it, which pushes back on the sender through
+ *   TCP flow control.  Applications that consume the queue outside of
+ *   on_data must call bot_tcp_conn_recv_consumed() afterwards.
+ *
+ * - bot_tcp_conn_send() appends to the send queue, which is written to the
+ *   socket as fast as the peer accepts it.  The on_backpressure handler is
+ *   called when the queue fills past its high water mark, and again when it
+ *   drains below its low water mark, so that producers can stop and resume
+ *   (or drop data) for slow clients.
+ *
+ * The server is driven by bot_tcp_server_dispatch(), either in a loop, or
+ * from an event loop whenever the file descriptor returned by
+ * bot_tcp_server_get_fileno() becomes readable (e.g., from a GLib IO watch).
+ *
+ * Only available on Linux.
+ *
+ * Linking: `pkg-config --libs bot2-core`
+ * @{
+ */
+
+#include "ringbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _BotTcpServer BotTcpServer;
+typedef struct _BotTcpConn BotTcpConn;
+
+/**
+ * BotTcpOptions:
+ *
+ * Socket tuning and queue sizes.  Use bot_tcp_options_init() to get the
+ * defaults, and change only the fields of interest.
+ */
+typedef struct _BotTcpOptions {
+    /* disable Nagle's algorithm.  Default: 1 */
+    int nodelay;
+    /* SO_SNDBUF and SO_RCVBUF in bytes, or 0 for the system default */
+    int sndbuf;
+    int rcvbuf;
+    /* seconds of idle time before sending keepalive probes, or 0 to
+     * disable keepalive.  Default: 30 */
+    int keepalive_idle;
+    /* seconds between keepalive probes.  Default: 10 */
+    int keepalive_interval;
+    /* number of unanswered probes before the connection is dropped.
+     * Default: 3 */
+    int keepalive_count;
+    /* size of the per-connection receive and send queues in bytes.
+     * Default: 256 KiB and 1 MiB */
+    int recv_queue_size;
+    int send_queue_size;
+    /* a message that doesn't fit in the receive queue can never be
+     * completed.  When on_data leaves a full queue untouched, the queue
+     * doubles up to this size in bytes; a connection whose queue is
+     * already this large is closed.  Set it to recv_queue_size to disable
+     * both, e.g., when the queue is consumed outside of on_data.
+     * Default: 64 MiB */
+    int max_recv_queue_size;
+    /* send queue levels that trigger the on_backpressure handler, in bytes.
+     * Default: 3/4 and 1/4 of send_queue_size */
+    int send_high_water;
+    int send_low_water;
+} BotTcpOptions;
+
+typedef struct _BotTcpServerHandlers {
+    /* a client connected.  Return 0 to keep the connection, or nonzero to
+     * close it.  May be NULL. */
+    int (*on_connect) (BotTcpServer *server, BotTcpConn *conn, void *user);
+    /* new data was appended to @recv_queue */
+    void (*on_data) (BotTcpServer *server, BotTcpConn *conn,
+            BotRingBuf *recv_queue, void *user);
+    /* the send queue went past its high water mark (@blocked = 1), or
+     * drained below its low water mark (@blocked = 0).  May be NULL. */
+    void (*on_backpressure) (BotTcpServer *server, BotTcpConn *conn,
+            int blocked, void *user);
+    /* the connection was closed, by either side.  @conn is freed when
+     * bot_tcp_server_dispatch() returns.  May be NULL. */
+    void (*on_close) (BotTcpServer *server, BotTcpConn *conn, void *user);
+} BotTcpServerHandlers;
+
+/**
+ * bot_tcp_options_init:
+ *
+ * Fills in @options with the default values.
+ */
+void bot_tcp_options_init (BotTcpOptions *options);
+
+/**
+ * bot_tcp_set_options:
+ *
+ * Applies the socket options in @options (not the queue sizes) to a
+ * connected TCP socket.  Useful for client sockets, e.g., from
+ * bot_ssocket_connect().
+ *
+ * Returns: 0 on success, -1 if any option could not be set.
+ */
+int bot_tcp_set_options (int fd, const BotTcpOptions *options);
+
+/**
+ * bot_tcp_server_new:
+ * @port: port to listen on.  0 picks a free port, see
+ *        bot_tcp_server_get_port().
+ * @localhost_only: only accept connections from this host.
+ * @options: socket tuning and queue sizes, or NULL for the defaults.
+ * @handlers: connection event handlers.  Copied.
+ *
+ * Returns: a newly allocated BotTcpServer, or NULL on failure.
+ */
+BotTcpServer *bot_tcp_server_new (int port, int localhost_only,
+        const BotTcpOptions *options, const BotTcpServerHandlers *handlers,
+        void *user);
+
+/**
+ * bot_tcp_server_destroy:
+ *
+ * Closes all of the connections, without calling on_close, and the listening
+ * socket.
+ */
+void bot_tcp_server_destroy (BotTcpServer *server);
+
+/**
+ * bot_tcp_server_get_port:
+ *
+ * Returns: the port the server is listening on.
+ */
+int bot_tcp_server_get_port (BotTcpServer *server);
+
+/**
+ * bot_tcp_server_get_fileno:
+ *
+ * Returns: a file descriptor that becomes readable when
+ * bot_tcp_server_dispatch() has work to do.
+ */
+int bot_tcp_server_get_fileno (BotTcpServer *server);
+
+/**
+ * bot_tcp_server_dispatch:
+ * @timeout_ms: maximum time to wait for events, 0 to not wait, or -1 to wait
+ *              indefinitely.
+ *
+ * Accepts new connections, moves data between the sockets and the queues,
+ * and calls the handlers.
+ *
+ * Returns: the number of events handled, or -1 on error.
+ */
+int bot_tcp_server_dispatch (BotTcpServer *server, int timeout_ms);
+
+/**
+ * bot_tcp_server_add_connection:
+ *
+ * Adds an already connected socket, e.g., an outgoing connection, to the
+ * server.  The server takes ownership of @fd.  on_connect is not called.
+ *
+ * Returns: the new connection, or NULL on failure.
+ */
+BotTcpConn *bot_tcp_server_add_connection (BotTcpServer *server, int fd);
+
+/**
+ * bot_tcp_server_get_num_connections:
+ */
+int bot_tcp_server_get_num_connections (BotTcpServer *server);
+
+/**
+ * bot_tcp_conn_send:
+ *
+ * Queues @len bytes of @data to be sent on @conn.  Data is only queued if
+ * all of it fits in the send queue.
+ *
+ * Returns: 0 on success, -1 if the send queue is full or the connection is
+ * closed.
+ */
+int bot_tcp_conn_send (BotTcpConn *conn, const void *data, int len);
+
+/**
+ * bot_tcp_conn_close:
+ * @flush: if nonzero, the connection is closed once the send queue has been
+ *         sent.  Otherwise, it is closed immediately.
+ *
+ * May be called from the handlers.  on_close is called when the connection
+ * is actually closed.
+ */
+void bot_tcp_conn_close (BotTcpConn *conn, int flush);
+
+/**
+ * bot_tcp_conn_recv_consumed:
+ *
+ * Tells the server that data was consumed from the receive queue of @conn
+ * outside of the on_data handler.  If the queue was full, the file
+ * descriptor returned by bot_tcp_server_get_fileno() becomes readable, and
+ * the next bot_tcp_server_dispatch() resumes reading from @conn.
+ */
+void bot_tcp_conn_recv_consumed (BotTcpConn *conn);
+
+/**
+ * bot_tcp_conn_get_send_queued:
+ *
+ * Returns: the number of bytes in the send queue.
+ */
+int bot_tcp_conn_get_send_queued (BotTcpConn *conn);
+
+int bot_tcp_conn_get_fileno (BotTcpConn *conn);
+
+void bot_tcp_conn_set_user (BotTcpConn *conn, void *user);
+
+void *bot_tcp_conn_get_user (BotTcpConn *conn);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <lcmtypes/bot_core_trace_spans_t.h>
+
+#include "timestamp.h"
+#include "trace.h"
+
+#define DEFAULT_CAPACITY 4096
+
+// spans per published message
+#define MAX_SPANS_PER_MSG 1024
+
+// how often the publishing thread checks if it should quit
+#define QUIT_CHECK_USEC 100000
+
+// The span buffer is a bounded multi-producer queue, with a sequence number
+// in each slot (D. Vyukov's design).  A slot is free for the producer that
+// claims position pos when its seq equals pos, and holds a span for the
+// consumer when its seq equals pos + 1.
+typedef struct {
+    volatile uint64_t seq;
+    char input_channel[BOT_TRACE_MAX_CHANNEL_LEN + 1];
+    char output_channel[BOT_TRACE_MAX_CHANNEL_LEN + 1];
+    int64_t input_utime;
+    int64_t recv_utime;
+    int64_t output_utime;
+    int64_t publish_utime;
+    int64_t processing_usec;
+} _slot_t;
+
+struct _BotTrace {
+    lcm_t *lcm;
+    char *process_name;
+
+    _slot_t *slots;
+    uint64_t capacity;
+    volatile uint64_t enqueue_pos;
+    volatile int64_t dropped;
+
+    // serializes consumers.  Only touched by bot_trace_publish().
+    GMutex *publish_mutex;
+    uint64_t dequeue_pos;
+    int64_t dropped_published;
+
+    // buffers for the published message
+    bot_core_trace_span_t *msg_spans;
+    char *msg_channels;
+
+    int publish_interval_ms;
+    GThread *thread;
+    volatile gint quit;
+};
+
+static void
+_copy_channel (char *dst, const char *src)
+{
+    strncpy (dst, src ? src : "", BOT_TRACE_MAX_CHANNEL_LEN);
+    dst[BOT_TRACE_MAX_CHANNEL_LEN] = 0;
+}
+
+static gpointer
+_publish_thread (gpointer user)
+{
+    BotTrace *trace = (BotTrace *) user;
+    int64_t next_utime = bot_timestamp_now () +
+        trace->publish_interval_ms * 1000LL;
+    while (!g_atomic_int_get (&trace->quit)) {
+        int64_t now = bot_timestamp_now ();
+        if (now >= next_utime) {
+            bot_trace_publish (trace);
+            next_utime += trace->publish_interval_ms * 1000LL;
+            if (next_utime < now)
+                next_utime = now + trace->publish_interval_ms * 1000LL;
+            continue;
+        }
+        int64_t wait = next_utime - now;
+        g_usleep (wait < QUIT_CHECK_USEC ? wait : QUIT_CHECK_USEC);
+    }
+    return NULL;
+}
+
+BotTrace *
+bot_trace_new (lcm_t *lcm, const char *process_name, int capacity,
+        int publish_interval_ms)
+{
+    BotTrace *trace = g_slice_new0 (BotTrace);
+    trace->lcm = lcm;
+    trace->process_name = g_strdup (process_name ? process_name : "");
+
+    trace->capacity = 1;
+    while (trace->capacity < (capacity > 0 ? capacity : DEFAULT_CAPACITY))
+        trace->capacity <<= 1;
+    trace->slots = (_slot_t *) calloc (trace->capacity, sizeof (_slot_t));
+    for (uint64_t i = 0; i < trace->capacity; i++)
+        trace->slots[i].seq = i;
+
+    trace->publish_mutex = g_mutex_new ();
+    trace->msg_spans = (bot_core_trace_span_t *) calloc (MAX_SPANS_PER_MSG,
+            sizeof (bot_core_trace_span_t));
+    trace->msg_channels = (char *) malloc (MAX_SPANS_PER_MSG * 2 *
+            (BOT_TRACE_MAX_CHANNEL_LEN + 1));
+
+    trace->publish_interval_ms = publish_interval_ms;
+    if (publish_interval_ms > 0)
+        trace->thread = g_thread_create (_publish_thread, trace, TRUE, NULL);
+    return trace;
+}
+
+void
+bot_trace_destroy (BotTrace *trace)
+{
+    if (trace->thread) {
+        g_atomic_int_set (&trace->quit, 1);
+        g_thread_join (trace->thread);
+    }
+    bot_trace_publish (trace);
+
+    g_mutex_free (trace->publish_mutex);
+    free (trace->slots);
+    free (trace->msg_spans);
+    free (trace->msg_channels);
+    g_free (trace->process_name);
+    g_slice_free (BotTrace, trace);
+}
+
+int
+bot_trace_record (BotTrace *trace,
+        const char *input_channel, int64_t input_utime, int64_t recv_utime,
+        const char *output_channel, int64_t output_utime,
+        int64_t processing_usec)
+{
+    if (!trace)
+        return 0;
+
+    int64_t now = bot_timestamp_now ();
+
+    // claim a slot
+    _slot_t *slot;
+    uint64_t pos = __atomic_load_n (&trace->enqueue_pos, __ATOMIC_RELAXED);
+    while (1) {
+        slot = &trace->slots[pos & (trace->capacity - 1)];
+        uint64_t seq = __atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t) (seq - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n (&trace->enqueue_pos, &pos,
+                        pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            // full
+            __atomic_add_fetch (&trace->dropped, 1, __ATOMIC_RELAXED);
+            return -1;
+        } else {
+            pos = __atomic_load_n (&trace->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    _copy_channel (slot->input_channel, input_channel);
+    _copy_channel (slot->output_channel, output_channel);
+    slot->input_utime = input_utime;
+    slot->recv_utime = recv_utime;
+    slot->output_utime = output_utime;
+    slot->publish_utime = now;
+    slot->processing_usec = processing_usec >= 0 ? processing_usec :
+        now - recv_utime;
+    __atomic_store_n (&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int
+bot_trace_publish (BotTrace *trace)
+{
+    g_mutex_lock (trace->publish_mutex);
+
+    int status = 0;
+    int total = 0;
+    while (1) {
+        int n = 0;
+        while (n < MAX_SPANS_PER_MSG) {
+            _slot_t *slot =
+                &trace->slots[trace->dequeue_pos & (trace->capacity - 1)];
+            uint64_t seq = __atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE);
+            if (seq != trace->dequeue_pos + 1)
+                break;
+
+            bot_core_trace_span_t *span = &trace->msg_spans[n];
+            span->input_channel = trace->msg_channels +
+                2 * n * (BOT_TRACE_MAX_CHANNEL_LEN + 1);
+            span->output_channel = span->input_channel +
+                BOT_TRACE_MAX_CHANNEL_LEN + 1;
+            memcpy (span->input_channel, slot->input_channel,
+                    BOT_TRACE_MAX_CHANNEL_LEN + 1);
+            memcpy (span->output_channel, slot->output_channel,
+                    BOT_TRACE_MAX_CHANNEL_LEN + 1);
+            span->input_utime = slot->input_utime;
+            span->recv_utime = slot->recv_utime;
+            span->output_utime = slot->output_utime;
+            span->publish_utime = slot->publish_utime;
+            span->processing_usec = slot->processing_usec;
+
+            // hand the slot back to the producers
+            __atomic_store_n (&slot->seq, trace->dequeue_pos + trace->capacity,
+                    __ATOMIC_RELEASE);
+            trace->dequeue_pos++;
+            n++;
+        }
+
+        int64_t dropped = __atomic_load_n (&trace->dropped, __ATOMIC_RELAXED);
+        if (n == 0 && dropped == trace->dropped_published)
+            break;
+
+        bot_core_trace_spans_t msg;
+        msg.utime = bot_timestamp_now ();
+        msg.process = trace->process_name;
+        msg.pid = getpid ();
+        msg.dropped = dropped - trace->dropped_published;
+        msg.num_spans = n;
+        msg.spans = trace->msg_spans;
+        if (0 != bot_core_trace_spans_t_publish (trace->lcm, BOT_TRACE_CHANNEL,
+                    &msg)) {
+            status = -1;
+            break;
+        }
+        trace->dropped_published = dropped;
+        total += n;
+        if (n < MAX_SPANS_PER_MSG)
+            break;
+    }
+
+    g_mutex_unlock (trace->publish_mutex);
+    return status ? status : total;
+}
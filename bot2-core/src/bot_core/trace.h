@@ -0,0 +1,104 @@
+#ifndef __bot_trace_h__
+#define __bot_trace_h__
+
+/**
+ * @defgroup BotCoreTrace Trace
+ * @ingroup BotCoreIO
+ * @brief Latency tracing for LCM processing pipelines
+ * @include: bot_core/bot_core.h
+ *
+ * BotTrace records where time goes between a sensor message and the
+ * messages that are eventually computed from it, across processes.  Each
+ * time a process publishes a message computed from an input message, it
+ * records a span with bot_trace_record(): the input channel and utime, when
+ * the input was received, the output channel and utime, when the output was
+ * published, and how long the computation took.
+ *
+ * Spans go into a fixed-size lock-free buffer, so recording is cheap and
+ * can be done from any thread.  They are published periodically as
+ * bot_core_trace_spans_t messages on #BOT_TRACE_CHANNEL, by a background
+ * thread or by calling bot_trace_publish().  The bot-lcm-latency tool in
+ * bot2-lcm-utils reconstructs the pipeline from the spans of all processes,
+ * live or from a log, by matching the output (channel, utime) of one span
+ * with the input of another.
+ *
+ * Linking: `pkg-config --libs bot2-core`
+ * @{
+ */
+
+#include <stdint.h>
+#include <lcm/lcm.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BOT_TRACE_CHANNEL "BOT_TRACE"
+
+/* longer channel names are truncated in spans */
+#define BOT_TRACE_MAX_CHANNEL_LEN 63
+
+typedef struct _BotTrace BotTrace;
+
+/**
+ * bot_trace_new:
+ * @process_name: name of this process in the published spans.
+ * @capacity: number of spans buffered between publishes.  Rounded up to a
+ *            power of two.  Spans recorded while the buffer is full are
+ *            dropped, and counted.  0 for the default of 4096.
+ * @publish_interval_ms: how often a background thread publishes the
+ *            buffered spans, or 0 to only publish from bot_trace_publish().
+ *
+ * Returns: a newly allocated BotTrace.
+ */
+BotTrace *bot_trace_new (lcm_t *lcm, const char *process_name, int capacity,
+        int publish_interval_ms);
+
+/**
+ * bot_trace_destroy:
+ *
+ * Stops the publishing thread, and publishes the spans still buffered.
+ */
+void bot_trace_destroy (BotTrace *trace);
+
+/**
+ * bot_trace_record:
+ * @trace: the trace, or NULL to do nothing.
+ * @input_utime: utime of the input message.
+ * @recv_utime: when the input message was received, e.g., the recv_utime of
+ *              the lcm_recv_buf_t passed to the message handler.
+ * @output_utime: utime of the output message.
+ * @processing_usec: time spent computing the output, or -1 to use the time
+ *                   elapsed since @recv_utime.
+ *
+ * Records that the message on @output_channel was computed from the message
+ * on @input_channel, and was published now.  Call once for each input of an
+ * output computed from several inputs.  Lock-free, and safe to call from
+ * any thread.
+ *
+ * Returns: 0 on success, -1 if the span was dropped because the buffer is
+ * full.
+ */
+int bot_trace_record (BotTrace *trace,
+        const char *input_channel, int64_t input_utime, int64_t recv_utime,
+        const char *output_channel, int64_t output_utime,
+        int64_t processing_usec);
+
+/**
+ * bot_trace_publish:
+ *
+ * Publishes the buffered spans now.
+ *
+ * Returns: the number of spans published, or -1 on error.
+ */
+int bot_trace_publish (BotTrace *trace);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
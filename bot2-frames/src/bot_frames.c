@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <glib.h>
 
@@ -13,15 +14,26 @@
 
 #include <bot_param/param_util.h>
 #include <lcmtypes/bot_frames_update_t.h>
+#include <lcmtypes/bot_frames_update_batch_t.h>
+
+#include "bot_frames_snapshot.h"
 
 #define BOT_FRAMES_UPDATE_CHANNEL "BOT_FRAMES_UPDATE"
+#define BOT_FRAMES_UPDATE_BATCH_CHANNEL "BOT_FRAMES_UPDATE_BATCH"
 #define DEFAULT_HISTORY_LEN 100
+#define DEFAULT_SERVER_NAME "default"
+// a frames server publishes the updates it applied to its snapshot here
+#define BOT_FRAMES_SERVER_CHANNEL_PREFIX "BOT_FRAMES_SERVER_UPDATE_"
+// room for links added with bot_frames_update_frame() after the server starts
+#define SERVER_EXTRA_LINKS 64
 
 typedef struct {
   int frame_num;
   char * frame_name;
   char * relative_to;
   char * update_channel;
+  int pose_update_channel;
+  int history;
   bot_core_rigid_transform_t_subscription_t * transform_subscription;
   bot_core_pose_t_subscription_t * pose_subscription;
 
@@ -29,11 +41,37 @@ typedef struct {
   int was_updated;
 } frame_handle_t;
 
+typedef struct {
+  char * frame;
+  char * relative_to;
+  int64_t utime;
+} pending_update_t;
+
 typedef struct {
   bot_frames_link_update_handler_t * callback_func;
+  bot_frames_batch_update_handler_t * batch_callback_func;
   void * user;
+  BotFrames * bot_frames;
+
+  // names of the frames of interest, or NULL for all frames
+  GHashTable * frames;
+
+  // coalescing: updates are held back until min_interval_usec has passed
+  // since the last dispatch.  Protected by the BotFrames mutex.
+  int64_t min_interval_usec;
+  int64_t last_dispatch;
+  GHashTable * pending; // frame name -> pending_update_t
+  guint timer_id;
 } update_handler_t;
 
+static void _pending_update_destroy(void * data)
+{
+  pending_update_t * pu = (pending_update_t *) data;
+  free(pu->frame);
+  free(pu->relative_to);
+  g_slice_free(pending_update_t, pu);
+}
+
 static void frame_handle_destroy(lcm_t * lcm, frame_handle_t * fh)
 {
   if (fh->frame_name != NULL)
@@ -61,17 +99,118 @@ struct _BotFrames {
   GHashTable* frame_handles_by_channel;
 
   bot_frames_update_t_subscription_t * update_subscription;
+  bot_frames_update_batch_t_subscription_t * update_batch_subscription;
   GList * update_callbacks;
-
+  int subscribed;
+
+  // client mode: transforms are read from the snapshot of a frames server,
+  // and update callbacks are driven by the updates the server applied to it.
+  BotFramesSnapshot * snapshot;
+  BotFramesSnapshot * dead_snapshot;
+  char * server_channel;
+  bot_frames_update_batch_t_subscription_t * server_subscription;
+  // number of snapshot links that have a frame handle
+  volatile gint snapshot_links;
+
+  // server mode
+  BotFramesSnapshot * server_snapshot;
 };
 
+// delivers the pending updates of a coalescing subscriber
+static void _flush_pending_updates(update_handler_t * uh)
+{
+  BotFrames * bot_frames = uh->bot_frames;
+  g_mutex_lock(bot_frames->mutex);
+  GHashTable * pending = uh->pending;
+  if (g_hash_table_size(pending) == 0) {
+    g_mutex_unlock(bot_frames->mutex);
+    return;
+  }
+  uh->pending = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, _pending_update_destroy);
+  uh->last_dispatch = bot_timestamp_now();
+  g_mutex_unlock(bot_frames->mutex);
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, pending);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    pending_update_t * pu = (pending_update_t *) value;
+    uh->callback_func(bot_frames, pu->frame, pu->relative_to, pu->utime, uh->user);
+  }
+  g_hash_table_destroy(pending);
+}
+
+static gboolean _on_coalesce_timer(void * user_data)
+{
+  update_handler_t * uh = (update_handler_t *) user_data;
+  g_mutex_lock(uh->bot_frames->mutex);
+  uh->timer_id = 0;
+  g_mutex_unlock(uh->bot_frames->mutex);
+  _flush_pending_updates(uh);
+  return FALSE;
+}
+
+static void _dispatch_to_handler(BotFrames * bot_frames, update_handler_t * uh, const char * frame_name,
+    const char * relative_to, int64_t utime)
+{
+  if (uh->frames != NULL && !g_hash_table_lookup(uh->frames, frame_name))
+    return;
+  if (uh->min_interval_usec <= 0) {
+    uh->callback_func(bot_frames, frame_name, relative_to,utime, uh->user);
+    return;
+  }
+
+  // keep only the latest update for each frame
+  g_mutex_lock(bot_frames->mutex);
+  pending_update_t * pu = (pending_update_t *) g_hash_table_lookup(uh->pending, frame_name);
+  if (pu == NULL) {
+    pu = g_slice_new0(pending_update_t);
+    pu->frame = strdup(frame_name);
+    g_hash_table_insert(uh->pending, pu->frame, pu);
+  }
+  if (pu->relative_to == NULL || strcmp(pu->relative_to, relative_to)) {
+    free(pu->relative_to);
+    pu->relative_to = strdup(relative_to);
+  }
+  pu->utime = utime;
+
+  int64_t wait = uh->last_dispatch + uh->min_interval_usec - bot_timestamp_now();
+  if (wait > 0 && !uh->timer_id) {
+    // deliver the latest updates once the interval is up, even if no more
+    // updates arrive
+    uh->timer_id = g_timeout_add_full(G_PRIORITY_DEFAULT, MAX(wait / 1000, 1), _on_coalesce_timer, uh, NULL);
+  }
+  g_mutex_unlock(bot_frames->mutex);
+
+  if (wait <= 0)
+    _flush_pending_updates(uh);
+}
+
 static void _dispatch_update_callbacks(BotFrames * bot_frames,const char * frame_name, const char * relative_to,
     int64_t utime)
 {
   GList * p = bot_frames->update_callbacks;
   for ( ; p != NULL; p = g_list_next(p)) {
     update_handler_t * uh = (update_handler_t *) p->data;
-    uh->callback_func(bot_frames, frame_name, relative_to,utime, uh->user);
+    if (uh->batch_callback_func)
+      uh->batch_callback_func(bot_frames, 1, &frame_name, &relative_to, utime, uh->user);
+    else
+      _dispatch_to_handler(bot_frames, uh, frame_name, relative_to, utime);
+  }
+}
+
+static void _dispatch_batch_update_callbacks(BotFrames * bot_frames, int num_links, const char ** frame_names,
+    const char ** relative_to, int64_t utime)
+{
+  GList * p = bot_frames->update_callbacks;
+  for ( ; p != NULL; p = g_list_next(p)) {
+    update_handler_t * uh = (update_handler_t *) p->data;
+    if (uh->batch_callback_func) {
+      uh->batch_callback_func(bot_frames, num_links, frame_names, relative_to, utime, uh->user);
+      continue;
+    }
+    for (int i = 0; i < num_links; i++)
+      _dispatch_to_handler(bot_frames, uh, frame_names[i], relative_to[i], utime);
   }
 }
 
@@ -111,43 +250,232 @@ static void on_pose_update(const lcm_recv_buf_t *rbuf, const char *channel, cons
 
 }
 
-static void on_frames_update(const lcm_recv_buf_t *rbuf, const char *channel, const bot_frames_update_t *msg,
-    void *user_data)
+// applies a bot_frames_update_t style update.  Must be called with the mutex
+// held.  Returns the handle of the updated frame, or NULL if the link could
+// not be created.
+static frame_handle_t * _update_frame(BotFrames * bot_frames, const char * frame, const char * relative_to,
+    const double trans[3], const double quat[4], int64_t utime)
 {
-  BotFrames * bot_frames = (BotFrames *) user_data;
-  g_mutex_lock(bot_frames->mutex);
   BotTrans link_transf;
-  bot_trans_set_from_quat_trans(&link_transf, msg->quat, msg->trans);
+  bot_trans_set_from_quat_trans(&link_transf, quat, trans);
 
-  frame_handle_t * frame_handle = (frame_handle_t *) g_hash_table_lookup(bot_frames->frame_handles_by_name, msg->frame);
+  frame_handle_t * frame_handle = (frame_handle_t *) g_hash_table_lookup(bot_frames->frame_handles_by_name, frame);
   if (frame_handle == NULL) {
-    fprintf(stderr, "Received frame update for unknown frame, adding link %s->%s to BotFrames\n", msg->frame, msg->relative_to);
+    fprintf(stderr, "Received frame update for unknown frame, adding link %s->%s to BotFrames\n", frame, relative_to);
+    bot_ctrans_add_frame(bot_frames->ctrans, frame);
+    BotCTransLink * link = bot_ctrans_link_frames(bot_frames->ctrans, frame, relative_to, DEFAULT_HISTORY_LEN);
+    if (link == NULL)
+      return NULL;
     frame_handle = (frame_handle_t *) calloc(1, sizeof(frame_handle_t));
-    frame_handle->ctrans_link = bot_ctrans_link_frames(bot_frames->ctrans, msg->frame, msg->relative_to, DEFAULT_HISTORY_LEN);
-    bot_ctrans_link_update(frame_handle->ctrans_link, &link_transf, msg->utime);
+    frame_handle->frame_num = bot_frames->num_frames++;
+    frame_handle->ctrans_link = link;
+    bot_ctrans_link_update(frame_handle->ctrans_link, &link_transf, utime);
     frame_handle->was_updated = 1;
-    frame_handle->frame_name = strdup(msg->frame);
-    frame_handle->relative_to = strdup(msg->relative_to);
+    frame_handle->frame_name = strdup(frame);
+    frame_handle->relative_to = strdup(relative_to);
     g_hash_table_insert(bot_frames->frame_handles_by_name, (gpointer) frame_handle->frame_name, (gpointer) frame_handle);
   }
-  else if(strcmp(msg->relative_to, frame_handle->relative_to) == 0){
+  else if(strcmp(relative_to, frame_handle->relative_to) == 0){
     //update the existing frame
+    if (frame_handle->ctrans_link == NULL) {
+      // a frame that was added to the snapshot of a frames server
+      frame_handle->ctrans_link = bot_ctrans_link_frames(bot_frames->ctrans, frame, relative_to, DEFAULT_HISTORY_LEN);
+      if (frame_handle->ctrans_link == NULL)
+        return NULL;
+    }
     frame_handle->was_updated = 1;
-    bot_ctrans_link_update(frame_handle->ctrans_link, &link_transf, msg->utime);
+    bot_ctrans_link_update(frame_handle->ctrans_link, &link_transf, utime);
   }
   else {
     //invalid update TODO: rate limit spewing? probably not worth it
-    fprintf(stderr, "Ignoring link update %s->%s, frame was constructed relative to %s\n", msg->frame,
-        msg->relative_to, frame_handle->relative_to);
+    fprintf(stderr, "Ignoring link update %s->%s, frame was constructed relative to %s\n", frame,
+        relative_to, frame_handle->relative_to);
   }
+  return frame_handle;
+}
+
+static void on_frames_update(const lcm_recv_buf_t *rbuf, const char *channel, const bot_frames_update_t *msg,
+    void *user_data)
+{
+  BotFrames * bot_frames = (BotFrames *) user_data;
+  g_mutex_lock(bot_frames->mutex);
+  frame_handle_t * frame_handle = _update_frame(bot_frames, msg->frame, msg->relative_to, msg->trans, msg->quat,
+      msg->utime);
   g_mutex_unlock(bot_frames->mutex);
 
-  _dispatch_update_callbacks(bot_frames, frame_handle->frame_name, frame_handle->relative_to, msg->utime);
+  if (frame_handle != NULL)
+    _dispatch_update_callbacks(bot_frames, frame_handle->frame_name, frame_handle->relative_to, msg->utime);
 }
 
+static void on_frames_update_batch(const lcm_recv_buf_t *rbuf, const char *channel,
+    const bot_frames_update_batch_t *msg, void *user_data)
+{
+  BotFrames * bot_frames = (BotFrames *) user_data;
+  const char ** frame_names = (const char **) malloc(msg->num_links * sizeof(char *));
+  const char ** relative_to = (const char **) malloc(msg->num_links * sizeof(char *));
+  int num_updated = 0;
+
+  // update all of the links atomically
+  g_mutex_lock(bot_frames->mutex);
+  for (int i = 0; i < msg->num_links; i++) {
+    frame_handle_t * frame_handle = _update_frame(bot_frames, msg->frame[i], msg->relative_to[i], msg->trans[i],
+        msg->quat[i], msg->utime);
+    if (frame_handle == NULL)
+      continue;
+    frame_names[num_updated] = frame_handle->frame_name;
+    relative_to[num_updated] = frame_handle->relative_to;
+    num_updated++;
+  }
+  g_mutex_unlock(bot_frames->mutex);
 
-BotFrames *
-bot_frames_new(lcm_t *lcm, BotParam *bot_param)
+  if (num_updated > 0)
+    _dispatch_batch_update_callbacks(bot_frames, num_updated, frame_names, relative_to, msg->utime);
+  free(frame_names);
+  free(relative_to);
+}
+
+// must be called with the mutex held
+static void _subscribe_frame_updates(BotFrames * self)
+{
+  if (self->subscribed)
+    return;
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, self->frame_handles_by_channel);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    frame_handle_t * frame_handle = (frame_handle_t *) value;
+    if (!frame_handle->pose_update_channel) {
+      frame_handle->transform_subscription = bot_core_rigid_transform_t_subscribe(self->lcm,
+          frame_handle->update_channel, on_transform_update, (void*) self);
+    }
+    else {
+      frame_handle->pose_subscription = bot_core_pose_t_subscribe(self->lcm, frame_handle->update_channel,
+          on_pose_update, (void*) self);
+    }
+  }
+
+  //subscribe to the default update handler
+  self->update_subscription = bot_frames_update_t_subscribe(self->lcm, BOT_FRAMES_UPDATE_CHANNEL, on_frames_update,
+      (void*) self);
+  self->update_batch_subscription = bot_frames_update_batch_t_subscribe(self->lcm, BOT_FRAMES_UPDATE_BATCH_CHANNEL,
+      on_frames_update_batch, (void*) self);
+  self->subscribed = 1;
+}
+
+static void on_server_update(const lcm_recv_buf_t *rbuf, const char *channel,
+    const bot_frames_update_batch_t *msg, void *user_data);
+
+// must be called with the mutex held
+static void _subscribe_updates(BotFrames * self)
+{
+  if (self->snapshot == NULL) {
+    _subscribe_frame_updates(self);
+    return;
+  }
+  // one channel carries the updates of all of the frames
+  if (self->server_subscription == NULL)
+    self->server_subscription = bot_frames_update_batch_t_subscribe(self->lcm, self->server_channel,
+        on_server_update, (void*) self);
+}
+
+/* Adds frame handles for the links that were added to the snapshot since the
+ * last call, e.g., with bot_frames_update_frame().  Must be called with the
+ * mutex held. */
+static void _add_snapshot_frames(BotFrames * bot_frames, BotFramesSnapshot * snapshot)
+{
+  int num_links = bot_frames_snapshot_get_num_links(snapshot);
+  for (int i = bot_frames->snapshot_links; i < num_links; i++) {
+    const char * frame, *relative_to;
+    bot_frames_snapshot_get_link_names(snapshot, i, &frame, &relative_to);
+    if (g_hash_table_lookup(bot_frames->frame_handles_by_name, frame))
+      continue;
+
+    bot_ctrans_add_frame(bot_frames->ctrans, frame);
+    frame_handle_t * frame_handle = (frame_handle_t *) calloc(1, sizeof(frame_handle_t));
+    frame_handle->frame_num = bot_frames->num_frames++;
+    frame_handle->frame_name = strdup(frame);
+    frame_handle->relative_to = strdup(relative_to);
+    // the link has no transforms of its own until we fall back to tracking
+    // the frames ourselves
+    frame_handle->ctrans_link = bot_ctrans_link_frames(bot_frames->ctrans, frame, relative_to, DEFAULT_HISTORY_LEN);
+    g_hash_table_insert(bot_frames->frame_handles_by_name, (gpointer) frame_handle->frame_name,
+        (gpointer) frame_handle);
+  }
+  g_atomic_int_set(&bot_frames->snapshot_links, num_links);
+}
+
+/* Returns the snapshot to read transforms from in client mode, or NULL if
+ * transforms should be read from our own BotCTrans. */
+static BotFramesSnapshot * _get_snapshot(BotFrames * bot_frames)
+{
+  BotFramesSnapshot * snapshot = (BotFramesSnapshot *) g_atomic_pointer_get(&bot_frames->snapshot);
+  if (snapshot != NULL && bot_frames_snapshot_is_live(snapshot)) {
+    if (bot_frames_snapshot_get_num_links(snapshot) != g_atomic_int_get(&bot_frames->snapshot_links)) {
+      g_mutex_lock(bot_frames->mutex);
+      if (bot_frames->snapshot == snapshot)
+        _add_snapshot_frames(bot_frames, snapshot);
+      g_mutex_unlock(bot_frames->mutex);
+    }
+    return snapshot;
+  }
+  if (snapshot == NULL)
+    return NULL;
+
+  // the frames server went away.  Fall back to tracking the frames ourselves.
+  g_mutex_lock(bot_frames->mutex);
+  if (bot_frames->snapshot == snapshot) {
+    fprintf(stderr, "BotFrames: frames server went away, subscribing to frame updates\n");
+    // other threads may still be reading from it
+    bot_frames->dead_snapshot = snapshot;
+    g_atomic_pointer_set(&bot_frames->snapshot, NULL);
+    _subscribe_frame_updates(bot_frames);
+  }
+  g_mutex_unlock(bot_frames->mutex);
+  return NULL;
+}
+
+static void on_server_update(const lcm_recv_buf_t *rbuf, const char *channel,
+    const bot_frames_update_batch_t *msg, void *user_data)
+{
+  BotFrames * bot_frames = (BotFrames *) user_data;
+  // after falling back, the update channels drive the callbacks
+  if (_get_snapshot(bot_frames) == NULL)
+    return;
+
+  // the server published this after updating the snapshot, so the callbacks
+  // see the new transforms
+  _dispatch_batch_update_callbacks(bot_frames, msg->num_links, (const char **) msg->frame,
+      (const char **) msg->relative_to, msg->utime);
+}
+
+static char * _get_server_channel(const char * server_name)
+{
+  return g_strdup_printf("%s%s", BOT_FRAMES_SERVER_CHANNEL_PREFIX, server_name);
+}
+
+static void _attach_to_server(BotFrames * self)
+{
+  const char * server_name = getenv("BOT_FRAMES_SERVER_NAME");
+  if (!server_name)
+    server_name = DEFAULT_SERVER_NAME;
+
+  BotFramesSnapshot * snapshot = bot_frames_snapshot_open(server_name);
+  if (snapshot == NULL)
+    return;
+  if (!bot_frames_snapshot_is_live(snapshot) || strcmp(bot_frames_snapshot_get_root_name(snapshot),
+      self->root_name)) {
+    bot_frames_snapshot_destroy(snapshot);
+    return;
+  }
+  self->snapshot = snapshot;
+  self->server_channel = _get_server_channel(server_name);
+  _add_snapshot_frames(self, snapshot);
+}
+
+
+static BotFrames *
+_bot_frames_new(lcm_t *lcm, BotParam *bot_param, int allow_client)
 {
   BotFrames *self = g_slice_new0(BotFrames);
 
@@ -247,6 +575,7 @@ bot_frames_new(lcm_t *lcm, BotParam *bot_param)
     //create the frame_handle
     frame_handle = (frame_handle_t *) calloc(1, sizeof(frame_handle_t));
     frame_handle->frame_num = self->num_frames++;
+    frame_handle->history = history + 1;
     frame_handle->ctrans_link = link;
     frame_handle->frame_name = frame_name;
     frame_handle->relative_to = relative_to;
@@ -273,24 +602,20 @@ bot_frames_new(lcm_t *lcm, BotParam *bot_param)
           frame_name, entry->frame_name);
       goto fail;
     }
-    //first time around, allocate and set the timer goin...
     frame_handle->update_channel = update_channel;
-    if (!pose_update_chan){
-      frame_handle->transform_subscription = bot_core_rigid_transform_t_subscribe(self->lcm, update_channel, on_transform_update,
-          (void*) self);
-    }
-    else{
-      frame_handle->pose_subscription = bot_core_pose_t_subscribe(self->lcm, update_channel, on_pose_update,
-                (void*) self);
-    }
+    frame_handle->pose_update_channel = pose_update_chan;
     g_hash_table_insert(self->frame_handles_by_channel, (gpointer) update_channel, (gpointer) frame_handle);
     }
 
 
   }
 
-  //subscribe to the default update handler
-  self->update_subscription = bot_frames_update_t_subscribe(self->lcm, BOT_FRAMES_UPDATE_CHANNEL, on_frames_update, (void*) self);
+  // if a frames server is running, read transforms from its snapshot instead
+  // of subscribing to all of the update channels
+  if (allow_client)
+    _attach_to_server(self);
+  if (self->snapshot == NULL)
+    _subscribe_frame_updates(self);
 
   g_strfreev(frame_names);
   g_mutex_unlock(self->mutex);
@@ -302,9 +627,115 @@ bot_frames_new(lcm_t *lcm, BotParam *bot_param)
 
 }
 
+BotFrames *
+bot_frames_new(lcm_t *lcm, BotParam *bot_param)
+{
+  return _bot_frames_new(lcm, bot_param, 1);
+}
+
+static void _on_server_frame_update(BotFrames * bot_frames, int num_links, const char ** frame_names,
+    const char ** relative_to, int64_t utime, void * user)
+{
+  bot_frames_update_batch_t msg;
+  msg.utime = utime;
+  msg.num_links = 0;
+  msg.frame = (char **) malloc(num_links * sizeof(char *));
+  msg.relative_to = (char **) malloc(num_links * sizeof(char *));
+  msg.trans = (double (*)[3]) malloc(num_links * sizeof(double[3]));
+  msg.quat = (double (*)[4]) malloc(num_links * sizeof(double[4]));
+
+  for (int i = 0; i < num_links; i++) {
+    // find the transform that triggered this update.  It may no longer be
+    // the most recent one.
+    g_mutex_lock(bot_frames->mutex);
+    BotCTransLink * link = bot_ctrans_get_link(bot_frames->ctrans, frame_names[i], relative_to[i]);
+    BotTrans trans;
+    int64_t trans_utime;
+    int found = 0;
+    for (int j = 0; link && !found && bot_ctrans_link_get_nth_trans(link, j, &trans, &trans_utime); j++)
+      found = (trans_utime == utime);
+    if (found && 0 != strcmp(relative_to[i], bot_ctrans_link_get_to_frame(link)))
+      bot_trans_invert(&trans);
+    g_mutex_unlock(bot_frames->mutex);
+
+    if (!found || !bot_frames_snapshot_update(bot_frames->server_snapshot, frame_names[i], relative_to[i], &trans,
+        utime))
+      continue;
+    int n = msg.num_links++;
+    msg.frame[n] = (char *) frame_names[i];
+    msg.relative_to[n] = (char *) relative_to[i];
+    memcpy(msg.trans[n], trans.trans_vec, 3 * sizeof(double));
+    memcpy(msg.quat[n], trans.rot_quat, 4 * sizeof(double));
+  }
+
+  // let clients dispatch their update callbacks
+  if (msg.num_links > 0)
+    bot_frames_update_batch_t_publish(bot_frames->lcm, bot_frames->server_channel, &msg);
+  free(msg.frame);
+  free(msg.relative_to);
+  free(msg.trans);
+  free(msg.quat);
+}
+
+BotFrames *
+bot_frames_new_server(lcm_t *lcm, BotParam *bot_param, const char *server_name)
+{
+  if (!server_name)
+    server_name = getenv("BOT_FRAMES_SERVER_NAME");
+  if (!server_name)
+    server_name = DEFAULT_SERVER_NAME;
+
+  BotFrames * self = _bot_frames_new(lcm, bot_param, 0);
+  if (!self)
+    return NULL;
+
+  g_mutex_lock(self->mutex);
+  int history_len = DEFAULT_HISTORY_LEN;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, self->frame_handles_by_name);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    frame_handle_t * han = (frame_handle_t *) value;
+    history_len = MAX(history_len, han->history);
+  }
+
+  self->server_channel = _get_server_channel(server_name);
+  self->server_snapshot = bot_frames_snapshot_create(server_name, self->root_name,
+      g_hash_table_size(self->frame_handles_by_name) + SERVER_EXTRA_LINKS, history_len);
+  if (!self->server_snapshot) {
+    g_mutex_unlock(self->mutex);
+    bot_frames_destroy(self);
+    return NULL;
+  }
+
+  // copy the current history of each link, oldest first
+  g_hash_table_iter_init(&iter, self->frame_handles_by_name);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    frame_handle_t * han = (frame_handle_t *) value;
+    if (!han->ctrans_link)
+      continue;
+    for (int i = bot_ctrans_link_get_n_trans(han->ctrans_link) - 1; i >= 0; i--) {
+      BotTrans trans;
+      int64_t utime;
+      bot_ctrans_link_get_nth_trans(han->ctrans_link, i, &trans, &utime);
+      bot_frames_snapshot_update(self->server_snapshot, han->frame_name, han->relative_to, &trans, utime);
+    }
+  }
+  g_mutex_unlock(self->mutex);
+
+  bot_frames_add_batch_update_subscriber(self, _on_server_frame_update, NULL);
+  return self;
+}
+
 static void _update_handler_t_destroy(void * data, void * user)
 {
-  g_slice_free(update_handler_t, data);
+  update_handler_t * uh = (update_handler_t *) data;
+  if (uh->timer_id)
+    g_source_remove(uh->timer_id);
+  if (uh->frames)
+    g_hash_table_destroy(uh->frames);
+  g_hash_table_destroy(uh->pending);
+  g_slice_free(update_handler_t, uh);
 }
 
 void bot_frames_destroy(BotFrames * bot_frames)
@@ -312,9 +743,21 @@ void bot_frames_destroy(BotFrames * bot_frames)
 
   g_mutex_lock(bot_frames->mutex);
 
+  if (bot_frames->snapshot)
+    bot_frames_snapshot_destroy(bot_frames->snapshot);
+  if (bot_frames->dead_snapshot)
+    bot_frames_snapshot_destroy(bot_frames->dead_snapshot);
+  if (bot_frames->server_snapshot)
+    bot_frames_snapshot_destroy(bot_frames->server_snapshot);
+
   bot_ctrans_destroy(bot_frames->ctrans);
   if(bot_frames->update_subscription!=NULL)
     bot_frames_update_t_unsubscribe(bot_frames->lcm,bot_frames->update_subscription);
+  if(bot_frames->update_batch_subscription!=NULL)
+    bot_frames_update_batch_t_unsubscribe(bot_frames->lcm,bot_frames->update_batch_subscription);
+  if(bot_frames->server_subscription!=NULL)
+    bot_frames_update_batch_t_unsubscribe(bot_frames->lcm,bot_frames->server_subscription);
+  g_free(bot_frames->server_channel);
 
   GHashTableIter iter;
   gpointer key, value;
@@ -349,14 +792,62 @@ void bot_frames_update_frame(BotFrames * bot_frames, const char * frame_name, co
   bot_frames_update_t_publish(bot_frames->lcm, BOT_FRAMES_UPDATE_CHANNEL, &msg); //lcm object is threadsafe
 }
 
+void bot_frames_update_frames(BotFrames * bot_frames, int num_links, const char ** frame_names,
+    const char ** relative_to, const BotTrans * trans, int64_t utime)
+{
+  bot_frames_update_batch_t msg;
+  msg.utime = utime;
+  msg.num_links = num_links;
+  msg.frame = (char **) frame_names;
+  msg.relative_to = (char **) relative_to;
+  msg.trans = (double (*)[3]) malloc(num_links * sizeof(double[3]));
+  msg.quat = (double (*)[4]) malloc(num_links * sizeof(double[4]));
+  for (int i = 0; i < num_links; i++) {
+    memcpy(msg.trans[i], trans[i].trans_vec, 3 * sizeof(double));
+    memcpy(msg.quat[i], trans[i].rot_quat, 4 * sizeof(double));
+  }
+  bot_frames_update_batch_t_publish(bot_frames->lcm, BOT_FRAMES_UPDATE_BATCH_CHANNEL, &msg);
+  free(msg.trans);
+  free(msg.quat);
+}
+
 void bot_frames_add_update_subscriber(BotFrames *bot_frames, bot_frames_link_update_handler_t * callback_func,
     void * user)
+{
+  bot_frames_add_update_subscriber_full(bot_frames, callback_func, user, NULL, 0);
+}
+
+void bot_frames_add_batch_update_subscriber(BotFrames *bot_frames,
+    bot_frames_batch_update_handler_t * callback_func, void * user)
+{
+  update_handler_t * uh = g_slice_new0(update_handler_t);
+  uh->batch_callback_func = callback_func;
+  uh->user = user;
+  uh->bot_frames = bot_frames;
+  uh->pending = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, _pending_update_destroy);
+  g_mutex_lock(bot_frames->mutex);
+  bot_frames->update_callbacks = g_list_append(bot_frames->update_callbacks, uh);
+  _subscribe_updates(bot_frames);
+  g_mutex_unlock(bot_frames->mutex);
+}
+
+void bot_frames_add_update_subscriber_full(BotFrames *bot_frames, bot_frames_link_update_handler_t * callback_func,
+    void * user, const char * const * frames, int64_t min_interval_usec)
 {
   update_handler_t * uh = g_slice_new0(update_handler_t);
   uh->callback_func = callback_func;
   uh->user = user;
+  uh->bot_frames = bot_frames;
+  if (frames != NULL) {
+    uh->frames = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    for (int i = 0; frames[i] != NULL; i++)
+      g_hash_table_insert(uh->frames, strdup(frames[i]), GINT_TO_POINTER(1));
+  }
+  uh->min_interval_usec = min_interval_usec;
+  uh->pending = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, _pending_update_destroy);
   g_mutex_lock(bot_frames->mutex);
   bot_frames->update_callbacks = g_list_append(bot_frames->update_callbacks, uh);
+  _subscribe_updates(bot_frames);
   g_mutex_unlock(bot_frames->mutex);
 
 }
@@ -364,6 +855,10 @@ void bot_frames_add_update_subscriber(BotFrames *bot_frames, bot_frames_link_upd
 int bot_frames_get_latest_timestamp(BotFrames * bot_frames, 
                                     const char *from_frame, const char *to_frame, int64_t *timestamp){
 
+    BotFramesSnapshot * snapshot = _get_snapshot(bot_frames);
+    if (snapshot)
+      return bot_frames_snapshot_get_latest_timestamp(snapshot, from_frame, to_frame, timestamp);
+
     g_mutex_lock(bot_frames->mutex);
     int status = bot_ctrans_get_trans_latest_timestamp(bot_frames->ctrans, from_frame, to_frame, timestamp);
     g_mutex_unlock(bot_frames->mutex);
@@ -373,6 +868,10 @@ int bot_frames_get_latest_timestamp(BotFrames * bot_frames,
 int bot_frames_get_trans_with_utime(BotFrames *bot_frames, const char *from_frame, const char *to_frame, int64_t utime,
     BotTrans *result)
 {
+  BotFramesSnapshot * snapshot = _get_snapshot(bot_frames);
+  if (snapshot)
+    return bot_frames_snapshot_get_trans(snapshot, from_frame, to_frame, utime, result);
+
   g_mutex_lock(bot_frames->mutex);
   int status = bot_ctrans_get_trans(bot_frames->ctrans, from_frame, to_frame, utime, result);
   g_mutex_unlock(bot_frames->mutex);
@@ -381,6 +880,10 @@ int bot_frames_get_trans_with_utime(BotFrames *bot_frames, const char *from_fram
 
 int bot_frames_get_trans(BotFrames *bot_frames, const char *from_frame, const char *to_frame, BotTrans *result)
 {
+  BotFramesSnapshot * snapshot = _get_snapshot(bot_frames);
+  if (snapshot)
+    return bot_frames_snapshot_get_trans(snapshot, from_frame, to_frame, -1, result);
+
   g_mutex_lock(bot_frames->mutex);
   int status = bot_ctrans_get_trans_latest(bot_frames->ctrans, from_frame, to_frame, result);
   g_mutex_unlock(bot_frames->mutex);
@@ -428,6 +931,10 @@ int bot_frames_get_trans_mat_4x4_with_utime(BotFrames *bot_frames, const char *f
 int bot_frames_get_trans_latest_timestamp(BotFrames *bot_frames, const char *from_frame, const char *to_frame,
     int64_t *timestamp)
 {
+  BotFramesSnapshot * snapshot = _get_snapshot(bot_frames);
+  if (snapshot)
+    return bot_frames_snapshot_get_latest_timestamp(snapshot, from_frame, to_frame, timestamp);
+
   g_mutex_lock(bot_frames->mutex);
   int status = bot_ctrans_get_trans_latest_timestamp(bot_frames->ctrans, from_frame, to_frame, timestamp);
   g_mutex_unlock(bot_frames->mutex);
@@ -436,6 +943,10 @@ int bot_frames_get_trans_latest_timestamp(BotFrames *bot_frames, const char *fro
 
 int bot_frames_have_trans(BotFrames *bot_frames, const char *from_frame, const char *to_frame)
 {
+  BotFramesSnapshot * snapshot = _get_snapshot(bot_frames);
+  if (snapshot)
+    return bot_frames_snapshot_have_trans(snapshot, from_frame, to_frame);
+
   g_mutex_lock(bot_frames->mutex);
   int status = bot_ctrans_have_trans(bot_frames->ctrans, from_frame, to_frame);
   g_mutex_unlock(bot_frames->mutex);
@@ -462,8 +973,72 @@ int bot_frames_rotate_vec(BotFrames *bot_frames, const char *from_frame, const c
   return 1;
 }
 
+int bot_frames_transform_points_with_time_offsets(BotFrames *bot_frames, const char *from_frame,
+    const char *to_frame, int64_t base_utime, const int32_t *utime_offsets, int num_knots, const double *src,
+    double *dst, int num_points)
+{
+  if (num_points <= 0)
+    return 1;
+  num_knots = MAX(num_knots, 2);
+
+  int32_t min_offset = utime_offsets[0];
+  int32_t max_offset = utime_offsets[0];
+  for (int i = 1; i < num_points; i++) {
+    min_offset = MIN(min_offset, utime_offsets[i]);
+    max_offset = MAX(max_offset, utime_offsets[i]);
+  }
+  if (max_offset == min_offset)
+    num_knots = 1;
+
+  // knot k is a 3x4 matrix, followed by its difference with knot k+1
+  double knot_spacing = (double) (max_offset - min_offset) / MAX(num_knots - 1, 1);
+  double * knots = (double *) malloc(num_knots * 24 * sizeof(double));
+  for (int k = 0; k < num_knots; k++) {
+    BotTrans trans;
+    int64_t utime = base_utime + min_offset + (int64_t) (k * knot_spacing + 0.5);
+    if (!bot_frames_get_trans_with_utime(bot_frames, from_frame, to_frame, utime, &trans)) {
+      free(knots);
+      return 0;
+    }
+    bot_trans_get_mat_3x4(&trans, &knots[k * 24]);
+  }
+  for (int k = 0; k < num_knots; k++) {
+    double * m = &knots[k * 24];
+    const double * next = k + 1 < num_knots ? &knots[(k + 1) * 24] : m;
+    for (int j = 0; j < 12; j++)
+      m[12 + j] = next[j] - m[j];
+  }
+
+  // blending a matrix and its difference with the next knot keeps the inner
+  // loops branch-free.  This is plain scalar code: there are no intrinsics,
+  // and whether the compiler vectorizes it depends on the target and flags
+  double inv_spacing = num_knots > 1 ? 1 / knot_spacing : 0;
+  for (int i = 0; i < num_points; i++) {
+    double u = (utime_offsets[i] - min_offset) * inv_spacing;
+    int k = MIN((int) u, num_knots - 1);
+    double w = u - k;
+    const double * m = &knots[k * 24];
+    double mat[12];
+    for (int j = 0; j < 12; j++)
+      mat[j] = m[j] + w * m[12 + j];
+
+    const double * p = &src[i * 3];
+    double x = p[0], y = p[1], z = p[2];
+    dst[i * 3 + 0] = mat[0] * x + mat[1] * y + mat[2] * z + mat[3];
+    dst[i * 3 + 1] = mat[4] * x + mat[5] * y + mat[6] * z + mat[7];
+    dst[i * 3 + 2] = mat[8] * x + mat[9] * y + mat[10] * z + mat[11];
+  }
+
+  free(knots);
+  return 1;
+}
+
 int bot_frames_get_n_trans(BotFrames *bot_frames, const char *from_frame, const char *to_frame, int nth_from_latest)
 {
+  BotFramesSnapshot * snapshot = _get_snapshot(bot_frames);
+  if (snapshot)
+    return bot_frames_snapshot_get_n_trans(snapshot, from_frame, to_frame);
+
   g_mutex_lock(bot_frames->mutex);
   BotCTransLink *link = bot_ctrans_get_link(bot_frames->ctrans, from_frame, to_frame);
   int n_trans;
@@ -482,13 +1057,17 @@ int bot_frames_get_n_trans(BotFrames *bot_frames, const char *from_frame, const
 int bot_frames_get_nth_trans(BotFrames *bot_frames, const char *from_frame, const char *to_frame, int nth_from_latest,
     BotTrans *btrans, int64_t *timestamp)
 {
+  BotFramesSnapshot * snapshot = _get_snapshot(bot_frames);
+  if (snapshot)
+    return bot_frames_snapshot_get_nth_trans(snapshot, from_frame, to_frame, nth_from_latest, btrans, timestamp);
+
   g_mutex_lock(bot_frames->mutex);
   BotCTransLink *link = bot_ctrans_get_link(bot_frames->ctrans, from_frame, to_frame);
   int status;
   if (!link)
     status =0;
   else{
-    int status = bot_ctrans_link_get_nth_trans(link, nth_from_latest, btrans, timestamp);
+    status = bot_ctrans_link_get_nth_trans(link, nth_from_latest, btrans, timestamp);
     if (status && btrans && 0 != strcmp(to_frame, bot_ctrans_link_get_to_frame(link))) {
       bot_trans_invert(btrans);
     }
@@ -499,6 +1078,7 @@ int bot_frames_get_nth_trans(BotFrames *bot_frames, const char *from_frame, cons
 const char * bot_frames_get_relative_to(BotFrames * bot_frames, const char * frame_name)
 {
   const char * rel_to = NULL;
+  _get_snapshot(bot_frames);
   g_mutex_lock(bot_frames->mutex);
   //get a reference to the frame_handle
   frame_handle_t * frame_handle = (frame_handle_t *) g_hash_table_lookup(bot_frames->frame_handles_by_name, frame_name);
@@ -516,6 +1096,8 @@ const char * bot_frames_get_root_name(BotFrames * bot_frames)
 
 int bot_frames_get_num_frames(BotFrames * bot_frames)
 {
+  // picks up frames that were added to the snapshot in client mode
+  _get_snapshot(bot_frames);
   g_mutex_lock(bot_frames->mutex);
   int num_frames = bot_frames->num_frames;
   g_mutex_unlock(bot_frames->mutex);
@@ -524,9 +1106,11 @@ int bot_frames_get_num_frames(BotFrames * bot_frames)
 
 char ** bot_frames_get_frame_names(BotFrames * bot_frames)
 {
-  int num_frames = bot_frames_get_num_frames(bot_frames);
+  // picks up frames that were added to the snapshot in client mode
+  _get_snapshot(bot_frames);
 
   g_mutex_lock(bot_frames->mutex);
+  int num_frames = bot_frames->num_frames;
   char ** frames = calloc(num_frames + 1, sizeof(char*));
 
   GHashTableIter iter;
@@ -541,6 +1125,96 @@ char ** bot_frames_get_frame_names(BotFrames * bot_frames)
   return frames;
 }
 
+// computes the transform from frame @han to the root, reusing the results of
+// its ancestors.  @state is 0 for frames that have not been visited yet, 1
+// while a frame is being computed, and 2 when it is done.  Must be called with
+// the mutex held.
+static int _get_to_root(BotFrames * bot_frames, frame_handle_t * han, BotTrans * to_root, int * valid,
+    int * state, int max_frames)
+{
+  int n = han->frame_num;
+  if (n >= max_frames)
+    return 0;
+  if (state[n] == 2)
+    return valid[n];
+  if (state[n] == 1) {
+    fprintf(stderr, "BotFrames Error: cycle in the frame tree at frame %s\n", han->frame_name);
+    return 0;
+  }
+  state[n] = 1;
+  valid[n] = 0;
+
+  if (han->relative_to == NULL) {
+    // the root
+    bot_trans_set_identity(&to_root[n]);
+    valid[n] = 1;
+  }
+  else if (han->ctrans_link != NULL) {
+    frame_handle_t * parent = (frame_handle_t *) g_hash_table_lookup(bot_frames->frame_handles_by_name,
+        han->relative_to);
+    BotTrans link_trans;
+    if (parent != NULL && bot_ctrans_link_get_nth_trans(han->ctrans_link, 0, &link_trans, NULL)
+        && _get_to_root(bot_frames, parent, to_root, valid, state, max_frames)) {
+      if (0 != strcmp(han->relative_to, bot_ctrans_link_get_to_frame(han->ctrans_link)))
+        bot_trans_invert(&link_trans);
+      to_root[n] = link_trans;
+      bot_trans_apply_trans(&to_root[n], &to_root[parent->frame_num]);
+      valid[n] = 1;
+    }
+  }
+  state[n] = 2;
+  return valid[n];
+}
+
+int bot_frames_get_all_to_root(BotFrames * bot_frames, BotTrans * to_root, int * valid, int max_frames)
+{
+  BotFramesSnapshot * snapshot = _get_snapshot(bot_frames);
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_mutex_lock(bot_frames->mutex);
+  int num_frames = MIN(bot_frames->num_frames, max_frames);
+  g_hash_table_iter_init(&iter, bot_frames->frame_handles_by_name);
+
+  if (snapshot) {
+    // the server holds the transforms.  Compose them in one pass over the
+    // links of its snapshot, then map the links to frame numbers.
+    int num_links = bot_frames_snapshot_get_num_links(snapshot);
+    BotTrans * link_to_root = (BotTrans *) malloc(MAX(num_links, 1) * sizeof(BotTrans));
+    int * link_valid = (int *) malloc(MAX(num_links, 1) * sizeof(int));
+    num_links = bot_frames_snapshot_get_all_to_root(snapshot, link_to_root, link_valid, num_links);
+
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+      frame_handle_t * han = (frame_handle_t *) value;
+      if (han->frame_num >= num_frames)
+        continue;
+      valid[han->frame_num] = han->relative_to == NULL;
+      if (han->relative_to == NULL)
+        bot_trans_set_identity(&to_root[han->frame_num]);
+    }
+    for (int i = 0; i < num_links; i++) {
+      const char * frame, *relative_to;
+      bot_frames_snapshot_get_link_names(snapshot, i, &frame, &relative_to);
+      frame_handle_t * han = (frame_handle_t *) g_hash_table_lookup(bot_frames->frame_handles_by_name, frame);
+      if (han != NULL && han->frame_num < num_frames && han->relative_to != NULL) {
+        to_root[han->frame_num] = link_to_root[i];
+        valid[han->frame_num] = link_valid[i];
+      }
+    }
+    g_mutex_unlock(bot_frames->mutex);
+    free(link_to_root);
+    free(link_valid);
+    return num_frames;
+  }
+
+  int * state = (int *) calloc(num_frames, sizeof(int));
+  while (g_hash_table_iter_next(&iter, &key, &value))
+    _get_to_root(bot_frames, (frame_handle_t *) value, to_root, valid, state, num_frames);
+  g_mutex_unlock(bot_frames->mutex);
+  free(state);
+  return num_frames;
+}
+
 static BotFrames *global_bot_frames = NULL;
 static GStaticMutex bot_frames_global_mutex = G_STATIC_MUTEX_INIT;
 
@@ -81,11 +81,39 @@ typedef struct _BotFrames BotFrames;
  *	frames described on the "coordinate_frames.'frame'.update_channel
  *	string
  *
+ * If a frames server (see bot_frames_new_server()) is running on this host,
+ * the returned BotFrames reads transforms from the server's shared memory
+ * snapshot instead of subscribing to the update channels and keeping its own
+ * transform history.  The server is selected by the BOT_FRAMES_SERVER_NAME
+ * environment variable, or "default" if it is not set.  Update callbacks
+ * are driven by a single channel on which the server publishes each update
+ * after applying it to the snapshot, and that channel is only subscribed to
+ * once a callback is added.  If the server goes away, the BotFrames falls
+ * back to subscribing to the update channels.
+ *
  * returns a newly allocated/initialized pointer to a BotFrames structure
  * 
  */
 BotFrames * bot_frames_new(lcm_t *lcm, BotParam *bot_param);
 
+/**
+ * bot_frames_new_server
+ *
+ * allocates and initializes a new BotFrames that maintains the authoritative
+ * transform history for all processes on this host.  The history of every
+ * link is kept in a shared memory snapshot, which BotFrames instances
+ * created by bot_frames_new() in other processes map and query without
+ * locking.
+ *
+ * server_name: name of the snapshot, or NULL to use the
+ *	BOT_FRAMES_SERVER_NAME environment variable, or "default" if that is not
+ *	set
+ *
+ * returns a newly allocated BotFrames, or NULL if another server is already
+ * serving @server_name.  Free with bot_frames_destroy.
+ */
+BotFrames * bot_frames_new_server(lcm_t *lcm, BotParam *bot_param, const char *server_name);
+
 /**
  * bot_frames_destroy
  *
@@ -137,6 +165,23 @@ int bot_frames_get_latest_timestamp(BotFrames * bot_frames,
 void bot_frames_update_frame(BotFrames * bot_frames, const char * frame_name,
     const char * relative_to, const BotTrans * trans, int64_t utime);
 
+/**
+ * bot_frames_update_frames
+ *
+ * bot_frames: pointer to a BotFrames structure
+ * num_links: number of frames to update
+ * frame_names: names of the frames to update
+ * relative_to: names of the frames the updated frames are relative to
+ * trans: transformations: from (frame_names[i]) to (relative_to[i])
+ * utime: timestamp of all of the transformations
+ *
+ * Publish a single message that updates several frames at once, e.g., all of
+ * the joints of an arm.  Receivers apply all of the updates atomically.
+ */
+void bot_frames_update_frames(BotFrames * bot_frames, int num_links,
+    const char ** frame_names, const char ** relative_to,
+    const BotTrans * trans, int64_t utime);
+
 /** 
  * bot_frames_link_update_handler_t
  *
@@ -163,6 +208,49 @@ typedef void(bot_frames_link_update_handler_t)(BotFrames *bot_frames,
 void bot_frames_add_update_subscriber(BotFrames *bot_frames,
     bot_frames_link_update_handler_t * callback_func, void * user);
 
+/**
+ * bot_frames_add_update_subscriber_full
+ *
+ * same as bot_frames_add_update_subscriber, with filtering and coalescing of
+ * the updates
+ *
+ * frames: NULL-terminated array of the names of the frames of interest, or
+ *      NULL to get called for updates of all frames
+ * min_interval_usec: if positive, the callback gets called at most once per
+ *      frame every min_interval_usec microseconds, with the most recent
+ *      update of the frame.  Updates that arrive too early are delivered from
+ *      a timeout in the default GLib main context when the interval is up.
+ *      Useful for subscribers that redraw on updates, e.g., renderers.
+ */
+void bot_frames_add_update_subscriber_full(BotFrames *bot_frames,
+    bot_frames_link_update_handler_t * callback_func, void * user,
+    const char * const * frames, int64_t min_interval_usec);
+
+/**
+ * bot_frames_batch_update_handler_t
+ *
+ * callback for updates of several links at once
+ *
+ * num_links: number of links that were updated
+ * frames: names of the updated frames
+ * relative_to: names of the frames that the updated frames are relative to
+ * utime: timestamp of the updates
+ */
+typedef void(bot_frames_batch_update_handler_t)(BotFrames *bot_frames,
+             int num_links, const char **frames, const char **relative_to,
+             int64_t utime, void *user);
+
+/**
+ * bot_frames_add_batch_update_subscriber
+ *
+ * add a callback handler that gets called once per update message, with all
+ * of the links that the message updated.  Batches published with
+ * bot_frames_update_frames() result in a single call.  Handlers added with
+ * bot_frames_add_update_subscriber() get called once per link instead.
+ */
+void bot_frames_add_batch_update_subscriber(BotFrames *bot_frames,
+    bot_frames_batch_update_handler_t * callback_func, void * user);
+
 
 /**
  * bot_frames_get_trans
@@ -270,6 +358,32 @@ int bot_frames_transform_vec(BotFrames *bot_frames, const char *from_frame,
 int bot_frames_rotate_vec(BotFrames *bot_frames, const char *from_frame,
         const char *to_frame, const double src[3], double dst[3]);
 
+/**
+ * bot_frames_transform_points_with_time_offsets
+ *
+ * Transforms points that were captured at different times from one coordinate
+ * frame to another, e.g., to compensate for motion during a lidar sweep or
+ * the rolling shutter of a camera.  Point i is transformed with the
+ * transformation at time base_utime + utime_offsets[i].
+ *
+ * Rather than looking up a transformation for each point, the
+ * transformations are looked up at num_knots times evenly spaced over the
+ * range of the offsets, and each point is transformed by a linear blend of
+ * the two nearest ones.  The blend is exact for translations, and accurate
+ * as long as the rotation between two consecutive knots is small.
+ *
+ * utime_offsets: per-point time offsets, in microseconds
+ * num_knots: number of interpolation knots.  At least 2.
+ * src: num_points points, as consecutive (x, y, z) triples
+ * dst: output, num_points points.  May be the same as src.
+ *
+ * Returns: 1 on success, 0 on failure
+ */
+int bot_frames_transform_points_with_time_offsets(BotFrames *bot_frames,
+        const char *from_frame, const char *to_frame, int64_t base_utime,
+        const int32_t *utime_offsets, int num_knots, const double *src,
+        double *dst, int num_points);
+
 /**
  * Retrieves the number of transformations available for the specified link.
  * Only valid for <from_frame, to_frame> pairs that are directly linked.  e.g.
@@ -312,6 +426,25 @@ int bot_frames_get_num_frames(BotFrames * bot_frames);
 
 char ** bot_frames_get_frame_names(BotFrames * bot_frames);
 
+/**
+ * bot_frames_get_all_to_root
+ *
+ * Computes the latest transformation from every frame to the root frame in a
+ * single pass over the frame tree.  Each link is composed only once, so this
+ * is much cheaper than calling bot_frames_get_trans() for each frame of a
+ * large tree, e.g., for all of the bodies of an articulated robot.
+ *
+ * to_root: output array, indexed by frame number as in
+ *          bot_frames_get_frame_names()
+ * valid: output array, set to 1 for the frames whose transformation
+ *        could be computed and to 0 for the others
+ * max_frames: the size of the to_root and valid arrays
+ *
+ * Returns: the number of frames filled in, at most max_frames
+ */
+int bot_frames_get_all_to_root(BotFrames * bot_frames, BotTrans * to_root,
+    int * valid, int max_frames);
+
 /**
  *
  * Returns: a string containing the name of the root
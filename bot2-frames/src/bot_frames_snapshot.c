@@ -0,0 +1,602 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "bot_frames_snapshot.h"
+
+#define SNAPSHOT_MAGIC 0x42465331
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_NAME_PREFIX "/bot_frames."
+#define SNAPSHOT_MAX_FRAME_NAME 64
+#define SNAPSHOT_MAX_DEPTH 64
+
+#define LIVENESS_CHECK_USEC 1000000
+
+// a reader gives up on a link that stays mid-update for this many retries,
+// e.g. because the server died while updating it
+#define READ_RETRIES 1000
+
+#define ALIGN64(x) (((x) + 63) & ~((size_t) 63))
+
+typedef struct {
+  int64_t utime;
+  double rot_quat[4];
+  double trans_vec[3];
+} snapshot_entry_t;
+
+// each link is followed by history_len entries
+typedef struct {
+  volatile gint seq; // odd while the server is updating the link
+  int32_t n; // number of transforms in the ring
+  int32_t head; // index of the most recent transform
+  char frame[SNAPSHOT_MAX_FRAME_NAME];
+  char relative_to[SNAPSHOT_MAX_FRAME_NAME];
+} snapshot_link_t;
+
+typedef struct {
+  volatile gint magic;
+  int32_t version;
+  volatile gint server_pid;
+  int32_t max_links;
+  int32_t history_len;
+  volatile gint num_links;
+  char root_name[SNAPSHOT_MAX_FRAME_NAME];
+} snapshot_header_t;
+
+struct _BotFramesSnapshot {
+  char * shm_name;
+  int is_server;
+  void * base;
+  size_t size;
+  snapshot_header_t * hdr;
+
+  // frame name -> link index + 1.  Readers use the current table without
+  // locking.  A new table is built when links are added, and replaced tables
+  // are kept around until the snapshot is destroyed.
+  GHashTable * volatile index;
+  volatile gint indexed_links;
+  GMutex * mutex;
+  GPtrArray * old_indices;
+
+  int64_t next_liveness_check;
+  int live;
+};
+
+static size_t _link_stride(int history_len)
+{
+  return ALIGN64(sizeof(snapshot_link_t)) + history_len * sizeof(snapshot_entry_t);
+}
+
+static size_t _snapshot_size(int max_links, int history_len)
+{
+  return ALIGN64(sizeof(snapshot_header_t)) + max_links * _link_stride(history_len);
+}
+
+static snapshot_link_t * _get_link(BotFramesSnapshot * snapshot, int idx)
+{
+  return (snapshot_link_t *) ((uint8_t *) snapshot->base + ALIGN64(sizeof(snapshot_header_t)) + idx
+      * _link_stride(snapshot->hdr->history_len));
+}
+
+static snapshot_entry_t * _link_entries(snapshot_link_t * link)
+{
+  return (snapshot_entry_t *) ((uint8_t *) link + ALIGN64(sizeof(snapshot_link_t)));
+}
+
+static void _entry_to_trans(const snapshot_entry_t * entry, BotTrans * trans)
+{
+  memcpy(trans->rot_quat, entry->rot_quat, 4 * sizeof(double));
+  memcpy(trans->trans_vec, entry->trans_vec, 3 * sizeof(double));
+}
+
+static int _pid_alive(int pid)
+{
+  return pid > 0 && (0 == kill(pid, 0) || errno == EPERM);
+}
+
+static BotFramesSnapshot * _snapshot_new(const char * name)
+{
+  BotFramesSnapshot * snapshot = g_slice_new0(BotFramesSnapshot);
+  snapshot->shm_name = g_strdup_printf("%s%s", SNAPSHOT_NAME_PREFIX, name);
+  for (char * p = snapshot->shm_name + 1; *p; p++) {
+    if (*p == '/')
+      *p = '_';
+  }
+  snapshot->mutex = g_mutex_new();
+  snapshot->old_indices = g_ptr_array_new();
+  return snapshot;
+}
+
+// must be called with the mutex held
+static void _rebuild_index(BotFramesSnapshot * snapshot, int num_links)
+{
+  GHashTable * index = g_hash_table_new(g_str_hash, g_str_equal);
+  for (int i = 0; i < num_links; i++) {
+    snapshot_link_t * link = _get_link(snapshot, i);
+    g_hash_table_insert(index, link->frame, GINT_TO_POINTER(i + 1));
+  }
+  if (snapshot->index)
+    g_ptr_array_add(snapshot->old_indices, snapshot->index);
+  g_atomic_pointer_set(&snapshot->index, index);
+  g_atomic_int_set(&snapshot->indexed_links, num_links);
+}
+
+static GHashTable * _get_index(BotFramesSnapshot * snapshot)
+{
+  int num_links = g_atomic_int_get(&snapshot->hdr->num_links);
+  if (num_links != g_atomic_int_get(&snapshot->indexed_links)) {
+    g_mutex_lock(snapshot->mutex);
+    if (num_links != snapshot->indexed_links)
+      _rebuild_index(snapshot, num_links);
+    g_mutex_unlock(snapshot->mutex);
+  }
+  return (GHashTable *) g_atomic_pointer_get(&snapshot->index);
+}
+
+static int _find_link(GHashTable * index, const char * frame)
+{
+  if (!index)
+    return -1;
+  return GPOINTER_TO_INT(g_hash_table_lookup(index, frame)) - 1;
+}
+
+BotFramesSnapshot * bot_frames_snapshot_create(const char * name, const char * root_name, int max_links,
+    int history_len)
+{
+  if (strlen(root_name) >= SNAPSHOT_MAX_FRAME_NAME) {
+    fprintf(stderr, "BotFrames Error: root frame name %s is too long for a snapshot\n", root_name);
+    return NULL;
+  }
+
+  BotFramesSnapshot * existing = bot_frames_snapshot_open(name);
+  if (existing) {
+    int live = bot_frames_snapshot_is_live(existing);
+    bot_frames_snapshot_destroy(existing);
+    if (live) {
+      fprintf(stderr, "BotFrames Error: another frames server is already serving '%s'\n", name);
+      return NULL;
+    }
+  }
+
+  BotFramesSnapshot * snapshot = _snapshot_new(name);
+  snapshot->is_server = 1;
+
+  // remove the snapshot of a server that went away
+  shm_unlink(snapshot->shm_name);
+
+  int fd = shm_open(snapshot->shm_name, O_RDWR | O_CREAT | O_EXCL, 0666);
+  if (fd < 0) {
+    perror("BotFrames Error: shm_open");
+    goto fail;
+  }
+  snapshot->size = _snapshot_size(max_links, history_len);
+  if (0 != ftruncate(fd, snapshot->size)) {
+    perror("BotFrames Error: ftruncate");
+    close(fd);
+    shm_unlink(snapshot->shm_name);
+    goto fail;
+  }
+  snapshot->base = mmap(NULL, snapshot->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (snapshot->base == MAP_FAILED) {
+    perror("BotFrames Error: mmap");
+    snapshot->base = NULL;
+    shm_unlink(snapshot->shm_name);
+    goto fail;
+  }
+
+  snapshot->hdr = (snapshot_header_t *) snapshot->base;
+  snapshot->hdr->version = SNAPSHOT_VERSION;
+  snapshot->hdr->server_pid = getpid();
+  snapshot->hdr->max_links = max_links;
+  snapshot->hdr->history_len = history_len;
+  strcpy(snapshot->hdr->root_name, root_name);
+  _rebuild_index(snapshot, 0);
+
+  // the snapshot is ready once the magic number is set
+  g_atomic_int_set(&snapshot->hdr->magic, SNAPSHOT_MAGIC);
+  return snapshot;
+
+  fail: bot_frames_snapshot_destroy(snapshot);
+  return NULL;
+}
+
+BotFramesSnapshot * bot_frames_snapshot_open(const char * name)
+{
+  BotFramesSnapshot * snapshot = _snapshot_new(name);
+
+  int fd = shm_open(snapshot->shm_name, O_RDONLY, 0);
+  if (fd < 0)
+    goto fail;
+
+  struct stat st;
+  if (0 != fstat(fd, &st) || st.st_size < sizeof(snapshot_header_t)) {
+    close(fd);
+    goto fail;
+  }
+  snapshot->size = st.st_size;
+  snapshot->base = mmap(NULL, snapshot->size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (snapshot->base == MAP_FAILED) {
+    snapshot->base = NULL;
+    goto fail;
+  }
+
+  snapshot->hdr = (snapshot_header_t *) snapshot->base;
+  if (g_atomic_int_get(&snapshot->hdr->magic) != SNAPSHOT_MAGIC || snapshot->hdr->version != SNAPSHOT_VERSION
+      || _snapshot_size(snapshot->hdr->max_links, snapshot->hdr->history_len) > snapshot->size)
+    goto fail;
+
+  return snapshot;
+
+  fail: bot_frames_snapshot_destroy(snapshot);
+  return NULL;
+}
+
+void bot_frames_snapshot_destroy(BotFramesSnapshot * snapshot)
+{
+  if (snapshot->base) {
+    if (snapshot->is_server) {
+      g_atomic_int_set(&snapshot->hdr->server_pid, 0);
+      shm_unlink(snapshot->shm_name);
+    }
+    munmap(snapshot->base, snapshot->size);
+  }
+  if (snapshot->index)
+    g_hash_table_destroy(snapshot->index);
+  for (int i = 0; i < snapshot->old_indices->len; i++)
+    g_hash_table_destroy((GHashTable *) g_ptr_array_index(snapshot->old_indices, i));
+  g_ptr_array_free(snapshot->old_indices, TRUE);
+  g_mutex_free(snapshot->mutex);
+  g_free(snapshot->shm_name);
+  g_slice_free(BotFramesSnapshot, snapshot);
+}
+
+int bot_frames_snapshot_is_live(BotFramesSnapshot * snapshot)
+{
+  if (snapshot->is_server)
+    return 1;
+  int64_t now = bot_timestamp_now();
+  if (now >= snapshot->next_liveness_check) {
+    snapshot->live = _pid_alive(g_atomic_int_get(&snapshot->hdr->server_pid));
+    snapshot->next_liveness_check = now + LIVENESS_CHECK_USEC;
+  }
+  return snapshot->live;
+}
+
+const char * bot_frames_snapshot_get_root_name(BotFramesSnapshot * snapshot)
+{
+  return snapshot->hdr->root_name;
+}
+
+int bot_frames_snapshot_get_num_links(BotFramesSnapshot * snapshot)
+{
+  return MIN(g_atomic_int_get(&snapshot->hdr->num_links), snapshot->hdr->max_links);
+}
+
+void bot_frames_snapshot_get_link_names(BotFramesSnapshot * snapshot, int idx, const char ** frame,
+    const char ** relative_to)
+{
+  snapshot_link_t * link = _get_link(snapshot, idx);
+  *frame = link->frame;
+  *relative_to = link->relative_to;
+}
+
+int bot_frames_snapshot_update(BotFramesSnapshot * snapshot, const char * frame, const char * relative_to,
+    const BotTrans * trans, int64_t utime)
+{
+  snapshot_header_t * hdr = snapshot->hdr;
+  g_mutex_lock(snapshot->mutex);
+
+  int idx = _find_link(snapshot->index, frame);
+  if (idx < 0) {
+    if (hdr->num_links >= hdr->max_links || strlen(frame) >= SNAPSHOT_MAX_FRAME_NAME
+        || strlen(relative_to) >= SNAPSHOT_MAX_FRAME_NAME) {
+      g_mutex_unlock(snapshot->mutex);
+      fprintf(stderr, "BotFrames Error: no room in snapshot for link %s->%s\n", frame, relative_to);
+      return 0;
+    }
+    idx = hdr->num_links;
+    snapshot_link_t * link = _get_link(snapshot, idx);
+    strcpy(link->frame, frame);
+    strcpy(link->relative_to, relative_to);
+    g_atomic_int_set(&hdr->num_links, idx + 1);
+    _rebuild_index(snapshot, idx + 1);
+  }
+
+  snapshot_link_t * link = _get_link(snapshot, idx);
+  if (strcmp(link->relative_to, relative_to)) {
+    g_mutex_unlock(snapshot->mutex);
+    return 0;
+  }
+
+  snapshot_entry_t * entries = _link_entries(link);
+  g_atomic_int_inc(&link->seq);
+
+  // if we've gone back in time, then clear the transformation history
+  if (link->n > 0) {
+    int64_t latest_utime = entries[link->head].utime;
+    if (utime < latest_utime) {
+      link->n = 0;
+    }
+    else if (utime == latest_utime) {
+      link->n--;
+      link->head = (link->head + hdr->history_len - 1) % hdr->history_len;
+    }
+  }
+  link->head = (link->head + 1) % hdr->history_len;
+  snapshot_entry_t * entry = &entries[link->head];
+  entry->utime = utime;
+  memcpy(entry->rot_quat, trans->rot_quat, 4 * sizeof(double));
+  memcpy(entry->trans_vec, trans->trans_vec, 3 * sizeof(double));
+  if (link->n < hdr->history_len)
+    link->n++;
+
+  g_atomic_int_inc(&link->seq);
+  g_mutex_unlock(snapshot->mutex);
+  return 1;
+}
+
+/* Reads from link @idx the transform at @utime (interpolated as in
+ * BotCTrans), the latest transform if @utime is -1, or the @nth most recent
+ * transform if @nth >= 0.  Returns the number of transforms in the link, or
+ * 0 if the requested transform is not available or the link can't be read
+ * consistently. */
+static int _read_link(BotFramesSnapshot * snapshot, int idx, int64_t utime, int nth, BotTrans * result,
+    int64_t * result_utime)
+{
+  snapshot_link_t * link = _get_link(snapshot, idx);
+  snapshot_entry_t * entries = _link_entries(link);
+  int history_len = snapshot->hdr->history_len;
+
+  int n;
+  snapshot_entry_t t1, t2;
+  int have_t2;
+  memset(&t1, 0, sizeof(t1));
+  int tries = 0;
+  while (1) {
+    if (tries++ == READ_RETRIES) {
+      // check the server now, so that callers fall back to LCM if it died
+      snapshot->next_liveness_check = 0;
+      return 0;
+    }
+    gint seq = g_atomic_int_get(&link->seq);
+    if (seq & 1) {
+      sched_yield();
+      continue;
+    }
+
+    n = MIN(MAX(link->n, 0), history_len);
+    int head = MIN(MAX(link->head, 0), history_len - 1);
+    have_t2 = 0;
+    if (nth >= 0) {
+      if (nth < n)
+        t1 = entries[(head - nth + history_len) % history_len];
+    }
+    else if (n > 0) {
+      int i = 0;
+      while (i < n) {
+        t2 = t1;
+        t1 = entries[(head - i + history_len) % history_len];
+        if (utime < 0 || t1.utime <= utime)
+          break;
+        i++;
+      }
+      have_t2 = i > 0 && i < n;
+    }
+
+    if (g_atomic_int_get(&link->seq) == seq)
+      break;
+  }
+
+  if (n == 0 || nth >= n)
+    return 0;
+
+  if (!have_t2) {
+    _entry_to_trans(&t1, result);
+  }
+  else {
+    BotTrans trans1, trans2;
+    _entry_to_trans(&t1, &trans1);
+    _entry_to_trans(&t2, &trans2);
+    double weight_2 = (double) (utime - t1.utime) / (t2.utime - t1.utime);
+    bot_trans_interpolate(result, &trans1, &trans2, weight_2);
+  }
+  if (result_utime)
+    *result_utime = t1.utime;
+  return n;
+}
+
+/* Fills @chain with the links from @frame up to the root of its tree, and
+ * returns the number of links, or -1 on failure. */
+static int _get_chain(BotFramesSnapshot * snapshot, GHashTable * index, const char * frame,
+    int chain[SNAPSHOT_MAX_DEPTH], const char ** root)
+{
+  int depth = 0;
+  *root = frame;
+  int idx = _find_link(index, frame);
+  while (idx >= 0) {
+    if (depth == SNAPSHOT_MAX_DEPTH)
+      return -1;
+    chain[depth++] = idx;
+    *root = _get_link(snapshot, idx)->relative_to;
+    idx = _find_link(index, *root);
+  }
+  return depth;
+}
+
+/* Computes the links relating two frames.  The transform from @from_frame to
+ * @to_frame is the composition of the links in @up, followed by the inverses
+ * of the links in @down in reverse order. */
+static int _get_path(BotFramesSnapshot * snapshot, const char * from_frame, const char * to_frame,
+    int up[SNAPSHOT_MAX_DEPTH], int * nup, int down[SNAPSHOT_MAX_DEPTH], int * ndown)
+{
+  GHashTable * index = _get_index(snapshot);
+  const char * from_root, *to_root;
+  *nup = _get_chain(snapshot, index, from_frame, up, &from_root);
+  *ndown = _get_chain(snapshot, index, to_frame, down, &to_root);
+  if (*nup < 0 || *ndown < 0 || strcmp(from_root, to_root))
+    return 0;
+
+  // drop the links the two chains have in common
+  while (*nup > 0 && *ndown > 0 && up[*nup - 1] == down[*ndown - 1]) {
+    (*nup)--;
+    (*ndown)--;
+  }
+  return 1;
+}
+
+int bot_frames_snapshot_get_trans(BotFramesSnapshot * snapshot, const char * from_frame, const char * to_frame,
+    int64_t utime, BotTrans * result)
+{
+  int up[SNAPSHOT_MAX_DEPTH], down[SNAPSHOT_MAX_DEPTH];
+  int nup, ndown;
+  if (!_get_path(snapshot, from_frame, to_frame, up, &nup, down, &ndown))
+    return 0;
+
+  bot_trans_set_identity(result);
+  BotTrans temp_trans;
+  for (int i = 0; i < nup; i++) {
+    if (!_read_link(snapshot, up[i], utime, -1, &temp_trans, NULL))
+      return 0;
+    bot_trans_apply_trans(result, &temp_trans);
+  }
+  for (int i = ndown - 1; i >= 0; i--) {
+    if (!_read_link(snapshot, down[i], utime, -1, &temp_trans, NULL))
+      return 0;
+    bot_trans_invert(&temp_trans);
+    bot_trans_apply_trans(result, &temp_trans);
+  }
+  return 1;
+}
+
+// computes the latest transform from the frame of link @idx to the root,
+// reusing the results of the links above it.  @state is 0 for links that
+// have not been visited yet, 1 while a link is being computed, and 2 when it
+// is done.
+static int _link_to_root(BotFramesSnapshot * snapshot, GHashTable * index, int idx, BotTrans * to_root,
+    int * valid, int * state, int num_links)
+{
+  if (state[idx] == 2)
+    return valid[idx];
+  if (state[idx] == 1) {
+    fprintf(stderr, "BotFrames Error: cycle in the snapshot at frame %s\n", _get_link(snapshot, idx)->frame);
+    return 0;
+  }
+  state[idx] = 1;
+  valid[idx] = 0;
+
+  snapshot_link_t * link = _get_link(snapshot, idx);
+  BotTrans link_trans;
+  if (_read_link(snapshot, idx, -1, -1, &link_trans, NULL)) {
+    if (0 == strcmp(link->relative_to, snapshot->hdr->root_name)) {
+      to_root[idx] = link_trans;
+      valid[idx] = 1;
+    }
+    else {
+      int parent = _find_link(index, link->relative_to);
+      if (parent >= 0 && parent < num_links
+          && _link_to_root(snapshot, index, parent, to_root, valid, state, num_links)) {
+        to_root[idx] = link_trans;
+        bot_trans_apply_trans(&to_root[idx], &to_root[parent]);
+        valid[idx] = 1;
+      }
+    }
+  }
+  state[idx] = 2;
+  return valid[idx];
+}
+
+int bot_frames_snapshot_get_all_to_root(BotFramesSnapshot * snapshot, BotTrans * to_root, int * valid,
+    int max_links)
+{
+  GHashTable * index = _get_index(snapshot);
+  int num_links = MIN(bot_frames_snapshot_get_num_links(snapshot), max_links);
+  int * state = (int *) calloc(MAX(num_links, 1), sizeof(int));
+  for (int i = 0; i < num_links; i++)
+    _link_to_root(snapshot, index, i, to_root, valid, state, num_links);
+  free(state);
+  return num_links;
+}
+
+int bot_frames_snapshot_get_latest_timestamp(BotFramesSnapshot * snapshot, const char * from_frame,
+    const char * to_frame, int64_t * timestamp)
+{
+  int up[SNAPSHOT_MAX_DEPTH], down[SNAPSHOT_MAX_DEPTH];
+  int nup, ndown;
+  if (!_get_path(snapshot, from_frame, to_frame, up, &nup, down, &ndown))
+    return 0;
+
+  int64_t result = 0;
+  BotTrans temp_trans;
+  for (int i = 0; i < nup + ndown; i++) {
+    int64_t link_timestamp;
+    int idx = i < nup ? up[i] : down[i - nup];
+    if (!_read_link(snapshot, idx, -1, 0, &temp_trans, &link_timestamp))
+      return 0;
+    if (0 == i || link_timestamp > result)
+      result = link_timestamp;
+  }
+  *timestamp = result;
+  return 1;
+}
+
+int bot_frames_snapshot_have_trans(BotFramesSnapshot * snapshot, const char * from_frame, const char * to_frame)
+{
+  BotTrans result;
+  return bot_frames_snapshot_get_trans(snapshot, from_frame, to_frame, -1, &result);
+}
+
+// Finds the link directly relating two frames
+static int _find_direct_link(BotFramesSnapshot * snapshot, const char * from_frame, const char * to_frame,
+    int * inverted)
+{
+  GHashTable * index = _get_index(snapshot);
+  int idx = _find_link(index, from_frame);
+  if (idx >= 0 && 0 == strcmp(_get_link(snapshot, idx)->relative_to, to_frame)) {
+    *inverted = 0;
+    return idx;
+  }
+  idx = _find_link(index, to_frame);
+  if (idx >= 0 && 0 == strcmp(_get_link(snapshot, idx)->relative_to, from_frame)) {
+    *inverted = 1;
+    return idx;
+  }
+  return -1;
+}
+
+int bot_frames_snapshot_get_n_trans(BotFramesSnapshot * snapshot, const char * from_frame, const char * to_frame)
+{
+  int inverted;
+  int idx = _find_direct_link(snapshot, from_frame, to_frame, &inverted);
+  if (idx < 0)
+    return 0;
+  BotTrans temp_trans;
+  return _read_link(snapshot, idx, -1, 0, &temp_trans, NULL);
+}
+
+int bot_frames_snapshot_get_nth_trans(BotFramesSnapshot * snapshot, const char * from_frame,
+    const char * to_frame, int nth_from_latest, BotTrans * btrans, int64_t * timestamp)
+{
+  int inverted;
+  int idx = _find_direct_link(snapshot, from_frame, to_frame, &inverted);
+  if (idx < 0 || nth_from_latest < 0)
+    return 0;
+  BotTrans temp_trans;
+  if (!_read_link(snapshot, idx, -1, nth_from_latest, &temp_trans, timestamp))
+    return 0;
+  if (inverted)
+    bot_trans_invert(&temp_trans);
+  if (btrans)
+    *btrans = temp_trans;
+  return 1;
+}
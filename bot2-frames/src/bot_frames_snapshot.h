@@ -0,0 +1,82 @@
+#ifndef __bot_frames_snapshot_h__
+#define __bot_frames_snapshot_h__
+
+/*
+ * Shared memory snapshot of the coordinate frame links maintained by a frames
+ * server.  Internal to libbot2-frames, see bot_frames_new_server().
+ *
+ * The snapshot holds, for each link, the frame name, the name of the frame it
+ * is relative to, and a ring of the most recent transforms.  The server is
+ * the only writer.  Each link is protected by a sequence lock, so readers
+ * never block the server or each other: a reader retries if the link changed
+ * while it was being read.  Links are only ever appended.
+ */
+
+#include <bot_core/bot_core.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _BotFramesSnapshot BotFramesSnapshot;
+
+// server side
+
+BotFramesSnapshot *bot_frames_snapshot_create(const char *name, const char *root_name, int max_links,
+    int history_len);
+
+/* Adds the transform of @frame relative to @relative_to, adding the link if
+ * needed.  Follows the history semantics of bot_ctrans_link_update(). */
+int bot_frames_snapshot_update(BotFramesSnapshot *snapshot, const char *frame, const char *relative_to,
+    const BotTrans *trans, int64_t utime);
+
+// client side
+
+BotFramesSnapshot *bot_frames_snapshot_open(const char *name);
+
+/* Returns: 1 if the server that created @snapshot is still running.  Only
+ * checks the server process once per second. */
+int bot_frames_snapshot_is_live(BotFramesSnapshot *snapshot);
+
+const char *bot_frames_snapshot_get_root_name(BotFramesSnapshot *snapshot);
+
+/* Returns: the number of links in @snapshot.  Links are only ever appended,
+ * so links 0 to the returned number - 1 are valid from then on. */
+int bot_frames_snapshot_get_num_links(BotFramesSnapshot *snapshot);
+
+/* Returns the names of the frames related by link @idx.  The names point into
+ * @snapshot and are valid until it is destroyed. */
+void bot_frames_snapshot_get_link_names(BotFramesSnapshot *snapshot, int idx, const char **frame,
+    const char **relative_to);
+
+/* The query functions follow the semantics of the corresponding BotCTrans
+ * functions.  A @utime of -1 requests the latest transform. */
+int bot_frames_snapshot_get_trans(BotFramesSnapshot *snapshot, const char *from_frame, const char *to_frame,
+    int64_t utime, BotTrans *result);
+
+/* Computes the latest transform from the frame of each link to the root, in
+ * one pass that reads each link once.  @to_root and @valid are indexed by
+ * link, as in bot_frames_snapshot_get_link_names().  Returns the number of
+ * links filled in, at most @max_links. */
+int bot_frames_snapshot_get_all_to_root(BotFramesSnapshot *snapshot, BotTrans *to_root, int *valid,
+    int max_links);
+
+int bot_frames_snapshot_get_latest_timestamp(BotFramesSnapshot *snapshot, const char *from_frame,
+    const char *to_frame, int64_t *timestamp);
+
+int bot_frames_snapshot_have_trans(BotFramesSnapshot *snapshot, const char *from_frame, const char *to_frame);
+
+int bot_frames_snapshot_get_n_trans(BotFramesSnapshot *snapshot, const char *from_frame, const char *to_frame);
+
+int bot_frames_snapshot_get_nth_trans(BotFramesSnapshot *snapshot, const char *from_frame,
+    const char *to_frame, int nth_from_latest, BotTrans *btrans, int64_t *timestamp);
+
+// both
+
+void bot_frames_snapshot_destroy(BotFramesSnapshot *snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -58,6 +58,7 @@ typedef struct _BodyProperties BodyProperties;
 
 struct _BodyProperties {
   char * frame_name;
+  int frame_num;
   vis_type_t vis_type;
   double scale[3];
   BotTrans body_to_frame_trans;
@@ -82,21 +83,21 @@ struct _RendererArticulated {
 
   int num_bodies;
   BodyProperties * body_properties;
+
+  // transforms of all frames to the root, updated once per draw
+  int max_frames;
+  BotTrans * to_root;
+  int * to_root_valid;
+  // number of frames when the frame numbers of the bodies were looked up
+  int resolved_num_frames;
 };
 
 static void frames_update_handler(BotFrames *bot_frames, const char *frame, const char * relative_to, int64_t utime,
     void *user)
 {
   RendererArticulated *self = (RendererArticulated *) user;
-  int ii;
-  //loop through all frames for bodies and request redraw if any are updated
-  //FIXME this will cause redundant redrawing as frame updates trickle through, not sure how to handle
-  for (ii = 0; ii < self->num_bodies; ii++) {
-    if (strcmp(self->body_properties[ii].frame_name, frame) == 0) {
-      bot_viewer_request_redraw(self->viewer);
-      return;
-    }
-  }
+  // only called for the frames of the bodies
+  bot_viewer_request_redraw(self->viewer);
 }
 
 static GLuint compile_rwx_display_list(BotRwxModel * model)
@@ -137,13 +138,12 @@ static GLuint compile_wave_display_list(BotWavefrontModel * model)
   return dl;
 }
 
-void draw_body(RendererArticulated * self, BodyProperties * body_properties)
+void draw_body(RendererArticulated * self, BodyProperties * body_properties, const BotTrans * frame_trans)
 {
-  BotTrans frame_trans, draw_trans;
-  bot_frames_get_trans(self->frames, body_properties->frame_name, bot_frames_get_root_name(self->frames), &frame_trans);
+  BotTrans draw_trans;
   draw_trans = body_properties->body_to_frame_trans;
 
-  bot_trans_apply_trans(&draw_trans, &frame_trans);
+  bot_trans_apply_trans(&draw_trans, frame_trans);
   // rotate and translate the vehicle
 
   double curr_quat_m[16];
@@ -210,7 +210,7 @@ void draw_body(RendererArticulated * self, BodyProperties * body_properties)
     break;
 
   case wavefront:
-    if (!body_properties->draw_list_ready) {
+    if (!body_properties->draw_list_ready && !bot_wavefront_model_textures_pending(body_properties->wave_model)) {
       body_properties->draw_list = compile_wave_display_list(body_properties->wave_model);
       body_properties->draw_list_ready = 1;
     }
@@ -220,7 +220,15 @@ void draw_body(RendererArticulated * self, BodyProperties * body_properties)
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glShadeModel(GL_SMOOTH);
     glEnable(GL_LIGHTING);
-    glCallList(body_properties->draw_list);
+    if (body_properties->draw_list_ready) {
+      glCallList(body_properties->draw_list);
+    }
+    else {
+      // draw without a display list until the textures are loaded
+      bot_wavefront_model_gl_draw(body_properties->wave_model);
+      glDisable(GL_LIGHTING);
+      bot_viewer_request_redraw(self->viewer);
+    }
     glPopMatrix();
     break;
   case invalid:
@@ -304,12 +312,49 @@ void configure_body(RendererArticulated * self, BodyProperties * body_properties
 
 }
 
+// looks up the frame numbers of the bodies, frames may have been added
+static void resolve_frame_nums(RendererArticulated * self, int num_frames)
+{
+  char ** frame_names = bot_frames_get_frame_names(self->frames);
+  int ii, jj;
+  for (ii = 0; ii < self->num_bodies; ii++) {
+    BodyProperties * body_properties = &self->body_properties[ii];
+    body_properties->frame_num = -1;
+    for (jj = 0; jj < num_frames && body_properties->frame_name; jj++) {
+      if (frame_names[jj] && strcmp(frame_names[jj], body_properties->frame_name) == 0) {
+        body_properties->frame_num = jj;
+        break;
+      }
+    }
+  }
+  g_strfreev(frame_names);
+  self->resolved_num_frames = num_frames;
+}
+
 static void articulated_body_draw(BotViewer *viewer, BotRenderer *renderer)
 {
   RendererArticulated *self = (RendererArticulated*) renderer;
+
+  int num_frames = bot_frames_get_num_frames(self->frames);
+  if (num_frames > self->max_frames) {
+    self->max_frames = num_frames;
+    self->to_root = (BotTrans *) realloc(self->to_root, num_frames * sizeof(BotTrans));
+    self->to_root_valid = (int *) realloc(self->to_root_valid, num_frames * sizeof(int));
+  }
+  if (num_frames != self->resolved_num_frames)
+    resolve_frame_nums(self, num_frames);
+
+  // compute the forward kinematics of the whole tree once, rather than
+  // walking from each body to the root
+  num_frames = bot_frames_get_all_to_root(self->frames, self->to_root, self->to_root_valid, self->max_frames);
+
   int ii;
-  for (ii = 0; ii < self->num_bodies; ii++)
-    draw_body(self, &self->body_properties[ii]);
+  for (ii = 0; ii < self->num_bodies; ii++) {
+    int frame_num = self->body_properties[ii].frame_num;
+    if (frame_num < 0 || frame_num >= num_frames || !self->to_root_valid[frame_num])
+      continue;
+    draw_body(self, &self->body_properties[ii], &self->to_root[frame_num]);
+  }
 }
 
 static void articulated_body_free(BotRenderer *renderer)
@@ -323,6 +368,8 @@ static void articulated_body_free(BotRenderer *renderer)
       bot_wavefront_model_destroy(self->body_properties[ii].wave_model);
   }
   free(self->body_properties);
+  free(self->to_root);
+  free(self->to_root_valid);
   free(self);
 }
 //
@@ -354,8 +401,6 @@ void bot_frames_add_articulated_body_renderer_to_viewer(BotViewer *viewer, int r
   self->viewer = viewer;
   strcpy(self->articulated_name, param_articulated_name);
 
-  bot_frames_add_update_subscriber(self->frames, frames_update_handler, (void *) self);
-
   renderer->draw = articulated_body_draw;
   renderer->destroy = articulated_body_free;
   renderer->name = self->articulated_name;
@@ -391,6 +436,14 @@ void bot_frames_add_articulated_body_renderer_to_viewer(BotViewer *viewer, int r
 
   g_strfreev(body_names);
 
+  // only redraw for the frames of the bodies, at most 30 times a second
+  const char ** body_frames = (const char **) calloc(self->num_bodies + 1, sizeof(char *));
+  for (ii = 0; ii < self->num_bodies; ii++)
+    body_frames[ii] = self->body_properties[ii].frame_name;
+  bot_frames_add_update_subscriber_full(self->frames, frames_update_handler, (void *) self, body_frames,
+      1000000 / 30);
+  free(body_frames);
+
   bot_viewer_add_renderer(viewer, &self->renderer, render_priority);
   return;
 
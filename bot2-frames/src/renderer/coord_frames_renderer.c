@@ -411,7 +411,8 @@ void bot_frames_add_named_renderer_to_viewer(BotViewer *viewer, int render_prior
 
   self->viewer = viewer;
   self->frames = frames;
-  bot_frames_add_update_subscriber(self->frames, frames_update_handler, (void *) self);
+  // redraw at most 30 times a second, no matter how fast the frames update
+  bot_frames_add_update_subscriber_full(self->frames, frames_update_handler, (void *) self, NULL, 1000000 / 30);
 
   self->pw = BOT_GTK_PARAM_WIDGET(bot_gtk_param_widget_new());
   self->path = bot_ptr_circular_new(MAX_HIST, free_path_element, NULL);
@@ -222,7 +222,7 @@ void bot_frames_add_frame_modifier_to_viewer(BotViewer *viewer, int render_prior
 
   self->viewer = viewer;
   self->frames = frames;
-  bot_frames_add_update_subscriber(self->frames, frames_update_handler, (void *) self);
+  bot_frames_add_update_subscriber_full(self->frames, frames_update_handler, (void *) self, NULL, 1000000 / 30);
 
   self->pw = BOT_GTK_PARAM_WIDGET(bot_gtk_param_widget_new());
 
@@ -0,0 +1,90 @@
+/*
+ * frames_server.c
+ *
+ * Maintains the coordinate frame transform history for all processes on the
+ * host.  BotFrames instances created with bot_frames_new() read transforms
+ * from the server's shared memory snapshot instead of each subscribing to
+ * every frame update channel.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <glib.h>
+
+#include <lcm/lcm.h>
+#include <bot_core/bot_core.h>
+#include <bot_param/param_client.h>
+#include <bot_frames/bot_frames.h>
+
+static void usage(int argc, char ** argv)
+{
+  fprintf(stderr, "Usage: %s [options]\n"
+      "\n"
+      "Frames Server: Maintains the coordinate frame transforms for all processes on this host\n"
+      "\n"
+      "Options:\n"
+      "   -h, --help          print this help and exit\n"
+      "   -n, --name NAME     snapshot name (default: $BOT_FRAMES_SERVER_NAME, or \"default\")\n"
+      "   -l, --lcm-url URL   Use this specified LCM URL\n"
+      "\n", argv[0]);
+}
+
+int main(int argc, char ** argv)
+{
+  char *optstring = "hn:l:";
+  struct option long_opts[] = {
+      { "help", no_argument, NULL, 'h' },
+      { "name", required_argument, NULL, 'n' },
+      { "lcm-url", required_argument, NULL, 'l' },
+      { 0, 0, 0, 0 }
+  };
+  int c = -1;
+  char *server_name = NULL;
+  char *lcm_url = NULL;
+  while ((c = getopt_long(argc, argv, optstring, long_opts, 0)) >= 0) {
+    switch (c) {
+    case 'n':
+      server_name = optarg;
+      break;
+    case 'l':
+      lcm_url = optarg;
+      break;
+    case 'h':
+    default:
+      usage(argc, argv);
+      return 1;
+    }
+  }
+
+  if (!g_thread_supported())
+    g_thread_init(NULL);
+
+  GMainLoop * mainloop = g_main_loop_new(NULL, FALSE);
+  lcm_t * lcm = lcm_create(lcm_url);
+  if (!lcm) {
+    fprintf(stderr, "Error creating LCM\n");
+    return 1;
+  }
+  bot_glib_mainloop_attach_lcm(lcm);
+
+  BotParam * param = bot_param_new_from_server(lcm, 0);
+  if (!param) {
+    fprintf(stderr, "Could not get params from the param server\n");
+    return 1;
+  }
+
+  BotFrames * frames = bot_frames_new_server(lcm, param, server_name);
+  if (!frames)
+    return 1;
+
+  // remove the snapshot on exit
+  bot_signal_pipe_glib_quit_on_kill(mainloop);
+
+  g_main_loop_run(mainloop);
+
+  bot_frames_destroy(frames);
+  bot_glib_mainloop_detach_lcm(lcm);
+  lcm_destroy(lcm);
+  return 0;
+}
@@ -0,0 +1,187 @@
+// file: lcm-blocklog.c
+// desc: converts LCM logs to and from block-compressed archives
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <inttypes.h>
+
+#include <lcm/lcm.h>
+
+#include "lcm_blocklog.h"
+
+static void
+usage()
+{
+    printf(
+            "usage: bot-lcm-blocklog [OPTIONS] <source_logfile> <dest_logfile>\n"
+                "\n"
+                "Compresses an LCM log file into a block archive, which is smaller\n"
+                "and can be read by time range or channel without decompressing\n"
+                "all of it.  bot-lcm-logfilter and bot-lcm-logsplice read block\n"
+                "archives directly.\n"
+                "\n"
+                "Options:\n"
+                "  -h        prints this help text and exits\n"
+                "  -d        decompress a block archive back into an LCM log file\n"
+                "  -b KB     uncompressed size of each block, in KiB.  Defaults to 1024.\n"
+                "  -l LEVEL  zlib compression level, from 1 (fastest) to 9 (smallest).\n"
+                "            Defaults to 1.\n"
+                "  -t        prints the block index of <source_logfile> and exits\n"
+                "  -v        verbose mode.  Prints the compression ratio\n");
+    exit(1);
+}
+
+static int
+_print_index(const char *fname)
+{
+    lcm_blocklog_t *log = lcm_blocklog_create(fname, "r");
+    if (!log) {
+        perror("Unable to open source logfile");
+        return 1;
+    }
+    int num_blocks = lcm_blocklog_get_num_blocks(log);
+    if (!num_blocks) {
+        fprintf(stderr, "%s is not a block archive, or is empty\n", fname);
+        lcm_blocklog_destroy(log);
+        return 1;
+    }
+    printf("%6s %12s %8s %10s %10s %20s %20s\n", "block", "offset", "events",
+            "size", "compressed", "first utime", "last utime");
+    for (int i = 0; i < num_blocks; i++) {
+        const lcm_blocklog_block_info_t *info =
+            lcm_blocklog_get_block_info(log, i);
+        printf("%6d %12"PRId64" %8d %10d %10d %20"PRId64" %20"PRId64"\n", i,
+                info->offset, info->num_events, info->uncompressed_size,
+                info->compressed_size, info->min_utime, info->max_utime);
+    }
+    lcm_blocklog_destroy(log);
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    int verbose = 0;
+    int decompress = 0;
+    int print_index = 0;
+    int block_kb = LCM_BLOCKLOG_DEFAULT_BLOCK_SIZE / 1024;
+    int level = 1;
+
+    char *optstring = "hdb:l:tv";
+    int c;
+
+    while ((c = getopt(argc, argv, optstring)) >= 0) {
+        switch (c)
+            {
+        case 'd':
+            decompress = 1;
+            break;
+        case 'b':
+            {
+                char *eptr = NULL;
+                block_kb = strtol(optarg, &eptr, 10);
+                if (*eptr != 0 || block_kb <= 0 || block_kb > 1024 * 1024)
+                    usage();
+            }
+            break;
+        case 'l':
+            {
+                char *eptr = NULL;
+                level = strtol(optarg, &eptr, 10);
+                if (*eptr != 0 || level < 1 || level > 9)
+                    usage();
+            }
+            break;
+        case 't':
+            print_index = 1;
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        case 'h':
+        default:
+            usage();
+            break;
+            };
+    }
+
+    if (print_index) {
+        if (optind != argc - 1)
+            usage();
+        return _print_index(argv[optind]);
+    }
+
+    if (optind != argc - 2)
+        usage();
+
+    char *src_fname = argv[optind];
+    char *dest_fname = argv[optind + 1];
+
+    lcm_blocklog_t *src_log = lcm_blocklog_create(src_fname, "r");
+    if (!src_log) {
+        perror("Unable to open source logfile");
+        return 1;
+    }
+
+    lcm_eventlog_t *dst_log = NULL;
+    lcm_blocklog_t *dst_archive = NULL;
+    if (decompress)
+        dst_log = lcm_eventlog_create(dest_fname, "w");
+    else
+        dst_archive = lcm_blocklog_create(dest_fname, "w");
+    if (!dst_log && !dst_archive) {
+        perror("Unable to open destination logfile");
+        lcm_blocklog_destroy(src_log);
+        return 1;
+    }
+    if (dst_archive) {
+        lcm_blocklog_set_block_size(dst_archive, block_kb * 1024);
+        lcm_blocklog_set_compression_level(dst_archive, level);
+    }
+
+    int status = 0;
+    int64_t nevents = 0;
+    int64_t nbytes = 0;
+    lcm_eventlog_event_t *event;
+    while ((event = lcm_blocklog_read_next_event(src_log))) {
+        int result;
+        if (dst_log)
+            result = lcm_eventlog_write_event(dst_log, event);
+        else
+            result = lcm_blocklog_write_event(dst_archive, event);
+        nevents++;
+        nbytes += 28 + event->channellen + event->datalen;
+        lcm_eventlog_free_event(event);
+        if (result < 0) {
+            perror("Unable to write destination logfile");
+            status = 1;
+            break;
+        }
+    }
+
+    lcm_blocklog_destroy(src_log);
+    if (dst_log)
+        lcm_eventlog_destroy(dst_log);
+    else
+        lcm_blocklog_destroy(dst_archive);
+
+    if (verbose && !decompress) {
+        FILE *f = fopen(dest_fname, "rb");
+        if (f) {
+            fseeko(f, 0, SEEK_END);
+            int64_t size = ftello(f);
+            fclose(f);
+            printf("Events written: %"PRId64"\n", nevents);
+            printf("%.1f MB -> %.1f MB (%.1f%%)\n", nbytes / 1e6, size / 1e6,
+                    nbytes ? 100.0 * size / nbytes : 0);
+        }
+    } else if (verbose) {
+        printf("Events written: %"PRId64"\n", nevents);
+    }
+    return status;
+}
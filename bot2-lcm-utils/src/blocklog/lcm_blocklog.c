@@ -0,0 +1,764 @@
+#define _FILE_OFFSET_BITS 64
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <zlib.h>
+
+#include "lcm_blocklog.h"
+
+#define MAGIC "LCMBLK01"
+#define TRAILER_MAGIC "LCMBLKIX"
+#define VERSION 1
+#define FILE_HEADER_SIZE 16
+#define BLOCK_HEADER_SIZE 32
+#define TRAILER_SIZE 16
+#define EVENT_SYNC 0xEDA1DA01
+#define EVENT_HEADER_SIZE 28
+
+typedef struct _block {
+    lcm_blocklog_block_info_t info;
+    uint8_t *mask;
+    int mask_len;
+} block_t;
+
+struct _lcm_blocklog {
+    int writing;
+
+    // plain LCM log, when reading something that isn't a block archive
+    lcm_eventlog_t *plain;
+
+    FILE *f;
+    int fd;
+
+    GArray *blocks;
+    GPtrArray *channel_names;
+    GHashTable *channel_ids;
+    // were the channel masks loaded from the index?
+    int have_masks;
+
+    // writing
+    int block_size;
+    int level;
+    int64_t eventcount;
+    GByteArray *wbuf;
+    GByteArray *wmask;
+    int32_t wnum_events;
+    int64_t wmin_utime;
+    int64_t wmax_utime;
+    uint8_t *zbuf;
+    uLong zbuf_size;
+
+    // reading
+    int next_block;
+    uint8_t *cbuf;
+    int cbuf_size;
+    uint8_t *ubuf;
+    int ubuf_size;
+    int ubuf_len;
+    int ubuf_pos;
+    int64_t skip_before;
+    int (*want_channel)(const char *channel, void *user);
+    void *want_channel_user;
+    // per channel id: -1 not known yet, 0 skip, 1 wanted
+    GArray *wanted;
+};
+
+static inline void
+_put_int32(uint8_t *p, int32_t v)
+{
+    p[0] = (v >> 24) & 0xff;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+static inline void
+_put_int64(uint8_t *p, int64_t v)
+{
+    _put_int32(p, v >> 32);
+    _put_int32(p + 4, v & 0xffffffff);
+}
+
+static inline int32_t
+_get_int32(const uint8_t *p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) |
+        ((uint32_t) p[2] << 8) | p[3];
+}
+
+static inline int64_t
+_get_int64(const uint8_t *p)
+{
+    return ((int64_t) (uint32_t) _get_int32(p) << 32) |
+        (uint32_t) _get_int32(p + 4);
+}
+
+static int
+_fwrite_int32(FILE *f, int32_t v)
+{
+    uint8_t b[4];
+    _put_int32(b, v);
+    return fwrite(b, 4, 1, f) == 1 ? 0 : -1;
+}
+
+static int
+_fwrite_int64(FILE *f, int64_t v)
+{
+    uint8_t b[8];
+    _put_int64(b, v);
+    return fwrite(b, 8, 1, f) == 1 ? 0 : -1;
+}
+
+static int
+_fread_int32(FILE *f, int32_t *v)
+{
+    uint8_t b[4];
+    if (fread(b, 4, 1, f) != 1)
+        return -1;
+    *v = _get_int32(b);
+    return 0;
+}
+
+static int
+_fread_int64(FILE *f, int64_t *v)
+{
+    uint8_t b[8];
+    if (fread(b, 8, 1, f) != 1)
+        return -1;
+    *v = _get_int64(b);
+    return 0;
+}
+
+static int
+_pread_full(int fd, void *buf, size_t len, off_t offset)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, (uint8_t *) buf + done, len - done,
+                offset + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        done += n;
+    }
+    return 0;
+}
+
+static int
+_get_channel_id(lcm_blocklog_t *log, const char *channel)
+{
+    gpointer id;
+    if (g_hash_table_lookup_extended(log->channel_ids, channel, NULL, &id))
+        return GPOINTER_TO_INT(id);
+
+    int new_id = log->channel_names->len;
+    char *name = g_strdup(channel);
+    g_ptr_array_add(log->channel_names, name);
+    g_hash_table_insert(log->channel_ids, name, GINT_TO_POINTER(new_id));
+    return new_id;
+}
+
+static void
+_free_blocks(GArray *blocks)
+{
+    for (int i = 0; i < blocks->len; i++)
+        free(g_array_index(blocks, block_t, i).mask);
+    g_array_free(blocks, TRUE);
+}
+
+static lcm_blocklog_t *
+_blocklog_new(void)
+{
+    lcm_blocklog_t *log = (lcm_blocklog_t *) calloc(1, sizeof(lcm_blocklog_t));
+    log->fd = -1;
+    log->blocks = g_array_new(FALSE, TRUE, sizeof(block_t));
+    log->channel_names = g_ptr_array_new();
+    log->channel_ids = g_hash_table_new(g_str_hash, g_str_equal);
+    log->wanted = g_array_new(FALSE, FALSE, sizeof(int8_t));
+    log->block_size = LCM_BLOCKLOG_DEFAULT_BLOCK_SIZE;
+    log->level = 1;
+    log->skip_before = INT64_MIN;
+    return log;
+}
+
+/* ==== writing ==== */
+
+static int
+_write_block(lcm_blocklog_t *log)
+{
+    if (!log->wnum_events)
+        return 0;
+
+    uLong bound = compressBound(log->wbuf->len);
+    if (bound > log->zbuf_size) {
+        log->zbuf_size = bound;
+        log->zbuf = (uint8_t *) realloc(log->zbuf, bound);
+    }
+    uLongf zlen = log->zbuf_size;
+    if (compress2(log->zbuf, &zlen, log->wbuf->data, log->wbuf->len,
+                log->level) != Z_OK) {
+        fprintf(stderr, "lcm_blocklog: compression failed\n");
+        return -1;
+    }
+
+    block_t block;
+    block.info.offset = ftello(log->f);
+    block.info.min_utime = log->wmin_utime;
+    block.info.max_utime = log->wmax_utime;
+    block.info.num_events = log->wnum_events;
+    block.info.compressed_size = zlen;
+    block.info.uncompressed_size = log->wbuf->len;
+    block.mask_len = log->wmask->len;
+    block.mask = (uint8_t *) malloc(block.mask_len + 1);
+    memcpy(block.mask, log->wmask->data, block.mask_len);
+
+    uint8_t header[BLOCK_HEADER_SIZE];
+    _put_int32(header, LCM_BLOCKLOG_BLOCK_SYNC);
+    _put_int32(header + 4, block.info.compressed_size);
+    _put_int32(header + 8, block.info.uncompressed_size);
+    _put_int32(header + 12, block.info.num_events);
+    _put_int64(header + 16, block.info.min_utime);
+    _put_int64(header + 24, block.info.max_utime);
+
+    g_array_append_val(log->blocks, block);
+
+    g_byte_array_set_size(log->wbuf, 0);
+    g_byte_array_set_size(log->wmask, 0);
+    log->wnum_events = 0;
+
+    if (fwrite(header, sizeof(header), 1, log->f) != 1 ||
+        fwrite(log->zbuf, zlen, 1, log->f) != 1)
+        return -1;
+    return 0;
+}
+
+static int
+_write_index(lcm_blocklog_t *log)
+{
+    int64_t index_offset = ftello(log->f);
+    FILE *f = log->f;
+    int status = 0;
+
+    status |= _fwrite_int32(f, LCM_BLOCKLOG_INDEX_SYNC);
+    status |= _fwrite_int32(f, log->channel_names->len);
+    status |= _fwrite_int32(f, log->blocks->len);
+    for (int i = 0; i < log->channel_names->len; i++) {
+        const char *name = g_ptr_array_index(log->channel_names, i);
+        int len = strlen(name);
+        status |= _fwrite_int32(f, len);
+        if (len && fwrite(name, len, 1, f) != 1)
+            status = -1;
+    }
+    for (int i = 0; i < log->blocks->len; i++) {
+        block_t *b = &g_array_index(log->blocks, block_t, i);
+        status |= _fwrite_int64(f, b->info.offset);
+        status |= _fwrite_int64(f, b->info.min_utime);
+        status |= _fwrite_int64(f, b->info.max_utime);
+        status |= _fwrite_int32(f, b->info.num_events);
+        status |= _fwrite_int32(f, b->info.compressed_size);
+        status |= _fwrite_int32(f, b->info.uncompressed_size);
+        status |= _fwrite_int32(f, b->mask_len);
+        if (b->mask_len && fwrite(b->mask, b->mask_len, 1, f) != 1)
+            status = -1;
+    }
+
+    status |= _fwrite_int64(f, index_offset);
+    if (fwrite(TRAILER_MAGIC, 8, 1, f) != 1)
+        status = -1;
+    return status;
+}
+
+int
+lcm_blocklog_write_event(lcm_blocklog_t *log,
+        const lcm_eventlog_event_t *event)
+{
+    if (!log->writing)
+        return -1;
+
+    int event_size = EVENT_HEADER_SIZE + event->channellen + event->datalen;
+    if (log->wnum_events && log->wbuf->len + event_size > log->block_size) {
+        if (_write_block(log) < 0)
+            return -1;
+    }
+
+    int offset = log->wbuf->len;
+    g_byte_array_set_size(log->wbuf, offset + event_size);
+    uint8_t *p = log->wbuf->data + offset;
+    _put_int32(p, EVENT_SYNC);
+    _put_int64(p + 4, log->eventcount);
+    _put_int64(p + 12, event->timestamp);
+    _put_int32(p + 20, event->channellen);
+    _put_int32(p + 24, event->datalen);
+    memcpy(p + EVENT_HEADER_SIZE, event->channel, event->channellen);
+    memcpy(p + EVENT_HEADER_SIZE + event->channellen, event->data,
+            event->datalen);
+    log->eventcount++;
+
+    int id = _get_channel_id(log, event->channel);
+    if (log->wmask->len <= id / 8) {
+        int old_len = log->wmask->len;
+        g_byte_array_set_size(log->wmask, id / 8 + 1);
+        memset(log->wmask->data + old_len, 0, log->wmask->len - old_len);
+    }
+    log->wmask->data[id / 8] |= 1 << (id % 8);
+
+    if (!log->wnum_events || event->timestamp < log->wmin_utime)
+        log->wmin_utime = event->timestamp;
+    if (!log->wnum_events || event->timestamp > log->wmax_utime)
+        log->wmax_utime = event->timestamp;
+    log->wnum_events++;
+    return 0;
+}
+
+void
+lcm_blocklog_set_block_size(lcm_blocklog_t *log, int block_size)
+{
+    log->block_size = block_size;
+}
+
+void
+lcm_blocklog_set_compression_level(lcm_blocklog_t *log, int level)
+{
+    log->level = level;
+}
+
+/* ==== opening ==== */
+
+static int
+_load_index(lcm_blocklog_t *log, int64_t file_size)
+{
+    uint8_t trailer[TRAILER_SIZE];
+    if (file_size < FILE_HEADER_SIZE + TRAILER_SIZE ||
+        _pread_full(log->fd, trailer, TRAILER_SIZE,
+            file_size - TRAILER_SIZE) < 0 ||
+        memcmp(trailer + 8, TRAILER_MAGIC, 8))
+        return -1;
+
+    int64_t index_offset = _get_int64(trailer);
+    if (index_offset < FILE_HEADER_SIZE ||
+        index_offset > file_size - TRAILER_SIZE ||
+        fseeko(log->f, index_offset, SEEK_SET) < 0)
+        return -1;
+
+    int32_t sync, num_channels, num_blocks;
+    if (_fread_int32(log->f, &sync) < 0 ||
+        sync != (int32_t) LCM_BLOCKLOG_INDEX_SYNC ||
+        _fread_int32(log->f, &num_channels) < 0 ||
+        _fread_int32(log->f, &num_blocks) < 0 ||
+        num_channels < 0 || num_blocks < 0)
+        return -1;
+
+    for (int i = 0; i < num_channels; i++) {
+        int32_t len;
+        if (_fread_int32(log->f, &len) < 0 || len < 0 ||
+            len > index_offset)
+            return -1;
+        char *name = (char *) malloc(len + 1);
+        if (fread(name, 1, len, log->f) != len) {
+            free(name);
+            return -1;
+        }
+        name[len] = 0;
+        int id = _get_channel_id(log, name);
+        free(name);
+        if (id != i)
+            return -1;
+    }
+
+    for (int i = 0; i < num_blocks; i++) {
+        block_t b;
+        memset(&b, 0, sizeof(b));
+        if (_fread_int64(log->f, &b.info.offset) < 0 ||
+            _fread_int64(log->f, &b.info.min_utime) < 0 ||
+            _fread_int64(log->f, &b.info.max_utime) < 0 ||
+            _fread_int32(log->f, &b.info.num_events) < 0 ||
+            _fread_int32(log->f, &b.info.compressed_size) < 0 ||
+            _fread_int32(log->f, &b.info.uncompressed_size) < 0 ||
+            _fread_int32(log->f, &b.mask_len) < 0 ||
+            b.mask_len < 0 || b.mask_len > (num_channels + 7) / 8)
+            return -1;
+        b.mask = (uint8_t *) malloc(b.mask_len + 1);
+        g_array_append_val(log->blocks, b);
+        if (fread(b.mask, 1, b.mask_len, log->f) != b.mask_len)
+            return -1;
+    }
+    log->have_masks = 1;
+    return 0;
+}
+
+static void
+_scan_blocks(lcm_blocklog_t *log, int64_t file_size)
+{
+    int64_t offset = FILE_HEADER_SIZE;
+    uint8_t header[BLOCK_HEADER_SIZE];
+    while (offset + BLOCK_HEADER_SIZE <= file_size &&
+           _pread_full(log->fd, header, BLOCK_HEADER_SIZE, offset) == 0) {
+        if (_get_int32(header) != (int32_t) LCM_BLOCKLOG_BLOCK_SYNC)
+            break;
+        block_t b;
+        memset(&b, 0, sizeof(b));
+        b.info.offset = offset;
+        b.info.compressed_size = _get_int32(header + 4);
+        b.info.uncompressed_size = _get_int32(header + 8);
+        b.info.num_events = _get_int32(header + 12);
+        b.info.min_utime = _get_int64(header + 16);
+        b.info.max_utime = _get_int64(header + 24);
+        if (b.info.compressed_size < 0 ||
+            offset + BLOCK_HEADER_SIZE + b.info.compressed_size > file_size)
+            break;
+        g_array_append_val(log->blocks, b);
+        offset += BLOCK_HEADER_SIZE + b.info.compressed_size;
+    }
+    fprintf(stderr, "lcm_blocklog: index missing, recovered %d blocks\n",
+            log->blocks->len);
+}
+
+int
+lcm_blocklog_is_blocklog(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return 0;
+    char magic[8];
+    int result = fread(magic, 8, 1, f) == 1 && !memcmp(magic, MAGIC, 8);
+    fclose(f);
+    return result;
+}
+
+lcm_blocklog_t *
+lcm_blocklog_create(const char *path, const char *mode)
+{
+    if (strcmp(mode, "r") && strcmp(mode, "w")) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (!strcmp(mode, "r") && !lcm_blocklog_is_blocklog(path)) {
+        lcm_eventlog_t *plain = lcm_eventlog_create(path, "r");
+        if (!plain)
+            return NULL;
+        lcm_blocklog_t *log = _blocklog_new();
+        log->plain = plain;
+        return log;
+    }
+
+    FILE *f = fopen(path, !strcmp(mode, "r") ? "rb" : "wb");
+    if (!f)
+        return NULL;
+
+    lcm_blocklog_t *log = _blocklog_new();
+    log->f = f;
+    log->fd = fileno(f);
+
+    if (!strcmp(mode, "w")) {
+        log->writing = 1;
+        log->wbuf = g_byte_array_new();
+        log->wmask = g_byte_array_new();
+        if (fwrite(MAGIC, 8, 1, f) != 1 || _fwrite_int32(f, VERSION) < 0 ||
+            _fwrite_int32(f, 0) < 0) {
+            lcm_blocklog_destroy(log);
+            return NULL;
+        }
+        return log;
+    }
+
+    uint8_t header[FILE_HEADER_SIZE];
+    struct stat st;
+    if (_pread_full(log->fd, header, FILE_HEADER_SIZE, 0) < 0 ||
+        fstat(log->fd, &st) < 0) {
+        lcm_blocklog_destroy(log);
+        return NULL;
+    }
+    if (_get_int32(header + 8) != VERSION) {
+        fprintf(stderr, "lcm_blocklog: %s: unsupported version %d\n", path,
+                _get_int32(header + 8));
+        lcm_blocklog_destroy(log);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (_load_index(log, st.st_size) < 0) {
+        _free_blocks(log->blocks);
+        log->blocks = g_array_new(FALSE, TRUE, sizeof(block_t));
+        g_hash_table_remove_all(log->channel_ids);
+        for (int i = 0; i < log->channel_names->len; i++)
+            g_free(g_ptr_array_index(log->channel_names, i));
+        g_ptr_array_set_size(log->channel_names, 0);
+        _scan_blocks(log, st.st_size);
+    }
+    return log;
+}
+
+void
+lcm_blocklog_destroy(lcm_blocklog_t *log)
+{
+    if (log->writing && log->f) {
+        if (_write_block(log) < 0 || _write_index(log) < 0)
+            perror("lcm_blocklog: write");
+    }
+    if (log->f)
+        fclose(log->f);
+    if (log->plain)
+        lcm_eventlog_destroy(log->plain);
+
+    _free_blocks(log->blocks);
+    for (int i = 0; i < log->channel_names->len; i++)
+        g_free(g_ptr_array_index(log->channel_names, i));
+    g_ptr_array_free(log->channel_names, TRUE);
+    g_hash_table_destroy(log->channel_ids);
+    g_array_free(log->wanted, TRUE);
+    if (log->wbuf)
+        g_byte_array_free(log->wbuf, TRUE);
+    if (log->wmask)
+        g_byte_array_free(log->wmask, TRUE);
+    free(log->zbuf);
+    free(log->cbuf);
+    free(log->ubuf);
+    free(log);
+}
+
+/* ==== reading ==== */
+
+int
+lcm_blocklog_get_num_blocks(lcm_blocklog_t *log)
+{
+    return log->plain ? 0 : log->blocks->len;
+}
+
+const lcm_blocklog_block_info_t *
+lcm_blocklog_get_block_info(lcm_blocklog_t *log, int block_index)
+{
+    if (log->plain || block_index < 0 || block_index >= log->blocks->len)
+        return NULL;
+    return &g_array_index(log->blocks, block_t, block_index).info;
+}
+
+// Reads and decompresses a block into *ubuf, growing the buffers as needed.
+// Only uses pread(), so that it can be called from several threads, each
+// with its own buffers.
+static int
+_load_block(lcm_blocklog_t *log, int block_index, uint8_t **cbuf,
+        int *cbuf_size, uint8_t **ubuf, int *ubuf_size)
+{
+    const lcm_blocklog_block_info_t *info =
+        &g_array_index(log->blocks, block_t, block_index).info;
+    int csize = info->compressed_size;
+    int usize = info->uncompressed_size;
+    if (csize < 0 || usize < 0)
+        return -1;
+
+    if (csize > *cbuf_size) {
+        *cbuf_size = csize;
+        *cbuf = (uint8_t *) realloc(*cbuf, csize);
+    }
+    if (usize > *ubuf_size) {
+        *ubuf_size = usize;
+        *ubuf = (uint8_t *) realloc(*ubuf, usize);
+    }
+
+    if (_pread_full(log->fd, *cbuf, csize,
+                info->offset + BLOCK_HEADER_SIZE) < 0)
+        return -1;
+
+    uLongf len = usize;
+    if (uncompress(*ubuf, &len, *cbuf, csize) != Z_OK || len != usize) {
+        fprintf(stderr, "lcm_blocklog: block %d is corrupt\n", block_index);
+        return -1;
+    }
+    return usize;
+}
+
+// Parses the event at @buf into @event, with channel and data pointing into
+// @buf.  The channel is not NUL terminated.
+static int
+_parse_event(const uint8_t *buf, int len, lcm_eventlog_event_t *event)
+{
+    if (len < EVENT_HEADER_SIZE || _get_int32(buf) != (int32_t) EVENT_SYNC)
+        return -1;
+    event->eventnum = _get_int64(buf + 4);
+    event->timestamp = _get_int64(buf + 12);
+    event->channellen = _get_int32(buf + 20);
+    event->datalen = _get_int32(buf + 24);
+    // compare against the remaining size, so that corrupt lengths can't
+    // overflow
+    int remaining = len - EVENT_HEADER_SIZE;
+    if (event->channellen < 0 || event->channellen > remaining)
+        return -1;
+    remaining -= event->channellen;
+    if (event->datalen < 0 || event->datalen > remaining)
+        return -1;
+    event->channel = (char *) buf + EVENT_HEADER_SIZE;
+    event->data = (void *) (buf + EVENT_HEADER_SIZE + event->channellen);
+    return EVENT_HEADER_SIZE + event->channellen + event->datalen;
+}
+
+static int
+_block_wanted(lcm_blocklog_t *log, int block_index)
+{
+    block_t *b = &g_array_index(log->blocks, block_t, block_index);
+    if (b->info.max_utime < log->skip_before)
+        return 0;
+    if (!log->want_channel || !log->have_masks)
+        return 1;
+
+    for (int id = 0; id < b->mask_len * 8; id++) {
+        if (!(b->mask[id / 8] & (1 << (id % 8))))
+            continue;
+        if (id >= log->wanted->len) {
+            int8_t unknown = -1;
+            while (log->wanted->len <= id)
+                g_array_append_val(log->wanted, unknown);
+        }
+        int8_t *wanted = &g_array_index(log->wanted, int8_t, id);
+        if (*wanted < 0)
+            *wanted = log->want_channel(
+                    g_ptr_array_index(log->channel_names, id),
+                    log->want_channel_user) ? 1 : 0;
+        if (*wanted)
+            return 1;
+    }
+    return 0;
+}
+
+lcm_eventlog_event_t *
+lcm_blocklog_read_next_event(lcm_blocklog_t *log)
+{
+    if (log->writing)
+        return NULL;
+
+    if (log->plain) {
+        lcm_eventlog_event_t *event;
+        while ((event = lcm_eventlog_read_next_event(log->plain))) {
+            if (event->timestamp >= log->skip_before)
+                return event;
+            lcm_eventlog_free_event(event);
+        }
+        return NULL;
+    }
+
+    while (1) {
+        while (log->ubuf_pos < log->ubuf_len) {
+            lcm_eventlog_event_t parsed;
+            int used = _parse_event(log->ubuf + log->ubuf_pos,
+                    log->ubuf_len - log->ubuf_pos, &parsed);
+            if (used < 0) {
+                fprintf(stderr, "lcm_blocklog: bad event in block %d\n",
+                        log->next_block - 1);
+                log->ubuf_pos = log->ubuf_len;
+                break;
+            }
+            log->ubuf_pos += used;
+            if (parsed.timestamp < log->skip_before)
+                continue;
+
+            lcm_eventlog_event_t *event = (lcm_eventlog_event_t *)
+                calloc(1, sizeof(lcm_eventlog_event_t));
+            *event = parsed;
+            event->channel = (char *) malloc(parsed.channellen + 1);
+            memcpy(event->channel, parsed.channel, parsed.channellen);
+            event->channel[parsed.channellen] = 0;
+            event->data = malloc(parsed.datalen ? parsed.datalen : 1);
+            memcpy(event->data, parsed.data, parsed.datalen);
+            return event;
+        }
+
+        while (log->next_block < log->blocks->len &&
+               !_block_wanted(log, log->next_block))
+            log->next_block++;
+        if (log->next_block >= log->blocks->len)
+            return NULL;
+
+        int len = _load_block(log, log->next_block, &log->cbuf,
+                &log->cbuf_size, &log->ubuf, &log->ubuf_size);
+        log->next_block++;
+        log->ubuf_len = len < 0 ? 0 : len;
+        log->ubuf_pos = 0;
+    }
+}
+
+int
+lcm_blocklog_seek_to_timestamp(lcm_blocklog_t *log, int64_t utime)
+{
+    if (log->writing)
+        return -1;
+    log->skip_before = utime;
+    if (log->plain)
+        return 0;
+
+    // timestamps are nearly but not strictly increasing, so start at the
+    // first block that could hold a later event
+    int i;
+    for (i = 0; i < log->blocks->len; i++) {
+        if (g_array_index(log->blocks, block_t, i).info.max_utime >= utime)
+            break;
+    }
+    log->next_block = i;
+    log->ubuf_len = log->ubuf_pos = 0;
+    return 0;
+}
+
+void
+lcm_blocklog_set_channel_filter(lcm_blocklog_t *log,
+        int (*want_channel)(const char *channel, void *user), void *user)
+{
+    log->want_channel = want_channel;
+    log->want_channel_user = user;
+    g_array_set_size(log->wanted, 0);
+}
+
+int
+lcm_blocklog_read_block(lcm_blocklog_t *log, int block_index,
+        int (*handler)(const lcm_eventlog_event_t *event, void *user),
+        void *user)
+{
+    if (log->plain || log->writing || block_index < 0 ||
+        block_index >= log->blocks->len)
+        return -1;
+
+    uint8_t *cbuf = NULL, *ubuf = NULL;
+    int cbuf_size = 0, ubuf_size = 0;
+    int len = _load_block(log, block_index, &cbuf, &cbuf_size, &ubuf,
+            &ubuf_size);
+    free(cbuf);
+    if (len < 0) {
+        free(ubuf);
+        return -1;
+    }
+
+    char *channel = NULL;
+    int channel_size = 0;
+    int count = 0;
+    int pos = 0;
+    while (pos < len) {
+        lcm_eventlog_event_t event;
+        int used = _parse_event(ubuf + pos, len - pos, &event);
+        if (used < 0) {
+            count = -1;
+            break;
+        }
+        pos += used;
+
+        if (event.channellen + 1 > channel_size) {
+            channel_size = event.channellen + 1;
+            channel = (char *) realloc(channel, channel_size);
+        }
+        memcpy(channel, event.channel, event.channellen);
+        channel[event.channellen] = 0;
+        event.channel = channel;
+
+        count++;
+        if (handler(&event, user))
+            break;
+    }
+    free(channel);
+    free(ubuf);
+    return count;
+}
@@ -0,0 +1,175 @@
+#ifndef __lcm_blocklog_h__
+#define __lcm_blocklog_h__
+
+/**
+ * Block-compressed LCM log archives.
+ *
+ * A block archive holds the same events as an LCM log, grouped into blocks
+ * of about 1 MB that are compressed independently.  An index at the end of
+ * the file records the file offset, time range, and channels of each block,
+ * so that a time range or a set of channels can be extracted without
+ * decompressing the rest of the archive, and blocks can be decompressed in
+ * parallel.
+ *
+ * File layout (all integers are big-endian, as in LCM logs):
+ *
+ *   header:  "LCMBLK01", int32 version, int32 flags
+ *   blocks:  int32 sync (LCM_BLOCKLOG_BLOCK_SYNC), int32 compressed size,
+ *            int32 uncompressed size, int32 number of events,
+ *            int64 min timestamp, int64 max timestamp, followed by the zlib
+ *            compressed events.  Uncompressed, the events of a block are
+ *            encoded exactly as in an LCM log.
+ *   index:   int32 sync (LCM_BLOCKLOG_INDEX_SYNC), int32 number of channels,
+ *            int32 number of blocks, the channel names (int32 length,
+ *            followed by the name), and for each block: int64 offset,
+ *            int64 min and max timestamps, int32 number of events, int32
+ *            compressed and uncompressed sizes, and a bit mask of the
+ *            channels in the block (int32 length, followed by the mask).
+ *   trailer: int64 index offset, "LCMBLKIX"
+ *
+ * If an archive is missing its index, e.g. because the writer was
+ * interrupted, it is rebuilt by scanning the block headers.
+ *
+ * For convenience, the reader also reads plain LCM logs, sequentially.
+ *
+ * Linking: `pkg-config --libs bot2-lcm-blocklog`
+ */
+
+#include <stdint.h>
+#include <lcm/lcm.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LCM_BLOCKLOG_BLOCK_SYNC 0xEDA1DB10
+#define LCM_BLOCKLOG_INDEX_SYNC 0xEDA1DB1D
+#define LCM_BLOCKLOG_DEFAULT_BLOCK_SIZE (1024 * 1024)
+
+typedef struct _lcm_blocklog lcm_blocklog_t;
+
+typedef struct _lcm_blocklog_block_info {
+    int64_t offset;
+    int64_t min_utime;
+    int64_t max_utime;
+    int32_t num_events;
+    int32_t compressed_size;
+    int32_t uncompressed_size;
+} lcm_blocklog_block_info_t;
+
+/**
+ * lcm_blocklog_is_blocklog:
+ *
+ * Returns: 1 if @path is a block archive, 0 otherwise.
+ */
+int lcm_blocklog_is_blocklog(const char *path);
+
+/**
+ * lcm_blocklog_create:
+ * @mode: "r" to read a block archive or a plain LCM log, "w" to write a
+ *        block archive.
+ *
+ * Returns: the new log, or NULL on error, with errno set.
+ */
+lcm_blocklog_t *lcm_blocklog_create(const char *path, const char *mode);
+
+/**
+ * lcm_blocklog_destroy:
+ *
+ * Closes the log.  When writing, the last block and the index are written
+ * first.
+ */
+void lcm_blocklog_destroy(lcm_blocklog_t *log);
+
+/**
+ * lcm_blocklog_set_block_size:
+ *
+ * Sets the uncompressed size of the blocks to write, in bytes.
+ * Default: LCM_BLOCKLOG_DEFAULT_BLOCK_SIZE.
+ */
+void lcm_blocklog_set_block_size(lcm_blocklog_t *log, int block_size);
+
+/**
+ * lcm_blocklog_set_compression_level:
+ *
+ * Sets the zlib compression level, from 1 (fastest) to 9 (smallest).
+ * Default: 1.
+ */
+void lcm_blocklog_set_compression_level(lcm_blocklog_t *log, int level);
+
+/**
+ * lcm_blocklog_write_event:
+ *
+ * Appends @event to the log.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int lcm_blocklog_write_event(lcm_blocklog_t *log,
+        const lcm_eventlog_event_t *event);
+
+/**
+ * lcm_blocklog_read_next_event:
+ *
+ * Returns: the next event, to be freed with lcm_eventlog_free_event(), or
+ * NULL at the end of the log.
+ */
+lcm_eventlog_event_t *lcm_blocklog_read_next_event(lcm_blocklog_t *log);
+
+/**
+ * lcm_blocklog_seek_to_timestamp:
+ *
+ * Moves to the first block that contains events at or after @utime.  Events
+ * before @utime are skipped by lcm_blocklog_read_next_event() from then on.
+ * Plain LCM logs can't seek exactly, and just skip the events.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int lcm_blocklog_seek_to_timestamp(lcm_blocklog_t *log, int64_t utime);
+
+/**
+ * lcm_blocklog_set_channel_filter:
+ * @want_channel: returns nonzero if events on @channel are wanted.  Called
+ *                at most once per channel.
+ *
+ * lcm_blocklog_read_next_event() skips the blocks that don't contain any of
+ * the wanted channels, without decompressing them.  The other blocks are
+ * returned in full, so the caller still needs to check each event.
+ */
+void lcm_blocklog_set_channel_filter(lcm_blocklog_t *log,
+        int (*want_channel)(const char *channel, void *user), void *user);
+
+/**
+ * lcm_blocklog_get_num_blocks:
+ *
+ * Returns: the number of blocks in the archive, or 0 for plain LCM logs.
+ */
+int lcm_blocklog_get_num_blocks(lcm_blocklog_t *log);
+
+/**
+ * lcm_blocklog_get_block_info:
+ *
+ * Returns: the index entry of block @block_index.
+ */
+const lcm_blocklog_block_info_t *lcm_blocklog_get_block_info(
+        lcm_blocklog_t *log, int block_index);
+
+/**
+ * lcm_blocklog_read_block:
+ * @handler: called for each event of the block, in order.  The event is
+ *           only valid during the call.  Return nonzero to stop.
+ *
+ * Decompresses block @block_index.  Unlike the other functions, this can be
+ * called from several threads at once, e.g., to process the blocks of an
+ * archive in parallel.
+ *
+ * Returns: the number of events handled, or -1 on error.
+ */
+int lcm_blocklog_read_block(lcm_blocklog_t *log, int block_index,
+        int (*handler)(const lcm_eventlog_event_t *event, void *user),
+        void *user);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
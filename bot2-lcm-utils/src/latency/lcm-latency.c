@@ -0,0 +1,451 @@
+// file: lcm-latency.c
+// desc: reconstructs LCM pipelines from trace spans published by BotTrace
+//       (bot2-core), and reports end-to-end latencies along them
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/time.h>
+#include <sys/select.h>
+
+#include <glib.h>
+
+#include <lcm/lcm.h>
+#include <lcmtypes/bot_core_trace_spans_t.h>
+
+#include "lcm_blocklog.h"
+
+#define DEFAULT_CHANNEL "BOT_TRACE"
+
+// longest chain of spans followed back from an output
+#define MAX_PATH_LEN 32
+
+typedef struct _span {
+    // channel names are interned in the app's string chunk, so they can be
+    // compared by pointer
+    const char *process;
+    const char *input_channel;
+    int64_t input_utime;
+    int64_t recv_utime;
+    const char *output_channel;
+    int64_t output_utime;
+    int64_t publish_utime;
+    int64_t processing_usec;
+} span_t;
+
+// a message, identified by its channel and utime
+typedef struct _msg_key {
+    const char *channel;
+    int64_t utime;
+} msg_key_t;
+
+// latencies of the outputs computed along one path
+typedef struct _path_stats {
+    char *name;
+    int num_stages;
+    const char *stage_process[MAX_PATH_LEN];
+    GArray *latencies;
+    // per stage totals, in usec
+    double transport[MAX_PATH_LEN];
+    double queueing[MAX_PATH_LEN];
+    double processing[MAX_PATH_LEN];
+} path_stats_t;
+
+typedef struct _app {
+    GStringChunk *strings;
+    GPtrArray *spans;
+    // process name -> dropped span count
+    GHashTable *dropped;
+    int64_t window_usec;
+    int64_t latest_utime;
+} app_t;
+
+static volatile int _quit = 0;
+
+static void
+_sig_handler(int signum)
+{
+    _quit = 1;
+}
+
+static inline int64_t
+_timestamp_now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void
+usage()
+{
+    printf("usage: bot-lcm-latency [OPTIONS] [logfile]\n"
+           "\n"
+           "Reconstructs LCM processing pipelines from the trace spans that\n"
+           "processes publish with BotTrace (bot_core/trace.h), and reports the\n"
+           "end-to-end latency along each path, from the utime of the first\n"
+           "input to the publication of the last output, with a breakdown per\n"
+           "stage.  When an output was computed from several inputs, the path\n"
+           "follows the input that arrived last (the critical path).\n"
+           "\n"
+           "Reads the spans from [logfile] (an LCM log or block archive) if given,\n"
+           "and from LCM otherwise.\n"
+           "\n"
+           "Options:\n"
+           "  -h        prints this help text and exits\n"
+           "  -c CHAN   channel of the trace spans.  Default: %s\n"
+           "  -p SEC    live mode: report every SEC seconds.  Default: 5\n"
+           "  -w SEC    live mode: only report the spans of the last SEC seconds.\n"
+           "            Default: 60\n"
+           "  -l URL    LCM URL to use in live mode\n",
+           DEFAULT_CHANNEL);
+    exit(1);
+}
+
+static guint
+_msg_key_hash(gconstpointer v)
+{
+    const msg_key_t *key = (const msg_key_t *) v;
+    return g_direct_hash(key->channel) ^ g_int64_hash(&key->utime);
+}
+
+static gboolean
+_msg_key_equal(gconstpointer a, gconstpointer b)
+{
+    const msg_key_t *ka = (const msg_key_t *) a;
+    const msg_key_t *kb = (const msg_key_t *) b;
+    return ka->channel == kb->channel && ka->utime == kb->utime;
+}
+
+static void
+_add_spans(app_t *app, const bot_core_trace_spans_t *msg)
+{
+    const char *process = g_string_chunk_insert_const(app->strings,
+            msg->process);
+    if (msg->dropped) {
+        int64_t *dropped = g_hash_table_lookup(app->dropped, process);
+        if (!dropped) {
+            dropped = g_new0(int64_t, 1);
+            g_hash_table_insert(app->dropped, (gpointer) process, dropped);
+        }
+        *dropped += msg->dropped;
+    }
+
+    for (int i = 0; i < msg->num_spans; i++) {
+        const bot_core_trace_span_t *s = &msg->spans[i];
+        span_t *span = g_slice_new(span_t);
+        span->process = process;
+        span->input_channel = g_string_chunk_insert_const(app->strings,
+                s->input_channel);
+        span->input_utime = s->input_utime;
+        span->recv_utime = s->recv_utime;
+        span->output_channel = g_string_chunk_insert_const(app->strings,
+                s->output_channel);
+        span->output_utime = s->output_utime;
+        span->publish_utime = s->publish_utime;
+        span->processing_usec = s->processing_usec;
+        g_ptr_array_add(app->spans, span);
+        if (span->publish_utime > app->latest_utime)
+            app->latest_utime = span->publish_utime;
+    }
+}
+
+static void
+_prune_spans(app_t *app)
+{
+    int64_t oldest = app->latest_utime - app->window_usec;
+    int kept = 0;
+    for (int i = 0; i < app->spans->len; i++) {
+        span_t *span = g_ptr_array_index(app->spans, i);
+        if (span->publish_utime < oldest)
+            g_slice_free(span_t, span);
+        else
+            g_ptr_array_index(app->spans, kept++) = span;
+    }
+    g_ptr_array_set_size(app->spans, kept);
+}
+
+static int
+_compare_int64(const void *a, const void *b)
+{
+    int64_t va = *(const int64_t *) a;
+    int64_t vb = *(const int64_t *) b;
+    return va < vb ? -1 : va > vb;
+}
+
+static int
+_compare_paths(const void *a, const void *b)
+{
+    const path_stats_t *pa = *(path_stats_t * const *) a;
+    const path_stats_t *pb = *(path_stats_t * const *) b;
+    return pb->latencies->len - pa->latencies->len;
+}
+
+static double
+_percentile_ms(GArray *sorted, double p)
+{
+    int i = (int) (p * (sorted->len - 1) + 0.5);
+    return g_array_index(sorted, int64_t, i) * 1e-3;
+}
+
+static void
+_free_path_stats(gpointer data)
+{
+    path_stats_t *ps = (path_stats_t *) data;
+    g_free(ps->name);
+    g_array_free(ps->latencies, TRUE);
+    g_slice_free(path_stats_t, ps);
+}
+
+static void
+_report(app_t *app)
+{
+    // the span that produced each message.  If there are several, e.g. a
+    // fusion step with several inputs, keep the one whose input arrived
+    // last, since that input gated the output.
+    GHashTable *producers = g_hash_table_new(_msg_key_hash, _msg_key_equal);
+    // the messages that were used as inputs
+    GHashTable *consumed = g_hash_table_new(_msg_key_hash, _msg_key_equal);
+    msg_key_t *keys = g_new(msg_key_t, 2 * app->spans->len);
+
+    for (int i = 0; i < app->spans->len; i++) {
+        span_t *span = g_ptr_array_index(app->spans, i);
+        msg_key_t *out = &keys[2 * i];
+        out->channel = span->output_channel;
+        out->utime = span->output_utime;
+        span_t *prev = g_hash_table_lookup(producers, out);
+        if (!prev || span->recv_utime > prev->recv_utime)
+            g_hash_table_insert(producers, out, span);
+
+        msg_key_t *in = &keys[2 * i + 1];
+        in->channel = span->input_channel;
+        in->utime = span->input_utime;
+        g_hash_table_insert(consumed, in, in);
+    }
+
+    // follow each final output (one that no span consumed) back to its
+    // first input
+    GHashTable *paths = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+            _free_path_stats);
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, producers);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        if (g_hash_table_lookup(consumed, key))
+            continue;
+
+        span_t *chain[MAX_PATH_LEN];
+        int n = 0;
+        span_t *span = (span_t *) value;
+        while (span && n < MAX_PATH_LEN) {
+            chain[n++] = span;
+            msg_key_t in = { span->input_channel, span->input_utime };
+            span = g_hash_table_lookup(producers, &in);
+        }
+
+        // chain runs from the final output back to the first input
+        GString *name = g_string_new(chain[n - 1]->input_channel);
+        for (int i = n - 1; i >= 0; i--)
+            g_string_append_printf(name, " -> %s", chain[i]->output_channel);
+
+        path_stats_t *ps = g_hash_table_lookup(paths, name->str);
+        if (!ps) {
+            ps = g_slice_new0(path_stats_t);
+            ps->name = g_string_free(name, FALSE);
+            ps->num_stages = n;
+            ps->latencies = g_array_new(FALSE, FALSE, sizeof(int64_t));
+            for (int i = 0; i < n; i++)
+                ps->stage_process[i] = chain[n - 1 - i]->process;
+            g_hash_table_insert(paths, ps->name, ps);
+        } else {
+            g_string_free(name, TRUE);
+        }
+
+        int64_t latency = chain[0]->publish_utime - chain[n - 1]->input_utime;
+        g_array_append_val(ps->latencies, latency);
+        for (int i = 0; i < n; i++) {
+            span_t *s = chain[n - 1 - i];
+            // the first stage's transport time is from the utime of the
+            // first message, e.g., from sensor acquisition
+            int64_t sent = i ? chain[n - i]->publish_utime : s->input_utime;
+            ps->transport[i] += s->recv_utime - sent;
+            ps->queueing[i] += s->publish_utime - s->recv_utime -
+                s->processing_usec;
+            ps->processing[i] += s->processing_usec;
+        }
+    }
+
+    GPtrArray *sorted = g_ptr_array_new();
+    g_hash_table_iter_init(&iter, paths);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+        g_ptr_array_add(sorted, value);
+    qsort(sorted->pdata, sorted->len, sizeof(gpointer), _compare_paths);
+
+    printf("===== %d spans, %d paths\n", app->spans->len, sorted->len);
+    for (int p = 0; p < sorted->len; p++) {
+        path_stats_t *ps = g_ptr_array_index(sorted, p);
+        int count = ps->latencies->len;
+        qsort(ps->latencies->data, count, sizeof(int64_t), _compare_int64);
+        printf("\n%s\n", ps->name);
+        printf("  %d outputs, latency (ms): p50 %.2f  p90 %.2f  p99 %.2f  "
+               "max %.2f\n", count,
+               _percentile_ms(ps->latencies, 0.5),
+               _percentile_ms(ps->latencies, 0.9),
+               _percentile_ms(ps->latencies, 0.99),
+               _percentile_ms(ps->latencies, 1.0));
+        printf("  %-20s %12s %12s %12s  (mean ms)\n", "stage", "transport",
+               "queued", "processing");
+        for (int i = 0; i < ps->num_stages; i++) {
+            printf("  %-20s %12.2f %12.2f %12.2f\n", ps->stage_process[i],
+                   ps->transport[i] * 1e-3 / count,
+                   ps->queueing[i] * 1e-3 / count,
+                   ps->processing[i] * 1e-3 / count);
+        }
+    }
+
+    g_hash_table_iter_init(&iter, app->dropped);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+        printf("\n%s dropped %"PRId64" spans\n", (char *) key,
+               *(int64_t *) value);
+    printf("\n");
+    fflush(stdout);
+
+    g_ptr_array_free(sorted, TRUE);
+    g_hash_table_destroy(paths);
+    g_hash_table_destroy(producers);
+    g_hash_table_destroy(consumed);
+    g_free(keys);
+}
+
+static void
+on_spans(const lcm_recv_buf_t *rbuf, const char *channel,
+        const bot_core_trace_spans_t *msg, void *user_data)
+{
+    _add_spans((app_t *) user_data, msg);
+}
+
+static int
+_read_log(app_t *app, const char *fname, const char *channel)
+{
+    lcm_blocklog_t *log = lcm_blocklog_create(fname, "r");
+    if (!log) {
+        perror("Unable to open logfile");
+        return -1;
+    }
+
+    lcm_eventlog_event_t *event;
+    while ((event = lcm_blocklog_read_next_event(log))) {
+        if (!strcmp(event->channel, channel)) {
+            bot_core_trace_spans_t msg;
+            if (bot_core_trace_spans_t_decode(event->data, 0, event->datalen,
+                        &msg) >= 0) {
+                _add_spans(app, &msg);
+                bot_core_trace_spans_t_decode_cleanup(&msg);
+            }
+        }
+        lcm_eventlog_free_event(event);
+    }
+    lcm_blocklog_destroy(log);
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    char *channel = DEFAULT_CHANNEL;
+    char *lcm_url = NULL;
+    double report_period = 5;
+    double window = 60;
+
+    char *optstring = "hc:p:w:l:";
+    int c;
+
+    while ((c = getopt(argc, argv, optstring)) >= 0) {
+        switch (c) {
+            case 'c':
+                channel = optarg;
+                break;
+            case 'p':
+                report_period = strtod(optarg, NULL);
+                if (report_period <= 0)
+                    usage();
+                break;
+            case 'w':
+                window = strtod(optarg, NULL);
+                if (window <= 0)
+                    usage();
+                break;
+            case 'l':
+                lcm_url = optarg;
+                break;
+            case 'h':
+            default:
+                usage();
+                break;
+        };
+    }
+
+    if (optind < argc - 1)
+        usage();
+
+    app_t app;
+    app.strings = g_string_chunk_new(4096);
+    app.spans = g_ptr_array_new();
+    app.dropped = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+            g_free);
+    app.window_usec = (int64_t) (window * 1000000);
+    app.latest_utime = 0;
+
+    int status = 0;
+    if (optind == argc - 1) {
+        if (_read_log(&app, argv[optind], channel) < 0)
+            status = 1;
+        else
+            _report(&app);
+    } else {
+        lcm_t *lcm = lcm_create(lcm_url);
+        if (!lcm) {
+            fprintf(stderr, "Couldn't initialize LCM\n");
+            return 1;
+        }
+        bot_core_trace_spans_t_subscribe(lcm, channel, on_spans, &app);
+
+        signal(SIGINT, _sig_handler);
+        signal(SIGTERM, _sig_handler);
+
+        int lcm_fd = lcm_get_fileno(lcm);
+        int64_t report_interval = (int64_t) (report_period * 1000000);
+        int64_t next_report_utime = _timestamp_now() + report_interval;
+
+        while (!_quit) {
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(lcm_fd, &fds);
+            struct timeval timeout = { 0, 100000 };
+            int sstatus = select(lcm_fd + 1, &fds, NULL, NULL, &timeout);
+            if (sstatus > 0 && FD_ISSET(lcm_fd, &fds)) {
+                if (0 != lcm_handle(lcm))
+                    break;
+            }
+
+            int64_t now = _timestamp_now();
+            if (now >= next_report_utime) {
+                _prune_spans(&app);
+                _report(&app);
+                next_report_utime = now + report_interval;
+            }
+        }
+        lcm_destroy(lcm);
+    }
+
+    for (int i = 0; i < app.spans->len; i++)
+        g_slice_free(span_t, g_ptr_array_index(app.spans, i));
+    g_ptr_array_free(app.spans, TRUE);
+    g_hash_table_destroy(app.dropped);
+    g_string_chunk_free(app.strings);
+    return status;
+}
@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <inttypes.h>
 #include <string.h>
 #include <unistd.h>
 #include <regex.h>
@@ -12,13 +13,17 @@
 
 #include <lcm/lcm.h>
 
+#include "lcm_blocklog.h"
+
 static void 
 usage()
 {
     printf("usage: bot-lcm-logfilter [OPTIONS] <source_logfile> <dest_logfile>\n"
            "\n"
            "Selectively extract channels from a source logfile to a destination\n"
-           "logfile.\n"
+           "logfile.  The source logfile may be a block archive written by\n"
+           "bot-lcm-blocklog, in which case only the parts of it that are needed\n"
+           "are decompressed.\n"
            "\n"
            "Options:\n"
            "  -h        prints this help text and exits\n"
@@ -33,15 +38,133 @@ usage()
            "  -e END    end time.  Messages logged more than END seconds\n"
            "            after the first message in the logfile will not be\n"
            "            extracted.\n"
+           "  -d CHAN=N\n"
+           "            decimate.  Only copy every Nth message on the channels\n"
+           "            matching the regular expression CHAN.\n"
+           "  -r CHAN=HZ\n"
+           "            rate limit.  Copy at most HZ messages per second on the\n"
+           "            channels matching CHAN, by log timestamp.\n"
+           "  -z CHAN=SIZE\n"
+           "            size cap.  Copy at most SIZE bytes of messages on each of\n"
+           "            the channels matching CHAN.  SIZE may end in k, M, or G.\n"
+           "  -a        write the destination logfile as a block archive\n"
            "  -v        verbose mode. Prints a summary of channels extracted\n"
+           "\n"
+           "-d, -r, and -z can be given multiple times.  For each channel, the first\n"
+           "of each that matches is used.\n"
+           "\n"
+           "Example:\n"
+           "  bot-lcm-logfilter -r 'CAMERA.*=1' -r 'LIDAR.*=5' -z '.*=100M' in.log out.log\n"
+           "    Copies cameras at 1 Hz and lidars at 5 Hz, everything else at full\n"
+           "    rate, and at most 100 MB of any one channel.\n"
            );
     exit(1);
 }
 
+typedef struct _filter_rule {
+    regex_t preg;
+    // N, HZ, or SIZE
+    double value;
+} filter_rule_t;
+
+// what to do with a channel, worked out the first time it is seen
+typedef struct _channel_state {
+    int copy;
+    int64_t decimate;       // 0 to copy every message
+    int64_t min_period;     // 0 for no rate limit
+    int64_t max_bytes;      // -1 for no size cap
+
+    int64_t nread;
+    int64_t nwritten;
+    int64_t bytes_written;
+    int64_t next_utime;     // rate limit: earliest time of the next message
+} channel_state_t;
+
+// parses CHAN=VALUE.  Returns the value, or -1 on error
+static double
+_parse_rule(const char *arg, regex_t *preg, int size_suffix)
+{
+    const char *eq = strrchr(arg, '=');
+    if (!eq || eq == arg)
+        return -1;
+
+    char *eptr = NULL;
+    double value = strtod(eq + 1, &eptr);
+    if (eptr == eq + 1 || value < 0)
+        return -1;
+    if (size_suffix) {
+        switch (*eptr) {
+            case 'k': case 'K': value *= 1024; eptr++; break;
+            case 'm': case 'M': value *= 1024 * 1024; eptr++; break;
+            case 'g': case 'G': value *= 1024 * 1024 * 1024; eptr++; break;
+        }
+    }
+    if (*eptr != 0)
+        return -1;
+
+    char *pattern = g_strndup(arg, eq - arg);
+    int status = regcomp(preg, pattern, REG_NOSUB | REG_EXTENDED);
+    g_free(pattern);
+    if (0 != status) {
+        fprintf(stderr, "bad regex in %s\n", arg);
+        return -1;
+    }
+    return value;
+}
+
+static void
+_add_rule(GPtrArray *rules, const char *arg, int size_suffix)
+{
+    filter_rule_t *rule = (filter_rule_t*) calloc(1, sizeof(filter_rule_t));
+    rule->value = _parse_rule(arg, &rule->preg, size_suffix);
+    if (rule->value <= 0)
+        usage();
+    g_ptr_array_add(rules, rule);
+}
+
+// returns the value of the first rule matching channel, or 0
+static double
+_match_rule(GPtrArray *rules, const char *channel)
+{
+    for (int i = 0; i < rules->len; i++) {
+        filter_rule_t *rule = g_ptr_array_index(rules, i);
+        if (0 == regexec(&rule->preg, channel, 0, NULL, 0))
+            return rule->value;
+    }
+    return 0;
+}
+
+static void
+_free_rules(GPtrArray *rules)
+{
+    for (int i = 0; i < rules->len; i++) {
+        filter_rule_t *rule = g_ptr_array_index(rules, i);
+        regfree(&rule->preg);
+        free(rule);
+    }
+    g_ptr_array_free(rules, TRUE);
+}
+
+typedef struct _channel_regex {
+    regex_t *preg;
+    int invert;
+} channel_regex_t;
+
+static int
+_want_channel(const char *channel, void *user)
+{
+    channel_regex_t *cr = (channel_regex_t*) user;
+    int regmatch = regexec(cr->preg, channel, 0, NULL, 0);
+    return (regmatch == 0 && !cr->invert) || (regmatch != 0 && cr->invert);
+}
+
 static void
 _verbose_entry_summary(gpointer key, gpointer value, gpointer user_data)
 {
-    printf("%20s: %d\n", (char*)key, *((int*)value));
+    channel_state_t *chan = (channel_state_t*) value;
+    if (chan->nwritten)
+        printf("%20s: %"PRId64" of %"PRId64" (%.1f MB)\n", (char*)key,
+                chan->nwritten, chan->nread, chan->bytes_written * 1e-6);
 }
 
 int main(int argc, char **argv)
@@ -54,8 +177,12 @@ int main(int argc, char **argv)
     int64_t end_utime = -1;
     int have_end_utime = 0;
     int invert_regex = 0;
+    int write_archive = 0;
+    GPtrArray *decimate_rules = g_ptr_array_new();
+    GPtrArray *rate_rules = g_ptr_array_new();
+    GPtrArray *size_rules = g_ptr_array_new();
 
-    char *optstring = "hc:vs:e:i";
+    char *optstring = "hc:vs:e:id:r:z:a";
     int c;
 
     while ((c = getopt_long (argc, argv, optstring, NULL, 0)) >= 0)
@@ -93,6 +220,18 @@ int main(int argc, char **argv)
             case 'v':
                 verbose = 1;
                 break;
+            case 'a':
+                write_archive = 1;
+                break;
+            case 'd':
+                _add_rule(decimate_rules, optarg, 0);
+                break;
+            case 'r':
+                _add_rule(rate_rules, optarg, 0);
+                break;
+            case 'z':
+                _add_rule(size_rules, optarg, 1);
+                break;
             default:
                 usage();
                 break;
@@ -114,32 +253,50 @@ int main(int argc, char **argv)
     source_fname = argv[argc - 2];
     dest_fname = argv[argc - 1];
 
-    lcm_eventlog_t *src_log = lcm_eventlog_create(source_fname, "r");
+    lcm_blocklog_t *src_log = lcm_blocklog_create(source_fname, "r");
     if (!src_log) {
         perror("Unable to open source logfile");
         regfree(&preg);
         return 1;
     }
-    lcm_eventlog_t *dst_log = lcm_eventlog_create(dest_fname, "w");
-    if (!dst_log) {
+    lcm_eventlog_t *dst_log = NULL;
+    lcm_blocklog_t *dst_archive = NULL;
+    if (write_archive)
+        dst_archive = lcm_blocklog_create(dest_fname, "w");
+    else
+        dst_log = lcm_eventlog_create(dest_fname, "w");
+    if (!dst_log && !dst_archive) {
         perror("Unable to open destination logfile");
-        lcm_eventlog_destroy(src_log);
+        lcm_blocklog_destroy(src_log);
         regfree(&preg);
         return 1;
     }
 
-    GHashTable *counts = g_hash_table_new_full(g_str_hash, g_str_equal,
+    // -s and -e are relative to the first event of the log, whatever its
+    // channel, so read it before the channel filter can skip its block
+    lcm_eventlog_event_t *event = lcm_blocklog_read_next_event(src_log);
+
+    // skip the blocks of a block archive that have none of the channels
+    channel_regex_t channel_regex = { &preg, invert_regex };
+    lcm_blocklog_set_channel_filter(src_log, _want_channel, &channel_regex);
+
+    // the regular expressions are only evaluated once per channel
+    GHashTable *channels = g_hash_table_new_full(g_str_hash, g_str_equal,
             free, free);
     int nwritten = 0;
     int have_first_event_timestamp = 0;
     int64_t first_event_timestamp;
 
-    for (lcm_eventlog_event_t *event = lcm_eventlog_read_next_event(src_log);
-            event != NULL;
-            event = lcm_eventlog_read_next_event(src_log)) {
+    for (; event != NULL; event = lcm_blocklog_read_next_event(src_log)) {
         if(!have_first_event_timestamp) {
             first_event_timestamp = event->timestamp;
             have_first_event_timestamp = 1;
+            if (start_utime > 0) {
+                lcm_eventlog_free_event(event);
+                lcm_blocklog_seek_to_timestamp(src_log,
+                        first_event_timestamp + start_utime);
+                continue;
+            }
         }
 
         int64_t elapsed = event->timestamp - first_event_timestamp;
@@ -152,37 +309,69 @@ int main(int argc, char **argv)
             break;
         }
 
-        int regmatch = regexec(&preg, event->channel, 0, NULL, 0);
-        int copy_to_dest = (regmatch == 0 && !invert_regex) ||
-                           (regmatch != 0 && invert_regex);
-        if (copy_to_dest) {
-            lcm_eventlog_write_event(dst_log, event);
-            nwritten++;
+        channel_state_t *chan = g_hash_table_lookup(channels, event->channel);
+        if (!chan) {
+            chan = (channel_state_t*) calloc(1, sizeof(channel_state_t));
+            int regmatch = regexec(&preg, event->channel, 0, NULL, 0);
+            chan->copy = (regmatch == 0 && !invert_regex) ||
+                         (regmatch != 0 && invert_regex);
+            chan->decimate = (int64_t) _match_rule(decimate_rules,
+                    event->channel);
+            double hz = _match_rule(rate_rules, event->channel);
+            chan->min_period = hz > 0 ? (int64_t) (1e6 / hz) : 0;
+            double max_bytes = _match_rule(size_rules, event->channel);
+            chan->max_bytes = max_bytes > 0 ? (int64_t) max_bytes : -1;
+            g_hash_table_insert(channels, strdup(event->channel), chan);
+            if (verbose && chan->copy)
+                printf("matched channel %s\n", event->channel);
+        }
+        chan->nread++;
 
-            if (verbose)  {
-                int *count = g_hash_table_lookup(counts, event->channel);
-                if (!count) {
-                    count = (int*) malloc(sizeof(int));
-                    *count = 1;
-                    g_hash_table_insert(counts, strdup(event->channel), count);
-                    printf("matched channel %s\n", event->channel);
-                } else {
-                    *count += 1;
-                }
+        int copy_to_dest = chan->copy;
+        if (copy_to_dest && chan->decimate > 1)
+            copy_to_dest = (chan->nread - 1) % chan->decimate == 0;
+        if (copy_to_dest && chan->min_period > 0) {
+            if (event->timestamp < chan->next_utime) {
+                copy_to_dest = 0;
+            } else {
+                // keep the average rate at the limit, even if messages
+                // aren't evenly spaced
+                chan->next_utime += chan->min_period;
+                if (chan->next_utime <= event->timestamp)
+                    chan->next_utime = event->timestamp + chan->min_period;
             }
         }
+        if (copy_to_dest && chan->max_bytes >= 0 &&
+                chan->bytes_written + event->datalen > chan->max_bytes)
+            copy_to_dest = 0;
+
+        if (copy_to_dest) {
+            if (dst_log)
+                lcm_eventlog_write_event(dst_log, event);
+            else
+                lcm_blocklog_write_event(dst_archive, event);
+            nwritten++;
+            chan->nwritten++;
+            chan->bytes_written += event->datalen;
+        }
         lcm_eventlog_free_event(event);
     }
 
     if (verbose) {
-        g_hash_table_foreach(counts, _verbose_entry_summary, NULL);
+        g_hash_table_foreach(channels, _verbose_entry_summary, NULL);
         printf("=====\n");
         printf("Events written: %d\n", nwritten);
     }
     
     regfree(&preg);
-    lcm_eventlog_destroy(src_log);
-    lcm_eventlog_destroy(dst_log);
-    g_hash_table_destroy(counts);
+    lcm_blocklog_destroy(src_log);
+    if (dst_log)
+        lcm_eventlog_destroy(dst_log);
+    else
+        lcm_blocklog_destroy(dst_archive);
+    g_hash_table_destroy(channels);
+    _free_rules(decimate_rules);
+    _free_rules(rate_rules);
+    _free_rules(size_rules);
     return 0;
 }
@@ -0,0 +1,878 @@
+// file: bot-lcm-logger.c
+// desc: logs LCM traffic to disk.  Messages are handed off from the LCM
+//       receive thread to a writer thread through a lock-free ring buffer,
+//       so that slow or stalled disk writes never block message reception.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <regex.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/select.h>
+#include <arpa/inet.h>
+
+#include <glib.h>
+#include <zlib.h>
+
+#include <lcm/lcm.h>
+
+#include "lcm_logger_stats_t.h"
+
+#define LOG_SYNC_WORD 0xEDA1DA01
+#define LOG_EVENT_HEADER_SIZE 28
+
+#define DIRECT_IO_ALIGN 4096
+#define RING_ALIGN 8
+#define RING_WRAP_MARKER -1
+
+#define DEFAULT_RING_MB 64
+#define DEFAULT_MAX_BACKLOG_MB 1024
+#define DEFAULT_BLOCK_KB 1024
+#define DEFAULT_STATS_CHANNEL "LCM_LOGGER_STATS"
+
+// how long the writer waits for more data before writing out a partially
+// filled buffer
+#define IDLE_FLUSH_USEC 200000
+
+static inline int64_t
+_timestamp_now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+#define ALIGN_UP(x, a) (((x) + (a) - 1) & ~((int64_t)(a) - 1))
+
+// header of an event stored in the ring buffer or the overflow queue.  The
+// channel (not NUL terminated) and the data immediately follow the header.
+typedef struct {
+    int32_t len;        // total record length, including this header
+    int32_t channellen;
+    int32_t datalen;
+    int32_t reserved;
+    int64_t timestamp;
+} record_t;
+
+typedef struct {
+    // configuration
+    char *fname;
+    int force;
+    int use_direct_io;
+    int compress;
+    int compress_level;
+    int64_t rotate_bytes;
+    int64_t rotate_usec;
+    int64_t max_backlog_bytes;
+    int verbose;
+
+    lcm_t *lcm;
+    regex_t preg;
+    int invert_regex;
+    GHashTable *channel_selected;
+
+    // lock-free single producer / single consumer ring.  The receive thread
+    // only advances ring_write_pos, and the writer thread only advances
+    // ring_read_pos.
+    uint8_t *ring;
+    int ring_size;
+    volatile gint ring_write_pos;
+    volatile gint ring_read_pos;
+
+    // events received while the ring was full, in order of arrival.  While
+    // the overflow queue is in use, new events are appended to it instead of
+    // the ring so that events are written in the order they were received.
+    GMutex *lock;
+    GQueue *overflow;
+    int64_t overflow_bytes;
+    volatile gint overflow_active;
+
+    GThread *writer_thread;
+    volatile gint quit;
+
+    // the writer thread sleeps on writer_cond, with lock held, while it has
+    // nothing to do.  writer_waiting tells the receive thread to wake it.
+    GCond *writer_cond;
+    volatile gint writer_waiting;
+
+    // writer state.  Only accessed by the writer thread
+    int fd;
+    int64_t file_bytes;
+    int64_t file_start_utime;
+    int64_t eventnum;
+
+    uint8_t *out;           // aligned, ready to be written to disk
+    int64_t out_len;
+    int64_t out_cap;
+
+    uint8_t *block;         // uncompressed events, when compressing
+    int64_t block_len;
+    int64_t block_cap;
+    z_stream zs;
+
+    int64_t last_write_utime;
+
+    // shared state, protected by lock
+    char *cur_fname;
+    int file_index;
+
+    // statistics.  Each counter is updated by only one thread.
+    volatile int64_t events_received;
+    volatile int64_t events_dropped;
+    volatile int64_t events_written;
+    volatile int64_t bytes_written;
+    volatile int64_t write_errors;
+    int64_t max_backlog_seen;
+} logger_t;
+
+static volatile sig_atomic_t _quit = 0;
+
+static void
+_sig_handler(int signum)
+{
+    _quit = 1;
+}
+
+// =========== writer thread ============
+
+static void
+_write_fully(logger_t *self, const uint8_t *buf, int64_t len)
+{
+    int warned = 0;
+    int retries = 0;
+    while (len > 0) {
+        ssize_t n = write(self->fd, buf, len);
+        if (n > 0) {
+            buf += n;
+            len -= n;
+            self->bytes_written += n;
+            self->file_bytes += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        // don't give up on the data.  The disk may recover, and in the
+        // meantime the receive thread keeps queueing up new events.
+        self->write_errors++;
+        if (!warned) {
+            fprintf(stderr, "Error writing to %s: %s (retrying)\n",
+                    self->cur_fname, strerror(errno));
+            warned = 1;
+        }
+        if (g_atomic_int_get(&self->quit) && ++retries > 50) {
+            fprintf(stderr, "Giving up on %"PRId64" unwritten bytes\n", len);
+            return;
+        }
+        g_usleep(100000);
+    }
+}
+
+// writes out the output buffer.  With direct I/O, only whole aligned blocks
+// are written unless this is the final flush of a file.
+static void
+_flush_output(logger_t *self, int final)
+{
+    int64_t n = self->out_len;
+    if (self->use_direct_io && !final)
+        n &= ~((int64_t) DIRECT_IO_ALIGN - 1);
+    if (!n)
+        return;
+
+    if (self->use_direct_io && (n % DIRECT_IO_ALIGN)) {
+        // the tail of the file isn't a whole block.  Turn off direct I/O
+        // for it.
+        int flags = fcntl(self->fd, F_GETFL);
+        fcntl(self->fd, F_SETFL, flags & ~O_DIRECT);
+    }
+
+    _write_fully(self, self->out, n);
+    self->out_len -= n;
+    if (self->out_len)
+        memmove(self->out, self->out + n, self->out_len);
+    self->last_write_utime = _timestamp_now();
+}
+
+static uint8_t *
+_reserve_output(logger_t *self, int64_t n)
+{
+    if (self->out_len + n > self->out_cap)
+        _flush_output(self, 0);
+    if (self->out_len + n > self->out_cap) {
+        int64_t cap = ALIGN_UP(self->out_len + n, DIRECT_IO_ALIGN);
+        uint8_t *out = NULL;
+        if (posix_memalign((void**) &out, DIRECT_IO_ALIGN, cap)) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+        memcpy(out, self->out, self->out_len);
+        free(self->out);
+        self->out = out;
+        self->out_cap = cap;
+    }
+    uint8_t *p = self->out + self->out_len;
+    self->out_len += n;
+    return p;
+}
+
+// compresses the pending events as a single gzip member.  A file made of
+// concatenated gzip members is itself a valid gzip file, so compressed logs
+// can be restored with zcat.
+static void
+_compress_block(logger_t *self)
+{
+    if (!self->block_len)
+        return;
+
+    int64_t bound = deflateBound(&self->zs, self->block_len) + 64;
+    uint8_t *dst = _reserve_output(self, bound);
+
+    self->zs.next_in = self->block;
+    self->zs.avail_in = self->block_len;
+    self->zs.next_out = dst;
+    self->zs.avail_out = bound;
+    int status = deflate(&self->zs, Z_FINISH);
+    if (status != Z_STREAM_END) {
+        fprintf(stderr, "Compression error (%d)\n", status);
+        exit(1);
+    }
+    self->out_len -= self->zs.avail_out;
+    deflateReset(&self->zs);
+    self->block_len = 0;
+}
+
+static uint8_t *
+_reserve_event(logger_t *self, int64_t n)
+{
+    if (!self->compress)
+        return _reserve_output(self, n);
+
+    if (self->block_len + n > self->block_cap)
+        _compress_block(self);
+    if (n > self->block_cap) {
+        self->block_cap = n;
+        self->block = (uint8_t*) realloc(self->block, self->block_cap);
+    }
+    uint8_t *p = self->block + self->block_len;
+    self->block_len += n;
+    return p;
+}
+
+static int
+_open_file(logger_t *self)
+{
+    char *fname;
+    if (self->rotate_bytes || self->rotate_usec)
+        fname = g_strdup_printf("%s.%05d", self->fname, self->file_index);
+    else
+        fname = g_strdup(self->fname);
+
+    int flags = O_WRONLY | O_CREAT | (self->force ? O_TRUNC : O_EXCL);
+    int fd = -1;
+    if (self->use_direct_io) {
+        fd = open(fname, flags | O_DIRECT, 0644);
+        if (fd < 0 && errno == EINVAL) {
+            fprintf(stderr, "Direct I/O not supported for %s\n", fname);
+            self->use_direct_io = 0;
+        }
+    }
+    if (fd < 0 && !self->use_direct_io)
+        fd = open(fname, flags, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to open %s: %s\n", fname, strerror(errno));
+        g_free(fname);
+        return -1;
+    }
+
+    self->fd = fd;
+    self->file_bytes = 0;
+    self->eventnum = 0;
+
+    g_mutex_lock(self->lock);
+    g_free(self->cur_fname);
+    self->cur_fname = fname;
+    g_mutex_unlock(self->lock);
+
+    if (self->verbose)
+        printf("Opened %s\n", fname);
+    return 0;
+}
+
+static void
+_close_file(logger_t *self)
+{
+    if (self->fd < 0)
+        return;
+    _compress_block(self);
+    _flush_output(self, 1);
+    close(self->fd);
+    self->fd = -1;
+}
+
+static void
+_rotate_file(logger_t *self)
+{
+    _close_file(self);
+    g_mutex_lock(self->lock);
+    self->file_index++;
+    g_mutex_unlock(self->lock);
+
+    // keep trying; events pile up in the backlog in the meantime.
+    while (_open_file(self) < 0 && !g_atomic_int_get(&self->quit))
+        g_usleep(1000000);
+}
+
+static void
+_write_event(logger_t *self, const record_t *rec)
+{
+    // when compressing, the pending block is counted uncompressed, so that
+    // a file never grows past rotate_bytes once the block is written out
+    if (self->fd >= 0 && self->eventnum &&
+            ((self->rotate_bytes &&
+              self->file_bytes + self->out_len + self->block_len >=
+              self->rotate_bytes) ||
+             (self->rotate_usec &&
+              rec->timestamp - self->file_start_utime >= self->rotate_usec)))
+        _rotate_file(self);
+    if (self->fd < 0)
+        return;
+
+    if (!self->eventnum)
+        self->file_start_utime = rec->timestamp;
+
+    const uint8_t *channel = (const uint8_t*) (rec + 1);
+    const uint8_t *data = channel + rec->channellen;
+
+    uint8_t *p = _reserve_event(self,
+            LOG_EVENT_HEADER_SIZE + rec->channellen + rec->datalen);
+
+    uint32_t sync = htonl(LOG_SYNC_WORD);
+    uint32_t eventnum_hi = htonl((uint32_t) (self->eventnum >> 32));
+    uint32_t eventnum_lo = htonl((uint32_t) self->eventnum);
+    uint32_t timestamp_hi = htonl((uint32_t) (rec->timestamp >> 32));
+    uint32_t timestamp_lo = htonl((uint32_t) rec->timestamp);
+    uint32_t channellen = htonl(rec->channellen);
+    uint32_t datalen = htonl(rec->datalen);
+    memcpy(p +  0, &sync, 4);
+    memcpy(p +  4, &eventnum_hi, 4);
+    memcpy(p +  8, &eventnum_lo, 4);
+    memcpy(p + 12, &timestamp_hi, 4);
+    memcpy(p + 16, &timestamp_lo, 4);
+    memcpy(p + 20, &channellen, 4);
+    memcpy(p + 24, &datalen, 4);
+    memcpy(p + LOG_EVENT_HEADER_SIZE, channel, rec->channellen);
+    memcpy(p + LOG_EVENT_HEADER_SIZE + rec->channellen, data, rec->datalen);
+
+    self->eventnum++;
+    self->events_written++;
+}
+
+static int
+_drain_ring(logger_t *self)
+{
+    int rpos = self->ring_read_pos;
+    int wpos = g_atomic_int_get(&self->ring_write_pos);
+    int n = 0;
+    while (rpos != wpos) {
+        record_t *rec = (record_t*) (self->ring + rpos);
+        if (rec->len == RING_WRAP_MARKER) {
+            rpos = 0;
+            continue;
+        }
+        _write_event(self, rec);
+        rpos += rec->len;
+
+        // hand the space back to the receive thread right away
+        g_atomic_int_set(&self->ring_read_pos, rpos);
+        n++;
+    }
+    return n;
+}
+
+static int
+_drain_overflow(logger_t *self)
+{
+    if (!g_atomic_int_get(&self->overflow_active))
+        return 0;
+
+    g_mutex_lock(self->lock);
+    GQueue *events = self->overflow;
+    self->overflow = g_queue_new();
+    g_atomic_int_set(&self->overflow_active, 0);
+    g_mutex_unlock(self->lock);
+
+    int n = 0;
+    for (record_t *rec = g_queue_pop_head(events); rec;
+            rec = g_queue_pop_head(events)) {
+        _write_event(self, rec);
+
+        g_mutex_lock(self->lock);
+        self->overflow_bytes -= rec->len;
+        g_mutex_unlock(self->lock);
+        free(rec);
+        n++;
+    }
+    g_queue_free(events);
+    return n;
+}
+
+// whether there is buffered output that an idle flush would write out.
+// With direct I/O, a partial block stays buffered until the file is closed.
+static int
+_have_unflushed_output(logger_t *self)
+{
+    if (self->block_len)
+        return 1;
+    if (self->use_direct_io)
+        return self->out_len >= DIRECT_IO_ALIGN;
+    return self->out_len > 0;
+}
+
+static int
+_have_pending_events(logger_t *self)
+{
+    return g_atomic_int_get(&self->ring_write_pos) != self->ring_read_pos ||
+        g_atomic_int_get(&self->overflow_active);
+}
+
+// blocks until the receive thread queues events, the logger quits or, if
+// there is buffered output, until it is time to write it out
+static void
+_wait_for_events(logger_t *self)
+{
+    g_mutex_lock(self->lock);
+    g_atomic_int_set(&self->writer_waiting, 1);
+    if (!_have_pending_events(self) && !g_atomic_int_get(&self->quit)) {
+        if (_have_unflushed_output(self)) {
+            GTimeVal deadline;
+            g_get_current_time(&deadline);
+            g_time_val_add(&deadline, MAX(0, self->last_write_utime +
+                        IDLE_FLUSH_USEC - _timestamp_now()));
+            g_cond_timed_wait(self->writer_cond, self->lock, &deadline);
+        } else {
+            g_cond_wait(self->writer_cond, self->lock);
+        }
+    }
+    g_atomic_int_set(&self->writer_waiting, 0);
+    g_mutex_unlock(self->lock);
+}
+
+// called by the receive thread, with lock held, after queueing an event
+static inline void
+_signal_writer(logger_t *self)
+{
+    if (g_atomic_int_get(&self->writer_waiting))
+        g_cond_signal(self->writer_cond);
+}
+
+static void *
+_writer_thread(void *user_data)
+{
+    logger_t *self = (logger_t*) user_data;
+    while (1) {
+        // the ring is always drained first.  Anything in the overflow queue
+        // arrived after everything in the ring.
+        int n = _drain_ring(self);
+        n += _drain_overflow(self);
+        if (n)
+            continue;
+
+        if (g_atomic_int_get(&self->quit)) {
+            // one last pass, in case events arrived just before quitting
+            if (!_drain_ring(self) && !_drain_overflow(self))
+                break;
+            continue;
+        }
+
+        if (_have_unflushed_output(self) &&
+                _timestamp_now() - self->last_write_utime >= IDLE_FLUSH_USEC) {
+            _compress_block(self);
+            _flush_output(self, 0);
+        }
+        _wait_for_events(self);
+    }
+    _close_file(self);
+    return NULL;
+}
+
+// =========== receive thread ============
+
+static int
+_ring_put(logger_t *self, const record_t *rec, const char *channel,
+        const void *data)
+{
+    int len = rec->len;
+    int wpos = self->ring_write_pos;
+    int rpos = g_atomic_int_get(&self->ring_read_pos);
+    int pos;
+
+    // the writer position never gets within RING_ALIGN bytes of the end of
+    // the ring, so that there is always room for a wrap marker
+    if (wpos >= rpos) {
+        if (self->ring_size - wpos - len >= RING_ALIGN) {
+            pos = wpos;
+        } else if (len < rpos) {
+            ((record_t*) (self->ring + wpos))->len = RING_WRAP_MARKER;
+            pos = 0;
+        } else {
+            return -1;
+        }
+    } else if (len < rpos - wpos) {
+        pos = wpos;
+    } else {
+        return -1;
+    }
+
+    uint8_t *p = self->ring + pos;
+    memcpy(p, rec, sizeof(record_t));
+    memcpy(p + sizeof(record_t), channel, rec->channellen);
+    memcpy(p + sizeof(record_t) + rec->channellen, data, rec->datalen);
+    g_atomic_int_set(&self->ring_write_pos, pos + len);
+    return 0;
+}
+
+static int
+_is_channel_selected(logger_t *self, const char *channel)
+{
+    gpointer value = g_hash_table_lookup(self->channel_selected, channel);
+    if (value)
+        return GPOINTER_TO_INT(value) > 0;
+
+    int regmatch = regexec(&self->preg, channel, 0, NULL, 0);
+    int selected = (regmatch == 0 && !self->invert_regex) ||
+                   (regmatch != 0 && self->invert_regex);
+    g_hash_table_insert(self->channel_selected, g_strdup(channel),
+            GINT_TO_POINTER(selected ? 1 : -1));
+    return selected;
+}
+
+static void
+on_message(const lcm_recv_buf_t *rbuf, const char *channel, void *user_data)
+{
+    logger_t *self = (logger_t*) user_data;
+    if (!_is_channel_selected(self, channel))
+        return;
+
+    record_t rec;
+    rec.channellen = strlen(channel);
+    rec.datalen = rbuf->data_size;
+    rec.len = ALIGN_UP(sizeof(record_t) + rec.channellen + rec.datalen,
+            RING_ALIGN);
+    rec.reserved = 0;
+    rec.timestamp = rbuf->recv_utime;
+    self->events_received++;
+
+    if (!g_atomic_int_get(&self->overflow_active) &&
+            !_ring_put(self, &rec, channel, rbuf->data)) {
+        // the writer sets writer_waiting before checking the ring, and the
+        // ring was updated before checking writer_waiting, so at least one
+        // of the two sees the other.  Only take the lock to wake it up.
+        if (g_atomic_int_get(&self->writer_waiting)) {
+            g_mutex_lock(self->lock);
+            _signal_writer(self);
+            g_mutex_unlock(self->lock);
+        }
+        return;
+    }
+
+    // the writer is falling behind.  Queue the event on the heap rather
+    // than drop it, up to the backlog limit.
+    g_mutex_lock(self->lock);
+    if (self->overflow_bytes + rec.len > self->max_backlog_bytes) {
+        self->events_dropped++;
+    } else {
+        record_t *copy = (record_t*) malloc(rec.len);
+        memcpy(copy, &rec, sizeof(record_t));
+        memcpy(copy + 1, channel, rec.channellen);
+        memcpy((uint8_t*) (copy + 1) + rec.channellen, rbuf->data,
+                rec.datalen);
+        g_queue_push_tail(self->overflow, copy);
+        self->overflow_bytes += rec.len;
+        g_atomic_int_set(&self->overflow_active, 1);
+        _signal_writer(self);
+    }
+    g_mutex_unlock(self->lock);
+}
+
+static void
+_publish_stats(logger_t *self, const char *channel)
+{
+    int rpos = g_atomic_int_get(&self->ring_read_pos);
+    int wpos = g_atomic_int_get(&self->ring_write_pos);
+    int64_t ring_bytes = (wpos >= rpos) ? wpos - rpos :
+        self->ring_size - rpos + wpos;
+
+    lcm_logger_stats_t msg;
+    msg.utime = _timestamp_now();
+
+    g_mutex_lock(self->lock);
+    msg.filename = g_strdup(self->cur_fname ? self->cur_fname : "");
+    msg.file_index = self->file_index;
+    msg.backlog_bytes = ring_bytes + self->overflow_bytes;
+    g_mutex_unlock(self->lock);
+
+    if (msg.backlog_bytes > self->max_backlog_seen)
+        self->max_backlog_seen = msg.backlog_bytes;
+
+    msg.events_received = self->events_received;
+    msg.events_written = self->events_written;
+    msg.events_dropped = self->events_dropped;
+    msg.bytes_written = self->bytes_written;
+    msg.write_errors = self->write_errors;
+    msg.max_backlog_bytes = self->max_backlog_seen;
+
+    lcm_logger_stats_t_publish(self->lcm, channel, &msg);
+
+    if (self->verbose)
+        printf("%s: %"PRId64" events, %.1f MB written, %"PRId64" dropped, "
+                "backlog %.1f MB\n", msg.filename, msg.events_written,
+                msg.bytes_written * 1e-6, msg.events_dropped,
+                msg.backlog_bytes * 1e-6);
+    g_free(msg.filename);
+}
+
+static void
+usage()
+{
+    printf("usage: bot-lcm-logger [OPTIONS] <logfile>\n"
+           "\n"
+           "Logs LCM traffic to a logfile.  Messages are received and written\n"
+           "to disk by separate threads, so that disk stalls are absorbed by an\n"
+           "in-memory backlog instead of causing messages to be dropped.\n"
+           "\n"
+           "Options:\n"
+           "  -h          prints this help text and exits\n"
+           "  -c CHAN     POSIX regular expression.  Only channels matching this\n"
+           "              expression are logged.  Defaults to .* if left\n"
+           "              unspecified.\n"
+           "  -i          invert the regular expression CHAN, so that only channels\n"
+           "              not matching CHAN are logged.\n"
+           "  -f          overwrite existing files\n"
+           "  -l URL      LCM provider URL\n"
+           "  -z          compress the log with gzip, in independently compressed\n"
+           "              blocks.  Decompress with zcat to get a regular logfile.\n"
+           "  -Z LEVEL    compression level, 1 (fastest) to 9 (smallest).\n"
+           "              Default is 1.\n"
+           "  -k KB       size of the blocks that are compressed.  Default is %d.\n"
+           "  -d          use direct I/O (O_DIRECT), bypassing the page cache.\n"
+           "  -r MB       start a new file once the current one reaches MB\n"
+           "              megabytes.  Files are named <logfile>.00000, .00001, ...\n"
+           "  -t SEC      start a new file every SEC seconds.\n"
+           "  -b MB       size of the receive ring buffer.  Default is %d.\n"
+           "  -m MB       maximum backlog, in megabytes.  Messages are only\n"
+           "              dropped if the backlog exceeds this.  Default is %d.\n"
+           "  -s CHANNEL  channel to publish logger statistics on.  Default is\n"
+           "              %s.  Use an empty string to disable.\n"
+           "  -p SEC      statistics period, in seconds.  Default is 1.\n"
+           "  -v          verbose mode\n",
+           DEFAULT_BLOCK_KB, DEFAULT_RING_MB, DEFAULT_MAX_BACKLOG_MB,
+           DEFAULT_STATS_CHANNEL);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    char *pattern = strdup(".*");
+    char *lcm_url = NULL;
+    char *stats_channel = strdup(DEFAULT_STATS_CHANNEL);
+    double stats_period = 1;
+    int64_t ring_mb = DEFAULT_RING_MB;
+    int64_t block_kb = DEFAULT_BLOCK_KB;
+
+    logger_t *self = (logger_t*) calloc(1, sizeof(logger_t));
+    self->max_backlog_bytes = (int64_t) DEFAULT_MAX_BACKLOG_MB << 20;
+    self->compress_level = 1;
+    self->fd = -1;
+
+    char *optstring = "hc:ifl:zZ:k:dr:t:b:m:s:p:v";
+    int c;
+
+    while ((c = getopt_long (argc, argv, optstring, NULL, 0)) >= 0)
+    {
+        char *eptr = NULL;
+        switch (c) {
+            case 'c':
+                free(pattern);
+                pattern = strdup(optarg);
+                break;
+            case 'i':
+                self->invert_regex = 1;
+                break;
+            case 'f':
+                self->force = 1;
+                break;
+            case 'l':
+                lcm_url = optarg;
+                break;
+            case 'z':
+                self->compress = 1;
+                break;
+            case 'Z':
+                self->compress_level = strtol(optarg, &eptr, 10);
+                if (*eptr != 0 || self->compress_level < 1 ||
+                        self->compress_level > 9)
+                    usage();
+                break;
+            case 'k':
+                block_kb = strtol(optarg, &eptr, 10);
+                if (*eptr != 0 || block_kb <= 0)
+                    usage();
+                break;
+            case 'd':
+                self->use_direct_io = 1;
+                break;
+            case 'r':
+                self->rotate_bytes = (int64_t) (strtod(optarg, &eptr) * (1 << 20));
+                if (*eptr != 0 || self->rotate_bytes <= 0)
+                    usage();
+                break;
+            case 't':
+                self->rotate_usec = (int64_t) (strtod(optarg, &eptr) * 1000000);
+                if (*eptr != 0 || self->rotate_usec <= 0)
+                    usage();
+                break;
+            case 'b':
+                ring_mb = strtol(optarg, &eptr, 10);
+                if (*eptr != 0 || ring_mb <= 0 || ring_mb >= 2048)
+                    usage();
+                break;
+            case 'm':
+                self->max_backlog_bytes = (int64_t) strtol(optarg, &eptr, 10) << 20;
+                if (*eptr != 0 || self->max_backlog_bytes < 0)
+                    usage();
+                break;
+            case 's':
+                free(stats_channel);
+                stats_channel = strdup(optarg);
+                break;
+            case 'p':
+                stats_period = strtod(optarg, &eptr);
+                if (*eptr != 0 || stats_period <= 0)
+                    usage();
+                break;
+            case 'v':
+                self->verbose = 1;
+                break;
+            case 'h':
+            default:
+                usage();
+                break;
+        };
+    }
+
+    if (optind != argc - 1)
+        usage();
+    self->fname = argv[argc - 1];
+
+    if (0 != regcomp(&self->preg, pattern, REG_NOSUB | REG_EXTENDED)) {
+        fprintf(stderr, "bad regex\n");
+        exit(1);
+    }
+    self->channel_selected = g_hash_table_new_full(g_str_hash, g_str_equal,
+            g_free, NULL);
+
+    if (!g_thread_supported())
+        g_thread_init(NULL);
+
+    self->lock = g_mutex_new();
+    self->writer_cond = g_cond_new();
+    self->overflow = g_queue_new();
+    self->ring_size = ring_mb << 20;
+    self->ring = (uint8_t*) malloc(self->ring_size);
+
+    self->out_cap = ALIGN_UP(block_kb << 10, DIRECT_IO_ALIGN) * 4;
+    if (posix_memalign((void**) &self->out, DIRECT_IO_ALIGN, self->out_cap)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    if (self->compress) {
+        self->block_cap = block_kb << 10;
+        self->block = (uint8_t*) malloc(self->block_cap);
+        if (Z_OK != deflateInit2(&self->zs, self->compress_level, Z_DEFLATED,
+                    15 + 16, 8, Z_DEFAULT_STRATEGY)) {
+            fprintf(stderr, "Unable to initialize compression\n");
+            return 1;
+        }
+    }
+
+    if (_open_file(self) < 0)
+        return 1;
+
+    self->lcm = lcm_create(lcm_url);
+    if (!self->lcm) {
+        fprintf(stderr, "Couldn't initialize LCM\n");
+        return 1;
+    }
+    lcm_subscribe(self->lcm, ".*", on_message, self);
+
+    signal(SIGINT, _sig_handler);
+    signal(SIGTERM, _sig_handler);
+    signal(SIGHUP, _sig_handler);
+
+    self->writer_thread = g_thread_create(_writer_thread, self, TRUE, NULL);
+
+    int lcm_fd = lcm_get_fileno(self->lcm);
+    int64_t stats_interval = (int64_t) (stats_period * 1000000);
+    int64_t next_stats_utime = _timestamp_now() + stats_interval;
+
+    while (!_quit) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(lcm_fd, &fds);
+        struct timeval timeout = { 0, 100000 };
+        int status = select(lcm_fd + 1, &fds, NULL, NULL, &timeout);
+        if (status > 0 && FD_ISSET(lcm_fd, &fds)) {
+            if (0 != lcm_handle(self->lcm))
+                break;
+        }
+
+        int64_t now = _timestamp_now();
+        if (now >= next_stats_utime) {
+            if (strlen(stats_channel))
+                _publish_stats(self, stats_channel);
+            next_stats_utime = now + stats_interval;
+        }
+    }
+
+    g_mutex_lock(self->lock);
+    g_atomic_int_set(&self->quit, 1);
+    g_cond_signal(self->writer_cond);
+    g_mutex_unlock(self->lock);
+    g_thread_join(self->writer_thread);
+
+    if (self->verbose) {
+        printf("=====\n");
+        printf("Events received: %"PRId64"\n", self->events_received);
+        printf("Events written:  %"PRId64"\n", self->events_written);
+        printf("Events dropped:  %"PRId64"\n", self->events_dropped);
+        printf("Bytes written:   %"PRId64"\n", self->bytes_written);
+    }
+
+    lcm_destroy(self->lcm);
+    if (self->compress) {
+        deflateEnd(&self->zs);
+        free(self->block);
+    }
+    regfree(&self->preg);
+    g_hash_table_destroy(self->channel_selected);
+    g_queue_free(self->overflow);
+    g_cond_free(self->writer_cond);
+    g_mutex_free(self->lock);
+    g_free(self->cur_fname);
+    free(self->ring);
+    free(self->out);
+    free(self);
+    free(pattern);
+    free(stats_channel);
+    return 0;
+}
@@ -0,0 +1,63 @@
+/** THIS IS AN AUTOMATICALLY GENERATED FILE.  DO NOT MODIFY
+ * BY HAND!!
+ *
+ * Generated by lcm-gen
+ **/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <lcm/lcm_coretypes.h>
+#include <lcm/lcm.h>
+
+#ifndef _lcm_logger_stats_t_h
+#define _lcm_logger_stats_t_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _lcm_logger_stats_t lcm_logger_stats_t;
+struct _lcm_logger_stats_t
+{
+    int64_t    utime;
+    char*      filename;
+    int32_t    file_index;
+    int64_t    events_received;
+    int64_t    events_written;
+    int64_t    events_dropped;
+    int64_t    bytes_written;
+    int64_t    write_errors;
+    int64_t    backlog_bytes;
+    int64_t    max_backlog_bytes;
+};
+ 
+lcm_logger_stats_t   *lcm_logger_stats_t_copy(const lcm_logger_stats_t *p);
+void lcm_logger_stats_t_destroy(lcm_logger_stats_t *p);
+
+typedef struct _lcm_logger_stats_t_subscription_t lcm_logger_stats_t_subscription_t;
+typedef void(*lcm_logger_stats_t_handler_t)(const lcm_recv_buf_t *rbuf, 
+             const char *channel, const lcm_logger_stats_t *msg, void *user);
+
+int lcm_logger_stats_t_publish(lcm_t *lcm, const char *channel, const lcm_logger_stats_t *p);
+lcm_logger_stats_t_subscription_t* lcm_logger_stats_t_subscribe(lcm_t *lcm, const char *channel, lcm_logger_stats_t_handler_t f, void *userdata);
+int lcm_logger_stats_t_unsubscribe(lcm_t *lcm, lcm_logger_stats_t_subscription_t* hid);
+
+int  lcm_logger_stats_t_encode(void *buf, int offset, int maxlen, const lcm_logger_stats_t *p);
+int  lcm_logger_stats_t_decode(const void *buf, int offset, int maxlen, lcm_logger_stats_t *p);
+int  lcm_logger_stats_t_decode_cleanup(lcm_logger_stats_t *p);
+int  lcm_logger_stats_t_encoded_size(const lcm_logger_stats_t *p);
+
+// LCM support functions. Users should not call these
+int64_t __lcm_logger_stats_t_get_hash(void);
+int64_t __lcm_logger_stats_t_hash_recursive(const __lcm_hash_ptr *p);
+int     __lcm_logger_stats_t_encode_array(void *buf, int offset, int maxlen, const lcm_logger_stats_t *p, int elements);
+int     __lcm_logger_stats_t_decode_array(const void *buf, int offset, int maxlen, lcm_logger_stats_t *p, int elements);
+int     __lcm_logger_stats_t_decode_array_cleanup(lcm_logger_stats_t *p, int elements);
+int     __lcm_logger_stats_t_encoded_array_size(const lcm_logger_stats_t *p, int elements);
+int     __lcm_logger_stats_t_clone_array(const lcm_logger_stats_t *p, lcm_logger_stats_t *q, int elements);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -12,6 +12,8 @@
 
 #include <lcm/lcm.h>
 
+#include "lcm_blocklog.h"
+
 static void
 usage()
 {
@@ -19,7 +21,8 @@ usage()
             "usage: bot-lcm-logsplice [OPTIONS] <source_logfile1> <source_logfile2> [source_logfile3...] <dest_logfile>\n"
                 "\n"
                 "Splice together (filtered) channels from two or more source\n"
-                "log files, and generate a single destination log file.\n"
+                "log files, and generate a single destination log file.  Source\n"
+                "log files may be block archives written by bot-lcm-blocklog.\n"
                 "\n"
                 "Options:\n"
                 "  -h        prints this help text and exits\n"
@@ -34,10 +37,24 @@ usage()
                 "  -e END    end time.  Messages logged more than END seconds\n"
                 "            after the first message in the logfile will not be\n"
                 "            extracted.\n"
+                "  -a        write the destination logfile as a block archive\n"
                 "  -v        verbose mode. Prints a summary of channels extracted\n");
     exit(1);
 }
 
+typedef struct _channel_regex {
+    regex_t *preg;
+    int invert;
+} channel_regex_t;
+
+static int
+_want_channel(const char *channel, void *user)
+{
+    channel_regex_t *cr = (channel_regex_t*) user;
+    int regmatch = regexec(cr->preg, channel, 0, NULL, 0);
+    return (regmatch == 0 && !cr->invert) || (regmatch != 0 && cr->invert);
+}
+
 static void
 _verbose_entry_summary(gpointer key, gpointer value, gpointer user_data)
 {
@@ -55,8 +72,9 @@ main(int argc, char **argv)
     int64_t end_utime = -1;
     int have_end_utime = 0;
     int invert_regex = 0;
+    int write_archive = 0;
 
-    char *optstring = "hc:vs:e:i";
+    char *optstring = "hc:vs:e:ia";
     int c;
 
     while ((c = getopt_long(argc, argv, optstring, NULL, 0)) >= 0) {
@@ -96,6 +114,9 @@ main(int argc, char **argv)
         case 'v':
             verbose = 1;
             break;
+        case 'a':
+            write_archive = 1;
+            break;
         default:
             usage();
             break;
@@ -116,14 +137,14 @@ main(int argc, char **argv)
 
     int num_src_logs = argc - optind - 1;
     fprintf(stderr, "Splicing together %d logs\n", num_src_logs);
-    lcm_eventlog_t *src_logs[num_src_logs];
+    lcm_blocklog_t *src_logs[num_src_logs];
     for (int i = 0; i < argc - optind - 1; i++) {
         char * src_fname = argv[optind + i];
-        src_logs[i] = lcm_eventlog_create(src_fname, "r");
+        src_logs[i] = lcm_blocklog_create(src_fname, "r");
         if (!src_logs[i]) {
             perror("Unable to open source logfile");
             for (int j = 0; j < i; j++)
-                lcm_eventlog_destroy(src_logs[j]);
+                lcm_blocklog_destroy(src_logs[j]);
             regfree(&preg);
             return 1;
         }
@@ -131,11 +152,16 @@ main(int argc, char **argv)
 
     dest_fname = argv[argc - 1];
 
-    lcm_eventlog_t *dst_log = lcm_eventlog_create(dest_fname, "w");
-    if (!dst_log) {
+    lcm_eventlog_t *dst_log = NULL;
+    lcm_blocklog_t *dst_archive = NULL;
+    if (write_archive)
+        dst_archive = lcm_blocklog_create(dest_fname, "w");
+    else
+        dst_log = lcm_eventlog_create(dest_fname, "w");
+    if (!dst_log && !dst_archive) {
         perror("Unable to open destination logfile");
         for (int i = 0; i < num_src_logs; i++)
-            lcm_eventlog_destroy(src_logs[i]);
+            lcm_blocklog_destroy(src_logs[i]);
         regfree(&preg);
         return 1;
     }
@@ -147,8 +173,33 @@ main(int argc, char **argv)
     int64_t first_event_timestamp = -1;
 
     lcm_eventlog_event_t *events[num_src_logs];
-    for (int i = 0; i < num_src_logs; i++)
-        events[i] = lcm_eventlog_read_next_event(src_logs[i]);
+    for (int i = 0; i < num_src_logs; i++) {
+        events[i] = lcm_blocklog_read_next_event(src_logs[i]);
+        if (events[i] && (!have_first_event_timestamp ||
+                    events[i]->timestamp < first_event_timestamp)) {
+            first_event_timestamp = events[i]->timestamp;
+            have_first_event_timestamp = 1;
+        }
+    }
+
+    // skip the blocks of block archives that have none of the channels.
+    // Installed after the first events were read, so that -s and -e are
+    // relative to the start of the logs, whatever the channels
+    channel_regex_t channel_regex = { &preg, invert_regex };
+    for (int i = 0; i < num_src_logs && filterChannels; i++)
+        lcm_blocklog_set_channel_filter(src_logs[i], _want_channel,
+                &channel_regex);
+
+    // skip to the start time without decoding the blocks before it
+    for (int i = 0; i < num_src_logs && start_utime > 0; i++) {
+        if (!events[i] ||
+                events[i]->timestamp >= first_event_timestamp + start_utime)
+            continue;
+        lcm_eventlog_free_event(events[i]);
+        lcm_blocklog_seek_to_timestamp(src_logs[i],
+                first_event_timestamp + start_utime);
+        events[i] = lcm_blocklog_read_next_event(src_logs[i]);
+    }
     while (1) {
         lcm_eventlog_event_t *event;
         int mind = -1;
@@ -165,12 +216,7 @@ main(int argc, char **argv)
             break;
 
         event = events[mind];
-        events[mind] = lcm_eventlog_read_next_event(src_logs[mind]);
-
-        if (!have_first_event_timestamp) {
-            first_event_timestamp = event->timestamp;
-            have_first_event_timestamp = 1;
-        }
+        events[mind] = lcm_blocklog_read_next_event(src_logs[mind]);
 
         int64_t elapsed = event->timestamp - first_event_timestamp;
         if (elapsed < start_utime) {
@@ -189,7 +235,10 @@ main(int argc, char **argv)
                     && invert_regex);
         }
         if (copy_to_dest) {
-            lcm_eventlog_write_event(dst_log, event);
+            if (dst_log)
+                lcm_eventlog_write_event(dst_log, event);
+            else
+                lcm_blocklog_write_event(dst_archive, event);
             nwritten++;
 
             if (verbose) {
@@ -215,8 +264,11 @@ main(int argc, char **argv)
 
     regfree(&preg);
     for (int i = 0; i < num_src_logs; i++)
-        lcm_eventlog_destroy(src_logs[i]);
-    lcm_eventlog_destroy(dst_log);
+        lcm_blocklog_destroy(src_logs[i]);
+    if (dst_log)
+        lcm_eventlog_destroy(dst_log);
+    else
+        lcm_blocklog_destroy(dst_archive);
     g_hash_table_destroy(counts);
     return 0;
 }
@@ -3,10 +3,16 @@
 #include <unistd.h>
 #include <inttypes.h>
 #include <getopt.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <netdb.h>
 #include <assert.h>
 #include <signal.h>
 
@@ -52,16 +58,119 @@ static int _fileutils_write_fully(int fd, const void *b, int len)
   return cnt;
 }
 
+// writes all of the data in iov, advancing iov past partial writes
+static int _fileutils_writev_fully(int fd, struct iovec *iov, int iovcnt)
+{
+  int cnt = 0;
+  while (iovcnt > 0) {
+    int thiscnt = writev(fd, iov, iovcnt);
+    if (thiscnt < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("writev");
+      return -1;
+    }
+    cnt += thiscnt;
+    while (iovcnt > 0 && thiscnt >= (int) iov->iov_len) {
+      thiscnt -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (uint8_t *) iov->iov_base + thiscnt;
+      iov->iov_len -= thiscnt;
+    }
+  }
+  return cnt;
+}
+
+static void _set_tcp_cork(int fd, int cork)
+{
+#ifdef TCP_CORK
+  setsockopt(fd, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork));
+#endif
+}
+
+// resolves a host name or dotted IPv4 address.  Returns 0 on success
+static int _resolve_ipv4(const char *host, struct in_addr *addr)
+{
+  struct hostent *h = gethostbyname(host);
+  if (h == NULL || h->h_addrtype != AF_INET) {
+    fprintf(stderr, "Couldn't resolve %s\n", host);
+    return -1;
+  }
+  memcpy(addr, h->h_addr_list[0], sizeof(struct in_addr));
+  return 0;
+}
+
+// allocates a UDP socket bound to addr, and stores the port it got in port.
+// Returns the socket, or -1 on error
+static int _udp_socket_bind(struct in_addr addr, int32_t *port)
+{
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    perror("allocating UDP socket");
+    return -1;
+  }
+
+  struct sockaddr_in udp_addr;
+  socklen_t udp_addr_len = sizeof(udp_addr);
+  memset(&udp_addr, 0, sizeof(udp_addr));
+  udp_addr.sin_family = AF_INET;
+  udp_addr.sin_addr = addr;
+  udp_addr.sin_port = 0;
+  if (bind(fd, (struct sockaddr*) &udp_addr, sizeof(udp_addr)) < 0) {
+    perror("binding UDP socket");
+    close(fd);
+    return -1;
+  }
+
+  getsockname(fd, (struct sockaddr*) &udp_addr, &udp_addr_len);
+  *port = ntohs(udp_addr.sin_port);
+  return fd;
+}
+
+// a - b for sequence numbers that wrap around at SEQNO_WRAP_VAL
+static inline int _seqno_diff(int32_t a, int32_t b)
+{
+  int d = a - b;
+  if (d > SEQNO_WRAP_VAL / 2)
+    d -= SEQNO_WRAP_VAL;
+  else if (d < -SEQNO_WRAP_VAL / 2)
+    d += SEQNO_WRAP_VAL;
+  return d;
+}
+
+// reads a big-endian field size, which may be at any offset of the receive
+// buffer
+static inline int _read_field_size(const char *data)
+{
+  uint32_t v;
+  memcpy(&v, data, sizeof(v));
+  return ntohl(v);
+}
+
 LcmTunnel::LcmTunnel(bool verbose, const char *lcm_channel) :
-  verbose(verbose), regex(NULL), buf_sz(65536), buf((char*) calloc(65536, sizeof(char))), channel_sz(65536), channel(
-      (char*) calloc(65536, sizeof(char))), recFlags_sz(1024), recFlags((char*) calloc(1024, sizeof(char))), ldpc_dec(
-      NULL), udp_fd(-1), server_udp_port(-1), udp_send_seqno(0), stopSendThread(false), bytesInQueue(0), cur_seqno(0),
-      errorStartTime(-1), numSuccessful(0), lastErrorPrintTime(-1)
+  verbose(verbose), regex(NULL), tunnel_params(NULL), tcp_sock(NULL), tcp_ioc(NULL), tcp_sid(0),
+      recv_buf((char*) malloc(TCP_RECV_BUF_SIZE)), recv_buf_sz(TCP_RECV_BUF_SIZE), recv_start(0), recv_end(0),
+      stopSendThread(false), bytesInQueue(0), flushImmediately(false), sendPaused(true), sendInProgress(false),
+      sendFailed(false), session_id(0), send_msg_seqno(0), recv_msg_seqno(0), peer_acked(0), bytesInReplay(0),
+      session_sid(0), last_recv_utime(0), detached(false), detach_utime(0), request_params(NULL), reconnect_fd(-1),
+      reconnect_ioc(NULL), reconnect_sid(0), reconnect_utime(0), channel((char*) calloc(65536, sizeof(char))),
+      channel_sz(65536), udp_fd(-1), server_udp_port(-1), udp_send_seqno(0), cur_seqno(-1), path_stats_sid(0),
+      last_path_stats_utime(-1), probe_path(-1), next_probe_path(0), path_phase_reports(PATH_PROBE_REPORTS),
+      path_phase_time(0), probe_saved_weight(0), probe_share_gain(1), probe_base_goodput(0), errorStartTime(-1), lastErrorPrintTime(-1), numSuccessful(0), subscription(NULL)
 {
   //allocate and initialize things
 
   init_regex(lcm_channel);
 
+  memset(recvMsgs, 0, sizeof(recvMsgs));
+  for (int i = 0; i < UDP_RECV_WINDOW; i++)
+    recvMsgs[i].seqno = -1;
+  udpPathsLock = g_mutex_new();
+  memset(&reconnect_addr, 0, sizeof(reconnect_addr));
+
   //sendThread stuff
   sendQueueLock = g_mutex_new();
   sendQueueCond = g_cond_new();
@@ -111,8 +220,18 @@ LcmTunnel::~LcmTunnel()
     delete sendQueue.front();
     sendQueue.pop_front();
   }
+  while (!replayQueue.empty()) {
+    delete replayQueue.front();
+    replayQueue.pop_front();
+  }
   g_mutex_unlock(sendQueueLock);
 
+  if (session_sid > 0)
+    g_source_remove(session_sid);
+  stopReconnect();
+  if (request_params != NULL)
+    lcm_tunnel_params_t_destroy(request_params);
+
   g_mutex_free(sendQueueLock);
   g_cond_free(sendQueueCond);
 
@@ -124,13 +243,31 @@ LcmTunnel::~LcmTunnel()
     int msg_sz = lcm_tunnel_disconnect_msg_t_encoded_size(&disc_msg);
     uint8_t msg_buf[msg_sz];
     lcm_tunnel_disconnect_msg_t_encode(msg_buf, 0, msg_sz, &disc_msg);
-    send(udp_fd, msg_buf, msg_sz, 0);
+    if (udp_paths.empty()) {
+      send(udp_fd, msg_buf, msg_sz, 0);
 
-    //close UDP socket
-    close(udp_fd);
-    g_io_channel_unref(udp_ioc);
-    g_source_remove(udp_sid);
+      //close UDP socket
+      close(udp_fd);
+      g_io_channel_unref(udp_ioc);
+      g_source_remove(udp_sid);
+    }
   }
+  //close the UDP sockets of a bonded tunnel
+  for (size_t i = 0; i < udp_paths.size(); i++) {
+    lcm_tunnel_disconnect_msg_t disc_msg;
+    disc_msg.utime = _timestamp_now();
+    int msg_sz = lcm_tunnel_disconnect_msg_t_encoded_size(&disc_msg);
+    uint8_t msg_buf[msg_sz];
+    lcm_tunnel_disconnect_msg_t_encode(msg_buf, 0, msg_sz, &disc_msg);
+    send(udp_paths[i].fd, msg_buf, msg_sz, 0);
+
+    close(udp_paths[i].fd);
+    g_io_channel_unref(udp_paths[i].ioc);
+    g_source_remove(udp_paths[i].sid);
+  }
+  if (path_stats_sid > 0)
+    g_source_remove(path_stats_sid);
+  g_mutex_free(udpPathsLock);
 
   //close TCP socket
   closeTCPSocket();
@@ -138,13 +275,16 @@ LcmTunnel::~LcmTunnel()
   if (regex != NULL)
     g_regex_unref(regex);
 
-  free(buf);
+  free(recv_buf);
   free(channel);
-  free(recFlags);
   free(tunnel_params);
 
-  if (ldpc_dec != NULL)
-    delete ldpc_dec;
+  for (int i = 0; i < UDP_RECV_WINDOW; i++) {
+    free(recvMsgs[i].buf);
+    free(recvMsgs[i].recFlags);
+    if (recvMsgs[i].ldpc_dec != NULL)
+      delete recvMsgs[i].ldpc_dec;
+  }
 
 }
 
@@ -159,7 +299,7 @@ void LcmTunnel::closeTCPSocket()
   tcp_ioc = NULL;
   if (tcp_sid > 0)
     g_source_remove(tcp_sid);
-  tcp_sid = -1;
+  tcp_sid = 0;
 }
 
 int LcmTunnel::connectToClient(lcm_t * lcm_, introspect_t *introspect_, GMainLoop * mainloop_, ssocket_t * sock_,
@@ -171,6 +311,8 @@ int LcmTunnel::connectToClient(lcm_t * lcm_, introspect_t *introspect_, GMainLoo
   introspect = introspect_;
   mainloop = mainloop_;
   tcp_sock = sock_;
+  //messages are batched before they are written, so Nagle only adds latency
+  ssocket_disable_nagle(tcp_sock);
 
   struct sockaddr_in client_addr;
   socklen_t addrlen = sizeof(client_addr);
@@ -183,14 +325,14 @@ int LcmTunnel::connectToClient(lcm_t * lcm_, introspect_t *introspect_, GMainLoo
   tcp_sid = g_io_add_watch(tcp_ioc, G_IO_IN, on_tcp_data, this);
 
   bytes_to_read = 4;
-  bytes_read = 0;
   tunnel_state = CLIENT_MSG_SZ; //we're waiting for the client connect message
 
   return 1;
 }
 
 int LcmTunnel::connectToServer(lcm_t * lcm_, introspect_t *introspect_, GMainLoop * mainloop_, char * server_addr_str,
-    int port, char * channels_to_recv, lcm_tunnel_params_t * tunnel_params_, tunnel_server_params_t * server_params_)
+    int port, char * channels_to_recv, lcm_tunnel_params_t * tunnel_params_, tunnel_server_params_t * server_params_,
+    char ** path_remote_addrs)
 { //for a client that should initiate a connection with a server
 
   tunnel_params = lcm_tunnel_params_t_copy(tunnel_params_);
@@ -199,7 +341,30 @@ int LcmTunnel::connectToServer(lcm_t * lcm_, introspect_t *introspect_, GMainLoo
   introspect = introspect_;
   mainloop = mainloop_;
 
-  if (tunnel_params->udp) {
+  if (tunnel_params->udp && tunnel_params->num_paths > 0) {
+    // bonded mode: one UDP socket bound to each of the local addresses
+    struct in_addr server_in_addr;
+    if (_resolve_ipv4(server_addr_str, &server_in_addr) < 0)
+      return 0;
+    struct in_addr local_addrs[MAX_UDP_PATHS];
+    for (int i = 0; i < tunnel_params->num_paths; i++) {
+      if (_resolve_ipv4(tunnel_params->path_addrs[i], &local_addrs[i]) < 0)
+        return 0;
+      //send the resolved address to the server
+      free(tunnel_params->path_addrs[i]);
+      tunnel_params->path_addrs[i] = strdup(inet_ntoa(local_addrs[i]));
+    }
+    if (!initUdpPaths(tunnel_params->num_paths, local_addrs, tunnel_params->path_ports))
+      return 0;
+    for (int i = 0; i < tunnel_params->num_paths; i++) {
+      udp_paths[i].remote_addr = server_in_addr;
+      if (path_remote_addrs != NULL && path_remote_addrs[i] != NULL && _resolve_ipv4(path_remote_addrs[i],
+          &udp_paths[i].remote_addr) < 0)
+        return 0;
+    }
+    tunnel_params->udp_port = tunnel_params->path_ports[0];
+  }
+  else if (tunnel_params->udp) {
     // allocate UDP socket
     udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
     if (udp_fd < 0) {
@@ -235,6 +400,7 @@ int LcmTunnel::connectToServer(lcm_t * lcm_, introspect_t *introspect_, GMainLoo
     perror("connecting");
     return 0;
   }
+  ssocket_disable_nagle(tcp_sock);
   tcp_ioc = g_io_channel_unix_new(ssocket_get_fd(tcp_sock));
   tcp_sid = g_io_add_watch(tcp_ioc, G_IO_IN, on_tcp_data, this);
 
@@ -245,42 +411,26 @@ int LcmTunnel::connectToServer(lcm_t * lcm_, introspect_t *introspect_, GMainLoo
   uint32_t server_port = ntohs(server_addr.sin_port);
   snprintf(name, sizeof(name), "%s:%d", inet_ntoa(server_addr.sin_addr), server_port);
   fprintf(stderr, "Connected to %s\n", name);
+  reconnect_addr = server_addr;
 
   // transmit subscription information
-  lcm_tunnel_params_t * tun_params_to_send = lcm_tunnel_params_t_copy(tunnel_params);
+  request_params = lcm_tunnel_params_t_copy(tunnel_params);
   //put the channels the server should send in the params we're sending it.
-  free(tun_params_to_send->channels);
-  tun_params_to_send->channels = strdup(channels_to_recv);
-  int msg_sz = lcm_tunnel_params_t_encoded_size(tun_params_to_send);
-  uint8_t * msg = (uint8_t *) calloc(msg_sz, sizeof(uint8_t));
-  lcm_tunnel_params_t_encode(msg, 0, msg_sz, tun_params_to_send);
-  uint32_t msg_sz_n = htonl(msg_sz);
-  if (4 != _fileutils_write_fully(ssocket_get_fd(tcp_sock), &msg_sz_n, 4)) {
-    perror("sending subscription data");
-    ssocket_destroy(tcp_sock);
-    free(msg);
-    lcm_tunnel_params_t_destroy(tun_params_to_send);
-    return 0;
-  }
-  if (msg_sz != _fileutils_write_fully(ssocket_get_fd(tcp_sock), msg, msg_sz)) {
-    perror("sending subscription data");
-    ssocket_destroy(tcp_sock);
-    free(msg);
-    lcm_tunnel_params_t_destroy(tun_params_to_send);
+  free(request_params->channels);
+  request_params->channels = strdup(channels_to_recv);
+  request_params->session_id = 0;
+  request_params->resume_seqno = 0;
+  if (!sendParams(request_params)) {
+    closeTCPSocket();
     return 0;
   }
-  lcm_tunnel_params_t_destroy(tun_params_to_send);
-  free(msg);
 
   //set state for tcp receptions
   bytes_to_read = 4;
-  bytes_read = 0;
-  if (tunnel_params->udp) {
-    tunnel_state = SERVER_MSG_SZ; //wait for udp port from server
-  }
-  else {
-    tunnel_state = RECV_CHAN_SZ;
-    //subscribe to the channels we want to send out
+  tunnel_state = SERVER_MSG_SZ; //wait for udp port or session from server
+  if (!tunnel_params->udp) {
+    //subscribe to the channels we want to send out.  Messages are queued until
+    //the server replies.
     //only subscribe if we're doing TCP, since UDP socket hasn't been setup yet
     subscription = lcm_subscribe(lcm, tunnel_params->channels, on_lcm_message, this);
 
@@ -288,13 +438,13 @@ int LcmTunnel::connectToServer(lcm_t * lcm_, introspect_t *introspect_, GMainLoo
   return 1;
 }
 
-int LcmTunnel::publishLcmMessagesInBuf(int numBytes)
+int LcmTunnel::publishLcmMessagesInBuf(const char * msgBuf, int numBytes)
 {
   uint32_t msgOffset = 0;
   while (msgOffset < numBytes) {
     //decode
     lcm_tunnel_sub_msg_t p;
-    msgOffset += lcm_tunnel_sub_msg_t_decode(buf, msgOffset, numBytes - msgOffset, &p);
+    msgOffset += lcm_tunnel_sub_msg_t_decode(msgBuf, msgOffset, numBytes - msgOffset, &p);
     // and publish
     LcmTunnelServer::check_and_send_to_tunnels(p.channel, p.data, p.data_size, this);
     lcm_publish(lcm, p.channel, p.data, p.data_size);
@@ -312,7 +462,8 @@ int LcmTunnel::on_udp_data(GIOChannel * source, GIOCondition cond, void *user_da
 
   uint8_t recv_buffer[65535];
 
-  int recv_status = recv(self->udp_fd, recv_buffer, 65535, 0);
+  int fd = g_io_channel_unix_get_fd(source);
+  int recv_status = recv(fd, recv_buffer, 65535, 0);
 
   if (recv_status < 0) {
     perror("recv error: ");
@@ -320,178 +471,257 @@ int LcmTunnel::on_udp_data(GIOChannel * source, GIOCondition cond, void *user_da
     //    LcmTunnelServer::disconnectClient(self);
   }
 
-  lcm_tunnel_udp_msg_t * recv_udp_msg = (lcm_tunnel_udp_msg_t *) calloc(1, sizeof(lcm_tunnel_udp_msg_t));
-  int decode_ret = lcm_tunnel_udp_msg_t_decode(recv_buffer, 0, recv_status, recv_udp_msg);
-  if (decode_ret < 0) {
-    lcm_tunnel_disconnect_msg_t disc_msg;
-    decode_ret = lcm_tunnel_disconnect_msg_t_decode(recv_buffer, 0, recv_status, &disc_msg);
-    if (decode_ret >= 0) {
-      fprintf(stderr, "Received a disconnect message... disconnecting!\n");
-      LcmTunnelServer::disconnectClient(self);
-    }
-    else {
-      fprintf(stderr, "Received Corrupted UDP packet!\n");
+  lcm_tunnel_udp_msg_t recv_udp_msg;
+  if (lcm_tunnel_udp_msg_t_decode(recv_buffer, 0, recv_status, &recv_udp_msg) >= 0) {
+    //count what arrives on each path, for the path statistics
+    for (size_t i = 0; i < self->udp_paths.size(); i++) {
+      if (self->udp_paths[i].fd == fd) {
+        self->udp_paths[i].frags_received++;
+        self->udp_paths[i].bytes_received += recv_status;
+        break;
+      }
     }
+    self->handleUdpFragment(&recv_udp_msg);
+    lcm_tunnel_udp_msg_t_decode_cleanup(&recv_udp_msg);
+    return TRUE;
+  }
 
+  lcm_tunnel_path_stats_t path_stats;
+  if (lcm_tunnel_path_stats_t_decode(recv_buffer, 0, recv_status, &path_stats) >= 0) {
+    self->handlePathStats(&path_stats);
+    lcm_tunnel_path_stats_t_decode_cleanup(&path_stats);
+    return TRUE;
   }
 
-  //  printf("received: %d, %d / %d\n", recv_udp_msg->seqno, recv_udp_msg->fragment, recv_udp_msg->nfrags);
+  lcm_tunnel_disconnect_msg_t disc_msg;
+  if (lcm_tunnel_disconnect_msg_t_decode(recv_buffer, 0, recv_status, &disc_msg) >= 0) {
+    fprintf(stderr, "Received a disconnect message... disconnecting!\n");
+    //this deletes self, and removes this watch
+    LcmTunnelServer::disconnectClient(self);
+    return FALSE;
+  }
 
+  fprintf(stderr, "Received Corrupted UDP packet!\n");
+  return TRUE;
+}
 
-  if (self->verbose, recv_udp_msg->seqno < self->cur_seqno) {
-    printf("Got Out of order packet!\n");
+void LcmTunnel::startRecvMessage(udp_recv_msg_t * rmsg, int32_t seqno, int32_t payload_size)
+{
+  rmsg->seqno = seqno;
+  rmsg->nfrags = getNumFragments(payload_size);
+  rmsg->numFragsRec = 0;
+  //increase the recFlags buffers
+  if (rmsg->recFlags_sz < rmsg->nfrags) {
+    rmsg->recFlags_sz = rmsg->nfrags;
+    rmsg->recFlags = (char *) realloc(rmsg->recFlags, rmsg->recFlags_sz);
   }
+  memset(rmsg->recFlags, 0, rmsg->recFlags_sz); //mark all frags as unreceived
+  rmsg->completeTo_fragno = 0;
 
-  // start of a new message?
-  if (recv_udp_msg->seqno > self->cur_seqno || recv_udp_msg->seqno < (int32_t) self->cur_seqno - SEQNO_WRAP_GAP) { //handle wrap-around with second part
-    if (!self->message_complete && self->cur_seqno > 0 || recv_udp_msg->seqno > (self->cur_seqno + 1)) {
-      printf("packets %d to %d dropped! with %d of %d fragments received, ", self->cur_seqno, recv_udp_msg->seqno - 1,
-          self->numFragsRec, self->nfrags);
-      if (self->tunnel_params->fec > 1 && self->nfrags >= MIN_NUM_FRAGMENTS_FOR_FEC) {
-        printf("was FECed\n");
-      }
-      else
-        printf("not FECed\n");
-    }
-    self->cur_seqno = recv_udp_msg->seqno;
-    self->nfrags = getNumFragments(recv_udp_msg->payload_size);
-    self->numFragsRec = 0;
-    //increase the recFlags buffers
-    if (self->recFlags_sz < self->nfrags) {
-      self->recFlags_sz = self->nfrags;
-      self->recFlags = (char *) realloc(self->recFlags, self->recFlags_sz);
-    }
-    memset(self->recFlags, 0, self->recFlags_sz); //mark all frags as unreceived
-    self->completeTo_fragno = 0;
-    self->fragment_buf_offset = 0;
-
-    int messageSize = recv_udp_msg->payload_size;
-    // increase buffer size if needed, also make enough space for the channel in case we're using FEC
-    if (self->buf_sz < messageSize) {
-      self->buf = (char *) realloc(self->buf, messageSize);
-      self->buf_sz = messageSize;
-    }
+  // increase buffer size if needed
+  if (rmsg->buf_sz < payload_size) {
+    rmsg->buf = (char *) realloc(rmsg->buf, payload_size);
+    rmsg->buf_sz = payload_size;
+  }
 
-    //create a new FEC decoder
-    if (self->ldpc_dec != NULL) {
-      delete self->ldpc_dec; //delete the old one if we haven't already
-      self->ldpc_dec = NULL;
-    }
-    if (self->tunnel_params->fec > 1 && self->nfrags >= MIN_NUM_FRAGMENTS_FOR_FEC) {
-      //allocate the new one
-      self->ldpc_dec = new ldpc_dec_wrapper(messageSize, MAX_PAYLOAD_BYTES_PER_FRAGMENT, self->tunnel_params->fec);
+  //create a new FEC decoder
+  if (rmsg->ldpc_dec != NULL) {
+    delete rmsg->ldpc_dec; //delete the old one if we haven't already
+    rmsg->ldpc_dec = NULL;
+  }
+  if (tunnel_params->fec >= 1 && rmsg->nfrags >= MIN_NUM_FRAGMENTS_FOR_FEC) {
+    //allocate the new one
+    rmsg->ldpc_dec = new ldpc_dec_wrapper(payload_size, MAX_PAYLOAD_BYTES_PER_FRAGMENT, tunnel_params->fec);
+  }
+  rmsg->message_complete = 0;
+}
+
+// adds a received fragment to the message it belongs to, and publishes the
+// message once it is complete.  Fragments of the last UDP_RECV_WINDOW messages
+// are accepted, since with several paths they don't arrive in order.
+void LcmTunnel::handleUdpFragment(lcm_tunnel_udp_msg_t * recv_udp_msg)
+{
+  int32_t seqno = recv_udp_msg->seqno;
+  if (seqno < 0 || seqno >= SEQNO_WRAP_VAL) {
+    fprintf(stderr, "Received UDP packet with invalid seqno %d\n", seqno);
+    return;
+  }
+
+  if (cur_seqno < 0) {
+    //first message: mark the ones before it as complete, so that they aren't
+    //reported as dropped
+    for (int i = 1; i < UDP_RECV_WINDOW; i++) {
+      int32_t prev_seqno = (seqno - i + SEQNO_WRAP_VAL) % SEQNO_WRAP_VAL;
+      recvMsgs[prev_seqno % UDP_RECV_WINDOW].seqno = prev_seqno;
+      recvMsgs[prev_seqno % UDP_RECV_WINDOW].message_complete = 1;
     }
-    self->message_complete = 0;
-  }
-
-  if (!self->message_complete && recv_udp_msg->seqno == self->cur_seqno && getNumFragments(recv_udp_msg->payload_size)
-      == self->nfrags) {
-    self->numFragsRec++;
-    if (self->tunnel_params->fec < 1 || self->nfrags < MIN_NUM_FRAGMENTS_FOR_FEC) { //we're not using FEC for this message
-      // have we already received this fragment?
-      if (recv_udp_msg->fragno < self->nfrags && !self->recFlags[recv_udp_msg->fragno]) {
-        self->recFlags[recv_udp_msg->fragno] = 1;
-
-        //copy everything to the app->buf
-        int64_t pos_start = recv_udp_msg->fragno * MAX_PAYLOAD_BYTES_PER_FRAGMENT;
-        int64_t pos_end = MIN(recv_udp_msg->payload_size, (recv_udp_msg->fragno + 1) * MAX_PAYLOAD_BYTES_PER_FRAGMENT);
-        int64_t curPayloadSize = pos_end - pos_start;
-        assert(recv_udp_msg->data_size==curPayloadSize);
-        memcpy(self->buf + pos_start, recv_udp_msg->data, curPayloadSize);
-
-        self->message_complete = 1;
-        for (int i = self->completeTo_fragno; i < self->nfrags; i++) {
-          if (!self->recFlags[i]) {
-            self->message_complete = 0;
-            break;
-          }
-          else
-            self->completeTo_fragno = i;
-        }
+    cur_seqno = seqno;
+  }
 
-        if (self->message_complete) {
-          //publish all the lcm messages in the buffer
-          self->publishLcmMessagesInBuf(recv_udp_msg->payload_size);
-        }
+  int seqno_diff = _seqno_diff(seqno, cur_seqno);
+  if (seqno_diff <= -UDP_RECV_WINDOW) {
+    if (verbose)
+      printf("ignoring udp packet seqno=%d, it is too old\n", seqno);
+    return;
+  }
+  if (verbose && seqno_diff < 0) {
+    printf("Got Out of order packet!\n");
+  }
 
+  // start of a new message? give up on the ones that fall out of the window
+  if (seqno_diff > 0) {
+    if (seqno_diff > UDP_RECV_WINDOW)
+      printf("packets %d to %d dropped!\n", (cur_seqno + 1) % SEQNO_WRAP_VAL, (seqno - UDP_RECV_WINDOW
+          + SEQNO_WRAP_VAL) % SEQNO_WRAP_VAL);
+    for (int i = 0; i < MIN(seqno_diff, UDP_RECV_WINDOW); i++) {
+      int32_t old_seqno = (cur_seqno - UDP_RECV_WINDOW + 1 + i + SEQNO_WRAP_VAL) % SEQNO_WRAP_VAL;
+      udp_recv_msg_t * old = &recvMsgs[old_seqno % UDP_RECV_WINDOW];
+      if (old->seqno != old_seqno) {
+        printf("packet %d dropped!\n", old_seqno);
       }
-      else if (self->verbose) {
-        printf("ignoring udp packet\n");
-        //        printf("seqno: %d (%d)  fragment: %d (%d) nfrags: %d (%d)\n",
-        //                recv_udp_msg->seqno, app->cur_seqno,
-        //                recv_udp_msg->fragment, app->expected_fragno,
-        //                recv_udp_msg->nfrags, app->nfrags);
+      else if (!old->message_complete) {
+        printf("packet %d dropped! with %d of %d fragments received, ", old_seqno, old->numFragsRec, old->nfrags);
+        if (old->ldpc_dec != NULL)
+          printf("was FECed\n");
+        else
+          printf("not FECed\n");
       }
+      old->seqno = -1;
     }
-    else { //we're using FEC
-      int dec_done = self->ldpc_dec->processPacket(recv_udp_msg->data, recv_udp_msg->fragno);
-      if (dec_done != 0) {
-        if (dec_done == 1) {
-          check_ret(self->ldpc_dec->getObject((uint8_t*) self->buf));
-          //publish all the lcm messages in the buffer
-          self->publishLcmMessagesInBuf(recv_udp_msg->payload_size);
-        }
-        else {
-          fprintf(stderr, "ldpc got all the sent packets, but couldn't reconstruct... this shouldn't happen!\n");
+    cur_seqno = seqno;
+  }
+
+  udp_recv_msg_t * rmsg = &recvMsgs[seqno % UDP_RECV_WINDOW];
+  if (rmsg->seqno != seqno)
+    startRecvMessage(rmsg, seqno, recv_udp_msg->payload_size);
+
+  if (rmsg->message_complete || getNumFragments(recv_udp_msg->payload_size) != rmsg->nfrags) {
+    if (verbose && !rmsg->message_complete)
+      printf("ignoring udp packet seqno=%d, nfrag =%d, expected nfrags=%d\n", seqno, getNumFragments(
+          recv_udp_msg->payload_size), rmsg->nfrags);
+    return;
+  }
+
+  rmsg->numFragsRec++;
+  if (rmsg->ldpc_dec == NULL) { //we're not using FEC for this message
+    // have we already received this fragment?
+    if (recv_udp_msg->fragno < rmsg->nfrags && !rmsg->recFlags[recv_udp_msg->fragno]) {
+      rmsg->recFlags[recv_udp_msg->fragno] = 1;
+
+      //copy everything to the message buffer
+      int64_t pos_start = recv_udp_msg->fragno * MAX_PAYLOAD_BYTES_PER_FRAGMENT;
+      int64_t pos_end = MIN(recv_udp_msg->payload_size, (recv_udp_msg->fragno + 1) * MAX_PAYLOAD_BYTES_PER_FRAGMENT);
+      int64_t curPayloadSize = pos_end - pos_start;
+      assert(recv_udp_msg->data_size==curPayloadSize);
+      memcpy(rmsg->buf + pos_start, recv_udp_msg->data, curPayloadSize);
+
+      rmsg->message_complete = 1;
+      for (int i = rmsg->completeTo_fragno; i < rmsg->nfrags; i++) {
+        if (!rmsg->recFlags[i]) {
+          rmsg->message_complete = 0;
+          break;
         }
-        self->message_complete = 1;
-        delete self->ldpc_dec; //we're all done, so we can delete it
-        self->ldpc_dec = NULL;
+        else
+          rmsg->completeTo_fragno = i;
       }
+
+      if (rmsg->message_complete) {
+        //publish all the lcm messages in the buffer
+        publishLcmMessagesInBuf(rmsg->buf, recv_udp_msg->payload_size);
+      }
+    }
+    else if (verbose) {
+      printf("ignoring udp packet\n");
     }
   }
-  else if (self->verbose && !self->message_complete) {
-    //    if (!self->message_complete && recv_udp_msg->seqno == self->cur_seqno && recv_udp_msg->nfrags == self->nfrags) {
-    printf("ignoring udp packet seqno=%d, nfrag =%d, \t self-> seqno=%d, nfrags=%d\n", recv_udp_msg->seqno,
-        getNumFragments(recv_udp_msg->payload_size), self->cur_seqno, self->nfrags);
+  else { //we're using FEC
+    int dec_done = rmsg->ldpc_dec->processPacket(recv_udp_msg->data, recv_udp_msg->fragno);
+    if (dec_done != 0) {
+      if (dec_done == 1) {
+        check_ret(rmsg->ldpc_dec->getObject((uint8_t*) rmsg->buf));
+        //publish all the lcm messages in the buffer
+        publishLcmMessagesInBuf(rmsg->buf, recv_udp_msg->payload_size);
+      }
+      else {
+        fprintf(stderr, "ldpc got all the sent packets, but couldn't reconstruct... this shouldn't happen!\n");
+      }
+      rmsg->message_complete = 1;
+      delete rmsg->ldpc_dec; //we're all done, so we can delete it
+      rmsg->ldpc_dec = NULL;
+    }
   }
-
-  lcm_tunnel_udp_msg_t_destroy(recv_udp_msg);
-
-  return TRUE;
 }
 
 int LcmTunnel::on_tcp_data(GIOChannel * source, GIOCondition cond, void *user_data)
 {
-  int ret = TRUE;
   LcmTunnel * self = (LcmTunnel*) user_data;
 
-  // increase buffer size if needed
-  if (self->buf_sz < self->bytes_to_read) {
-    assert(self->bytes_read == 0);
-    self->buf = (char *) realloc(self->buf, self->bytes_to_read);
-    self->buf_sz = self->bytes_to_read;
+  // make room for more data: move the unparsed data to the front, and grow
+  // the buffer if the field being parsed doesn't fit
+  int unparsed = self->recv_end - self->recv_start;
+  if (self->recv_start > 0) {
+    memmove(self->recv_buf, self->recv_buf + self->recv_start, unparsed);
+    self->recv_start = 0;
+    self->recv_end = unparsed;
+  }
+  if (self->recv_buf_sz < self->bytes_to_read || self->recv_end == self->recv_buf_sz) {
+    self->recv_buf_sz = MAX(2 * self->recv_buf_sz, self->bytes_to_read);
+    self->recv_buf = (char *) realloc(self->recv_buf, self->recv_buf_sz);
   }
 
-  ssize_t nread = read(ssocket_get_fd(self->tcp_sock), self->buf + self->bytes_read, self->bytes_to_read
-      - self->bytes_read);
+  // read everything that is available, up to the size of the buffer
+  ssize_t nread = read(ssocket_get_fd(self->tcp_sock), self->recv_buf + self->recv_end, self->recv_buf_sz
+      - self->recv_end);
 
   if (nread <= 0) {
+    if (self->session_id != 0) {
+      //keep the session, so that it can be resumed on a new connection
+      if (!self->detached)
+        self->detachSession();
+      else
+        self->closeTCPSocket(); //the reconnect failed, try again later
+      return FALSE;
+    }
     perror("tcp receive error: ");
     LcmTunnelServer::disconnectClient(self);
     return FALSE;
   }
+  self->recv_end += nread;
+  self->last_recv_utime = _timestamp_now();
+
+  // handle all of the complete fields in the buffer
+  while (self->recv_end - self->recv_start >= self->bytes_to_read) {
+    const char * data = self->recv_buf + self->recv_start;
+    int len = self->bytes_to_read;
+    self->recv_start += len;
+    if (!on_tcp_field(self, data, len))
+      return FALSE;
+  }
 
-  self->bytes_read += nread;
-  assert(self->bytes_read <= self->bytes_to_read);
+  return TRUE;
+}
 
-  if (self->bytes_read != self->bytes_to_read)
-    return TRUE;
+// handles the next field of the TCP stream, which is in data.  Returns FALSE
+// if the TCP socket should no longer be watched.
+int LcmTunnel::on_tcp_field(LcmTunnel * self, const char * data, int len)
+{
+  int ret = TRUE;
 
   switch (self->tunnel_state) {
   case CLIENT_MSG_SZ:
-    self->bytes_to_read = ntohl(*(uint32_t*) self->buf);
+    self->bytes_to_read = _read_field_size(data);
     self->tunnel_state = CLIENT_MSG_DATA;
     break;
   case CLIENT_MSG_DATA:
     {
       lcm_tunnel_params_t tp_rec;
-      int decode_status = lcm_tunnel_params_t_decode(self->buf, 0, self->bytes_read, &tp_rec);
+      int decode_status = lcm_tunnel_params_t_decode(data, 0, len, &tp_rec);
       if (decode_status <= 0) {
         fprintf(stdout, "invalid request (%d)\n", decode_status);
         return FALSE;
       }
       self->tunnel_params = lcm_tunnel_params_t_copy(&tp_rec);
+      lcm_tunnel_params_t_decode_cleanup(&tp_rec);
 
       if (self->udp_fd >= 0) {
         close(self->udp_fd);
@@ -506,27 +736,66 @@ int LcmTunnel::on_tcp_data(GIOChannel * source, GIOCondition cond, void *user_da
         self->server_udp_port = ntohs(client_addr.sin_port);
         client_addr.sin_port = htons(self->tunnel_params->udp_port);
 
-        // allocate UDP socket
-        self->udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
-        if (self->udp_fd < 0) {
-          perror("allocating UDP socket");
+        lcm_tunnel_params_t tp_port_msg;
+        memset(&tp_port_msg, 0, sizeof(tp_port_msg));
+        tp_port_msg.channels = (char *) " ";
+        int32_t path_ports[MAX_UDP_PATHS];
+        char * path_addrs[MAX_UDP_PATHS];
+
+        int num_paths = self->tunnel_params->num_paths;
+        if (num_paths > MAX_UDP_PATHS) {
+          fprintf(stderr, "%s requested %d UDP paths, at most %d are supported\n", self->name, num_paths,
+              MAX_UDP_PATHS);
           LcmTunnelServer::disconnectClient(self);
           return FALSE;
         }
+        else if (num_paths > 0) {
+          //bonded mode: one UDP socket for each of the client's paths
+          struct in_addr local_addrs[MAX_UDP_PATHS];
+          for (int i = 0; i < num_paths; i++)
+            local_addrs[i].s_addr = INADDR_ANY;
+          if (!self->initUdpPaths(num_paths, local_addrs, path_ports)) {
+            LcmTunnelServer::disconnectClient(self);
+            return FALSE;
+          }
+          for (int i = 0; i < num_paths; i++) {
+            //paths without an address go to the address the client connected from
+            self->udp_paths[i].remote_addr = client_addr.sin_addr;
+            if (strlen(self->tunnel_params->path_addrs[i]) > 0)
+              inet_aton(self->tunnel_params->path_addrs[i], &self->udp_paths[i].remote_addr);
+            path_addrs[i] = (char *) "";
+          }
+          self->connectUdpPaths(self->tunnel_params->path_ports);
+          tp_port_msg.udp_port = path_ports[0];
+          tp_port_msg.num_paths = num_paths;
+          tp_port_msg.path_ports = path_ports;
+          tp_port_msg.path_addrs = path_addrs;
+        }
+        else {
+          // allocate UDP socket
+          self->udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+          if (self->udp_fd < 0) {
+            perror("allocating UDP socket");
+            LcmTunnelServer::disconnectClient(self);
+            return FALSE;
+          }
 
-        connect(self->udp_fd, (struct sockaddr*) &client_addr, sizeof(client_addr));
+          connect(self->udp_fd, (struct sockaddr*) &client_addr, sizeof(client_addr));
+
+          struct sockaddr_in udp_addr;
+          socklen_t udp_addr_len = sizeof(udp_addr);
+          memset(&udp_addr, 0, sizeof(udp_addr));
+          udp_addr.sin_family = AF_INET;
+          udp_addr.sin_addr.s_addr = INADDR_ANY;
+          udp_addr.sin_port = 0;
+          getsockname(self->udp_fd, (struct sockaddr*) &udp_addr, &udp_addr_len);
+          tp_port_msg.udp_port = ntohs(udp_addr.sin_port);
+
+          self->udp_ioc = g_io_channel_unix_new(self->udp_fd);
+          self->udp_sid = g_io_add_watch(self->udp_ioc, G_IO_IN, LcmTunnel::on_udp_data, self);
+        }
 
         // transmit the udp port info
-        struct sockaddr_in udp_addr;
-        socklen_t udp_addr_len = sizeof(udp_addr);
-        memset(&udp_addr, 0, sizeof(udp_addr));
-        udp_addr.sin_family = AF_INET;
-        udp_addr.sin_addr.s_addr = INADDR_ANY;
-        udp_addr.sin_port = 0;
-        getsockname(self->udp_fd, (struct sockaddr*) &udp_addr, &udp_addr_len);
-        lcm_tunnel_params_t tp_port_msg;
-        tp_port_msg.channels = (char *) " ";
-        tp_port_msg.udp_port = ntohs(udp_addr.sin_port);
         int msg_sz = lcm_tunnel_params_t_encoded_size(&tp_port_msg);
         uint8_t msg[msg_sz];
         lcm_tunnel_params_t_encode(msg, 0, msg_sz, &tp_port_msg);
@@ -542,13 +811,41 @@ int LcmTunnel::on_tcp_data(GIOChannel * source, GIOCondition cond, void *user_da
           return FALSE;
         }
 
-        self->udp_ioc = g_io_channel_unix_new(self->udp_fd);
-        self->udp_sid = g_io_add_watch(self->udp_ioc, G_IO_IN, LcmTunnel::on_udp_data, self);
+        self->resumeSending(0);
 
         //we're done setting up the UDP connection...Disconnect tcp socket
         self->closeTCPSocket();
         ret = false;
       }
+      else {
+        //TCP tunnel: pick up the client's session if we still have it
+        if (self->tunnel_params->session_id != 0) {
+          LcmTunnel * prev = LcmTunnelServer::findSession(self->tunnel_params->session_id);
+          if (prev != NULL) {
+            prev->takeOverSession(self, self->tunnel_params->resume_seqno);
+            //self was only needed for the handshake
+            LcmTunnelServer::clients_list.remove(self);
+            delete self;
+            return FALSE;
+          }
+          fprintf(stderr, "%s tried to resume an expired session, starting a new one\n", self->name);
+        }
+
+        int64_t id = 0;
+        while (id == 0)
+          id = ((int64_t) g_random_int() << 32) | g_random_int();
+        self->startSession(id);
+        lcm_tunnel_params_t tp_session_msg;
+        memset(&tp_session_msg, 0, sizeof(tp_session_msg));
+        tp_session_msg.channels = (char *) " ";
+        tp_session_msg.session_id = self->session_id;
+        tp_session_msg.resume_seqno = 0;
+        if (!self->sendParams(&tp_session_msg)) {
+          LcmTunnelServer::disconnectClient(self);
+          return FALSE;
+        }
+        self->resumeSending(0);
+      }
 
       //get ready to receive
       self->tunnel_state = RECV_CHAN_SZ;
@@ -557,6 +854,8 @@ int LcmTunnel::on_tcp_data(GIOChannel * source, GIOCondition cond, void *user_da
       //      if (self->server_params->verbose)
       fprintf(stderr, "%s subscribed to \"%s\" -- ", self->name, self->tunnel_params->channels);
 
+      if (self->udp_paths.size() > 0)
+        fprintf(stderr, "bonded over %d paths, ", (int) self->udp_paths.size());
       if (self->udp_fd >= 0) {
         if (self->tunnel_params->fec > 1)
           fprintf(stderr, "UDP with FEC rate of %.2f and max_delay of %dms\n", self->tunnel_params->fec,
@@ -583,25 +882,59 @@ int LcmTunnel::on_tcp_data(GIOChannel * source, GIOCondition cond, void *user_da
     }
     break;
   case SERVER_MSG_SZ:
-    self->bytes_to_read = ntohl(*(uint32_t*) self->buf);
+    self->bytes_to_read = _read_field_size(data);
     self->tunnel_state = SERVER_MSG_DATA;
     break;
   case SERVER_MSG_DATA:
     {
       lcm_tunnel_params_t tp_rec;
-      int decode_status = lcm_tunnel_params_t_decode(self->buf, 0, self->bytes_read, &tp_rec);
+      int decode_status = lcm_tunnel_params_t_decode(data, 0, len, &tp_rec);
       if (decode_status <= 0) {
         fprintf(stderr, "invalid request (%d)\n", decode_status);
         return FALSE;
       }
+      if (!self->tunnel_params->udp) {
+        //TCP tunnel: the server replies with the session it set up
+        if (self->session_id != 0 && tp_rec.session_id == self->session_id) {
+          fprintf(stderr, "Resumed the session with %s\n", self->name);
+          self->resumeSending(tp_rec.resume_seqno);
+        }
+        else {
+          if (self->session_id != 0)
+            fprintf(stderr, "%s no longer has our session, unacknowledged messages were lost\n", self->name);
+          self->startSession(tp_rec.session_id);
+          self->resumeSending(0);
+        }
+        self->detached = false;
+        lcm_tunnel_params_t_decode_cleanup(&tp_rec);
+
+        self->tunnel_state = RECV_CHAN_SZ;
+        self->bytes_to_read = 4;
+        break;
+      }
       assert(self->udp_fd>0);
-      struct sockaddr_in client_addr;
-      socklen_t addrlen = sizeof(client_addr);
-      getpeername(self->tcp_sock->socket, (struct sockaddr*) &client_addr, &addrlen);
+      if (tp_rec.num_paths != (int) self->udp_paths.size()) {
+        fprintf(stderr, "server set up %d UDP paths, but we asked for %d\n", tp_rec.num_paths,
+            (int) self->udp_paths.size());
+        lcm_tunnel_params_t_decode_cleanup(&tp_rec);
+        LcmTunnelServer::disconnectClient(self);
+        return FALSE;
+      }
+      if (tp_rec.num_paths > 0) {
+        //connect each of the bonded paths
+        self->connectUdpPaths(tp_rec.path_ports);
+      }
+      else {
+        struct sockaddr_in client_addr;
+        socklen_t addrlen = sizeof(client_addr);
+        getpeername(self->tcp_sock->socket, (struct sockaddr*) &client_addr, &addrlen);
+        client_addr.sin_port = htons(tp_rec.udp_port);
+        //connect the udp socket
+        connect(self->udp_fd, (struct sockaddr*) &client_addr, sizeof(client_addr));
+      }
       self->server_udp_port = tp_rec.udp_port;
-      client_addr.sin_port = htons(tp_rec.udp_port);
-      //connect the udp socket
-      connect(self->udp_fd, (struct sockaddr*) &client_addr, sizeof(client_addr));
+      lcm_tunnel_params_t_decode_cleanup(&tp_rec);
+      self->resumeSending(0);
 
       //now we can subscribe to LCM
       fprintf(stderr, "%s subscribed to \"%s\" \n", self->name, self->tunnel_params->channels);
@@ -613,7 +946,7 @@ int LcmTunnel::on_tcp_data(GIOChannel * source, GIOCondition cond, void *user_da
     }
     break;
   case RECV_CHAN_SZ:
-    self->bytes_to_read = ntohl(*(uint32_t*) self->buf);
+    self->bytes_to_read = _read_field_size(data);
     self->tunnel_state = RECV_CHAN;
 
     if (self->channel_sz < self->bytes_to_read + 1) {
@@ -622,32 +955,315 @@ int LcmTunnel::on_tcp_data(GIOChannel * source, GIOCondition cond, void *user_da
     }
     break;
   case RECV_CHAN:
-    memcpy(self->channel, self->buf, self->bytes_read);
-    self->channel[self->bytes_read] = 0;
+    memcpy(self->channel, data, len);
+    self->channel[len] = 0;
 
     self->bytes_to_read = 4;
     self->tunnel_state = RECV_DATA_SZ;
     break;
   case RECV_DATA_SZ:
-    self->bytes_to_read = ntohl(*(uint32_t*) self->buf);
+    self->bytes_to_read = _read_field_size(data);
     self->tunnel_state = RECV_DATA;
     break;
   case RECV_DATA:
-    if (self->verbose)
-      printf("Recieved TCP message on channel \"%s\"\n", self->channel);
-    LcmTunnelServer::check_and_send_to_tunnels(self->channel, self->buf, self->bytes_read, self);
-    lcm_publish(self->lcm, self->channel, (uint8_t*) self->buf, self->bytes_read);
+    if (self->channel[0] == '\0') {
+      //no channel: the other side acknowledging what it received
+      self->handleAck(data, len);
+    }
+    else {
+      if (self->verbose)
+        printf("Recieved TCP message on channel \"%s\"\n", self->channel);
+      LcmTunnelServer::check_and_send_to_tunnels(self->channel, data, len, self);
+      lcm_publish(self->lcm, self->channel, (const uint8_t*) data, len);
+      self->recv_msg_seqno++;
+    }
 
     self->bytes_to_read = 4;
     self->tunnel_state = RECV_CHAN_SZ;
     break;
   }
 
-  self->bytes_read = 0;
 
   return ret;
 }
 
+// sends params over the TCP socket, prefixed by their size.  Returns 0 on error
+int LcmTunnel::sendParams(lcm_tunnel_params_t * params)
+{
+  int msg_sz = lcm_tunnel_params_t_encoded_size(params);
+  uint8_t msg[msg_sz];
+  lcm_tunnel_params_t_encode(msg, 0, msg_sz, params);
+  uint32_t msg_sz_n = htonl(msg_sz);
+  if (4 != _fileutils_write_fully(ssocket_get_fd(tcp_sock), &msg_sz_n, 4) || msg_sz != _fileutils_write_fully(
+      ssocket_get_fd(tcp_sock), msg, msg_sz)) {
+    perror("sending tunnel params");
+    return 0;
+  }
+  return 1;
+}
+
+// starts a new session, dropping whatever is left of the previous one.  The
+// send thread must be paused
+void LcmTunnel::startSession(int64_t id)
+{
+  g_mutex_lock(sendQueueLock);
+  while (!replayQueue.empty()) {
+    delete replayQueue.front();
+    replayQueue.pop_front();
+  }
+  bytesInReplay = 0;
+  send_msg_seqno = 0;
+  peer_acked = 0;
+  g_mutex_unlock(sendQueueLock);
+
+  session_id = id;
+  recv_msg_seqno = 0;
+  last_recv_utime = _timestamp_now();
+  if (session_sid == 0)
+    session_sid = g_timeout_add(SESSION_ACK_INTERVAL_MS, LcmTunnel::on_session_timer, this);
+}
+
+// (re)starts the send thread, once the other side has received
+// peer_recv_seqno messages of the session.  Sent messages after that are
+// resent, ahead of the ones that were queued while the connection was down
+void LcmTunnel::resumeSending(int64_t peer_recv_seqno)
+{
+  g_mutex_lock(sendQueueLock);
+  while (!replayQueue.empty() && replayQueue.front()->seqno < peer_recv_seqno) {
+    TunnelLcmMessage * msg = replayQueue.front();
+    replayQueue.pop_front();
+    bytesInReplay -= msg->encoded_size;
+    delete msg;
+  }
+  int64_t first_seqno = replayQueue.empty() ? send_msg_seqno : replayQueue.front()->seqno;
+  if (first_seqno > peer_recv_seqno)
+    fprintf(stderr, "%" PRId64 " messages to %s were lost while the connection was down\n", first_seqno
+        - peer_recv_seqno, name);
+  while (!replayQueue.empty()) {
+    TunnelLcmMessage * msg = replayQueue.back();
+    replayQueue.pop_back();
+    bytesInQueue += msg->encoded_size;
+    sendQueue.push_front(msg);
+  }
+  bytesInReplay = 0;
+  //the resent messages are numbered from where the other side is
+  send_msg_seqno = peer_recv_seqno;
+  peer_acked = peer_recv_seqno;
+  sendPaused = false;
+  sendFailed = false;
+  g_mutex_unlock(sendQueueLock);
+  g_cond_broadcast(sendQueueCond);
+}
+
+// drops the sent messages that the other side has acknowledged.
+// sendQueueLock must be held
+void LcmTunnel::trimReplayQueue()
+{
+  while (!replayQueue.empty() && replayQueue.front()->seqno < peer_acked) {
+    TunnelLcmMessage * msg = replayQueue.front();
+    replayQueue.pop_front();
+    bytesInReplay -= msg->encoded_size;
+    delete msg;
+  }
+}
+
+// queues an acknowledgement of the messages received so far: a message with
+// no channel, and the count as a big-endian int64
+void LcmTunnel::queueAck()
+{
+  uint8_t ack[8];
+  for (int i = 0; i < 8; i++)
+    ack[i] = (recv_msg_seqno >> (56 - 8 * i)) & 0xff;
+  lcm_recv_buf_t rbuf;
+  rbuf.data = ack;
+  rbuf.data_size = sizeof(ack);
+  rbuf.recv_utime = _timestamp_now();
+  rbuf.lcm = lcm;
+
+  g_mutex_lock(sendQueueLock);
+  if (sendPaused) {
+    g_mutex_unlock(sendQueueLock);
+    return;
+  }
+  TunnelLcmMessage * ack_msg = new TunnelLcmMessage(&rbuf, "");
+  bytesInQueue += ack_msg->encoded_size;
+  sendQueue.push_back(ack_msg);
+  flushImmediately = true;
+  g_mutex_unlock(sendQueueLock);
+  g_cond_broadcast(sendQueueCond);
+}
+
+void LcmTunnel::handleAck(const char * data, int len)
+{
+  if (len != 8) {
+    fprintf(stderr, "Received invalid acknowledgement from %s\n", name);
+    return;
+  }
+  int64_t acked = 0;
+  for (int i = 0; i < 8; i++)
+    acked = (acked << 8) | (uint8_t) data[i];
+  g_mutex_lock(sendQueueLock);
+  peer_acked = MAX(peer_acked, acked);
+  g_mutex_unlock(sendQueueLock);
+}
+
+// the connection dropped: stop sending, and keep the session around until the
+// client reconnects
+void LcmTunnel::detachSession()
+{
+  fprintf(stderr, "Lost the connection to %s, %s\n", name, reconnect_addr.sin_family == AF_INET ? "reconnecting"
+      : "waiting for it to reconnect");
+
+  //stop the send thread, and wait for it to finish the write it may be in
+  g_mutex_lock(sendQueueLock);
+  sendPaused = true;
+  if (tcp_sock != NULL)
+    shutdown(ssocket_get_fd(tcp_sock), SHUT_RDWR); //so that a blocked write returns
+  while (sendInProgress)
+    g_cond_wait(sendQueueCond, sendQueueLock);
+  g_mutex_unlock(sendQueueLock);
+
+  closeTCPSocket();
+  detached = true;
+  detach_utime = _timestamp_now();
+}
+
+// server side: the client reconnected as other, move its connection over to
+// this session
+void LcmTunnel::takeOverSession(LcmTunnel * other, int64_t peer_recv_seqno)
+{
+  if (!detached)
+    detachSession(); //we hadn't noticed the old connection drop yet
+
+  tcp_sock = other->tcp_sock;
+  other->tcp_sock = NULL;
+  strcpy(name, other->name);
+  tcp_ioc = g_io_channel_unix_new(ssocket_get_fd(tcp_sock));
+  tcp_sid = g_io_add_watch(tcp_ioc, G_IO_IN, on_tcp_data, this);
+  recv_start = recv_end = 0;
+  tunnel_state = RECV_CHAN_SZ;
+  bytes_to_read = 4;
+
+  lcm_tunnel_params_t tp_session_msg;
+  memset(&tp_session_msg, 0, sizeof(tp_session_msg));
+  tp_session_msg.channels = (char *) " ";
+  tp_session_msg.session_id = session_id;
+  tp_session_msg.resume_seqno = recv_msg_seqno;
+  if (!sendParams(&tp_session_msg)) {
+    closeTCPSocket();
+    return;
+  }
+  fprintf(stderr, "Resumed the session with %s\n", name);
+  detached = false;
+  last_recv_utime = _timestamp_now();
+  resumeSending(peer_recv_seqno);
+}
+
+// client side: starts connecting to the server again, without blocking
+void LcmTunnel::startReconnect()
+{
+  reconnect_utime = _timestamp_now();
+  reconnect_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (reconnect_fd < 0) {
+    perror("allocating TCP socket");
+    return;
+  }
+  fcntl(reconnect_fd, F_SETFL, fcntl(reconnect_fd, F_GETFL) | O_NONBLOCK);
+  if (connect(reconnect_fd, (struct sockaddr*) &reconnect_addr, sizeof(reconnect_addr)) < 0 && errno != EINPROGRESS) {
+    //e.g. the network is unreachable.  Try again later
+    close(reconnect_fd);
+    reconnect_fd = -1;
+    return;
+  }
+  reconnect_ioc = g_io_channel_unix_new(reconnect_fd);
+  reconnect_sid = g_io_add_watch(reconnect_ioc, (GIOCondition) (G_IO_OUT | G_IO_ERR | G_IO_HUP), on_reconnect, this);
+}
+
+void LcmTunnel::stopReconnect()
+{
+  if (reconnect_fd < 0)
+    return;
+  g_source_remove(reconnect_sid);
+  g_io_channel_unref(reconnect_ioc);
+  close(reconnect_fd);
+  reconnect_fd = -1;
+}
+
+int LcmTunnel::on_reconnect(GIOChannel * source, GIOCondition cond, void *user_data)
+{
+  LcmTunnel * self = (LcmTunnel*) user_data;
+
+  int err = 0;
+  socklen_t err_len = sizeof(err);
+  getsockopt(self->reconnect_fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+  if (err != 0) {
+    //try again on the next session timer
+    self->stopReconnect();
+    return FALSE;
+  }
+
+  //connected, hand the socket over to the TCP handlers
+  int fd = self->reconnect_fd;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+  g_io_channel_unref(self->reconnect_ioc);
+  self->reconnect_fd = -1;
+  self->tcp_sock = ssocket_create();
+  self->tcp_sock->socket = fd;
+  ssocket_disable_nagle(self->tcp_sock);
+  self->tcp_ioc = g_io_channel_unix_new(fd);
+  self->tcp_sid = g_io_add_watch(self->tcp_ioc, G_IO_IN, on_tcp_data, self);
+  self->recv_start = self->recv_end = 0;
+  self->bytes_to_read = 4;
+  self->tunnel_state = SERVER_MSG_SZ;
+
+  //ask to resume the session
+  self->request_params->session_id = self->session_id;
+  self->request_params->resume_seqno = self->recv_msg_seqno;
+  if (!self->sendParams(self->request_params))
+    self->closeTCPSocket();
+  return FALSE;
+}
+
+// acknowledges what was received, which also lets the other side know that the
+// connection is still up.  Detects dropped connections, and reconnects
+gboolean LcmTunnel::on_session_timer(gpointer user_data)
+{
+  LcmTunnel * self = (LcmTunnel*) user_data;
+  int64_t now = _timestamp_now();
+
+  if (!self->detached) {
+    g_mutex_lock(self->sendQueueLock);
+    bool send_failed = self->sendFailed;
+    g_mutex_unlock(self->sendQueueLock);
+    if (!send_failed && now - self->last_recv_utime < SESSION_TIMEOUT_MS * 1000) {
+      self->queueAck();
+      return TRUE;
+    }
+    self->detachSession();
+  }
+
+  if (now - self->detach_utime > SESSION_GRACE_MS * 1000) {
+    fprintf(stderr, "Could not resume the session with %s\n", self->name);
+    //this deletes self, and removes this timer
+    LcmTunnelServer::disconnectClient(self);
+    return FALSE;
+  }
+
+  //only the client knows where to reconnect to
+  if (self->reconnect_addr.sin_family == AF_INET) {
+    if (self->tcp_sock == NULL && self->reconnect_fd < 0) {
+      self->startReconnect();
+    }
+    else if (now - self->reconnect_utime > SESSION_RECONNECT_TIMEOUT_MS * 1000) {
+      //the connect, or the handshake after it, is taking too long
+      self->stopReconnect();
+      self->closeTCPSocket();
+      self->startReconnect();
+    }
+  }
+  return TRUE;
+}
+
 gpointer LcmTunnel::sendThreadFunc(gpointer user_data)
 {
 
@@ -656,12 +1272,14 @@ gpointer LcmTunnel::sendThreadFunc(gpointer user_data)
   g_mutex_lock(self->sendQueueLock);
   int64_t nextFlushTime = 0;
   while (!self->stopSendThread) {
-    if (self->sendQueue.empty()) {
+    if (self->sendQueue.empty() || self->sendPaused) {
       g_cond_wait(self->sendQueueCond, self->sendQueueLock);
-      nextFlushTime = _timestamp_now() + self->tunnel_params->max_delay_ms * 1000;
+      nextFlushTime = -1;
       continue;
     }
     int64_t now = _timestamp_now();
+    if (nextFlushTime < 0)
+      nextFlushTime = now + self->tunnel_params->max_delay_ms * 1000;
     if (self->tunnel_params->max_delay_ms > 0 && self->bytesInQueue < NUM_BYTES_TO_SEND_IMMEDIATELY && nextFlushTime
         > now && !self->flushImmediately) {
       GTimeVal next_timeout;
@@ -672,12 +1290,14 @@ gpointer LcmTunnel::sendThreadFunc(gpointer user_data)
     }
     //there is stuff in the queue that we need to handle
     self->flushImmediately = false;
+    self->trimReplayQueue();
 
     //take current contents out of the queue
     std::deque<TunnelLcmMessage *> tmpQueue;
     tmpQueue.swap(self->sendQueue);
     uint32_t bytesInTmpQueue = self->bytesInQueue;
     self->bytesInQueue = 0;
+    self->sendInProgress = true;
     g_mutex_unlock(self->sendQueueLock);
     //release lock for sending
 
@@ -686,8 +1306,21 @@ gpointer LcmTunnel::sendThreadFunc(gpointer user_data)
 
     //reaquire lock to go around the loop
     g_mutex_lock(self->sendQueueLock);
-    if (!success)
-      break;
+    self->sendInProgress = false;
+    g_cond_broadcast(self->sendQueueCond);
+    if (!success) {
+      if (self->session_id == 0)
+        break;
+      //the connection dropped.  Keep what wasn't sent until the session is
+      //resumed
+      self->sendFailed = true;
+      self->sendPaused = true;
+      while (!tmpQueue.empty()) {
+        self->bytesInQueue += tmpQueue.back()->encoded_size;
+        self->sendQueue.push_front(tmpQueue.back());
+        tmpQueue.pop_back();
+      }
+    }
   }
   g_mutex_unlock(self->sendQueueLock);
 
@@ -718,8 +1351,9 @@ void LcmTunnel::send_to_remote(const lcm_recv_buf_t *rbuf, const char *lcm_chann
     bytesInQueue -= drop_msg->encoded_size;
     delete drop_msg;
   }
-  //hack to not delay time sync messages
-  flushImmediately = strcmp(lcm_channel, "TIMESYNC") == 0;
+  //hack to not delay time sync messages.  Don't clear a flush requested by
+  //an ack that is still queued.
+  flushImmediately = flushImmediately || strcmp(lcm_channel, "TIMESYNC") == 0;
   g_mutex_unlock(sendQueueLock);
   g_cond_broadcast(sendQueueCond); //signal to say there is a message waiting
 }
@@ -763,6 +1397,215 @@ void LcmTunnel::checkUDPSendStatus(int send_status)
   }
 }
 
+// creates a UDP socket for each path, bound to local_addrs, and stores the
+// ports they got in ports.  Returns 0 on error
+int LcmTunnel::initUdpPaths(int num_paths, const struct in_addr * local_addrs, int32_t * ports)
+{
+  for (int i = 0; i < num_paths; i++) {
+    udp_path_t path;
+    memset(&path, 0, sizeof(path));
+    path.fd = _udp_socket_bind(local_addrs[i], &ports[i]);
+    if (path.fd < 0)
+      return 0;
+    path.weight = 1;
+    path.ioc = g_io_channel_unix_new(path.fd);
+    path.sid = g_io_add_watch(path.ioc, G_IO_IN, LcmTunnel::on_udp_data, this);
+    udp_paths.push_back(path);
+  }
+  udp_fd = udp_paths[0].fd;
+  path_stats_sid = g_timeout_add(PATH_STATS_INTERVAL_MS, LcmTunnel::on_path_stats_timer, this);
+  return 1;
+}
+
+// connects each path to its remote_addr, on the port given in remote_ports
+int LcmTunnel::connectUdpPaths(const int32_t * remote_ports)
+{
+  for (size_t i = 0; i < udp_paths.size(); i++) {
+    struct sockaddr_in remote;
+    memset(&remote, 0, sizeof(remote));
+    remote.sin_family = AF_INET;
+    remote.sin_addr = udp_paths[i].remote_addr;
+    remote.sin_port = htons(remote_ports[i]);
+    if (connect(udp_paths[i].fd, (struct sockaddr*) &remote, sizeof(remote)) < 0) {
+      perror("connecting UDP path");
+      return 0;
+    }
+    if (verbose)
+      fprintf(stderr, "UDP path %d to %s:%d\n", (int) i, inet_ntoa(remote.sin_addr), remote_ports[i]);
+  }
+  return 1;
+}
+
+// smooth weighted round robin: spreads the fragments over the paths in
+// proportion to their weights, without sending bursts down any one of them.
+// udpPathsLock must be held
+int LcmTunnel::pickUdpPath()
+{
+  double total = 0;
+  int best = 0;
+  for (size_t i = 0; i < udp_paths.size(); i++) {
+    udp_paths[i].current_weight += udp_paths[i].weight;
+    total += udp_paths[i].weight;
+    if (udp_paths[i].current_weight > udp_paths[best].current_weight)
+      best = i;
+  }
+  udp_paths[best].current_weight -= total;
+  return best;
+}
+
+void LcmTunnel::sendUdpPacket(const uint8_t * msg_buf, int msg_sz)
+{
+  int fd = udp_fd;
+  if (!udp_paths.empty()) {
+    g_mutex_lock(udpPathsLock);
+    int path = pickUdpPath();
+    udp_paths[path].frags_sent++;
+    fd = udp_paths[path].fd;
+    g_mutex_unlock(udpPathsLock);
+  }
+  //  printf("sending %d bytes on fd %d\n", msg_sz, fd);
+  int send_status = send(fd, msg_buf, msg_sz, 0);
+  checkUDPSendStatus(send_status);
+}
+
+// updates the loss and goodput estimates of each path from the counts the
+// other side received, and reweights the paths
+void LcmTunnel::handlePathStats(const lcm_tunnel_path_stats_t * stats)
+{
+  if (stats->num_paths != (int) udp_paths.size()) {
+    fprintf(stderr, "Received statistics for %d paths, but there are %d\n", stats->num_paths,
+        (int) udp_paths.size());
+    return;
+  }
+  //the same stats are sent on every path, use the first copy to arrive
+  if (stats->utime <= last_path_stats_utime)
+    return;
+
+  g_mutex_lock(udpPathsLock);
+  if (last_path_stats_utime > 0) {
+    double dt = (stats->utime - last_path_stats_utime) * 1e-6;
+    for (int i = 0; i < stats->num_paths; i++) {
+      udp_path_t * path = &udp_paths[i];
+      int64_t bytes = stats->bytes_received[i] - path->bytes_recv_reported;
+      path->phase_bytes += bytes;
+      path->goodput = 0.7 * path->goodput + 0.3 * bytes / dt;
+      //the loss is only reported, the weights come from the goodput, which
+      //already leaves out what was lost
+      int64_t sent = path->frags_sent - path->frags_sent_reported;
+      if (sent <= 0)
+        continue;
+      int64_t received = stats->frags_received[i] - path->frags_recv_reported;
+      double loss = MAX(0.0, 1.0 - (double) received / sent);
+      path->loss = 0.7 * path->loss + 0.3 * loss;
+    }
+    path_phase_time += dt;
+    if (udp_paths.size() > 1) {
+      if (--path_phase_reports <= 0)
+        endPathPhase();
+      else if (probe_path < 0)
+        setPathWeightsFromGoodput();
+    }
+  }
+  for (int i = 0; i < stats->num_paths; i++) {
+    udp_paths[i].frags_sent_reported = udp_paths[i].frags_sent;
+    udp_paths[i].frags_recv_reported = stats->frags_received[i];
+    udp_paths[i].bytes_recv_reported = stats->bytes_received[i];
+  }
+
+  if (verbose) {
+    double total = 0;
+    for (size_t i = 0; i < udp_paths.size(); i++)
+      total += udp_paths[i].weight;
+    for (size_t i = 0; i < udp_paths.size(); i++)
+      printf("path %d: loss %.3f, %.1fKB/s, weight %.3f%s\n", (int) i, udp_paths[i].loss,
+          udp_paths[i].goodput * 1e-3, udp_paths[i].weight / total, (int) i == probe_path ? " (probing)" : "");
+  }
+  g_mutex_unlock(udpPathsLock);
+
+  last_path_stats_utime = stats->utime;
+}
+
+// gives each path the share of the fragments that the other side received
+// on it.  Paths that have the capacity keep their share, paths that lose
+// fragments shrink.  udpPathsLock must be held
+void LcmTunnel::setPathWeightsFromGoodput()
+{
+  double total = 0;
+  for (size_t i = 0; i < udp_paths.size(); i++)
+    total += udp_paths[i].goodput;
+  if (total <= 0)
+    return; //nothing is being sent, keep the weights we have
+  for (size_t i = 0; i < udp_paths.size(); i++)
+    udp_paths[i].weight = MAX(udp_paths[i].goodput / total, PATH_MIN_SHARE);
+}
+
+// ends the current probing or settling phase.  A probe is kept if the goodput
+// of the probed path rose along with its share, and undone otherwise.  After
+// settling, the next path is probed.  udpPathsLock must be held
+void LcmTunnel::endPathPhase()
+{
+  if (probe_path >= 0) {
+    udp_path_t * path = &udp_paths[probe_path];
+    double goodput = path->phase_bytes / path_phase_time;
+    bool keep = goodput >= probe_base_goodput * (1 + PATH_PROBE_ACCEPT * (probe_share_gain - 1));
+    if (!keep)
+      path->weight = probe_saved_weight;
+    if (verbose)
+      printf("probe of path %d %s: %.1fKB/s -> %.1fKB/s\n", probe_path, keep ? "kept" : "undone",
+          probe_base_goodput * 1e-3, goodput * 1e-3);
+    probe_path = -1;
+  }
+  else {
+    udp_path_t * path = &udp_paths[next_probe_path];
+    probe_base_goodput = path->phase_bytes / path_phase_time;
+    //a path that carries nothing can't show whether it could carry more
+    if (probe_base_goodput > 0) {
+      double total = 0;
+      for (size_t i = 0; i < udp_paths.size(); i++)
+        total += udp_paths[i].weight;
+      probe_path = next_probe_path;
+      probe_saved_weight = path->weight;
+      path->weight *= PATH_PROBE_GAIN;
+      probe_share_gain = PATH_PROBE_GAIN * total / (total + path->weight - probe_saved_weight);
+    }
+    next_probe_path = (next_probe_path + 1) % udp_paths.size();
+  }
+
+  for (size_t i = 0; i < udp_paths.size(); i++)
+    udp_paths[i].phase_bytes = 0;
+  path_phase_time = 0;
+  path_phase_reports = PATH_PROBE_REPORTS;
+}
+
+// periodically tells the other side how much was received on each path
+gboolean LcmTunnel::on_path_stats_timer(gpointer user_data)
+{
+  LcmTunnel * self = (LcmTunnel*) user_data;
+  if (self->server_udp_port <= 0)
+    return TRUE; //connection hasn't been setup yet.
+
+  int num_paths = self->udp_paths.size();
+  int64_t frags_received[MAX_UDP_PATHS];
+  int64_t bytes_received[MAX_UDP_PATHS];
+  for (int i = 0; i < num_paths; i++) {
+    frags_received[i] = self->udp_paths[i].frags_received;
+    bytes_received[i] = self->udp_paths[i].bytes_received;
+  }
+  lcm_tunnel_path_stats_t stats;
+  stats.utime = _timestamp_now();
+  stats.num_paths = num_paths;
+  stats.frags_received = frags_received;
+  stats.bytes_received = bytes_received;
+
+  int msg_sz = lcm_tunnel_path_stats_t_encoded_size(&stats);
+  uint8_t msg_buf[msg_sz];
+  lcm_tunnel_path_stats_t_encode(msg_buf, 0, msg_sz, &stats);
+  //send on every path, so that the stats get through as long as any path works
+  for (int i = 0; i < num_paths; i++)
+    send(self->udp_paths[i].fd, msg_buf, msg_sz, 0);
+  return TRUE;
+}
+
 bool LcmTunnel::send_lcm_messages(std::deque<TunnelLcmMessage *> &msgQueue, uint32_t bytesInQueue)
 {
   if (udp_fd >= 0) {
@@ -828,9 +1671,7 @@ bool LcmTunnel::send_lcm_messages(std::deque<TunnelLcmMessage *> &msgQueue, uint
           uint8_t msg_buf[msg_sz];
           lcm_tunnel_udp_msg_t_encode(msg_buf, 0, msg_sz, &msg);
           //          printf("sending: %d, %d / %d\n", msg.seqno, msg.fragment, msg.nfrags);
-          int send_status = send(udp_fd, msg_buf, msg_sz, 0);
-          //          fprintf(stderr,"sent packet\n");
-          checkUDPSendStatus(send_status);
+          sendUdpPacket(msg_buf, msg_sz);
         }
       }
     }
@@ -855,8 +1696,7 @@ bool LcmTunnel::send_lcm_messages(std::deque<TunnelLcmMessage *> &msgQueue, uint
         uint8_t msg_buf[msg_sz];
         lcm_tunnel_udp_msg_t_encode(msg_buf, 0, msg_sz, &msg);
         //          printf("sending: %d, %d / %d\n", msg.seqno, msg.fragment, msg.nfrags);
-        int send_status = send(udp_fd, msg_buf, msg_sz, 0);
-        checkUDPSendStatus(send_status);
+        sendUdpPacket(msg_buf, msg_sz);
       }
       //          printf("finished encoding and sending packet %d for channel: %s\n",recv_udp_msg->seqno,channel);
       delete ldpc_enc;
@@ -867,46 +1707,87 @@ bool LcmTunnel::send_lcm_messages(std::deque<TunnelLcmMessage *> &msgQueue, uint
     int cfd = ssocket_get_fd(tcp_sock);
     assert(cfd>0);
 
-    while (!msgQueue.empty()) {
-      TunnelLcmMessage * msg = msgQueue.front();
-      msgQueue.pop_front();
+    //each message is sent as 4 pieces: channel length, channel, data length,
+    //and data.  Batch as many messages as possible into each writev call.
+    const int max_msgs_per_write = MIN(IOV_MAX, 1024) / 4;
+    int num_msgs = msgQueue.size();
+    struct iovec * iov = (struct iovec *) malloc(4 * MIN(num_msgs, max_msgs_per_write) * sizeof(struct iovec));
+    uint32_t * sizes_n = (uint32_t *) malloc(2 * MIN(num_msgs, max_msgs_per_write) * sizeof(uint32_t));
+    std::deque<TunnelLcmMessage *> batch;
 
-      int64_t now = _timestamp_now();
-      double age_ms = (now - msg->recv_utime) * 1.0e-3;
-      if (tunnel_params->tcp_max_age_ms > 0 && age_ms > tunnel_params->tcp_max_age_ms) {
-        // message has been queued up for too long.  Drop it.
-        if (verbose)
-          fprintf(stderr, "%s message too old (age = %d, param = %d), dropping.\n", msg->sub_msg->channel,
-              (int) age_ms, tunnel_params->tcp_max_age_ms);
-      }
-      else {
-        // send channel
-        int chan_len = strlen(msg->sub_msg->channel);
-        uint32_t chan_len_n = htonl(chan_len);
-        if (4 != _fileutils_write_fully(cfd, &chan_len_n, 4)) {
-          delete msg;
-          return false;
-        }
-        if (chan_len != _fileutils_write_fully(cfd, msg->sub_msg->channel, chan_len)) {
+    //hold back partial segments while the queue is split over several writes
+    bool cork = num_msgs > max_msgs_per_write;
+    if (cork)
+      _set_tcp_cork(cfd, 1);
+
+    int64_t now = _timestamp_now();
+    bool success = true;
+    while (success && !msgQueue.empty()) {
+      int iovcnt = 0;
+      while (!msgQueue.empty() && (int) batch.size() < max_msgs_per_write) {
+        TunnelLcmMessage * msg = msgQueue.front();
+        msgQueue.pop_front();
+
+        double age_ms = (now - msg->recv_utime) * 1.0e-3;
+        if (tunnel_params->tcp_max_age_ms > 0 && age_ms > tunnel_params->tcp_max_age_ms) {
+          // message has been queued up for too long.  Drop it.
+          if (verbose)
+            fprintf(stderr, "%s message too old (age = %d, param = %d), dropping.\n", msg->sub_msg->channel,
+                (int) age_ms, tunnel_params->tcp_max_age_ms);
           delete msg;
-          return false;
+          continue;
         }
 
-        // send data
-        int data_size_n = htonl(msg->sub_msg->data_size);
-        if (4 != _fileutils_write_fully(cfd, &data_size_n, 4)) {
+        //number the session's messages, so that the ones that get lost when
+        //the connection drops can be resent
+        if (session_id != 0 && msg->sub_msg->channel[0] != '\0')
+          msg->seqno = send_msg_seqno++;
+
+        uint32_t * msg_sizes_n = &sizes_n[2 * batch.size()];
+        int chan_len = strlen(msg->sub_msg->channel);
+        msg_sizes_n[0] = htonl(chan_len);
+        msg_sizes_n[1] = htonl(msg->sub_msg->data_size);
+        iov[iovcnt].iov_base = &msg_sizes_n[0];
+        iov[iovcnt++].iov_len = 4;
+        iov[iovcnt].iov_base = msg->sub_msg->channel;
+        iov[iovcnt++].iov_len = chan_len;
+        iov[iovcnt].iov_base = &msg_sizes_n[1];
+        iov[iovcnt++].iov_len = 4;
+        iov[iovcnt].iov_base = msg->sub_msg->data;
+        iov[iovcnt++].iov_len = msg->sub_msg->data_size;
+        batch.push_back(msg);
+      }
+
+      if (iovcnt > 0 && _fileutils_writev_fully(cfd, iov, iovcnt) < 0)
+        success = false;
+
+      while (!batch.empty()) {
+        TunnelLcmMessage * msg = batch.front();
+        batch.pop_front();
+        if (verbose && success)
+          printf("Sent \"%s\".\n", msg->sub_msg->channel);
+        if (msg->seqno < 0) {
           delete msg;
-          return false;
+          continue;
         }
-        if (msg->sub_msg->data_size != _fileutils_write_fully(cfd, msg->sub_msg->data, msg->sub_msg->data_size)) {
-          delete msg;
-          return false;
+        //keep it until the other side acknowledges it
+        replayQueue.push_back(msg);
+        bytesInReplay += msg->encoded_size;
+        while (bytesInReplay > REPLAY_BUFFER_SIZE) {
+          TunnelLcmMessage * drop_msg = replayQueue.front();
+          replayQueue.pop_front();
+          bytesInReplay -= drop_msg->encoded_size;
+          delete drop_msg;
         }
       }
-      if (verbose)
-        printf("Sent \"%s\".\n", msg->sub_msg->channel);
-      delete msg;
     }
+
+    if (cork)
+      _set_tcp_cork(cfd, 0);
+    free(iov);
+    free(sizes_n);
+    if (!success)
+      return false;
   }
 
   return true;
@@ -931,6 +1812,10 @@ typedef struct {
   char lcm_url[1024];
   int tcp_max_age_ms;
   int max_delay_ms;
+  //bonded UDP paths: local address, and optionally the server's address
+  int num_paths;
+  char * path_local_addrs[MAX_UDP_PATHS];
+  char * path_remote_addrs[MAX_UDP_PATHS];
   float fec;
 } app_params_t;
 
@@ -960,6 +1845,13 @@ static void usage(const char *progname)
     "\n"
     "    -u, --udp                 Request server transmit via UDP instead of TCP\n"
     "\n"
+    "    -b, --bond=LOCAL[@REMOTE] Send UDP over several paths, e.g. redundant\n"
+    "                              radios.  Give once per path, with the local\n"
+    "                              address of the path, and the server's address\n"
+    "                              on that path if it differs from server_addr.\n"
+    "                              Traffic is spread over the paths according to\n"
+    "                              their measured goodput.  Implies -u\n"
+    "\n"
     "    -m, --tcp-max-age-ms=AGE  Instructs the server not to tunnel messages\n"
     "                              that have been queued up and waiting for\n"
     "                              delivery for more than AGE ms.  If less than\n"
@@ -1001,7 +1893,11 @@ static void usage(const char *progname)
     " %s -u -f 1.5 -s \"ABC|DEF\" -r \"\" 192.168.1.1\n"
     "    We forward traffic on channels ABC and DEF to 192.168.1.1 via UDP with\n"
     "    FEC 1.5.  Server does not forward anything back.\n"
-    "\n", basename, DEFAULT_PORT, DEFAULT_PORT, basename, basename, basename, basename, basename);
+    "\n"
+    " %s -b 10.0.1.2@10.0.1.1 -b 10.0.2.2@10.0.2.1 10.0.1.1\n"
+    "    Tunnels traffic via UDP to a server that can be reached over two\n"
+    "    radios, on the 10.0.1.x and 10.0.2.x networks.\n"
+    "\n", basename, DEFAULT_PORT, DEFAULT_PORT, basename, basename, basename, basename, basename, basename);
   free(basename);
   exit(1);
 }
@@ -1010,7 +1906,7 @@ int main(int argc, char **argv)
 {
   setlinebuf(stdout);
 
-  const char *optstring = "hvqur:s:R:S:p:f:l:m:d:w:";
+  const char *optstring = "hvqur:s:R:S:p:f:l:m:d:w:b:";
 
   app_params_t params;
   memset(&params, 0, sizeof(params));
@@ -1039,6 +1935,7 @@ int main(int argc, char **argv)
       { "wait-time-us", required_argument, 0, 'w' },
       { "lcm-url", required_argument, 0, 'l' },
       { "tcp-max-age-ms", required_argument, 0, 'm' },
+      { "bond", required_argument, 0, 'b' },
       { 0, 0, 0, 0 } };
 
   int c;
@@ -1094,6 +1991,24 @@ int main(int argc, char **argv)
     case 'u':
       params.udp = 1;
       break;
+    case 'b':
+      {
+        if (params.num_paths >= MAX_UDP_PATHS) {
+          fprintf(stderr, "at most %d paths can be bonded\n", MAX_UDP_PATHS);
+          return 1;
+        }
+        char * local = strdup(optarg);
+        char * at = strchr(local, '@');
+        params.path_remote_addrs[params.num_paths] = NULL;
+        if (at != NULL) {
+          *at = '\0';
+          params.path_remote_addrs[params.num_paths] = at + 1;
+        }
+        params.path_local_addrs[params.num_paths] = local;
+        params.num_paths++;
+        params.udp = 1;
+        break;
+      }
     case 'l':
       if (strlen(optarg) > sizeof(params.lcm_url) - 1) {
         fprintf(stderr, "LCM URL string too long\n");
@@ -1200,10 +2115,14 @@ int main(int argc, char **argv)
     tunnel_params.udp = params.udp;
     tunnel_params.max_delay_ms = params.max_delay_ms;
     tunnel_params.channels = strdup(params.channels_send);
+    int32_t path_ports[MAX_UDP_PATHS] = { 0 };
+    tunnel_params.num_paths = params.num_paths;
+    tunnel_params.path_ports = path_ports;
+    tunnel_params.path_addrs = params.path_local_addrs;
     LcmTunnel * tunnelClient = new LcmTunnel(params.verbose, NULL);
     int ret = tunnelClient->connectToServer(LcmTunnelServer::lcm, LcmTunnelServer::introspect,
         LcmTunnelServer::mainloop, params.server_addr_str, params.server_port, params.channels_recv, &tunnel_params,
-        &LcmTunnelServer::params);
+        &LcmTunnelServer::params, params.path_remote_addrs);
 
     if (ret) {
       LcmTunnelServer::clients_list.push_front(tunnelClient);
@@ -1214,6 +2133,8 @@ int main(int argc, char **argv)
     }
 
     free(tunnel_params.channels);
+    for (int i = 0; i < params.num_paths; i++)
+      free(params.path_local_addrs[i]);
   }
 
   // periodically send an introspection packet in case network routes change
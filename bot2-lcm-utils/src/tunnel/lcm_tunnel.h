@@ -3,13 +3,16 @@
 
 #include <inttypes.h>
 #include <deque>
+#include <vector>
 #include <glib.h>
+#include <netinet/in.h>
 
 #include "ldpc/ldpc_wrapper.h"
 #include "lcm_tunnel_params_t.h"
 #include "lcm_tunnel_sub_msg_t.h"
 #include "lcm_tunnel_udp_msg_t.h"
 #include "lcm_tunnel_disconnect_msg_t.h"
+#include "lcm_tunnel_path_stats_t.h"
 
 #include "ssocket.h"
 #include "introspect.h"
@@ -28,11 +31,46 @@
 
 #define MAX_SEND_BUFFER_SIZE 33554432 //2^25 ~33MB
 
+ //initial size of the TCP receive buffer, it grows to fit the largest message
+#define TCP_RECV_BUF_SIZE 262144
+
 #define MAX_NUM_FRAGMENTS 32768  //since we're using a int16_t for the fragment number
   //and wrap around explicitly at this value
 #define SEQNO_WRAP_VAL 30000
-  //at wrap around, the prev once should be at least this much bigger
-#define SEQNO_WRAP_GAP 5000
+
+  //number of UDP messages that can be reassembled at the same time, so that
+  //fragments that arrive out of order aren't dropped.  Must divide
+  //SEQNO_WRAP_VAL
+#define UDP_RECV_WINDOW 8
+
+  //bonded mode: maximum number of UDP paths
+#define MAX_UDP_PATHS 8
+  //how often the receiving side reports per-path statistics
+#define PATH_STATS_INTERVAL_MS 250
+  //the paths are probed one at a time: the weight of the probed path is
+  //raised by PATH_PROBE_GAIN for PATH_PROBE_REPORTS statistics reports, and
+  //the raise is kept if the goodput of the path rises by at least
+  //PATH_PROBE_ACCEPT of the increase in its share.  Between probes the
+  //weights follow the goodput for PATH_PROBE_REPORTS reports
+#define PATH_PROBE_GAIN 1.25
+#define PATH_PROBE_REPORTS 4
+#define PATH_PROBE_ACCEPT 0.5
+  //every path gets at least this share of the fragments, so that a path that
+  //comes back after a dropout is noticed
+#define PATH_MIN_SHARE 0.05
+
+  //TCP tunnels are sessions that survive the connection dropping: the client
+  //reconnects, and both sides resend what the other didn't receive.
+  //acknowledgements (which double as heartbeats) are sent this often
+#define SESSION_ACK_INTERVAL_MS 200
+  //the connection is considered dropped if nothing is received for this long
+#define SESSION_TIMEOUT_MS 2000
+  //how long to wait for a reconnect attempt to succeed
+#define SESSION_RECONNECT_TIMEOUT_MS 1000
+  //how long a dropped session is kept around for the client to reconnect
+#define SESSION_GRACE_MS 30000
+  //sent messages are kept until they are acknowledged, up to this many bytes
+#define REPLAY_BUFFER_SIZE 4194304 //2^22 ~4MB
 
 static inline int getNumFragments(int32_t msgSize){
   return (int) ceil((float) msgSize / MAX_PAYLOAD_BYTES_PER_FRAGMENT);
@@ -46,6 +84,47 @@ typedef struct {
 } tunnel_server_params_t;
 
 
+//one UDP path of a bonded tunnel, e.g. over one of several radios
+typedef struct {
+  int fd;
+  GIOChannel * ioc;
+  guint sid;
+  struct in_addr remote_addr;
+
+  //sending side, protected by udpPathsLock
+  int64_t frags_sent;
+  //totals when the last statistics were received
+  int64_t frags_sent_reported;
+  int64_t frags_recv_reported;
+  int64_t bytes_recv_reported;
+  //smoothed fraction of fragments lost, and received bytes per second
+  double loss;
+  double goodput;
+  //bytes received during the current probing or settling phase
+  int64_t phase_bytes;
+  //smooth weighted round robin state
+  double weight;
+  double current_weight;
+
+  //receiving side
+  int64_t frags_received;
+  int64_t bytes_received;
+} udp_path_t;
+
+//a UDP message that is being reassembled from its fragments
+typedef struct {
+  int32_t seqno; //-1 if unused
+  uint32_t nfrags;
+  uint32_t numFragsRec;
+  uint32_t completeTo_fragno;
+  int message_complete;
+  char * buf;
+  int buf_sz;
+  char * recFlags;
+  int recFlags_sz;
+  ldpc_dec_wrapper * ldpc_dec;
+} udp_recv_msg_t;
+
 class  TunnelLcmMessage {
 public:
   TunnelLcmMessage(const lcm_recv_buf_t *rbuf, const char *chan){
@@ -56,6 +135,7 @@ public:
     sub_msg->data = (uint8_t *)malloc(sub_msg->data_size);
     memcpy(sub_msg->data,rbuf->data,sub_msg->data_size);
     encoded_size = lcm_tunnel_sub_msg_t_encoded_size(sub_msg);
+    seqno = -1;
   }
   ~TunnelLcmMessage(){
     lcm_tunnel_sub_msg_t_destroy(sub_msg);
@@ -64,6 +144,7 @@ public:
   lcm_tunnel_sub_msg_t * sub_msg;
   int64_t recv_utime;
   int encoded_size;
+  int64_t seqno; //position in the session once sent, -1 if not sent yet
 } ;
 
 
@@ -76,12 +157,14 @@ public:
   int connectToServer(lcm_t * lcm_, introspect_t *introspect_, GMainLoop *
       mainloop_, char * server_addr_str, int port, char *
       channels_to_recv, lcm_tunnel_params_t * tunnel_params_,
-      tunnel_server_params_t * server_params_);
+      tunnel_server_params_t * server_params_,
+      char ** path_remote_addrs = NULL);
 
   void send_to_remote(const void *data, uint32_t len, const char *lcm_channel);
   void send_to_remote(const lcm_recv_buf_t *rbuf, const char *lcm_channel);
   bool match_regex(const char *channel);
   void init_regex(const char *channel);
+  bool has_session(int64_t id) const { return session_id != 0 && session_id == id; }
 
   ~LcmTunnel();
 
@@ -89,8 +172,12 @@ public:
   static gpointer sendThreadFunc(gpointer user_data);
   bool send_lcm_messages(std::deque<TunnelLcmMessage *> &msgQueue,uint32_t bytesInQueue);
   static int on_tcp_data(GIOChannel * source, GIOCondition cond, void *user_data);
+  static int on_tcp_field(LcmTunnel * self, const char * data, int len);
   static int on_udp_data(GIOChannel * source, GIOCondition cond, void *user_data);
-  int publishLcmMessagesInBuf(int numBytes);
+  static gboolean on_path_stats_timer(gpointer user_data);
+  static gboolean on_session_timer(gpointer user_data);
+  static int on_reconnect(GIOChannel * source, GIOCondition cond, void *user_data);
+  int publishLcmMessagesInBuf(const char * msgBuf, int numBytes);
 
   bool verbose;
 
@@ -119,7 +206,13 @@ private:
   tunnel_state_t tunnel_state;
 
   int bytes_to_read;
-  int bytes_read;
+
+  //TCP data that has been received but not handled yet, from recv_start
+  //to recv_end
+  char *recv_buf;
+  int recv_buf_sz;
+  int recv_start;
+  int recv_end;
 
   //threaded sending stuff:
   bool stopSendThread;
@@ -130,15 +223,48 @@ private:
   GMutex * sendQueueLock;
   GCond* sendQueueCond; //thread waits on this
   bool flushImmediately;
-
+  bool sendPaused; //don't send while the session is being set up or resumed
+  bool sendInProgress; //the thread is writing to the socket
+  bool sendFailed;
+
+  //session resumption, for TCP tunnels.  The session's messages are numbered
+  //from 0 in each direction, and each side acknowledges the number it has
+  //received with a message on an empty channel.
+  int64_t session_id; //0 if not using a session
+  int64_t send_msg_seqno; //number of messages sent, only used by the send thread
+  int64_t recv_msg_seqno; //number of messages received
+  int64_t peer_acked; //number of messages the other side acknowledged
+  //messages that were sent but not acknowledged yet
+  std::deque<TunnelLcmMessage *> replayQueue;
+  uint32_t bytesInReplay;
+  guint session_sid;
+  int64_t last_recv_utime;
+  bool detached; //the connection dropped, waiting for it to be resumed
+  int64_t detach_utime;
+  //client side: where to reconnect to (sin_family is 0 on the server side),
+  //and the params to send when reconnecting
+  struct sockaddr_in reconnect_addr;
+  lcm_tunnel_params_t * request_params;
+  int reconnect_fd;
+  GIOChannel * reconnect_ioc;
+  guint reconnect_sid;
+  int64_t reconnect_utime;
+  void startSession(int64_t id);
+  void detachSession();
+  void startReconnect();
+  void stopReconnect();
+  int sendParams(lcm_tunnel_params_t * params);
+  void resumeSending(int64_t peer_recv_seqno);
+  void queueAck();
+  void handleAck(const char * data, int len);
+  void trimReplayQueue();
+  void takeOverSession(LcmTunnel * other, int64_t peer_recv_seqno);
 
 
 
   //buffers to store incoming messages
   char *channel;
   int channel_sz;
-  char *buf;
-  int buf_sz;
 
   int udp_fd;
   int server_udp_port;
@@ -147,14 +273,32 @@ private:
   uint32_t udp_send_seqno;
 
   //stuff to keep track of received fragments
-  char * recFlags;
-  int recFlags_sz;
-  int32_t cur_seqno;
-  uint32_t numFragsRec;
-  uint32_t completeTo_fragno;
-  uint32_t nfrags;
-  uint32_t fragment_buf_offset;
-  int message_complete;
+  int32_t cur_seqno; //newest message seen, -1 if none
+  udp_recv_msg_t recvMsgs[UDP_RECV_WINDOW];
+  void startRecvMessage(udp_recv_msg_t * rmsg, int32_t seqno, int32_t payload_size);
+  void handleUdpFragment(lcm_tunnel_udp_msg_t * recv_udp_msg);
+
+  //bonded mode: fragments are spread over several UDP paths, weighted by
+  //the goodput reported by the other side.  udp_fd is the first path
+  std::vector<udp_path_t> udp_paths;
+  GMutex * udpPathsLock;
+  guint path_stats_sid;
+  int64_t last_path_stats_utime; //remote timestamp of the last stats
+  //probing, protected by udpPathsLock.  probe_path is -1 while settling
+  int probe_path;
+  int next_probe_path;
+  int path_phase_reports; //reports left in the current phase
+  double path_phase_time; //seconds since the current phase started
+  double probe_saved_weight; //weight of probe_path before the probe
+  double probe_share_gain; //how much the probe raised the share of probe_path
+  double probe_base_goodput; //goodput of probe_path before the probe
+  int initUdpPaths(int num_paths, const struct in_addr * local_addrs, int32_t * ports);
+  int connectUdpPaths(const int32_t * remote_ports);
+  int pickUdpPath();
+  void sendUdpPacket(const uint8_t * msg_buf, int msg_sz);
+  void handlePathStats(const lcm_tunnel_path_stats_t * stats);
+  void setPathWeightsFromGoodput();
+  void endPathPhase();
 
   //for monitoring the UDP link status
   void checkUDPSendStatus(int send_status);
@@ -163,9 +307,6 @@ private:
   int numSuccessful;
 
 
-  //forward error correction variables
-  ldpc_dec_wrapper * ldpc_dec;
-
   lcm_subscription_t *subscription;
 
 };
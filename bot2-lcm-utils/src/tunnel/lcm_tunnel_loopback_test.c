@@ -0,0 +1,248 @@
+// file: lcm_tunnel_loopback_test.c
+// desc: runs a bonded bot-lcm-tunnel over several loopback addresses and
+//       checks that the messages published on one end arrive at the other
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+
+#include <lcm/lcm.h>
+
+#define TEST_CHANNEL "TUNNEL_LOOPBACK_TEST"
+// the two ends of the tunnel are on separate LCM networks, which only the
+// tunnel connects
+#define SERVER_LCM_URL "udpm://239.255.76.67:7681?ttl=0"
+#define CLIENT_LCM_URL "udpm://239.255.76.67:7682?ttl=0"
+#define TUNNEL_PORT 6733
+#define MAX_PATHS 8
+
+typedef struct _app {
+    int num_msgs;
+    int num_received;
+    int num_duplicates;
+    uint8_t *seen;
+} app_t;
+
+static inline int64_t
+_timestamp_now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void
+usage(const char *progname)
+{
+    printf("usage: %s [OPTIONS] [path/to/bot-lcm-tunnel]\n"
+           "\n"
+           "Starts a tunnel server and a client that bonds NPATHS UDP paths,\n"
+           "from the loopback addresses 127.0.0.2, 127.0.0.3, ... to 127.0.0.1,\n"
+           "then publishes messages on the client's LCM network and checks that\n"
+           "they arrive on the server's.  Linux routes all of 127.0.0.0/8 to the\n"
+           "loopback interface, so no setup is needed.\n"
+           "\n"
+           "The tunnel defaults to the bot-lcm-tunnel in the current directory.\n"
+           "\n"
+           "Options:\n"
+           "  -h        prints this help text and exits\n"
+           "  -b NPATHS number of bonded paths.  Default: 2\n"
+           "  -n NUM    number of messages to publish.  Default: 2000\n"
+           "  -s SIZE   message size in bytes.  Default: 4000\n"
+           "  -r RATE   messages per second.  Default: 500\n"
+           "  -v        runs the tunnels in verbose mode, which prints the\n"
+           "            weight of each path\n",
+           progname);
+    exit(1);
+}
+
+static void
+on_msg(const lcm_recv_buf_t *rbuf, const char *channel, void *user_data)
+{
+    app_t *app = (app_t *) user_data;
+    if (rbuf->data_size < 4)
+        return;
+    const uint8_t *d = (const uint8_t *) rbuf->data;
+    int seqno = d[0] << 24 | d[1] << 16 | d[2] << 8 | d[3];
+    if (seqno < 0 || seqno >= app->num_msgs)
+        return;
+    if (app->seen[seqno]) {
+        app->num_duplicates++;
+        return;
+    }
+    app->seen[seqno] = 1;
+    app->num_received++;
+}
+
+// handles the messages that arrive on lcm for up to timeout_usec
+static void
+handle_for(lcm_t *lcm, int64_t timeout_usec)
+{
+    int64_t end = _timestamp_now() + timeout_usec;
+    int fd = lcm_get_fileno(lcm);
+    while (1) {
+        int64_t left = end - _timestamp_now();
+        if (left <= 0)
+            return;
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(fd, &fds);
+        struct timeval tv = { left / 1000000, left % 1000000 };
+        if (select(fd + 1, &fds, NULL, NULL, &tv) > 0)
+            lcm_handle(lcm);
+    }
+}
+
+static pid_t
+spawn(char **argv)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        execv(argv[0], argv);
+        perror(argv[0]);
+        _exit(1);
+    }
+    return pid;
+}
+
+int
+main(int argc, char **argv)
+{
+    int num_paths = 2;
+    int num_msgs = 2000;
+    int msg_size = 4000;
+    double rate = 500;
+    int verbose = 0;
+
+    int c;
+    char *e;
+    while ((c = getopt(argc, argv, "hb:n:s:r:v")) >= 0) {
+        switch (c) {
+        case 'b':
+            num_paths = strtol(optarg, &e, 0);
+            if (*e != '\0' || num_paths < 1 || num_paths > MAX_PATHS)
+                usage(argv[0]);
+            break;
+        case 'n':
+            num_msgs = strtol(optarg, &e, 0);
+            if (*e != '\0' || num_msgs < 1)
+                usage(argv[0]);
+            break;
+        case 's':
+            msg_size = strtol(optarg, &e, 0);
+            if (*e != '\0' || msg_size < 4)
+                usage(argv[0]);
+            break;
+        case 'r':
+            rate = strtod(optarg, &e);
+            if (*e != '\0' || rate <= 0)
+                usage(argv[0]);
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        case 'h':
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind < argc - 1)
+        usage(argv[0]);
+    char *tunnel = optind < argc ? argv[optind] : "./bot-lcm-tunnel";
+
+    char port_arg[16];
+    char server_arg[32];
+    char path_args[MAX_PATHS][40];
+    sprintf(port_arg, "%d", TUNNEL_PORT);
+    sprintf(server_arg, "127.0.0.1:%d", TUNNEL_PORT);
+
+    char *server_argv[8];
+    int n = 0;
+    server_argv[n++] = tunnel;
+    server_argv[n++] = "-p";
+    server_argv[n++] = port_arg;
+    server_argv[n++] = "-l";
+    server_argv[n++] = SERVER_LCM_URL;
+    if (verbose)
+        server_argv[n++] = "-v";
+    server_argv[n] = NULL;
+
+    char *client_argv[16 + 2 * MAX_PATHS];
+    n = 0;
+    client_argv[n++] = tunnel;
+    client_argv[n++] = "-l";
+    client_argv[n++] = CLIENT_LCM_URL;
+    client_argv[n++] = "-s";
+    client_argv[n++] = TEST_CHANNEL;
+    client_argv[n++] = "-r";
+    client_argv[n++] = "";
+    for (int i = 0; i < num_paths; i++) {
+        sprintf(path_args[i], "127.0.0.%d@127.0.0.1", i + 2);
+        client_argv[n++] = "-b";
+        client_argv[n++] = path_args[i];
+    }
+    if (verbose)
+        client_argv[n++] = "-v";
+    client_argv[n++] = server_arg;
+    client_argv[n] = NULL;
+
+    lcm_t *server_lcm = lcm_create(SERVER_LCM_URL);
+    lcm_t *client_lcm = lcm_create(CLIENT_LCM_URL);
+    if (!server_lcm || !client_lcm) {
+        fprintf(stderr, "couldn't create the LCM instances\n");
+        return 1;
+    }
+
+    app_t app;
+    memset(&app, 0, sizeof(app));
+    app.num_msgs = num_msgs;
+    app.seen = (uint8_t *) calloc(num_msgs, 1);
+    lcm_subscribe(server_lcm, TEST_CHANNEL, on_msg, &app);
+
+    pid_t server_pid = spawn(server_argv);
+    usleep(500000);
+    pid_t client_pid = spawn(client_argv);
+    // give the tunnel time to set up the paths
+    handle_for(server_lcm, 2000000);
+
+    uint8_t *msg = (uint8_t *) malloc(msg_size);
+    for (int i = 0; i < msg_size; i++)
+        msg[i] = i;
+    int64_t interval = 1e6 / rate;
+    int64_t start = _timestamp_now();
+    for (int i = 0; i < num_msgs; i++) {
+        msg[0] = i >> 24;
+        msg[1] = i >> 16;
+        msg[2] = i >> 8;
+        msg[3] = i;
+        lcm_publish(client_lcm, TEST_CHANNEL, msg, msg_size);
+        handle_for(server_lcm, start + (i + 1) * interval - _timestamp_now());
+    }
+    handle_for(server_lcm, 2000000);
+    double elapsed = (_timestamp_now() - start) * 1e-6;
+
+    kill(client_pid, SIGTERM);
+    kill(server_pid, SIGTERM);
+    waitpid(client_pid, NULL, 0);
+    waitpid(server_pid, NULL, 0);
+
+    // UDP over loopback can still drop when the socket buffers overflow
+    int ok = app.num_received >= 0.99 * num_msgs;
+    printf("%d paths: received %d of %d messages (%d duplicates), %.1f KB/s: %s\n",
+            num_paths, app.num_received, num_msgs, app.num_duplicates,
+            app.num_received * (double) msg_size / elapsed * 1e-3,
+            ok ? "OK" : "FAILED");
+
+    free(msg);
+    free(app.seen);
+    lcm_destroy(client_lcm);
+    lcm_destroy(server_lcm);
+    return ok ? 0 : 1;
+}
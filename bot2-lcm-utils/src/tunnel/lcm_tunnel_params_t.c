@@ -20,13 +20,18 @@ int64_t __lcm_tunnel_params_t_hash_recursive(const __lcm_hash_ptr *p)
     const __lcm_hash_ptr cp = { p, (void*)__lcm_tunnel_params_t_get_hash };
     (void) cp;
  
-    int64_t hash = 0x88279ccb7db6160aLL
+    int64_t hash = 0x8f3e6fe1b4da3bbcLL
          + __boolean_hash_recursive(&cp)
          + __int32_t_hash_recursive(&cp)
          + __int32_t_hash_recursive(&cp)
          + __int32_t_hash_recursive(&cp)
          + __string_hash_recursive(&cp)
          + __float_hash_recursive(&cp)
+         + __int32_t_hash_recursive(&cp)
+         + __int32_t_hash_recursive(&cp)
+         + __string_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
         ;
  
     return (hash<<1) + ((hash>>63)&1);
@@ -66,6 +71,21 @@ int __lcm_tunnel_params_t_encode_array(void *buf, int offset, int maxlen, const
         thislen = __float_encode_array(buf, offset + pos, maxlen - pos, &(p[element].fec), 1);
         if (thislen < 0) return thislen; else pos += thislen;
  
+        thislen = __int32_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].num_paths), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int32_t_encode_array(buf, offset + pos, maxlen - pos, p[element].path_ports, p[element].num_paths);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __string_encode_array(buf, offset + pos, maxlen - pos, p[element].path_addrs, p[element].num_paths);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].session_id), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].resume_seqno), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
     }
     return pos;
 }
@@ -101,6 +121,16 @@ int __lcm_tunnel_params_t_encoded_array_size(const lcm_tunnel_params_t *p, int e
  
         size += __float_encoded_array_size(&(p[element].fec), 1);
  
+        size += __int32_t_encoded_array_size(&(p[element].num_paths), 1);
+ 
+        size += __int32_t_encoded_array_size(p[element].path_ports, p[element].num_paths);
+ 
+        size += __string_encoded_array_size(p[element].path_addrs, p[element].num_paths);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].session_id), 1);
+ 
+        size += __int64_t_encoded_array_size(&(p[element].resume_seqno), 1);
+ 
     }
     return size;
 }
@@ -134,6 +164,23 @@ int __lcm_tunnel_params_t_decode_array(const void *buf, int offset, int maxlen,
         thislen = __float_decode_array(buf, offset + pos, maxlen - pos, &(p[element].fec), 1);
         if (thislen < 0) return thislen; else pos += thislen;
  
+        thislen = __int32_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].num_paths), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        p[element].path_ports = (int32_t*) lcm_malloc(sizeof(int32_t) * p[element].num_paths);
+        thislen = __int32_t_decode_array(buf, offset + pos, maxlen - pos, p[element].path_ports, p[element].num_paths);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        p[element].path_addrs = (char**) lcm_malloc(sizeof(char*) * p[element].num_paths);
+        thislen = __string_decode_array(buf, offset + pos, maxlen - pos, p[element].path_addrs, p[element].num_paths);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].session_id), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].resume_seqno), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+ 
     }
     return pos;
 }
@@ -155,6 +202,18 @@ int __lcm_tunnel_params_t_decode_array_cleanup(lcm_tunnel_params_t *p, int eleme
  
         __float_decode_array_cleanup(&(p[element].fec), 1);
  
+        __int32_t_decode_array_cleanup(&(p[element].num_paths), 1);
+ 
+        __int32_t_decode_array_cleanup(p[element].path_ports, p[element].num_paths);
+        if (p[element].path_ports) free(p[element].path_ports);
+ 
+        __string_decode_array_cleanup(p[element].path_addrs, p[element].num_paths);
+        if (p[element].path_addrs) free(p[element].path_addrs);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].session_id), 1);
+ 
+        __int64_t_decode_array_cleanup(&(p[element].resume_seqno), 1);
+ 
     }
     return 0;
 }
@@ -197,6 +256,18 @@ int __lcm_tunnel_params_t_clone_array(const lcm_tunnel_params_t *p, lcm_tunnel_p
  
         __float_clone_array(&(p[element].fec), &(q[element].fec), 1);
  
+        __int32_t_clone_array(&(p[element].num_paths), &(q[element].num_paths), 1);
+ 
+        q[element].path_ports = (int32_t*) lcm_malloc(sizeof(int32_t) * q[element].num_paths);
+        __int32_t_clone_array(p[element].path_ports, q[element].path_ports, p[element].num_paths);
+ 
+        q[element].path_addrs = (char**) lcm_malloc(sizeof(char*) * q[element].num_paths);
+        __string_clone_array(p[element].path_addrs, q[element].path_addrs, p[element].num_paths);
+ 
+        __int64_t_clone_array(&(p[element].session_id), &(q[element].session_id), 1);
+ 
+        __int64_t_clone_array(&(p[element].resume_seqno), &(q[element].resume_seqno), 1);
+ 
     }
     return 0;
 }
@@ -25,6 +25,11 @@ struct _lcm_tunnel_params_t
     int32_t    max_delay_ms;
     char*      channels;
     float      fec;
+    int32_t    num_paths;
+    int32_t    *path_ports;
+    char*      *path_addrs;
+    int64_t    session_id;
+    int64_t    resume_seqno;
 };
  
 lcm_tunnel_params_t   *lcm_tunnel_params_t_copy(const lcm_tunnel_params_t *p);
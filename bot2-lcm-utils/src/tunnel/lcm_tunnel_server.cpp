@@ -44,6 +44,18 @@ bool LcmTunnelServer::matches_a_client(const char *channel)
   return false;
 }
 
+LcmTunnel * LcmTunnelServer::findSession(int64_t session_id)
+{
+  for (std::list<LcmTunnel*>::iterator iter =
+                LcmTunnelServer::clients_list.begin();
+        iter != clients_list.end(); iter++)
+  {
+    if ((*iter)->has_session(session_id))
+      return *iter;
+  }
+  return NULL;
+}
+
 void LcmTunnelServer::check_and_send_to_tunnels(const char *channel,
     const void *data, unsigned int len, LcmTunnel *to_skip)
 {
@@ -17,6 +17,7 @@ public:
 
   static int acceptClient(GIOChannel *source, GIOCondition cond, void *user_data);
   static int disconnectClient(LcmTunnel * client);
+  static LcmTunnel * findSession(int64_t session_id);
 
   static GMainLoop * mainloop;
   static lcm_t * lcm;
@@ -1,7 +1,11 @@
-import cStringIO as StringIO
 import bot_lcmgl.data_t as data_t
 import struct
 
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
 LCMGL_GL_BEGIN         = 4
 LCMGL_GL_END           = 5
 LCMGL_GL_VERTEX3F      = 6
@@ -105,29 +109,66 @@ for n in range(1, 9):
 def _lcmgl_make_encode_%d(cmd, fmt):
     st = struct.Struct(">B%%s" %% fmt)
     def encode(self, %s):
-        self.data.write(st.pack(cmd, %s))
+        self._reserve(st.size)
+        st.pack_into(self.data, self.datalen, cmd, %s)
         self.datalen += st.size
     return encode
 """ % (n, args, args)
 
 def _lcmgl_make_encode_0(cmd):
-    data = struct.pack("B", cmd)
     def encode(self):
-        self.data.write(data)
+        self._reserve(1)
+        self.data[self.datalen] = cmd
         self.datalen += 1
     return encode
-    
+
+# per-vertex commands written by the array methods.  Each is keyed by the
+# number of columns of the array and whether it holds float32 values.
+_lcmgl_vertex_cmds = {
+    (2, True)  : (LCMGL_GL_VERTEX2F, ">f4"),
+    (2, False) : (LCMGL_GL_VERTEX2D, ">f8"),
+    (3, True)  : (LCMGL_GL_VERTEX3F, ">f4"),
+    (3, False) : (LCMGL_GL_VERTEX3D, ">f8"),
+}
+
+def _lcmgl_as_columns(name, a, ncols, nrows=None):
+    if numpy is None:
+        raise ImportError("numpy is required by the lcmgl array methods")
+    a = numpy.asarray(a)
+    if a.ndim == 1 and nrows is None:
+        a = a.reshape(1, -1)
+    if a.ndim != 2 or a.shape[1] not in ncols:
+        raise ValueError("%s must be an N x %s array" % (name,
+            " or ".join([str(c) for c in ncols])))
+    if nrows is not None and a.shape[0] != nrows:
+        raise ValueError("%s must have one row per vertex" % name)
+    return a
+
 class lcmgl:
-    def __init__(self, name, lcm):
+    def __init__(self, name, lcm, capacity = 65536):
         self.lcm = lcm
-        self.data = StringIO.StringIO()
+        # commands are packed in place into a preallocated buffer, which
+        # grows as needed and is reused from one scene to the next
+        self.data = bytearray(capacity)
         self.datalen = 0
         self.scene = 1
         self.name = name
         self.ntextures = 0
 
+    def _reserve(self, size):
+        needed = self.datalen + size
+        if needed > len(self.data):
+            self.data.extend(bytearray(max(needed, 2 * len(self.data)) -
+                len(self.data)))
+
+    def _write(self, data):
+        size = len(data)
+        self._reserve(size)
+        self.data[self.datalen:self.datalen + size] = data
+        self.datalen += size
+
     def switch_buffer(self):
-        d = self.data.getvalue()
+        d = bytes(self.data[:self.datalen])
 
         msg = data_t()
         msg.name = self.name
@@ -138,7 +179,7 @@ class lcmgl:
         self.lcm.publish("LCMGL", msg.encode())
 
         self.ntextures = 0
-        self.data = StringIO.StringIO()
+        self.datalen = 0
         self.scene += 1
 
     glBegin        = _lcmgl_make_encode_1(LCMGL_GL_BEGIN, "I")
@@ -178,11 +219,87 @@ class lcmgl:
     # cylinder(x, y, z, r_base, r_top, height, slices, stacks)
     cylinder       = _lcmgl_make_encode_8(LCMGL_CYLINDER, "ddddddII")
 
+    def vertices(self, xyz, colors = None, normals = None):
+        """Sends the vertices in the rows of the N x 2 or N x 3 array xyz,
+        as glVertex calls.  float32 arrays are sent as glVertex*f, others as
+        glVertex*d.  colors (N x 3 or N x 4) and normals (N x 3), if given,
+        are sent before each vertex.  The commands of all the vertices are
+        packed by numpy and written to the buffer at once."""
+        xyz = _lcmgl_as_columns("xyz", xyz, (2, 3))
+        n = xyz.shape[0]
+        vcmd, vtype = _lcmgl_vertex_cmds[(xyz.shape[1],
+            xyz.dtype == numpy.float32)]
+
+        fields = []
+        if colors is not None:
+            colors = _lcmgl_as_columns("colors", colors, (3, 4), n)
+            ccmd = { 3 : LCMGL_GL_COLOR3F,
+                     4 : LCMGL_GL_COLOR4F }[colors.shape[1]]
+            fields.append(("c", ccmd, ">f4", colors))
+        if normals is not None:
+            normals = _lcmgl_as_columns("normals", normals, (3,), n)
+            fields.append(("n", LCMGL_GL_NORMAL3F, ">f4", normals))
+        fields.append(("v", vcmd, vtype, xyz))
+
+        # one packed record per vertex: the opcode byte and the arguments
+        # of each command, in order
+        dtype = []
+        for name, cmd, ftype, a in fields:
+            dtype.append((name + "_cmd", "u1"))
+            dtype.append((name, ftype, (a.shape[1],)))
+        records = numpy.empty(n, dtype = dtype)
+        for name, cmd, ftype, a in fields:
+            records[name + "_cmd"] = cmd
+            records[name] = a
+        self._write(records.tobytes())
+
+    def colors(self, rgb):
+        """Sends the colors in the rows of the N x 3 or N x 4 array rgb as
+        glColor calls.  Per-vertex colors are usually sent with
+        vertices()."""
+        rgb = _lcmgl_as_columns("rgb", rgb, (3, 4))
+        cmd = { 3 : LCMGL_GL_COLOR3F, 4 : LCMGL_GL_COLOR4F }[rgb.shape[1]]
+        records = numpy.empty(rgb.shape[0],
+                dtype = [("cmd", "u1"), ("c", ">f4", (rgb.shape[1],))])
+        records["cmd"] = cmd
+        records["c"] = rgb
+        self._write(records.tobytes())
+
+    def normals(self, xyz):
+        """Sends the normals in the rows of the N x 3 array xyz as glNormal3f
+        calls.  Per-vertex normals are usually sent with vertices()."""
+        xyz = _lcmgl_as_columns("xyz", xyz, (3,))
+        records = numpy.empty(xyz.shape[0],
+                dtype = [("cmd", "u1"), ("n", ">f4", (3,))])
+        records["cmd"] = LCMGL_GL_NORMAL3F
+        records["n"] = xyz
+        self._write(records.tobytes())
+
+    def _primitive(self, mode, xyz, colors):
+        # on bad arrays, raise before glBegin is written
+        start = self.datalen
+        try:
+            self.glBegin(mode)
+            self.vertices(xyz, colors)
+        except:
+            self.datalen = start
+            raise
+        self.glEnd()
+
+    def points(self, xyz, colors = None):
+        """Draws the rows of xyz as GL_POINTS.  See vertices()."""
+        self._primitive(GL_POINTS, xyz, colors)
+
+    def lines(self, xyz, colors = None, strip = False):
+        """Draws the rows of xyz as GL_LINES, i.e. a segment between each
+        pair of rows, or as a GL_LINE_STRIP if strip is True.  See
+        vertices()."""
+        self._primitive(strip and GL_LINE_STRIP or GL_LINES, xyz, colors)
+
     def text(self, x, y, z, text, flags = 0):
         font = 0
-        self.data.write(struct.pack(">BIIdddI", LCMGL_TEXT_LONG, font, flags, x, y, z, len(text)))
-        self.data.write(text)
-        self.datalen += 37 + len(text)
+        self._write(struct.pack(">BIIdddI", LCMGL_TEXT_LONG, font, flags, x, y, z, len(text)))
+        self._write(text)
 
     def texture2d(self, data, width, height, format, compression):
         self.ntextures += 1
@@ -206,9 +323,9 @@ class lcmgl:
         else:
             raise ValueError("Invalid compression value")
 
-        self.data.write(struct.pack(">BIIIIII", LCMGL_TEXTURE2D, tex_id,
+        self._write(struct.pack(">BIIIIII", LCMGL_TEXTURE2D, tex_id,
             width, height, format, compression, len(data_tosend)))
-        self.data.write(data_tosend)
+        self._write(data_tosend)
 
         return tex_id
 
@@ -218,7 +335,7 @@ class lcmgl:
 
         if tex_id > self.ntextures or tex_id <= 0:
             raise ValueError("Invalid texture ID")
-        self.data.write(struct.pack(">BIdddddddddddd", LCMGL_TEXTURE_DRAW_QUAD,
+        self._write(struct.pack(">BIdddddddddddd", LCMGL_TEXTURE_DRAW_QUAD,
             tex_id,
             top_left_xyz[0], top_left_xyz[1], top_left_xyz[2], 
             bot_left_xyz[0], bot_left_xyz[1], bot_left_xyz[2], 
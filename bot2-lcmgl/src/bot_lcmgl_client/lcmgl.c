@@ -7,6 +7,7 @@
 #include <time.h>
 #include <sys/time.h>
 #include <zlib.h> //for texture compression //TODO: is this portable?
+#include <glib.h>
 
 #include "lcmtypes/bot_lcmgl_data_t.h"
 
@@ -28,6 +29,9 @@
 
 #define INITIAL_ALLOC (1024*1024)
 
+// how often the data of a cached texture is transmitted again
+#define TEXTURE_RESEND_INTERVAL_USEC 1000000
+
 static int64_t _timestamp_now()
 {
     struct timeval tv;
@@ -49,8 +53,16 @@ struct lcmgl
     int     data_alloc;
 
     uint32_t texture_count;
+
+    // hash of cached textures -> time their data was last transmitted
+    GHashTable *texture_sent_utimes;
 };
 
+typedef struct {
+    uint64_t hash;
+    int64_t  utime;
+} _sent_texture_t;
+
 union bot_lcmgl_bytefloat
 {
     uint32_t u32;
@@ -151,6 +163,16 @@ void bot_lcmgl_switch_buffer(bot_lcmgl_t *lcmgl)
     lcmgl->texture_count = 0;
 
     lcmgl->scene++;
+
+    // forget the textures that are due to be transmitted again anyway
+    int64_t expired = _timestamp_now() - TEXTURE_RESEND_INTERVAL_USEC;
+    GHashTableIter iter;
+    _sent_texture_t *sent;
+    g_hash_table_iter_init (&iter, lcmgl->texture_sent_utimes);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer*) &sent)) {
+        if (sent->utime < expired)
+            g_hash_table_iter_remove (&iter);
+    }
 }
 
 bot_lcmgl_t *bot_lcmgl_init(lcm_t *lcm, const char *name)
@@ -166,6 +188,8 @@ bot_lcmgl_t *bot_lcmgl_init(lcm_t *lcm, const char *name)
     lcmgl->data_alloc = INITIAL_ALLOC;
 
     lcmgl->texture_count = 0;
+    lcmgl->texture_sent_utimes = g_hash_table_new_full (g_int64_hash,
+            g_int64_equal, NULL, free);
 
     // XXX sanitize BOT_LCMGL channel name?
     snprintf(lcmgl->channel_name, 128, "LCMGL_%s", lcmgl->name);
@@ -176,6 +200,7 @@ bot_lcmgl_t *bot_lcmgl_init(lcm_t *lcm, const char *name)
 void bot_lcmgl_destroy (bot_lcmgl_t *lcmgl)
 {
     free (lcmgl->data);
+    g_hash_table_destroy (lcmgl->texture_sent_utimes);
     memset (lcmgl->name, 0, strlen (lcmgl->name));
     free (lcmgl->name);
     free (lcmgl->channel_name);
@@ -634,20 +659,10 @@ void bot_lcmgl_scale_to_viewer_ar(bot_lcmgl_t *lcmgl){
 
 // texture API
 
-int 
-bot_lcmgl_texture2d(bot_lcmgl_t *lcmgl, const void *data, 
-        int width, int height, int row_stride,
-        bot_lcmgl_texture_format_t format,
-        bot_lcmgl_texture_type_t type,
-        bot_lcmgl_compress_mode_t compression)
+static int
+_texture_bytes_per_row(int width, bot_lcmgl_texture_format_t format,
+        bot_lcmgl_texture_type_t type)
 {
-    bot_lcmgl_encode_u8(lcmgl, BOT_LCMGL_TEX_2D);
-
-    uint32_t tex_id = lcmgl->texture_count + 1;
-    lcmgl->texture_count ++;
-
-    bot_lcmgl_encode_u32(lcmgl, tex_id);
-
     int subpix_per_pixel = 1;
     switch(format) {
         case BOT_LCMGL_LUMINANCE:
@@ -678,7 +693,19 @@ bot_lcmgl_texture2d(bot_lcmgl_t *lcmgl, const void *data,
             break;
     }
 
-    int bytes_per_row = width * subpix_per_pixel * bytes_per_subpixel;
+    return width * subpix_per_pixel * bytes_per_subpixel;
+}
+
+// encodes the texture description and pixel data that follow the texture
+// ID in the BOT_LCMGL_TEX_2D and BOT_LCMGL_TEX_2D_CACHED commands
+static void
+_encode_texture_data(bot_lcmgl_t *lcmgl, const void *data,
+        int width, int height, int row_stride,
+        bot_lcmgl_texture_format_t format,
+        bot_lcmgl_texture_type_t type,
+        bot_lcmgl_compress_mode_t compression)
+{
+    int bytes_per_row = _texture_bytes_per_row(width, format, type);
     int datalen = bytes_per_row * height;
 
     bot_lcmgl_encode_u32(lcmgl, width);
@@ -719,6 +746,92 @@ bot_lcmgl_texture2d(bot_lcmgl_t *lcmgl, const void *data,
         }
         break;
     }
+}
+
+int 
+bot_lcmgl_texture2d(bot_lcmgl_t *lcmgl, const void *data, 
+        int width, int height, int row_stride,
+        bot_lcmgl_texture_format_t format,
+        bot_lcmgl_texture_type_t type,
+        bot_lcmgl_compress_mode_t compression)
+{
+    bot_lcmgl_encode_u8(lcmgl, BOT_LCMGL_TEX_2D);
+
+    uint32_t tex_id = lcmgl->texture_count + 1;
+    lcmgl->texture_count ++;
+
+    bot_lcmgl_encode_u32(lcmgl, tex_id);
+
+    _encode_texture_data(lcmgl, data, width, height, row_stride,
+            format, type, compression);
+
+    return tex_id;
+}
+
+// 64-bit FNV-1a
+static inline uint64_t
+_fnv1a(uint64_t h, const void *data, int len)
+{
+    const uint8_t *p = (const uint8_t*) data;
+    for (int i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// hashes the description and the pixels of a texture, but not the padding
+// at the end of its rows
+static uint64_t
+_texture_hash(const void *data, int width, int height, int row_stride,
+        bot_lcmgl_texture_format_t format,
+        bot_lcmgl_texture_type_t type)
+{
+    int bytes_per_row = _texture_bytes_per_row(width, format, type);
+    uint32_t desc[4] = { width, height, format, type };
+
+    uint64_t h = _fnv1a(0xcbf29ce484222325ULL, desc, sizeof(desc));
+    for (int row = 0; row < height; row++)
+        h = _fnv1a(h, (const uint8_t*) data + row * row_stride,
+                bytes_per_row);
+    return h;
+}
+
+int
+bot_lcmgl_texture2d_cached(bot_lcmgl_t *lcmgl, const void *data,
+        int width, int height, int row_stride,
+        bot_lcmgl_texture_format_t format,
+        bot_lcmgl_texture_type_t type,
+        bot_lcmgl_compress_mode_t compression)
+{
+    uint64_t hash = _texture_hash(data, width, height, row_stride,
+            format, type);
+    int64_t now = _timestamp_now();
+
+    uint32_t tex_id = lcmgl->texture_count + 1;
+    lcmgl->texture_count ++;
+
+    _sent_texture_t *sent =
+        g_hash_table_lookup(lcmgl->texture_sent_utimes, &hash);
+    if (sent && now - sent->utime < TEXTURE_RESEND_INTERVAL_USEC) {
+        bot_lcmgl_encode_u8(lcmgl, BOT_LCMGL_TEX_2D_REF);
+        bot_lcmgl_encode_u32(lcmgl, tex_id);
+        bot_lcmgl_encode_u64(lcmgl, hash);
+        return tex_id;
+    }
+
+    bot_lcmgl_encode_u8(lcmgl, BOT_LCMGL_TEX_2D_CACHED);
+    bot_lcmgl_encode_u32(lcmgl, tex_id);
+    bot_lcmgl_encode_u64(lcmgl, hash);
+    _encode_texture_data(lcmgl, data, width, height, row_stride,
+            format, type, compression);
+
+    if (!sent) {
+        sent = (_sent_texture_t*) malloc(sizeof(_sent_texture_t));
+        sent->hash = hash;
+        g_hash_table_insert(lcmgl->texture_sent_utimes, &sent->hash, sent);
+    }
+    sent->utime = now;
 
     return tex_id;
 }
@@ -306,6 +306,26 @@ int bot_lcmgl_texture2d(bot_lcmgl_t *lcmgl, const void *data,
         bot_lcmgl_texture_type_t type,
         bot_lcmgl_compress_mode_t compression);
 
+/**
+ * bot_lcmgl_texture2d_cached:
+ *
+ * Like bot_lcmgl_texture2d(), for textures that are drawn again in later
+ * scenes, e.g. an image overlay or a colormap.  The texture is identified by
+ * a hash of its contents, and renderers keep the textures they have received
+ * in a cache.  The pixel data is only transmitted the first time, and again
+ * once a second so that renderers that started late, or evicted the texture
+ * from their cache, get it back.  Other scenes only transmit the hash.  A
+ * renderer that doesn't have the texture yet doesn't draw it.
+ *
+ * @return: the texture ID.  This ID is valid until bot_lcmgl_switch_buffer is
+ * called.
+ */
+int bot_lcmgl_texture2d_cached(bot_lcmgl_t *lcmgl, const void *data,
+        int width, int height, int row_stride,
+        bot_lcmgl_texture_format_t format,
+        bot_lcmgl_texture_type_t type,
+        bot_lcmgl_compress_mode_t compression);
+
 /**
  * Renders the specified texture with the active OpenGL color.
  */
@@ -357,7 +377,9 @@ enum _bot_lcmgl_enum_t
     BOT_LCMGL_CYLINDER,
     BOT_LCMGL_MATRIX_MODE,
     BOT_LCMGL_ORTHO,
-    BOT_LCMGL_SCALE_TO_VIEWER_AR
+    BOT_LCMGL_SCALE_TO_VIEWER_AR,
+    BOT_LCMGL_TEX_2D_CACHED,
+    BOT_LCMGL_TEX_2D_REF
 };
 
 /**
@@ -7,6 +7,9 @@
 #include "lcmgl_decode.h"
 #include "lcmgl_bot_renderer.h"
 
+// GPU memory kept for the textures of bot_lcmgl_texture2d_cached()
+#define TEXTURE_CACHE_SIZE (64 * 1024 * 1024)
+
 typedef struct
 {
     GPtrArray *backbuffer;
@@ -22,12 +25,15 @@ typedef struct _BotLcmglRenderer {
 
     GHashTable *channels;
 
+    bot_lcmgl_texture_cache_t *texture_cache;
+
 } BotLcmglRenderer;
 
 static void my_free( BotRenderer *renderer )
 {
     BotLcmglRenderer *self = (BotLcmglRenderer*) renderer;
 
+    bot_lcmgl_texture_cache_destroy(self->texture_cache);
     free( self );
 }
 
@@ -54,7 +60,8 @@ static void my_draw( BotViewer *viewer, BotRenderer *renderer )
                 bot_lcmgl_data_t *data =
                     g_ptr_array_index(chan->frontbuffer, i);
 
-                bot_lcmgl_decode(data->data, data->datalen);
+                bot_lcmgl_decode_with_cache(data->data, data->datalen,
+                        self->texture_cache);
             }
         }
         glPopAttrib ();
@@ -169,6 +176,7 @@ bot_lcmgl_add_renderer_to_viewer(BotViewer* viewer, lcm_t* lcm, int priority)
     renderer->user = self;
 
     self->channels = g_hash_table_new(g_str_hash, g_str_equal);
+    self->texture_cache = bot_lcmgl_texture_cache_new(TEXTURE_CACHE_SIZE);
 
     g_signal_connect (G_OBJECT (self->pw), "changed",
                       G_CALLBACK (on_param_widget_changed), self);
@@ -131,9 +131,225 @@ static void gl_box(double xyz[3], double dim[3])
 typedef struct {
     int lcmgl_tex_id;
     BotGlTexture *tex;
+    // textures from the cache are not freed at the end of the scene
+    int cached;
 } _lcmgl_texture_t;
 
+typedef struct {
+    uint64_t hash;
+    BotGlTexture *tex;
+    int size;
+    // serial of the last bot_lcmgl_decode_with_cache call that used it
+    uint32_t last_used;
+    GList *lru_link;
+} _cached_texture_t;
+
+struct bot_lcmgl_texture_cache
+{
+    // hash -> _cached_texture_t
+    GHashTable *textures;
+    // most recently used textures first
+    GQueue *lru;
+    int64_t size;
+    int64_t max_size;
+    uint32_t serial;
+};
+
+bot_lcmgl_texture_cache_t *
+bot_lcmgl_texture_cache_new(int64_t max_size)
+{
+    bot_lcmgl_texture_cache_t *cache =
+        (bot_lcmgl_texture_cache_t*) calloc(1, sizeof(bot_lcmgl_texture_cache_t));
+    cache->textures = g_hash_table_new(g_int64_hash, g_int64_equal);
+    cache->lru = g_queue_new();
+    cache->max_size = max_size;
+    return cache;
+}
+
+void
+bot_lcmgl_texture_cache_destroy(bot_lcmgl_texture_cache_t *cache)
+{
+    for (GList *iter = cache->lru->head; iter; iter = iter->next) {
+        _cached_texture_t *ct = iter->data;
+        bot_gl_texture_free(ct->tex);
+        free(ct);
+    }
+    g_queue_free(cache->lru);
+    g_hash_table_destroy(cache->textures);
+    free(cache);
+}
+
+static BotGlTexture *
+_cache_lookup(bot_lcmgl_texture_cache_t *cache, uint64_t hash)
+{
+    _cached_texture_t *ct = g_hash_table_lookup(cache->textures, &hash);
+    if (!ct)
+        return NULL;
+    ct->last_used = cache->serial;
+    g_queue_unlink(cache->lru, ct->lru_link);
+    g_queue_push_head_link(cache->lru, ct->lru_link);
+    return ct->tex;
+}
+
+static void
+_cache_insert(bot_lcmgl_texture_cache_t *cache, uint64_t hash,
+        BotGlTexture *tex, int size)
+{
+    _cached_texture_t *ct = (_cached_texture_t*) calloc(1, sizeof(_cached_texture_t));
+    ct->hash = hash;
+    ct->tex = tex;
+    ct->size = size;
+    ct->last_used = cache->serial;
+    g_queue_push_head(cache->lru, ct);
+    ct->lru_link = cache->lru->head;
+    g_hash_table_insert(cache->textures, &ct->hash, ct);
+    cache->size += size;
+
+    // evict the least recently used textures, but not the ones that the
+    // scene being decoded still refers to
+    while (cache->size > cache->max_size) {
+        _cached_texture_t *lru = g_queue_peek_tail(cache->lru);
+        if (lru->last_used == cache->serial)
+            break;
+        g_queue_pop_tail(cache->lru);
+        g_hash_table_remove(cache->textures, &lru->hash);
+        cache->size -= lru->size;
+        bot_gl_texture_free(lru->tex);
+        free(lru);
+    }
+}
+
+// decodes the description and pixel data of a texture, that follow the
+// texture ID in the BOT_LCMGL_TEX_2D and BOT_LCMGL_TEX_2D_CACHED commands.
+// If upload is zero, the data is skipped and NULL is returned.
+static BotGlTexture *
+_decode_texture(lcmgl_decoder_t *ldec, int upload, int *size)
+{
+    uint32_t width = lcmgl_decode_u32(ldec);
+    uint32_t height = lcmgl_decode_u32(ldec);
+    uint32_t format = lcmgl_decode_u32(ldec);
+    uint32_t type = lcmgl_decode_u32(ldec);
+
+    int subpix_per_pixel = 1;
+    GLenum gl_format = format;
+    switch(format) {
+        case BOT_LCMGL_LUMINANCE:
+            subpix_per_pixel = 1;
+            break;
+        case BOT_LCMGL_RGB:
+            subpix_per_pixel = 3;
+            break;
+        case BOT_LCMGL_RGBA:
+            subpix_per_pixel = 4;
+            break;
+    }
+
+    GLenum gl_type = type;
+    int bytes_per_subpixel = 1;
+    switch (type) {
+          case BOT_LCMGL_UNSIGNED_BYTE:
+          case BOT_LCMGL_BYTE:
+              bytes_per_subpixel = 1;
+              break;
+          case BOT_LCMGL_UNSIGNED_SHORT:
+          case BOT_LCMGL_SHORT:
+              bytes_per_subpixel = 1;
+              break;
+          case BOT_LCMGL_UNSIGNED_INT:
+          case BOT_LCMGL_INT:
+          case BOT_LCMGL_FLOAT:
+              bytes_per_subpixel = 4;
+              break;
+    }
+
+
+    int bytes_per_row = width * subpix_per_pixel * bytes_per_subpixel;
+    int max_data_size = height * bytes_per_row;
+
+
+    int compression = lcmgl_decode_u32(ldec);
+    int raw_datalen = lcmgl_decode_u32(ldec);
+
+    if (!upload) {
+        switch (compression) {
+        case BOT_LCMGL_COMPRESS_NONE:
+            ldec->datapos += raw_datalen;
+            break;
+        case BOT_LCMGL_COMPRESS_ZLIB:
+            for (int row = 0; row < height; row++) {
+                uint32_t compressed_size = lcmgl_decode_u32(ldec);
+                ldec->datapos += compressed_size;
+            }
+            break;
+        }
+        return NULL;
+    }
+
+    void *data_uncompressed = NULL;
+    int free_uncompressed_data = 0;
+    switch (compression) {
+    case BOT_LCMGL_COMPRESS_NONE:
+      data_uncompressed = &ldec->data[ldec->datapos];
+      ldec->datapos += raw_datalen;
+      break;
+    case BOT_LCMGL_COMPRESS_ZLIB:
+    {
+      data_uncompressed = malloc(raw_datalen);
+      free_uncompressed_data = 1;
+
+      for (int row = 0; row < height; row++) {
+        void *row_start = (uint8_t*) data_uncompressed + row * bytes_per_row;
+        uint32_t compressed_size = lcmgl_decode_u32(ldec);
+        uLong uncompressed_size = bytes_per_row;
+        uLong uncompress_return = uncompress((Bytef *) row_start, (uLong *) &uncompressed_size,
+            (Bytef *) &ldec->data[ldec->datapos], (uLong) compressed_size);
+        if (uncompress_return != Z_OK || bytes_per_row != uncompressed_size) {
+          fprintf(stderr, "ERROR uncompressing the texture2D, ret = %lu\n", uncompress_return);
+          exit(1);
+        }
+        ldec->datapos += compressed_size;
+      }
+    }
+    break;
+    }
+
+    BotGlTexture *tex = bot_gl_texture_new(width, height, max_data_size);
+    bot_gl_texture_upload(tex, gl_format, gl_type,
+            bytes_per_row, data_uncompressed);
+
+    if (free_uncompressed_data)
+      free(data_uncompressed);
+
+    if (size)
+        *size = max_data_size;
+    return tex;
+}
+
+static void
+_add_texture(_lcmgl_texture_t ***textures, int *ntextures, uint32_t id,
+        BotGlTexture *tex, int cached)
+{
+    _lcmgl_texture_t *t = (_lcmgl_texture_t*)malloc(sizeof(_lcmgl_texture_t));
+    t->lcmgl_tex_id = id;
+    t->tex = tex;
+    t->cached = cached;
+
+    (*ntextures)++;
+    *textures = realloc(*textures, *ntextures * sizeof(_lcmgl_texture_t*));
+    (*textures)[*ntextures-1] = t;
+
+    if(id != *ntextures) {
+        // TODO emit warning...
+    }
+}
+
 void bot_lcmgl_decode(uint8_t *data, int datalen)
+{
+    bot_lcmgl_decode_with_cache(data, datalen, NULL);
+}
+
+void bot_lcmgl_decode_with_cache(uint8_t *data, int datalen,
+        bot_lcmgl_texture_cache_t *cache)
 {
     lcmgl_decoder_t ldec;
     ldec.data = data;
@@ -143,6 +359,9 @@ void bot_lcmgl_decode(uint8_t *data, int datalen)
     _lcmgl_texture_t **textures = NULL;
     int ntextures = 0;
 
+    if (cache)
+        cache->serial++;
+
     while (ldec.datapos < ldec.datalen) {
 
         uint8_t opcode = lcmgl_decode_u8(&ldec);
@@ -532,94 +751,42 @@ void bot_lcmgl_decode(uint8_t *data, int datalen)
         case BOT_LCMGL_TEX_2D:
         {
             uint32_t id = lcmgl_decode_u32(&ldec);
-            uint32_t width = lcmgl_decode_u32(&ldec);
-            uint32_t height = lcmgl_decode_u32(&ldec);
-            uint32_t format = lcmgl_decode_u32(&ldec);
-            uint32_t type = lcmgl_decode_u32(&ldec);
-
-            int subpix_per_pixel = 1;
-            GLenum gl_format = format;
-            switch(format) {
-                case BOT_LCMGL_LUMINANCE:
-                    subpix_per_pixel = 1;
-                    break;
-                case BOT_LCMGL_RGB:
-                    subpix_per_pixel = 3;
-                    break;
-                case BOT_LCMGL_RGBA:
-                    subpix_per_pixel = 4;
-                    break;
-            }
-
-            GLenum gl_type = type;
-            int bytes_per_subpixel = 1;
-            switch (type) {
-                  case BOT_LCMGL_UNSIGNED_BYTE:
-                  case BOT_LCMGL_BYTE:
-                      bytes_per_subpixel = 1;
-                      break;
-                  case BOT_LCMGL_UNSIGNED_SHORT:
-                  case BOT_LCMGL_SHORT:
-                      bytes_per_subpixel = 1;
-                      break;
-                  case BOT_LCMGL_UNSIGNED_INT:
-                  case BOT_LCMGL_INT:
-                  case BOT_LCMGL_FLOAT:
-                      bytes_per_subpixel = 4;
-                      break;
+            BotGlTexture *tex = _decode_texture(&ldec, 1, NULL);
+            _add_texture(&textures, &ntextures, id, tex, 0);
+            break;
+        }
+        case BOT_LCMGL_TEX_2D_CACHED:
+        {
+            uint32_t id = lcmgl_decode_u32(&ldec);
+            uint64_t hash = lcmgl_decode_u64(&ldec);
+            if (!cache) {
+                BotGlTexture *tex = _decode_texture(&ldec, 1, NULL);
+                _add_texture(&textures, &ntextures, id, tex, 0);
+                break;
             }
 
-
-            int bytes_per_row = width * subpix_per_pixel * bytes_per_subpixel;
-            int max_data_size = height * bytes_per_row;
-
-
-            int compression = lcmgl_decode_u32(&ldec);
-            int raw_datalen = lcmgl_decode_u32(&ldec);
-            void *data_uncompressed = NULL;
-            int free_uncompressed_data = 0;
-            switch (compression) {
-            case BOT_LCMGL_COMPRESS_NONE:
-              data_uncompressed = &ldec.data[ldec.datapos];
-              ldec.datapos += raw_datalen;
-              break;
-            case BOT_LCMGL_COMPRESS_ZLIB:
-            {
-              data_uncompressed = malloc(raw_datalen);
-              free_uncompressed_data = 1;
-
-              for (int row = 0; row < height; row++) {
-                void *row_start = (uint8_t*) data_uncompressed + row * bytes_per_row;
-                uint32_t compressed_size = lcmgl_decode_u32(&ldec);
-                uLong uncompressed_size = bytes_per_row;
-                uLong uncompress_return = uncompress((Bytef *) row_start, (uLong *) &uncompressed_size,
-                    (Bytef *) &ldec.data[ldec.datapos], (uLong) compressed_size);
-                if (uncompress_return != Z_OK || bytes_per_row != uncompressed_size) {
-                  fprintf(stderr, "ERROR uncompressing the texture2D, ret = %lu\n", uncompress_return);
-                  exit(1);
-                }
-                ldec.datapos += compressed_size;
-              }
+            // only decode and upload the texture if it isn't cached yet,
+            // e.g. when this scene is drawn again
+            BotGlTexture *tex = _cache_lookup(cache, hash);
+            if (tex) {
+                _decode_texture(&ldec, 0, NULL);
+            } else {
+                int size = 0;
+                tex = _decode_texture(&ldec, 1, &size);
+                _cache_insert(cache, hash, tex, size);
             }
+            _add_texture(&textures, &ntextures, id, tex, 1);
             break;
-            }
-
-            _lcmgl_texture_t *tex = (_lcmgl_texture_t*)malloc(sizeof(_lcmgl_texture_t));
-
-            tex->tex = bot_gl_texture_new(width, height, max_data_size);
-            bot_gl_texture_upload(tex->tex, gl_format, gl_type,
-                    bytes_per_row, data_uncompressed);
-
-            if (free_uncompressed_data)
-              free(data_uncompressed);
-
-            ntextures++;
-            textures = realloc(textures, ntextures * sizeof(_lcmgl_texture_t));
-            textures[ntextures-1] = tex;
+        }
+        case BOT_LCMGL_TEX_2D_REF:
+        {
+            uint32_t id = lcmgl_decode_u32(&ldec);
+            uint64_t hash = lcmgl_decode_u64(&ldec);
 
-            if(id != ntextures) {
-                // TODO emit warning...
-            }
+            // if the texture isn't cached, it isn't drawn until the client
+            // transmits its data again
+            BotGlTexture *tex = cache ? _cache_lookup(cache, hash) : NULL;
+            _add_texture(&textures, &ntextures, id, tex, 1);
             break;
         }
         case BOT_LCMGL_TEX_DRAW_QUAD:
@@ -642,7 +809,7 @@ void bot_lcmgl_decode(uint8_t *data, int datalen)
             double y_bot_left = lcmgl_decode_double(&ldec);
             double z_bot_left = lcmgl_decode_double(&ldec);
 
-            if(id <= ntextures) {
+            if(id > 0 && id <= ntextures && textures[id - 1]->tex) {
                 _lcmgl_texture_t *tex = textures[id - 1];
                 bot_gl_texture_draw_coords(tex->tex, 
                         x_top_left, y_top_left, z_top_left,
@@ -672,7 +839,8 @@ void bot_lcmgl_decode(uint8_t *data, int datalen)
     }
 
     for(int i=0; i<ntextures; i++) {
-        bot_gl_texture_free(textures[i]->tex);
+        if (!textures[i]->cached)
+            bot_gl_texture_free(textures[i]->tex);
         free(textures[i]);
     }
     free(textures);
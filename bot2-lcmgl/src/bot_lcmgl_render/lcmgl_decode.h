@@ -28,6 +28,32 @@ extern "C" {
  */
 void bot_lcmgl_decode(uint8_t *data, int datalen);
 
+typedef struct bot_lcmgl_texture_cache bot_lcmgl_texture_cache_t;
+
+/**
+ * bot_lcmgl_texture_cache_new:
+ * @max_size: size, in bytes, above which the least recently used textures
+ * are evicted.
+ *
+ * Creates a cache of the textures sent with bot_lcmgl_texture2d_cached(),
+ * keyed by the hash of their contents.  The textures are freed with the
+ * current OpenGL context.
+ */
+bot_lcmgl_texture_cache_t *bot_lcmgl_texture_cache_new(int64_t max_size);
+
+void bot_lcmgl_texture_cache_destroy(bot_lcmgl_texture_cache_t *cache);
+
+/**
+ * bot_lcmgl_decode_with_cache:
+ *
+ * Like bot_lcmgl_decode(), but textures sent with
+ * bot_lcmgl_texture2d_cached() are uploaded only once and kept in @cache.
+ * Scenes that only refer to a texture by its hash draw it from @cache.
+ * bot_lcmgl_decode() does not draw those references.
+ */
+void bot_lcmgl_decode_with_cache(uint8_t *data, int datalen,
+        bot_lcmgl_texture_cache_t *cache);
+
 /**
  * @}
  */
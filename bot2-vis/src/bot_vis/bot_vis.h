@@ -7,13 +7,16 @@
 #include "fbgl_drawing_area.h"
 #include "gl_drawing_area.h"
 #include "gl_image_area.h"
+#include "gl_text.h"
 #include "gl_util.h"
 #include "gtk_util.h"
+#include "occ_grid_renderer.h"
 #include "param_widget.h"
 #include "rwx.h"
 #include "wavefront.h"
 #include "scrollplot2d.h"
 #include "texture.h"
+#include "tiled_image_renderer.h"
 #include "viewer.h"
 #include "view.h"
 
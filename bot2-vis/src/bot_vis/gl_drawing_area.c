@@ -4,6 +4,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <X11/Xlib.h>
+#include <X11/Xlibint.h>
 #include <gdk/gdkx.h>
 
 #ifdef __APPLE__
@@ -45,6 +46,14 @@ struct _BotGtkGlDrawingAreaPrivate {
 #endif
 };
 
+/* The contexts of all drawing areas on a display share display lists,
+ * textures and other GL objects through share_root, a context that is never
+ * destroyed, so that the objects outlive any one drawing area. */
+G_LOCK_DEFINE_STATIC (share_group);
+static Display * share_root_dpy = NULL;
+static GLXContext share_root = NULL;
+static GHashTable * share_contexts = NULL;
+
 static void bot_gtk_gl_drawing_area_realize (GtkWidget * widget);
 static void bot_gtk_gl_drawing_area_unrealize (GtkWidget * widget);
 static void bot_gtk_gl_drawing_area_size_allocate (GtkWidget * widget,
@@ -227,6 +236,59 @@ swap_func (GIOChannel * source, GIOCondition cond, gpointer data)
 }
 #endif
 
+/* Creates a context that shares objects with the contexts of the other
+ * drawing areas.  If the GLX implementation can't share them, the context
+ * is created on its own. */
+static GLXContext
+create_shared_context (Display * dpy, XVisualInfo * visual)
+{
+    GLXContext context = NULL;
+
+    G_LOCK (share_group);
+    if (!share_root) {
+        share_root = glXCreateContext (dpy, visual, NULL, GL_TRUE);
+        share_root_dpy = dpy;
+        share_contexts = g_hash_table_new (g_direct_hash, g_direct_equal);
+    }
+    if (share_root && dpy == share_root_dpy) {
+        context = glXCreateContext (dpy, visual, share_root,
+                glXIsDirect (dpy, share_root));
+        if (context)
+            g_hash_table_insert (share_contexts, context, context);
+    }
+    G_UNLOCK (share_group);
+
+    if (!context) {
+        fprintf (stderr, "Warning: GL objects can't be shared with other "
+                "drawing areas\n");
+        context = glXCreateContext (dpy, visual, NULL, GL_TRUE);
+    }
+    return context;
+}
+
+static void
+remove_shared_context (GLXContext context)
+{
+    G_LOCK (share_group);
+    if (share_contexts)
+        g_hash_table_remove (share_contexts, context);
+    G_UNLOCK (share_group);
+}
+
+void *
+bot_gl_get_current_share_group (void)
+{
+    GLXContext context = glXGetCurrentContext ();
+    void * group = context;
+
+    G_LOCK (share_group);
+    if (context && share_contexts &&
+            g_hash_table_lookup (share_contexts, context))
+        group = share_root;
+    G_UNLOCK (share_group);
+    return group;
+}
+
 /* Returns 1 if the specified GLX extension is present, 0 if not. */
 static int
 is_glx_extension_present (Display * dpy, int screen, char * ext)
@@ -286,8 +348,7 @@ bot_gtk_gl_drawing_area_realize (GtkWidget * widget)
     if (nitems != 1)
         fprintf (stderr, "Warning: more than one matching X visual found\n");
 
-    priv->context = glXCreateContext (priv->dpy, priv->visual, 0,
-            GL_TRUE);
+    priv->context = create_shared_context (priv->dpy, priv->visual);
     if (!priv->context) {
         g_warning ("Failed to get GLX context\n");
         XFree (priv->visual);
@@ -368,8 +429,10 @@ bot_gtk_gl_drawing_area_unrealize (GtkWidget * widget)
     if (priv->vblank_watch)
         g_source_remove (priv->vblank_watch);
 #endif
-    if (priv->context)
+    if (priv->context) {
+        remove_shared_context (priv->context);
         glXDestroyContext (priv->dpy, priv->context);
+    }
     if (priv->visual)
         XFree (priv->visual);
 
@@ -435,3 +498,81 @@ bot_gtk_gl_drawing_area_invalidate (BotGtkGlDrawingArea * self)
             widget->allocation.width, widget->allocation.height);
 }
 
+
+struct _BotGtkGlThreadContext {
+    Window window;
+    Display * dpy;
+    GLXContext context;
+};
+
+BotGtkGlThreadContext *
+bot_gtk_gl_drawing_area_new_thread_context (BotGtkGlDrawingArea * self)
+{
+    GtkWidget * widget = GTK_WIDGET (self);
+    BotGtkGlDrawingAreaPrivate * priv = BOT_GTK_GL_DRAWING_AREA_GET_PRIVATE (self);
+
+    if (!GTK_WIDGET_REALIZED (widget) || !priv->visual || !priv->context)
+        return NULL;
+
+    // the context is created on the display connection of the drawing area,
+    // since direct rendering drivers can't reliably share objects between
+    // contexts on different connections.  Xlib only allows the connection to
+    // be used from two threads if XInitThreads() was called before it was
+    // opened, which is when it gets a lock.
+    if (!priv->dpy->lock) {
+        fprintf (stderr, "GLX Context Error: XInitThreads() was not called "
+                "before gtk_init(), can't draw from another thread\n");
+        return NULL;
+    }
+
+    BotGtkGlThreadContext * ctx = g_slice_new0 (BotGtkGlThreadContext);
+    ctx->window = GDK_WINDOW_XID (widget->window);
+    ctx->dpy = priv->dpy;
+
+    // share display lists, textures and other GL objects with the context of
+    // the drawing area, so that either context can draw with them
+    ctx->context = glXCreateContext (ctx->dpy, priv->visual, priv->context,
+            glXIsDirect (ctx->dpy, priv->context));
+    if (!ctx->context) {
+        fprintf (stderr, "GLX Context Error: Failed to get a thread GLX "
+                "context that shares objects with the drawing area\n");
+        bot_gtk_gl_thread_context_destroy (ctx);
+        return NULL;
+    }
+
+    G_LOCK (share_group);
+    if (share_contexts && g_hash_table_lookup (share_contexts, priv->context))
+        g_hash_table_insert (share_contexts, ctx->context, ctx->context);
+    G_UNLOCK (share_group);
+    return ctx;
+}
+
+int
+bot_gtk_gl_thread_context_make_current (BotGtkGlThreadContext * ctx)
+{
+    if (!glXMakeCurrent (ctx->dpy, ctx->window, ctx->context)) {
+        fprintf (stderr, "GLX Context Error: Could not make thread GLX context current\n");
+        return -1;
+    }
+    return 0;
+}
+
+void
+bot_gtk_gl_thread_context_swap_buffers (BotGtkGlThreadContext * ctx)
+{
+    if (ctx->context)
+        glXSwapBuffers (ctx->dpy, ctx->window);
+}
+
+void
+bot_gtk_gl_thread_context_destroy (BotGtkGlThreadContext * ctx)
+{
+    if (ctx->context) {
+        // the context is only current if this is the drawing thread
+        if (glXGetCurrentContext () == ctx->context)
+            glXMakeCurrent (ctx->dpy, None, NULL);
+        remove_shared_context (ctx->context);
+        glXDestroyContext (ctx->dpy, ctx->context);
+    }
+    g_slice_free (BotGtkGlThreadContext, ctx);
+}
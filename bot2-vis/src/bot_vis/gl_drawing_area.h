@@ -47,6 +47,37 @@ void        bot_gtk_gl_drawing_area_swap_buffers (BotGtkGlDrawingArea * glarea);
 int         bot_gtk_gl_drawing_area_set_context (BotGtkGlDrawingArea * glarea);
 void        bot_gtk_gl_drawing_area_invalidate (BotGtkGlDrawingArea * glarea);
 
+/*
+ * The contexts of all drawing areas, and their thread contexts, share
+ * display lists, textures and other GL objects when the GLX implementation
+ * allows it.  Returns a key that is the same for all contexts that share
+ * objects with the current context, for caching objects per share group,
+ * or NULL if no context is current.  A context that shares with no other
+ * context is its own group.
+ */
+void *      bot_gl_get_current_share_group (void);
+
+/*
+ * A second OpenGL context for the window of a realized drawing area, for
+ * drawing from another thread.  Create it on the GTK+ thread, then use and
+ * destroy it on the drawing thread, before the drawing area is unrealized.
+ *
+ * The context shares display lists, textures and other GL objects with the
+ * context of the drawing area, so objects created in either context can be
+ * used in the other.  It uses the X connection of the drawing area, since
+ * GL objects can't reliably be shared across connections, so XInitThreads()
+ * must be called before gtk_init().  Otherwise, or if the GLX implementation
+ * can't share the objects, creating the context fails and the caller has to
+ * keep drawing on the GTK+ thread.
+ */
+typedef struct _BotGtkGlThreadContext BotGtkGlThreadContext;
+
+BotGtkGlThreadContext * bot_gtk_gl_drawing_area_new_thread_context (
+        BotGtkGlDrawingArea * glarea);
+int         bot_gtk_gl_thread_context_make_current (BotGtkGlThreadContext * ctx);
+void        bot_gtk_gl_thread_context_swap_buffers (BotGtkGlThreadContext * ctx);
+void        bot_gtk_gl_thread_context_destroy (BotGtkGlThreadContext * ctx);
+
 G_END_DECLS
 
 /**
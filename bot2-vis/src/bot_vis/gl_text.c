@@ -0,0 +1,573 @@
+/* gl_text.c:
+ *
+ * Text labels drawn from a per-font glyph atlas.  Fonts are rasterized once
+ * with pango/cairo, label layouts are cached by (font, flags, text), and
+ * queued labels are drawn with one vertex array per font.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <glib.h>
+#include <pango/pangocairo.h>
+
+#include "gl_util.h"
+#include "gl_text.h"
+#include "gl_drawing_area.h"
+
+#define err(args...) fprintf(stderr, args)
+
+#define FIRST_GLYPH 32
+#define NUM_GLYPHS 256
+#define MAX_ATLAS_SIZE 2048
+
+// the atlas reserves an opaque block in its top left corner, used to draw
+// drop shadows with the same texture as the glyphs
+#define SOLID_BLOCK_SIZE 2
+
+#define MAX_CACHED_LAYOUTS 2048
+
+// flags that affect the layout of a label relative to its anchor point
+#define LAYOUT_FLAGS (BOT_GL_DRAW_TEXT_DROP_SHADOW | \
+        BOT_GL_DRAW_TEXT_JUSTIFY_LEFT | BOT_GL_DRAW_TEXT_JUSTIFY_RIGHT | \
+        BOT_GL_DRAW_TEXT_JUSTIFY_CENTER | BOT_GL_DRAW_TEXT_ANCHOR_LEFT | \
+        BOT_GL_DRAW_TEXT_ANCHOR_RIGHT | BOT_GL_DRAW_TEXT_ANCHOR_TOP | \
+        BOT_GL_DRAW_TEXT_ANCHOR_BOTTOM)
+
+typedef struct {
+    int advance;
+    GLfloat s0, t0, s1, t1;
+} _glyph_t;
+
+typedef struct {
+    // window coordinates.  z is the window depth of the label, or 0 for
+    // labels that are not depth tested
+    GLfloat x, y, z;
+    GLfloat s, t;
+    GLubyte rgba[4];
+} _vertex_t;
+
+typedef struct {
+    void *font;
+    // the share group of the contexts that can use texname
+    void *group;
+    GLuint texname;
+    int width, height;
+    int line_height;
+    int baseline;     // distance from the top of a line to its baseline
+    GLfloat solid_s, solid_t;
+    _glyph_t glyphs[NUM_GLYPHS];
+
+    // vertices queued for the next flush
+    GArray *vertices;
+} _font_atlas_t;
+
+// a laid out label, as quads relative to the label's anchor point.  Each
+// quad is { x0, y0, x1, y1, s0, t0, s1, t1 }.  If the label has a drop
+// shadow, it is the first quad.
+typedef struct {
+    _font_atlas_t *atlas;
+    int nquads;
+    int has_shadow;
+    GLfloat *quads;
+} _text_layout_t;
+
+static GPtrArray *_atlases = NULL;
+static GHashTable *_layouts = NULL;
+static int _batch_depth = 0;
+
+static const char *
+_font_family (void *font, int *pixel_size)
+{
+    if (font == GLUT_BITMAP_8_BY_13) {
+        *pixel_size = 11;
+        return "Monospace";
+    }
+    if (font == GLUT_BITMAP_9_BY_15) {
+        *pixel_size = 13;
+        return "Monospace";
+    }
+    if (font == GLUT_BITMAP_HELVETICA_10) {
+        *pixel_size = 10;
+        return "Sans";
+    }
+    if (font == GLUT_BITMAP_HELVETICA_18) {
+        *pixel_size = 18;
+        return "Sans";
+    }
+    if (font == GLUT_BITMAP_TIMES_ROMAN_10) {
+        *pixel_size = 10;
+        return "Serif";
+    }
+    if (font == GLUT_BITMAP_TIMES_ROMAN_24) {
+        *pixel_size = 24;
+        return "Serif";
+    }
+    *pixel_size = 12;
+    return "Sans";
+}
+
+// assigns each glyph a position in a width x height atlas.  Returns 0 if all
+// glyphs fit, -1 otherwise
+static int
+_pack_glyphs (const int *advances, int line_height, int width, int height,
+        int *xs, int *ys)
+{
+    int x = SOLID_BLOCK_SIZE + 1;
+    int y = 0;
+    for (int c = FIRST_GLYPH; c < NUM_GLYPHS; c++) {
+        if (x + advances[c] > width) {
+            x = 0;
+            y += line_height + 1;
+        }
+        if (y + line_height > height)
+            return -1;
+        xs[c] = x;
+        ys[c] = y;
+        x += advances[c] + 1;
+    }
+    return 0;
+}
+
+static _font_atlas_t *
+_font_atlas_new (void *font)
+{
+    int pixel_size;
+    const char *family = _font_family (font, &pixel_size);
+
+    PangoFontDescription *desc = pango_font_description_new ();
+    pango_font_description_set_family (desc, family);
+    pango_font_description_set_absolute_size (desc, pixel_size * PANGO_SCALE);
+
+    // measure the glyphs using a scratch surface
+    cairo_surface_t *surface = cairo_image_surface_create (CAIRO_FORMAT_A8,
+            1, 1);
+    cairo_t *cr = cairo_create (surface);
+    PangoLayout *layout = pango_cairo_create_layout (cr);
+    pango_layout_set_font_description (layout, desc);
+
+    PangoRectangle logical;
+    pango_layout_set_text (layout, "Mg", -1);
+    pango_layout_get_pixel_extents (layout, NULL, &logical);
+    int line_height = logical.height;
+    int baseline = PANGO_PIXELS (pango_layout_get_baseline (layout));
+
+    // bytes are interpreted as Latin-1, like the GLUT bitmap fonts
+    int advances[NUM_GLYPHS];
+    memset (advances, 0, sizeof (advances));
+    for (int c = FIRST_GLYPH; c < NUM_GLYPHS; c++) {
+        char utf8[8];
+        int len = g_unichar_to_utf8 (c, utf8);
+        pango_layout_set_text (layout, utf8, len);
+        pango_layout_get_pixel_extents (layout, NULL, &logical);
+        advances[c] = logical.width;
+    }
+    g_object_unref (layout);
+    cairo_destroy (cr);
+    cairo_surface_destroy (surface);
+
+    int xs[NUM_GLYPHS], ys[NUM_GLYPHS];
+    int size = 128;
+    while (size <= MAX_ATLAS_SIZE &&
+            _pack_glyphs (advances, line_height, size, size, xs, ys) < 0)
+        size *= 2;
+    if (size > MAX_ATLAS_SIZE || line_height <= 0) {
+        err ("bot_gl_text: unable to create glyph atlas for font %s %dpx\n",
+                family, pixel_size);
+        pango_font_description_free (desc);
+        return NULL;
+    }
+
+    // rasterize the glyphs
+    surface = cairo_image_surface_create (CAIRO_FORMAT_A8, size, size);
+    cr = cairo_create (surface);
+    layout = pango_cairo_create_layout (cr);
+    pango_layout_set_font_description (layout, desc);
+    cairo_set_source_rgba (cr, 1, 1, 1, 1);
+    cairo_rectangle (cr, 0, 0, SOLID_BLOCK_SIZE, SOLID_BLOCK_SIZE);
+    cairo_fill (cr);
+    for (int c = FIRST_GLYPH; c < NUM_GLYPHS; c++) {
+        char utf8[8];
+        int len = g_unichar_to_utf8 (c, utf8);
+        pango_layout_set_text (layout, utf8, len);
+        cairo_move_to (cr, xs[c], ys[c]);
+        pango_cairo_show_layout (cr, layout);
+    }
+    cairo_surface_flush (surface);
+    g_object_unref (layout);
+    cairo_destroy (cr);
+    pango_font_description_free (desc);
+
+    _font_atlas_t *atlas = g_slice_new0 (_font_atlas_t);
+    atlas->font = font;
+    atlas->width = size;
+    atlas->height = size;
+    atlas->line_height = line_height;
+    atlas->baseline = baseline;
+    atlas->solid_s = (SOLID_BLOCK_SIZE / 2.0) / size;
+    atlas->solid_t = (SOLID_BLOCK_SIZE / 2.0) / size;
+    for (int c = FIRST_GLYPH; c < NUM_GLYPHS; c++) {
+        _glyph_t *g = &atlas->glyphs[c];
+        g->advance = advances[c];
+        g->s0 = (GLfloat) xs[c] / size;
+        g->s1 = (GLfloat) (xs[c] + advances[c]) / size;
+        g->t0 = (GLfloat) ys[c] / size;
+        g->t1 = (GLfloat) (ys[c] + line_height) / size;
+    }
+    atlas->vertices = g_array_new (FALSE, FALSE, sizeof (_vertex_t));
+
+    glPushAttrib (GL_TEXTURE_BIT);
+    glPushClientAttrib (GL_CLIENT_PIXEL_STORE_BIT);
+    glGenTextures (1, &atlas->texname);
+    glBindTexture (GL_TEXTURE_2D, atlas->texname);
+    glPixelStorei (GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei (GL_UNPACK_ROW_LENGTH, cairo_image_surface_get_stride (surface));
+    glPixelStorei (GL_UNPACK_SKIP_ROWS, 0);
+    glPixelStorei (GL_UNPACK_SKIP_PIXELS, 0);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glTexImage2D (GL_TEXTURE_2D, 0, GL_ALPHA8, size, size, 0, GL_ALPHA,
+            GL_UNSIGNED_BYTE, cairo_image_surface_get_data (surface));
+    glPopClientAttrib ();
+    glPopAttrib ();
+
+    cairo_surface_destroy (surface);
+    return atlas;
+}
+
+// atlases are created once per font in each share group, since contexts
+// that don't share textures can't use each other's
+static _font_atlas_t *
+_get_font_atlas (void *font)
+{
+    if (!_atlases)
+        _atlases = g_ptr_array_new ();
+
+    void *group = bot_gl_get_current_share_group ();
+    for (int i = 0; i < _atlases->len; i++) {
+        _font_atlas_t *atlas = g_ptr_array_index (_atlases, i);
+        if (atlas->font == font && atlas->group == group)
+            return atlas;
+    }
+
+    _font_atlas_t *atlas = _font_atlas_new (font);
+    if (atlas) {
+        atlas->group = group;
+        g_ptr_array_add (_atlases, atlas);
+    }
+    return atlas;
+}
+
+static void
+_text_layout_free (_text_layout_t *tl)
+{
+    g_free (tl->quads);
+    g_slice_free (_text_layout_t, tl);
+}
+
+static inline int
+_glyph_index (unsigned char c)
+{
+    return (c < FIRST_GLYPH || (c >= 127 && c < 160)) ? '?' : c;
+}
+
+static int
+_line_width (_font_atlas_t *atlas, const char *line, int len)
+{
+    int width = 0;
+    for (int i = 0; i < len; i++)
+        width += atlas->glyphs[_glyph_index (line[i])].advance;
+    return width;
+}
+
+// lays out a label around its anchor point, using the same conventions as
+// the original GLUT bitmap implementation of bot_gl_draw_text
+static _text_layout_t *
+_text_layout_new (_font_atlas_t *atlas, const char *text, int flags)
+{
+    int text_len = strlen (text);
+    int nlines = 1;
+    for (int i = 0; i < text_len - 1; i++)
+        if (text[i] == '\n')
+            nlines++;
+
+    int line_starts[nlines], line_lens[nlines], line_widths[nlines];
+    int nglyphs = 0;
+    int max_width = 0;
+    int line = 0;
+    int start = 0;
+    for (int i = 0; i <= text_len && line < nlines; i++) {
+        if (i == text_len || text[i] == '\n') {
+            line_starts[line] = start;
+            line_lens[line] = i - start;
+            line_widths[line] = _line_width (atlas, text + start, i - start);
+            if (line_widths[line] > max_width)
+                max_width = line_widths[line];
+            nglyphs += line_lens[line];
+            start = i + 1;
+            line++;
+        }
+    }
+
+    int line_height = atlas->line_height;
+    int height = line_height * nlines;
+
+    // offset of the label center from the anchor point
+    int cx = 0, cy = 0;
+    if (flags & BOT_GL_DRAW_TEXT_ANCHOR_TOP)
+        cy -= height / 2;
+    if (flags & BOT_GL_DRAW_TEXT_ANCHOR_BOTTOM)
+        cy += height / 2;
+    if (flags & BOT_GL_DRAW_TEXT_ANCHOR_LEFT)
+        cx += max_width / 2;
+    if (flags & BOT_GL_DRAW_TEXT_ANCHOR_RIGHT)
+        cx -= max_width / 2;
+
+    _text_layout_t *tl = g_slice_new0 (_text_layout_t);
+    tl->atlas = atlas;
+    tl->has_shadow = (flags & BOT_GL_DRAW_TEXT_DROP_SHADOW) ? 1 : 0;
+    tl->quads = g_new (GLfloat, 8 * (nglyphs + tl->has_shadow));
+
+    GLfloat *q = tl->quads;
+    if (tl->has_shadow) {
+        double hmargin = 3;
+        double vmargin_top = 0;
+        double vmargin_bottom = 5;
+        q[0] = cx - max_width / 2 - hmargin;
+        q[1] = cy - height / 2.0 - vmargin_bottom;
+        q[2] = cx + max_width / 2 + hmargin;
+        q[3] = cy + height / 2.0 + vmargin_top;
+        q[4] = q[6] = atlas->solid_s;
+        q[5] = q[7] = atlas->solid_t;
+        q += 8;
+    }
+
+    for (int i = 0; i < nlines; i++) {
+        // baseline of this line
+        int y = cy - height / 2 + (nlines - 1 - i) * line_height +
+            (line_height - atlas->baseline);
+        int x = cx - line_widths[i] / 2; // default = justify center
+
+        if (flags & BOT_GL_DRAW_TEXT_JUSTIFY_LEFT)
+            x = cx - max_width / 2;
+        if (flags & BOT_GL_DRAW_TEXT_JUSTIFY_RIGHT)
+            x = cx + max_width / 2 - line_widths[i];
+        if (flags & BOT_GL_DRAW_TEXT_JUSTIFY_CENTER)
+            x = cx - line_widths[i] / 2;
+
+        for (int j = 0; j < line_lens[i]; j++) {
+            const _glyph_t *g =
+                &atlas->glyphs[_glyph_index (text[line_starts[i] + j])];
+            q[0] = x;
+            q[1] = y - (line_height - atlas->baseline);
+            q[2] = x + g->advance;
+            q[3] = y + atlas->baseline;
+            q[4] = g->s0;
+            q[5] = g->t1;
+            q[6] = g->s1;
+            q[7] = g->t0;
+            q += 8;
+            x += g->advance;
+        }
+    }
+    tl->nquads = (q - tl->quads) / 8;
+    return tl;
+}
+
+static _text_layout_t *
+_get_text_layout (_font_atlas_t *atlas, const char *text, int flags)
+{
+    if (!_layouts)
+        _layouts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                (GDestroyNotify) _text_layout_free);
+
+    char keybuf[256];
+    char *key = keybuf;
+    int keylen = snprintf (keybuf, sizeof (keybuf), "%p|%x|%s", atlas,
+            flags & LAYOUT_FLAGS, text);
+    if (keylen >= (int) sizeof (keybuf))
+        key = g_strdup_printf ("%p|%x|%s", atlas, flags & LAYOUT_FLAGS,
+                text);
+
+    _text_layout_t *tl = g_hash_table_lookup (_layouts, key);
+    if (!tl) {
+        if (g_hash_table_size (_layouts) >= MAX_CACHED_LAYOUTS)
+            g_hash_table_remove_all (_layouts);
+        tl = _text_layout_new (atlas, text, flags);
+        g_hash_table_insert (_layouts, key == keybuf ? g_strdup (key) : key,
+                tl);
+        key = NULL;
+    }
+
+    if (key && key != keybuf)
+        g_free (key);
+    return tl;
+}
+
+static inline void
+_add_quad (GArray *vertices, const GLfloat *q, double x, double y, double z,
+        const GLubyte rgba[4])
+{
+    _vertex_t v[4] = {
+        { x + q[0], y + q[1], z, q[4], q[5], { rgba[0], rgba[1], rgba[2], rgba[3] } },
+        { x + q[2], y + q[1], z, q[6], q[5], { rgba[0], rgba[1], rgba[2], rgba[3] } },
+        { x + q[2], y + q[3], z, q[6], q[7], { rgba[0], rgba[1], rgba[2], rgba[3] } },
+        { x + q[0], y + q[3], z, q[4], q[7], { rgba[0], rgba[1], rgba[2], rgba[3] } },
+    };
+    g_array_append_vals (vertices, v, 4);
+}
+
+void
+bot_gl_text_flush (void)
+{
+    if (!_atlases)
+        return;
+
+    int have_vertices = 0;
+    for (int i = 0; i < _atlases->len; i++) {
+        _font_atlas_t *atlas = g_ptr_array_index (_atlases, i);
+        if (atlas->vertices->len)
+            have_vertices = 1;
+    }
+    if (!have_vertices)
+        return;
+
+    GLint viewport[4];
+    glGetIntegerv (GL_VIEWPORT, viewport);
+
+    glMatrixMode (GL_PROJECTION);
+    glPushMatrix ();
+    glLoadIdentity ();
+    // maps vertex z to the same window depth
+    glOrtho (viewport[0], viewport[0] + viewport[2],
+            viewport[1], viewport[1] + viewport[3], 0, -1);
+    glMatrixMode (GL_MODELVIEW);
+    glPushMatrix ();
+    glLoadIdentity ();
+
+    glPushAttrib (GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_COLOR_BUFFER_BIT |
+            GL_DEPTH_BUFFER_BIT);
+    glPushClientAttrib (GL_CLIENT_VERTEX_ARRAY_BIT);
+    // labels are occluded by the geometry in front of them, but don't
+    // occlude anything themselves
+    glEnable (GL_DEPTH_TEST);
+    glDepthFunc (GL_LEQUAL);
+    glDepthMask (GL_FALSE);
+    glDisable (GL_LIGHTING);
+    glDisable (GL_CULL_FACE);
+    glEnable (GL_BLEND);
+    glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable (GL_TEXTURE_2D);
+    glTexEnvi (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+
+    glEnableClientState (GL_VERTEX_ARRAY);
+    glEnableClientState (GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState (GL_COLOR_ARRAY);
+    glDisableClientState (GL_NORMAL_ARRAY);
+
+    for (int i = 0; i < _atlases->len; i++) {
+        _font_atlas_t *atlas = g_ptr_array_index (_atlases, i);
+        if (!atlas->vertices->len)
+            continue;
+
+        _vertex_t *v = (_vertex_t *) atlas->vertices->data;
+        glBindTexture (GL_TEXTURE_2D, atlas->texname);
+        glVertexPointer (3, GL_FLOAT, sizeof (_vertex_t), &v->x);
+        glTexCoordPointer (2, GL_FLOAT, sizeof (_vertex_t), &v->s);
+        glColorPointer (4, GL_UNSIGNED_BYTE, sizeof (_vertex_t), v->rgba);
+        glDrawArrays (GL_QUADS, 0, atlas->vertices->len);
+
+        g_array_set_size (atlas->vertices, 0);
+    }
+
+    glPopClientAttrib ();
+    glPopAttrib ();
+    glMatrixMode (GL_MODELVIEW);
+    glPopMatrix ();
+    glMatrixMode (GL_PROJECTION);
+    glPopMatrix ();
+    glMatrixMode (GL_MODELVIEW);
+}
+
+void
+bot_gl_text_begin_batch (void)
+{
+    _batch_depth++;
+}
+
+void
+bot_gl_text_end_batch (void)
+{
+    if (_batch_depth > 0)
+        _batch_depth--;
+    if (!_batch_depth)
+        bot_gl_text_flush ();
+}
+
+int
+bot_gl_text_draw (const double xyz[3], void *font, const char *text,
+        int flags)
+{
+    if (font == NULL) {
+        if (flags & BOT_GL_DRAW_TEXT_MONOSPACED)
+            font = GLUT_BITMAP_8_BY_13;
+        else
+            font = GLUT_BITMAP_HELVETICA_12;
+    }
+
+    _font_atlas_t *atlas = _get_font_atlas (font);
+    if (!atlas)
+        return -1;
+
+    if (!text || !*text)
+        return 0;
+
+    GLint viewport[4];
+    glGetIntegerv (GL_VIEWPORT, viewport);
+
+    double winxy[2];
+    double depth = 0;
+    if (flags & BOT_GL_DRAW_TEXT_NORMALIZED_SCREEN_COORDINATES) {
+        winxy[0] = viewport[0] + xyz[0] * viewport[2];
+        winxy[1] = viewport[1] + (1.0 - xyz[1]) * viewport[3];
+    } else {
+        GLdouble model_matrix[16];
+        GLdouble proj_matrix[16];
+        glGetDoublev (GL_MODELVIEW_MATRIX, model_matrix);
+        glGetDoublev (GL_PROJECTION_MATRIX, proj_matrix);
+
+        if (!gluProject (xyz[0], xyz[1], xyz[2],
+                        model_matrix, proj_matrix, viewport,
+                        &winxy[0], &winxy[1], &depth))
+            return 0;
+        // labels drawn with depth testing disabled stay on top
+        if (!glIsEnabled (GL_DEPTH_TEST))
+            depth = 0;
+    }
+
+    // snap to whole pixels so that glyphs are sampled 1:1 from the atlas
+    double x = floor (winxy[0] + 0.5);
+    double y = floor (winxy[1] + 0.5);
+
+    _text_layout_t *tl = _get_text_layout (atlas, text, flags);
+
+    GLfloat color[4];
+    glGetFloatv (GL_CURRENT_COLOR, color);
+    GLubyte rgba[4];
+    for (int i = 0; i < 4; i++)
+        rgba[i] = (GLubyte) (CLAMP (color[i], 0, 1) * 255 + 0.5);
+    const GLubyte shadow_rgba[4] = { 0, 0, 0, 153 };
+
+    const GLfloat *q = tl->quads;
+    for (int i = 0; i < tl->nquads; i++, q += 8)
+        _add_quad (atlas->vertices, q, x, y, depth,
+                (i == 0 && tl->has_shadow) ? shadow_rgba : rgba);
+
+    if (!_batch_depth)
+        bot_gl_text_flush ();
+    return 0;
+}
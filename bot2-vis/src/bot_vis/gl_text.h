@@ -0,0 +1,86 @@
+#ifndef __bot_gl_text_h__
+#define __bot_gl_text_h__
+
+/**
+ * @defgroup BotGlText Batched text rendering
+ * @brief Rendering text labels from a glyph atlas texture
+ * @ingroup BotVisGl
+ * @include: bot_vis/bot_vis.h
+ *
+ * Each font is rasterized once into a texture atlas the first time it is
+ * used.  A text label is then just a handful of textured quads, and the
+ * pixel layout of a label (line breaking, justification, anchoring) is
+ * cached so that labels which do not change between frames are not laid out
+ * again.
+ *
+ * Between bot_gl_text_begin_batch() and bot_gl_text_end_batch(), labels are
+ * queued instead of drawn, and all queued labels that share a font are drawn
+ * together with a single call to glDrawArrays().  BotViewer opens a batch
+ * around its renderers, so renderers calling bot_gl_draw_text() get batching
+ * automatically.  Outside of a batch, each label is drawn immediately.
+ *
+ * Fonts are selected using the GLUT bitmap font identifiers (e.g.,
+ * GLUT_BITMAP_HELVETICA_12).  An atlas is created for each share group of
+ * OpenGL contexts that draws with a font, see
+ * bot_gl_get_current_share_group().
+ *
+ * Linking: `pkg-config --libs bot2-vis`
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * bot_gl_text_draw:
+ * @xyz: position of the label, in the current modelview coordinates or, if
+ * BOT_GL_DRAW_TEXT_NORMALIZED_SCREEN_COORDINATES is set, in normalized
+ * screen coordinates.
+ * @font: a GLUT bitmap font identifier, or %NULL for the default font.
+ * @text: the text to draw.  May contain multiple lines.
+ * @flags: bitwise OR of the BOT_GL_DRAW_TEXT_* flags.
+ *
+ * Draws (or, inside a batch, queues) a text label using the current OpenGL
+ * color.  The label position is computed immediately, so the modelview and
+ * projection matrices in effect at the time of the call are used even if
+ * the label is drawn later.  If depth testing is enabled at the time of the
+ * call, the label is hidden by the geometry in front of @xyz.
+ *
+ * Returns: 0 on success, -1 if the font atlas could not be created.
+ */
+int bot_gl_text_draw (const double xyz[3], void *font, const char *text,
+        int flags);
+
+/**
+ * bot_gl_text_begin_batch:
+ *
+ * Starts queueing text labels instead of drawing them immediately.
+ */
+void bot_gl_text_begin_batch (void);
+
+/**
+ * bot_gl_text_end_batch:
+ *
+ * Draws all text labels queued since bot_gl_text_begin_batch() and stops
+ * queueing.
+ */
+void bot_gl_text_end_batch (void);
+
+/**
+ * bot_gl_text_flush:
+ *
+ * Draws all queued text labels without ending the current batch.  Useful for
+ * renderers that need their text to appear before subsequent drawing.
+ */
+void bot_gl_text_flush (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif
@@ -459,7 +459,10 @@ bot_glutBitmapString(void* font, const unsigned char* text)
 #endif
 }
 
-void bot_gl_draw_text (const double xyz[3], void *font, const char *text, int flags)
+// per-character GLUT bitmap rendering, used if the glyph atlas for a font
+// can't be created.
+static void
+_draw_text_glut (const double xyz[3], void *font, const char *text, int flags)
 {
     GLdouble model_matrix[16];
     GLdouble proj_matrix[16];
@@ -606,6 +609,12 @@ void bot_gl_draw_text (const double xyz[3], void *font, const char *text, int fl
     g_ptr_array_free(text_lines, TRUE);
 }
 
+void bot_gl_draw_text (const double xyz[3], void *font, const char *text, int flags)
+{
+    if (bot_gl_text_draw(xyz, font, text, flags) < 0)
+        _draw_text_glut(xyz, font, text, flags);
+}
+
 int 
 _bot_gl_check_errors(const char *file, int line)
 {
@@ -17,6 +17,7 @@
 #include "scrollplot2d.h"
 #include "console.h"
 #include "batch_gl.h"
+#include "gl_text.h"
 #include <bot_core/bot_core.h>
 
 /**
@@ -125,6 +126,9 @@ bot_gl_draw_arrow_3d (double length, double head_width, double head_length,
  *
  * We DO support multi-line text.
  *
+ * Glyphs are drawn from a texture atlas (see bot_gl_text_draw()), and are
+ * batched when called from a BotViewer renderer.
+ *
  **/
 void bot_gl_draw_text (const double xyz[3], void *font, const char *text, 
         int flags);
@@ -253,7 +253,6 @@ glmFindOrAddTexture(GLMmodel* model, const char* name)
 {
     GLuint i;
     char *dir, *filename;
-    float width, height;
 
     /* XXX doing a linear search on a string key'd list is pretty lame,
        but it works and is fast enough for now. */
@@ -268,22 +267,53 @@ glmFindOrAddTexture(GLMmodel* model, const char* name)
     strcat(filename, name);
     free(dir);
 
-    /* didn't find the name, so print a warning and return the default
-       texture (0). */
+    /* the image is decoded in the background, and uploaded by the first
+       glmDraw() after that */
     model->numtextures++;
     model->textures = (GLMtexture*)realloc(model->textures, sizeof(GLMtexture)*model->numtextures);
     model->textures[model->numtextures-1].name = strdup(name);
-    model->textures[model->numtextures-1].id =
-        glmLoadTexture(filename, GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE, &width, &height);
-    model->textures[model->numtextures-1].width = width;
-    model->textures[model->numtextures-1].height = height;
-    DBG_(__glmWarning("allocated texture %d (id=%d,width=%g,height=%g)",model->numtextures-1, model->textures[model->numtextures-1].id, width, height));
+    model->textures[model->numtextures-1].shared = glmAcquireTexture(filename);
+    model->textures[model->numtextures-1].id = 0;
+    model->textures[model->numtextures-1].group = NULL;
+    model->textures[model->numtextures-1].width = 1;
+    model->textures[model->numtextures-1].height = 1;
+    DBG_(__glmWarning("allocated texture %d (%s)",model->numtextures-1, filename));
 
     free(filename);
 
     return model->numtextures-1;
 }
 
+/* glmUploadTextures: upload the textures of a model that are decoded */
+GLvoid
+glmUploadTextures(GLMmodel* model)
+{
+    GLuint i;
+    
+    for (i = 0; i < model->numtextures; i++) {
+        GLMtexture *texture = &model->textures[i];
+        if (!texture->id)
+            texture->id = glmUploadSharedTexture(texture->shared,
+                                                 &texture->group,
+                                                 &texture->width,
+                                                 &texture->height);
+    }
+}
+
+/* glmTexturesPending: check if some textures are still loading */
+GLboolean
+glmTexturesPending(GLMmodel* model)
+{
+    GLuint i;
+    
+    for (i = 0; i < model->numtextures; i++) {
+        if (!model->textures[i].id &&
+            !glmSharedTextureFailed(model->textures[i].shared))
+            return GL_TRUE;
+    }
+    return GL_FALSE;
+}
+
 /* glmReadMTL: read a wavefront material library file
  *
  * model - properly initialized GLMmodel structure
@@ -1523,7 +1553,9 @@ glmDelete(GLMmodel* model)
     if (model->textures) {
         for (i = 0; i < model->numtextures; i++) {
             free(model->textures[i].name);
-            glDeleteTextures(1,&model->textures[i].id);
+            glmReleaseTexture(model->textures[i].shared,
+                              model->textures[i].group,
+                              model->textures[i].id);
         }
         free(model->textures);
     }
@@ -1905,6 +1937,7 @@ glmDraw(GLMmodel* model, GLuint mode)
     else if (mode & GLM_MATERIAL)
         glDisable(GL_COLOR_MATERIAL);
     if (mode & GLM_TEXTURE) {
+        glmUploadTextures(model);
         glEnable(_glmTextureTarget);
         glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
     }
@@ -1975,7 +2008,8 @@ glmDraw(GLMmodel* model, GLuint mode)
 				if(map_diffuse == -1)
 				    glBindTexture(_glmTextureTarget, 0);
 				else
-				    glBindTexture(_glmTextureTarget, model->textures[map_diffuse].id);
+				    glBindTexture(_glmTextureTarget,
+						  model->textures[map_diffuse].id);
 				glBegin(GL_TRIANGLES);
 			    }
 			}
@@ -2046,6 +2080,9 @@ glmList(GLMmodel* model, GLuint mode)
 {
     GLuint list;
     
+    /* uploads can't be compiled into the list */
+    if (mode & GLM_TEXTURE)
+        glmUploadTextures(model);
     list = glGenLists(1);
     glNewList(list, GL_COMPILE);
     glmDraw(model, mode);
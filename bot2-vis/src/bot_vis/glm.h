@@ -80,9 +80,17 @@ typedef struct _GLMtriangle {
 #endif
 } GLMtriangle;
 
+/* GLMsharedtexture: An image shared by all the models that use it.  It is
+ * uploaded once for each group of contexts that share textures, and the
+ * models drawn in the group use the same OpenGL texture.
+ */
+typedef struct _GLMsharedtexture GLMsharedtexture;
+
 typedef struct _GLMtexture {
   char *name;
-  GLuint id;                    /* OpenGL texture ID */
+  GLMsharedtexture *shared;     /* image shared with other models */
+  GLuint id;			/* OpenGL texture, 0 until uploaded */
+  void *group;			/* share group of the contexts id is valid in */
   GLfloat width;		/* width and height for texture coordinates */
   GLfloat height;
 } GLMtexture;
@@ -226,7 +234,9 @@ glmLinearTexture(GLMmodel* model);
 GLvoid
 glmSpheremapTexture(GLMmodel* model);
 
-/* glmDelete: Deletes a GLMmodel structure.
+/* glmDelete: Deletes a GLMmodel structure.  Deletes the OpenGL textures
+ * of the model that no other model uses, so the context it was drawn in
+ * must be current.
  *
  * model - initialized GLMmodel structure
  */
@@ -296,6 +306,54 @@ glmList(GLMmodel* model, GLuint mode);
 GLvoid
 glmWeld(GLMmodel* model, GLfloat epsilon);
 
+/* glmReadImage: Reads a PPM, JPEG or PNG image, bottom row first.
+ * Can be called from any thread.
+ */
+GLubyte*
+glmReadImage(const char* filename, GLboolean alpha, int* width, int* height, int* type);
+
+/* glmAcquireTexture: Returns the shared texture of an image file, which
+ * is decoded in the background.  Can be called from any thread.
+ */
+GLMsharedtexture*
+glmAcquireTexture(const char* filename);
+
+/* glmReleaseTexture: Releases a texture returned by glmAcquireTexture(),
+ * and the OpenGL texture id returned by glmUploadSharedTexture() in group,
+ * if any.  The OpenGL texture is deleted once no model uses it, so a
+ * context of group must be current.
+ */
+GLvoid
+glmReleaseTexture(GLMsharedtexture* texture, void* group, GLuint id);
+
+/* glmUploadSharedTexture: Returns the OpenGL texture of a shared texture in
+ * the share group of the current context, which is stored in group, and
+ * uploads it if no other model did.  Returns 0 if the image isn't decoded
+ * yet, or can't be uploaded.
+ */
+GLuint
+glmUploadSharedTexture(GLMsharedtexture* texture, void** group,
+                       GLfloat* width, GLfloat* height);
+
+/* glmSharedTextureFailed: Returns GL_TRUE if the image of a shared texture
+ * can't be read or uploaded.
+ */
+GLboolean
+glmSharedTextureFailed(GLMsharedtexture* texture);
+
+/* glmUploadTextures: Uploads the textures of a model that are decoded.
+ * Called by glmDraw().
+ */
+GLvoid
+glmUploadTextures(GLMmodel* model);
+
+/* glmTexturesPending: Returns GL_TRUE while some textures of a model are
+ * being decoded or haven't been uploaded.  Until then, the model is drawn
+ * without them, and should not be compiled into a display list.
+ */
+GLboolean
+glmTexturesPending(GLMmodel* model);
+
 GLuint
 glmLoadTexture(const char *filename, GLboolean alpha, GLboolean repeat, GLboolean filtering, GLboolean mipmaps, GLfloat *width, GLfloat *height);
 
@@ -16,17 +16,24 @@
 #include <assert.h>
 #include <math.h>
 
+#include <glib.h>
+
 # ifdef _WIN32
 #   include <windows.h>
 # endif
 #ifdef __APPLE__
+#include <dlfcn.h>
 #include <OpenGL/gl.h>
 #include <OpenGL/glext.h>
 #else
 #include <GL/gl.h>
 #include <GL/glext.h>
+#ifndef _WIN32
+#include <GL/glx.h>
+#endif
 #endif
 #include "glm.h"
+#include "gl_drawing_area.h"
 /*
 #define DEBUG
 #define GLDEBUG
@@ -40,6 +47,35 @@ GLenum _glmTextureTarget = GL_TEXTURE_2D;
 static GLint gl_max_texture_size;
 static int glm_do_init = 1;
 static GLboolean gl_sgis_generate_mipmap = GL_FALSE;
+static GLboolean gl_non_power_of_two = GL_FALSE;
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+typedef void (APIENTRY *glmGenerateMipmapProc)(GLenum target);
+static glmGenerateMipmapProc gl_generate_mipmap = NULL;
+
+/* textures shared by all models, keyed by file name */
+#define GLM_DECODE_THREADS 4
+enum { TEXTURE_DECODING, TEXTURE_DECODED, TEXTURE_FAILED };
+/* the OpenGL texture of a shared texture in one group of contexts that
+   share objects */
+typedef struct _GLMtextureupload {
+    void *group;
+    GLuint id;
+    GLfloat texcoordwidth, texcoordheight;
+    int refcount;               /* models that use the id */
+} GLMtextureupload;
+struct _GLMsharedtexture {
+    char *filename;
+    int refcount;               /* users, and the decoder while decoding */
+    int state;
+    GLubyte *data;              /* decoded image, until it is uploaded */
+    int width, height, type;
+    GSList *uploads;            /* one GLMtextureupload per share group */
+};
+G_LOCK_DEFINE_STATIC(texture_cache);
+static GHashTable *texture_cache = NULL;
+static GThreadPool *texture_decoders = NULL;
 
 static GLboolean glmIsExtensionSupported(const char *extension)
 {
@@ -74,6 +110,19 @@ static GLboolean glmIsExtensionSupported(const char *extension)
     return GL_FALSE;
 }
 
+/* look up an OpenGL entry point that may not be exported by the library */
+static void*
+glmGetProcAddress(const char *name)
+{
+#if defined(__APPLE__)
+    return dlsym(RTLD_DEFAULT, name);
+#elif defined(_WIN32)
+    return (void*)wglGetProcAddress(name);
+#else
+    return (void*)glXGetProcAddressARB((const GLubyte*)name);
+#endif
+}
+
 static void glmImgInit(void)
 {
     glm_do_init = 0;
@@ -106,6 +155,21 @@ static void glmImgInit(void)
         gl_sgis_generate_mipmap = GL_TRUE;
     }
 #endif
+    {
+        int major = 0, minor = 0;
+        const char *version = (const char *) glGetString(GL_VERSION);
+        if (version)
+            sscanf(version, "%d.%d", &major, &minor);
+        if (major >= 2 || glmIsExtensionSupported("GL_ARB_texture_non_power_of_two"))
+            gl_non_power_of_two = GL_TRUE;
+        if (major >= 3 || glmIsExtensionSupported("GL_ARB_framebuffer_object"))
+            gl_generate_mipmap = (glmGenerateMipmapProc)
+                glmGetProcAddress("glGenerateMipmap");
+        if (!gl_generate_mipmap &&
+            glmIsExtensionSupported("GL_EXT_framebuffer_object"))
+            gl_generate_mipmap = (glmGenerateMipmapProc)
+                glmGetProcAddress("glGenerateMipmapEXT");
+    }
     /*_glmTextureTarget = GL_TEXTURE_2D;*/
 }
 
@@ -153,29 +217,48 @@ glmReadPPM(const char* filename, GLboolean alpha, int* width, int* height, int *
     
     /* grab first two chars of the file and make sure that it has the
        correct magic cookie for a raw PPM file. */
-    fgets(head, 70, fp);
-    if (strncmp(head, "P6", 2)) {
+    if (!fgets(head, 70, fp) || strncmp(head, "P6", 2)) {
         DBG_(__glmWarning("glmReadPPM() failed: %s: Not a raw PPM file", filename));
+        fclose(fp);
         return NULL;
     }
     
-    /* grab the three elements in the header (width, height, maxval). */
-    i = 0;
+    /* grab the three elements in the header (width, height, maxval),
+       which may also be on the first line. */
+    i = sscanf(head + 2, "%d %d %d", &w, &h, &d);
+    if (i < 0)
+        i = 0;
     while(i < 3) {
-        fgets(head, 70, fp);
+        int n = 0;
+        if (!fgets(head, 70, fp)) {
+            DBG_(__glmWarning("glmReadPPM() failed: %s: Truncated header", filename));
+            fclose(fp);
+            return NULL;
+        }
         if (head[0] == '#')     /* skip comments. */
             continue;
         if (i == 0)
-            i += sscanf(head, "%d %d %d", &w, &h, &d);
+            n = sscanf(head, "%d %d %d", &w, &h, &d);
         else if (i == 1)
-            i += sscanf(head, "%d %d", &h, &d);
+            n = sscanf(head, "%d %d", &h, &d);
         else if (i == 2)
-            i += sscanf(head, "%d", &d);
+            n = sscanf(head, "%d", &d);
+        if (n > 0)
+            i += n;
+    }
+    if (w <= 0 || h <= 0) {
+        fclose(fp);
+        return NULL;
     }
     
     /* grab all the image data in one fell swoop. */
     image = (unsigned char*)malloc(sizeof(unsigned char)*w*h*3);
-    fread(image, sizeof(unsigned char), w*h*3, fp);
+    if (fread(image, sizeof(unsigned char), w*h*3, fp) != w*h*3) {
+        DBG_(__glmWarning("glmReadPPM() failed: %s: Truncated data", filename));
+        free(image);
+        fclose(fp);
+        return NULL;
+    }
     fclose(fp);
     
     *type = GL_RGB;
@@ -187,16 +270,61 @@ glmReadPPM(const char* filename, GLboolean alpha, int* width, int* height, int *
 
 
 
-/* don't try alpha=GL_FALSE: gluScaleImage implementations seem to be buggy */
-GLuint
-glmLoadTexture(const char *filename, GLboolean alpha, GLboolean repeat, GLboolean filtering, 
-               GLboolean mipmaps, GLfloat *texcoordwidth, GLfloat *texcoordheight)
+/* glmReadImage: read a raw PPM, JPEG or PNG file, without making any
+ * OpenGL calls, so that it can be called from any thread.
+ *
+ * Unlike glmLoadTexture(), the first row of the returned data is always
+ * the bottom row of the image, as expected by glTexImage2D().  type is set
+ * to GL_LUMINANCE, GL_LUMINANCE_ALPHA, GL_RGB or GL_RGBA.  The malloc()'d
+ * memory should be free()'d by the caller.  Returns NULL if the file can't
+ * be read.
+ */
+GLubyte*
+glmReadImage(const char* filename, GLboolean alpha, int* width, int* height,
+             int* type)
+{
+    GLubyte *data;
+
+    data = glmReadPPM(filename, alpha, width, height, type);
+    if (data) {
+        /* PPM rows are stored top to bottom */
+        int stride = *width * 3;
+        GLubyte *row = (GLubyte*)malloc(stride);
+        int y;
+        for (y = 0; y < *height / 2; y++) {
+            GLubyte *top = data + y * stride;
+            GLubyte *bottom = data + (*height - 1 - y) * stride;
+            memcpy(row, top, stride);
+            memcpy(top, bottom, stride);
+            memcpy(bottom, row, stride);
+        }
+        free(row);
+        return data;
+    }
+
+    data = glmReadJPG(filename, alpha, width, height, type);
+    if (data)
+        return data;
+
+    return glmReadPNG(filename, alpha, width, height, type);
+}
+
+
+/* glmUploadTexture: create an OpenGL texture from a decoded image.  The
+ * image is left to the caller.  Images are scaled to a power of two size only if
+ * the OpenGL implementation doesn't support other sizes, or if they are
+ * larger than the maximum texture size.  Mipmaps are generated by OpenGL
+ * when possible.
+ */
+static GLuint
+glmUploadTexture(GLubyte *data, int width, int height, int type,
+                 GLboolean repeat, GLboolean filtering, GLboolean mipmaps,
+                 GLfloat *texcoordwidth, GLfloat *texcoordheight)
 {
     GLuint tex;
-    int width, height,pixelsize;
-    int type;
+    int pixelsize;
     int filter_min, filter_mag;
-    GLubyte *data, *rdata;
+    GLubyte *rdata = NULL;
     double xPow2, yPow2;
     int ixPow2, iyPow2;
     int xSize2, ySize2;
@@ -204,74 +332,21 @@ glmLoadTexture(const char *filename, GLboolean alpha, GLboolean repeat, GLboolea
     
     if(glm_do_init)
         glmImgInit();
-    
-    /* fallback solution (PPM only) */
-    data = glmReadPPM(filename, alpha, &width, &height, &type);
-    if(data != NULL) {
-        DBG_(__glmWarning("glmLoadTexture(): got PPM for %s",filename));
-        goto DONE;
-    }
-
-
-    // Assuming that we have libjpeg
-    data = glmReadJPG(filename, alpha, &width, &height, &type);
-    if(data != NULL) {
-        DBG_(__glmWarning("glmLoadTexture(): got JPG for %s",filename));
-        goto DONE;
-    }
-
-    // Assuming that we have libpng
-    data = glmReadPNG(filename, alpha, &width, &height, &type);
-    if(data != NULL) {
-        DBG_(__glmWarning("glmLoadTexture(): got PNG for %s",filename));
-        goto DONE;
-    }
-    
-    __glmWarning("glmLoadTexture() failed: Unable to load texture from %s!", filename);
-    DBG_(__glmWarning("glmLoadTexture() failed: tried PPM"));
-    
-    DBG_(__glmWarning("glmLoadTexture() failed: tried JPEG"));
-    
-    return 0;
-    
- DONE:
 
    // Give up if the maximum texture size is 0
     if (gl_max_texture_size == 0) {
         DBG_(__glmWarning("glmLoadTexture(): Maximum texture size is %d. Skipping texture!",
                           gl_max_texture_size));
-        
         return 0;
     }
 
-    /*#define FORCE_ALPHA*/
-#ifdef FORCE_ALPHA
-    if(alpha && type == GL_RGB) {
-        /* if we really want RGBA */
-        const unsigned int size = width * height;
-        
-        unsigned char *rgbaimage;
-        unsigned char *ptri, *ptro;
-        int i;
-        
-        rgbaimage = (unsigned char*)malloc(sizeof(unsigned char)* size * 4);
-        ptri = data;
-        ptro = rgbaimage;
-        for(i=0; i<size; i++) {
-            *(ptro++) = *(ptri++);
-            *(ptro++) = *(ptri++);
-            *(ptro++) = *(ptri++);
-            *(ptro++) = 255;
-        }
-        free(data);
-        data = rgbaimage;
-        type = GL_RGBA;
-    }
-#endif /* FORCE_ALPHA */
     switch(type) {
     case GL_LUMINANCE:
         pixelsize = 1;
         break;
+    case GL_LUMINANCE_ALPHA:
+        pixelsize = 2;
+        break;
     case GL_RGB:
     case GL_BGR:
         pixelsize = 3;
@@ -298,7 +373,7 @@ glmLoadTexture(const char *filename, GLboolean alpha, GLboolean repeat, GLboolea
     if (ySize2 > gl_max_texture_size)
         ySize2 = gl_max_texture_size;
     
-    if (_glmTextureTarget == GL_TEXTURE_2D) {
+    if (_glmTextureTarget == GL_TEXTURE_2D && !gl_non_power_of_two) {
         //if(1) {
         /* scale image to power of 2 in height and width */
         xPow2 = log((double)xSize2) / log(2.0);
@@ -329,7 +404,6 @@ glmLoadTexture(const char *filename, GLboolean alpha, GLboolean repeat, GLboolea
                                xSize2, ySize2, GL_UNSIGNED_BYTE,
                                rdata);
         
-        free(data);
         data = rdata;
     }
     
@@ -356,6 +430,13 @@ glmLoadTexture(const char *filename, GLboolean alpha, GLboolean repeat, GLboolea
     glTexParameteri(_glmTextureTarget, GL_TEXTURE_WRAP_T, (repeat) ? GL_REPEAT : GL_CLAMP);
     if(mipmaps && _glmTextureTarget == GL_TEXTURE_2D) {
         /* only works for GL_TEXTURE_2D */
+        if(gl_generate_mipmap) {
+            DBG_(__glmWarning("framebuffer object mipmapping"));
+            glTexImage2D(_glmTextureTarget, 0, type, xSize2, ySize2, 0, type, 
+                         GL_UNSIGNED_BYTE, data);
+            gl_generate_mipmap(_glmTextureTarget);
+        }
+        else
 #ifdef GL_GENERATE_MIPMAP_SGIS
         if(gl_sgis_generate_mipmap) {
             DBG_(__glmWarning("sgis mipmapping"));
@@ -378,7 +459,7 @@ glmLoadTexture(const char *filename, GLboolean alpha, GLboolean repeat, GLboolea
     
     
     /* Clean up and return the texture ID */
-    free(data);
+    free(rdata);
     
     if (_glmTextureTarget == GL_TEXTURE_2D) {
         *texcoordwidth = 1.;		/* texcoords are in [0,1] */
@@ -391,3 +472,228 @@ glmLoadTexture(const char *filename, GLboolean alpha, GLboolean repeat, GLboolea
     
     return tex;
 }
+
+/* don't try alpha=GL_FALSE: gluScaleImage implementations seem to be buggy */
+GLuint
+glmLoadTexture(const char *filename, GLboolean alpha, GLboolean repeat, GLboolean filtering, 
+               GLboolean mipmaps, GLfloat *texcoordwidth, GLfloat *texcoordheight)
+{
+    int width, height;
+    int type;
+    GLubyte *data;
+    GLuint tex;
+    
+    data = glmReadImage(filename, alpha, &width, &height, &type);
+    if (data == NULL) {
+        __glmWarning("glmLoadTexture() failed: Unable to load texture from %s!", filename);
+        return 0;
+    }
+
+    tex = glmUploadTexture(data, width, height, type, repeat, filtering,
+                           mipmaps, texcoordwidth, texcoordheight);
+    free(data);
+    return tex;
+}
+
+/* called with the texture_cache lock held */
+static void
+glmUnrefTexture(GLMsharedtexture *texture)
+{
+    if (--texture->refcount > 0)
+        return;
+    g_hash_table_remove(texture_cache, texture->filename);
+    free(texture->data);
+    free(texture->filename);
+    free(texture);
+}
+
+/* runs on the decoder threads */
+static void
+glmDecodeTexture(gpointer data, gpointer user_data)
+{
+    GLMsharedtexture *texture = (GLMsharedtexture*)data;
+    int width, height, type;
+    GLubyte *image;
+
+    image = glmReadImage(texture->filename, GL_TRUE, &width, &height, &type);
+    if (image == NULL)
+        __glmWarning("glmLoadTexture() failed: Unable to load texture from %s!",
+                     texture->filename);
+
+    G_LOCK(texture_cache);
+    if (image) {
+        texture->data = image;
+        texture->width = width;
+        texture->height = height;
+        texture->type = type;
+        texture->state = TEXTURE_DECODED;
+    }
+    else {
+        texture->state = TEXTURE_FAILED;
+    }
+    glmUnrefTexture(texture);
+    G_UNLOCK(texture_cache);
+}
+
+/* decode the image of a texture on a worker thread, after its state was
+   set to TEXTURE_DECODING and a reference was taken for the decoder */
+static void
+glmStartDecoding(GLMsharedtexture *texture)
+{
+    if (texture_decoders)
+        g_thread_pool_push(texture_decoders, texture, NULL);
+    else
+        glmDecodeTexture(texture, NULL);
+}
+
+/* glmAcquireTexture: return the shared texture for an image file, and
+ * start decoding it on a worker thread if no other model uses it.  Does
+ * not make any OpenGL calls.  Release it with glmReleaseTexture().
+ */
+GLMsharedtexture*
+glmAcquireTexture(const char *filename)
+{
+    GLMsharedtexture *texture;
+    char *path;
+
+    if (!g_thread_supported())
+        g_thread_init(NULL);
+
+    /* the same file may be named differently by different models */
+    path = realpath(filename, NULL);
+    if (!path)
+        path = __glmStrdup(filename);
+
+    G_LOCK(texture_cache);
+    if (!texture_cache) {
+        texture_cache = g_hash_table_new(g_str_hash, g_str_equal);
+        texture_decoders = g_thread_pool_new(glmDecodeTexture, NULL,
+                                             GLM_DECODE_THREADS, FALSE, NULL);
+    }
+    texture = (GLMsharedtexture*)g_hash_table_lookup(texture_cache, path);
+    if (texture) {
+        texture->refcount++;
+        G_UNLOCK(texture_cache);
+        free(path);
+        return texture;
+    }
+
+    texture = (GLMsharedtexture*)calloc(1, sizeof(GLMsharedtexture));
+    texture->filename = path;
+    texture->refcount = 2;
+    texture->state = TEXTURE_DECODING;
+    g_hash_table_insert(texture_cache, texture->filename, texture);
+    G_UNLOCK(texture_cache);
+
+    glmStartDecoding(texture);
+    return texture;
+}
+
+/* glmReleaseTexture: release a texture returned by glmAcquireTexture().
+ * If the model uploaded it, group is the share group it was uploaded in,
+ * and the OpenGL texture is deleted when no other model in that group
+ * uses it, which needs a context of the group to be current.
+ */
+GLvoid
+glmReleaseTexture(GLMsharedtexture *texture, void *group, GLuint id)
+{
+    G_LOCK(texture_cache);
+    if (id) {
+        GSList *iter;
+        for (iter = texture->uploads; iter; iter = iter->next) {
+            GLMtextureupload *upload = (GLMtextureupload*)iter->data;
+            if (upload->group != group || upload->id != id)
+                continue;
+            if (--upload->refcount == 0) {
+                glDeleteTextures(1, &upload->id);
+                texture->uploads = g_slist_delete_link(texture->uploads, iter);
+                free(upload);
+            }
+            break;
+        }
+    }
+    glmUnrefTexture(texture);
+    G_UNLOCK(texture_cache);
+}
+
+/* glmUploadSharedTexture: return the OpenGL texture of a shared texture
+ * in the share group of the current context, and upload it if no other
+ * model did.  The image is freed after the first upload, and decoded
+ * again if a context that shares nothing with it needs the texture.
+ * group is set to the share group of the returned texture.  Returns 0
+ * while the image is being decoded, if it failed, or while a display list
+ * is being compiled, since the upload would only be recorded in the list.
+ */
+GLuint
+glmUploadSharedTexture(GLMsharedtexture *texture, void **group,
+                       GLfloat *texcoordwidth, GLfloat *texcoordheight)
+{
+    GLMtextureupload *upload = NULL;
+    GLint list = 0;
+    GLuint id = 0;
+    GSList *iter;
+    int decode = 0;
+
+    *group = bot_gl_get_current_share_group();
+
+    G_LOCK(texture_cache);
+    for (iter = texture->uploads; iter; iter = iter->next) {
+        if (((GLMtextureupload*)iter->data)->group == *group) {
+            upload = (GLMtextureupload*)iter->data;
+            break;
+        }
+    }
+    if (upload) {
+        upload->refcount++;
+        id = upload->id;
+        *texcoordwidth = upload->texcoordwidth;
+        *texcoordheight = upload->texcoordheight;
+    }
+    else if (texture->state == TEXTURE_DECODED && !texture->data) {
+        texture->state = TEXTURE_DECODING;
+        texture->refcount++;
+        decode = 1;
+    }
+    else if (texture->state == TEXTURE_DECODED) {
+        glGetIntegerv(GL_LIST_INDEX, &list);
+        if (!list) {
+            id = glmUploadTexture(texture->data, texture->width,
+                                  texture->height, texture->type,
+                                  GL_TRUE, GL_TRUE, GL_TRUE,
+                                  texcoordwidth, texcoordheight);
+            free(texture->data);
+            texture->data = NULL;
+            if (id) {
+                upload = (GLMtextureupload*)calloc(1, sizeof(GLMtextureupload));
+                upload->group = *group;
+                upload->id = id;
+                upload->texcoordwidth = *texcoordwidth;
+                upload->texcoordheight = *texcoordheight;
+                upload->refcount = 1;
+                texture->uploads = g_slist_prepend(texture->uploads, upload);
+            }
+            else {
+                texture->state = TEXTURE_FAILED;
+            }
+        }
+    }
+    G_UNLOCK(texture_cache);
+
+    if (decode)
+        glmStartDecoding(texture);
+    return id;
+}
+
+/* glmSharedTextureFailed: GL_TRUE if the image of a shared texture
+ * can't be read or uploaded.
+ */
+GLboolean
+glmSharedTextureFailed(GLMsharedtexture *texture)
+{
+    GLboolean failed;
+
+    G_LOCK(texture_cache);
+    failed = texture->state == TEXTURE_FAILED;
+    G_UNLOCK(texture_cache);
+    return failed;
+}
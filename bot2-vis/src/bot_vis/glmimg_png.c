@@ -33,9 +33,6 @@
 
 static int pngerror = ERR_NO_ERROR;
 
-/* my setjmp buffer */
-static jmp_buf setjmp_buffer;
-
 /* called my libpng */
 static void 
 warn_callback(png_structp ps, png_const_charp pc)
@@ -50,7 +47,9 @@ err_callback(png_structp ps, png_const_charp pc)
     fprintf(stderr,"PNG error: %s\n", pc);
     
     /* FIXME: store error message? */
-    longjmp(setjmp_buffer, 1);
+    /* the jump buffer is per read struct, so images can be read on
+     * several threads at once */
+    longjmp(png_jmpbuf(ps), 1);
 }
 
 GLubyte* 
@@ -108,7 +107,7 @@ glmReadPNG(const char* filename, GLboolean alpha, int* width_ret,
     
     buffer = NULL;
     
-    if (setjmp(setjmp_buffer)) {
+    if (setjmp(png_jmpbuf(png_ptr))) {
         pngerror = ERR_PNGLIB;
         /* Free all of the memory associated with the png_ptr and info_ptr */
         png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
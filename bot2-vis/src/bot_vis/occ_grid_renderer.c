@@ -0,0 +1,195 @@
+/*
+ * renders occupancy grids published by bot_occ_grid_publish()
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bot_core/bot_core.h>
+#include <lcmtypes/bot_core_image_t.h>
+
+#include "viewer.h"
+#include "texture.h"
+#include "occ_grid_renderer.h"
+
+#define PARAM_OPACITY "Opacity"
+#define PARAM_HEIGHT "Height"
+
+#define RENDERER_NAME "Occupancy Grid"
+
+typedef struct _RendererOccGrid RendererOccGrid;
+
+struct _RendererOccGrid {
+    BotRenderer renderer;
+
+    BotGtkParamWidget *pw;
+    BotViewer *viewer;
+    lcm_t *lcm;
+    bot_core_image_t_subscription_t *sub;
+
+    bot_core_image_t *last_msg;
+    int need_upload;
+    BotGlTexture *texture;
+
+    // bounds of the grid in last_msg
+    double x0, y0, x1, y1;
+};
+
+static int
+_get_metadata_double (const bot_core_image_t *msg, const char *key,
+        double *val)
+{
+    for (int i = 0; i < msg->nmetadata; i++) {
+        const bot_core_image_metadata_t *md = &msg->metadata[i];
+        if (strcmp (md->key, key))
+            continue;
+        char buf[64];
+        int n = MIN (md->n, (int) sizeof (buf) - 1);
+        memcpy (buf, md->value, n);
+        buf[n] = 0;
+        char *end;
+        *val = g_ascii_strtod (buf, &end);
+        return end != buf ? 0 : -1;
+    }
+    return -1;
+}
+
+static void
+occ_grid_draw (BotViewer *viewer, BotRenderer *renderer)
+{
+    RendererOccGrid *self = (RendererOccGrid*) renderer->user;
+    if (!self->last_msg)
+        return;
+
+    bot_core_image_t *msg = self->last_msg;
+    if (self->need_upload) {
+        if (self->texture &&
+                (bot_gl_texture_get_width (self->texture) != msg->width ||
+                 bot_gl_texture_get_height (self->texture) != msg->height)) {
+            bot_gl_texture_free (self->texture);
+            self->texture = NULL;
+        }
+        if (!self->texture) {
+            self->texture = bot_gl_texture_new (msg->width, msg->height,
+                    msg->row_stride * msg->height);
+            bot_gl_texture_set_interp (self->texture, GL_NEAREST);
+        }
+        bot_gl_texture_upload (self->texture, GL_LUMINANCE, GL_UNSIGNED_BYTE,
+                msg->row_stride, msg->data);
+        self->need_upload = 0;
+    }
+
+    double z = bot_gtk_param_widget_get_double (self->pw, PARAM_HEIGHT);
+
+    glPushAttrib (GL_ENABLE_BIT | GL_CURRENT_BIT);
+    glEnable (GL_BLEND);
+    glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable (GL_DEPTH_TEST);
+    glColor4f (1, 1, 1,
+            bot_gtk_param_widget_get_double (self->pw, PARAM_OPACITY));
+
+    // the first image row is the row of cells with the smallest y
+    bot_gl_texture_draw_coords (self->texture,
+            self->x0, self->y0, z,
+            self->x0, self->y1, z,
+            self->x1, self->y1, z,
+            self->x1, self->y0, z);
+
+    glPopAttrib ();
+}
+
+static void
+occ_grid_free (BotRenderer *renderer)
+{
+    RendererOccGrid *self = (RendererOccGrid*) renderer->user;
+    bot_core_image_t_unsubscribe (self->lcm, self->sub);
+    if (self->last_msg)
+        bot_core_image_t_destroy (self->last_msg);
+    if (self->texture)
+        bot_gl_texture_free (self->texture);
+    free (self);
+}
+
+static void
+on_occ_grid (const lcm_recv_buf_t *rbuf, const char *channel,
+        const bot_core_image_t *msg, void *user_data)
+{
+    RendererOccGrid *self = (RendererOccGrid*) user_data;
+
+    double x0, y0, resolution;
+    if (msg->pixelformat != BOT_CORE_IMAGE_T_PIXEL_FORMAT_GRAY ||
+            _get_metadata_double (msg, "x0", &x0) ||
+            _get_metadata_double (msg, "y0", &y0) ||
+            _get_metadata_double (msg, "resolution", &resolution)) {
+        fprintf (stderr, "%s: ignoring image on %s, not an occupancy grid\n",
+                RENDERER_NAME, channel);
+        return;
+    }
+
+    if (self->last_msg)
+        bot_core_image_t_destroy (self->last_msg);
+    self->last_msg = bot_core_image_t_copy (msg);
+    self->need_upload = 1;
+    self->x0 = x0;
+    self->y0 = y0;
+    self->x1 = x0 + msg->width * resolution;
+    self->y1 = y0 + msg->height * resolution;
+    bot_viewer_request_redraw (self->viewer);
+}
+
+static void
+on_param_widget_changed (BotGtkParamWidget *pw, const char *param,
+        void *user_data)
+{
+    RendererOccGrid *self = (RendererOccGrid*) user_data;
+    bot_viewer_request_redraw (self->viewer);
+}
+
+static void
+on_load_preferences (BotViewer *viewer, GKeyFile *keyfile, void *user_data)
+{
+    RendererOccGrid *self = user_data;
+    bot_gtk_param_widget_load_from_key_file (self->pw, keyfile, RENDERER_NAME);
+}
+
+static void
+on_save_preferences (BotViewer *viewer, GKeyFile *keyfile, void *user_data)
+{
+    RendererOccGrid *self = user_data;
+    bot_gtk_param_widget_save_to_key_file (self->pw, keyfile, RENDERER_NAME);
+}
+
+void
+bot_occ_grid_add_renderer_to_viewer (BotViewer *viewer, lcm_t *lcm,
+        const char *channel, int priority)
+{
+    RendererOccGrid *self =
+        (RendererOccGrid*) calloc (1, sizeof (RendererOccGrid));
+    self->viewer = viewer;
+    self->lcm = lcm;
+    self->renderer.draw = occ_grid_draw;
+    self->renderer.destroy = occ_grid_free;
+    self->renderer.name = RENDERER_NAME;
+    self->renderer.user = self;
+    self->renderer.enabled = 1;
+
+    self->pw = BOT_GTK_PARAM_WIDGET (bot_gtk_param_widget_new ());
+    self->renderer.widget = GTK_WIDGET (self->pw);
+    bot_gtk_param_widget_add_double (self->pw, PARAM_OPACITY,
+            BOT_GTK_PARAM_WIDGET_SLIDER, 0, 1, 0.01, 0.7);
+    bot_gtk_param_widget_add_double (self->pw, PARAM_HEIGHT,
+            BOT_GTK_PARAM_WIDGET_SPINBOX, -10, 10, 0.01, 0);
+    gtk_widget_show (GTK_WIDGET (self->pw));
+
+    g_signal_connect (G_OBJECT (self->pw), "changed",
+            G_CALLBACK (on_param_widget_changed), self);
+    g_signal_connect (G_OBJECT (viewer), "load-preferences",
+            G_CALLBACK (on_load_preferences), self);
+    g_signal_connect (G_OBJECT (viewer), "save-preferences",
+            G_CALLBACK (on_save_preferences), self);
+
+    self->sub = bot_core_image_t_subscribe (lcm, channel, on_occ_grid, self);
+
+    bot_viewer_add_renderer (viewer, &self->renderer, priority);
+}
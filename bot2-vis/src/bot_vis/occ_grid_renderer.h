@@ -0,0 +1,42 @@
+#ifndef __bot_occ_grid_renderer_h__
+#define __bot_occ_grid_renderer_h__
+
+/**
+ * @defgroup BotOccGridRenderer Occupancy grid renderer
+ * @ingroup BotViewerGroup
+ * @brief Draws occupancy grids published by bot_occ_grid_publish()
+ * @include: bot_vis/bot_vis.h
+ *
+ * Subscribes to a channel of grayscale bot_core_image_t messages published
+ * by bot_occ_grid_publish() (see bot_core/occ_grid.h), and draws the most
+ * recent one as a texture on the ground plane of the local frame, using the
+ * grid bounds stored in the image metadata.
+ *
+ * Linking: `pkg-config --libs bot2-vis`
+ * @{
+ */
+
+#include <lcm/lcm.h>
+
+#include "viewer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * bot_occ_grid_add_renderer_to_viewer:
+ * @channel: channel the grid is published on.
+ */
+void bot_occ_grid_add_renderer_to_viewer (BotViewer *viewer, lcm_t *lcm,
+        const char *channel, int priority);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,688 @@
+/*
+ * renders large images from pyramids of tiles, see tiled_image_renderer.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <glib.h>
+
+#include "viewer.h"
+#include "texture.h"
+#include "glm.h"
+#include "tiled_image_renderer.h"
+
+#define PARAM_OPACITY "Opacity"
+#define PARAM_HEIGHT "Height"
+
+#define DEFAULT_NAME "Tiled Image"
+#define GROUP "tiles"
+
+#define DEFAULT_CACHE_SIZE 256
+#define NUM_LOADER_THREADS 4
+
+// limits the time spent uploading textures in one frame
+#define MAX_UPLOADS_PER_FRAME 8
+
+// textures of evicted tiles kept for reuse
+#define MAX_SPARE_TEXTURES 16
+
+// tiles are identified by a 31 bit key: 5 bits of level, 13 bits of row and
+// 13 bits of column
+#define MAX_LEVELS 32
+#define MAX_TILES_PER_SIDE 8192
+
+enum {
+    TILE_EMPTY,
+    TILE_LOADING,
+    TILE_LOADED,
+    TILE_FAILED
+};
+
+typedef struct _tile tile_t;
+struct _tile {
+    int level, col, row;
+    int state;
+    BotGlTexture *texture;
+
+    // frame in which the tile was last drawn, or needed
+    volatile gint last_used;
+
+    // link in the list of loaded tiles
+    GList link;
+};
+
+typedef struct _RendererTiledImage RendererTiledImage;
+
+typedef struct _load_request load_request_t;
+struct _load_request {
+    tile_t *tile;
+    int frame;
+    char *fname;
+
+    // set by the loader
+    int cancelled;
+    GLubyte *data;
+    int width, height, type;
+};
+
+struct _RendererTiledImage {
+    BotRenderer renderer;
+
+    BotGtkParamWidget *pw;
+    BotViewer *viewer;
+    char *name;
+
+    // description of the pyramid
+    char *path;
+    char *format;
+    int width, height;
+    int tile_size;
+    int levels;
+    double resolution;
+    double x0, y0;
+    int cache_size;
+
+    // key -> tile_t *
+    GHashTable *tiles;
+    // loaded tiles, most recently used at the head
+    GQueue *lru;
+    // tile_size x tile_size textures of evicted tiles
+    GQueue *spare_textures;
+
+    GThreadPool *loaders;
+    // load_request_t * handled by the loaders
+    GAsyncQueue *loaded;
+    volatile gint frame;
+    volatile gint shutdown;
+    volatile gint redraw_pending;
+
+    // state of the frame being drawn
+    double mvp[16];
+    int viewport[4];
+    GPtrArray *draw_list;
+};
+
+static guint
+_tile_key (int level, int col, int row)
+{
+    return (level << 26) | (row << 13) | col;
+}
+
+// number of tiles along a side of length size at level
+static int
+_num_tiles (RendererTiledImage *self, int size, int level)
+{
+    int64_t span = (int64_t) self->tile_size << level;
+    return (size + span - 1) / span;
+}
+
+// bounds of a tile in the local frame, and its size in texels
+static void
+_tile_bounds (RendererTiledImage *self, int level, int col, int row,
+        double xy0[2], double xy1[2], int *tw, int *th)
+{
+    int64_t span = (int64_t) self->tile_size << level;
+    int64_t px0 = col * span;
+    int64_t px1 = MIN (px0 + span, self->width);
+    // rows are counted from the top of the image
+    int64_t py0 = row * span;
+    int64_t py1 = MIN (py0 + span, self->height);
+
+    xy0[0] = self->x0 + px0 * self->resolution;
+    xy1[0] = self->x0 + px1 * self->resolution;
+    xy0[1] = self->y0 + (self->height - py1) * self->resolution;
+    xy1[1] = self->y0 + (self->height - py0) * self->resolution;
+
+    *tw = (px1 - px0 + ((int64_t) 1 << level) - 1) >> level;
+    *th = (py1 - py0 + ((int64_t) 1 << level) - 1) >> level;
+}
+
+// Returns 1 if a tile is outside of the view frustum.  Otherwise, sets
+// *too_coarse if its texels are drawn larger than a pixel.
+static int
+_cull_tile (RendererTiledImage *self, const double xy0[2],
+        const double xy1[2], double z, int tw, int th, int *too_coarse)
+{
+    const double corners[4][2] = {
+        { xy0[0], xy0[1] },
+        { xy0[0], xy1[1] },
+        { xy1[0], xy1[1] },
+        { xy1[0], xy0[1] },
+    };
+    const double *m = self->mvp;
+    double px[4][2];
+    int outside_all = 0x3f;
+    int behind = 0;
+
+    for (int i = 0; i < 4; i++) {
+        double x = corners[i][0], y = corners[i][1];
+        double clip[4];
+        for (int r = 0; r < 4; r++)
+            clip[r] = m[r] * x + m[4+r] * y + m[8+r] * z + m[12+r];
+        double w = clip[3];
+
+        int outside = 0;
+        for (int a = 0; a < 3; a++) {
+            if (clip[a] < -w)
+                outside |= 1 << (2 * a);
+            if (clip[a] > w)
+                outside |= 2 << (2 * a);
+        }
+        outside_all &= outside;
+
+        if (w <= 0) {
+            behind = 1;
+            continue;
+        }
+        px[i][0] = (clip[0] / w + 1) * 0.5 * self->viewport[2];
+        px[i][1] = (clip[1] / w + 1) * 0.5 * self->viewport[3];
+    }
+
+    // all the corners are on the outer side of the same clipping plane
+    if (outside_all)
+        return 1;
+
+    // the tile crosses the plane of the eye, and is drawn large
+    if (behind) {
+        *too_coarse = 1;
+        return 0;
+    }
+
+    double horiz = MAX (hypot (px[2][0] - px[1][0], px[2][1] - px[1][1]),
+            hypot (px[3][0] - px[0][0], px[3][1] - px[0][1]));
+    double vert = MAX (hypot (px[1][0] - px[0][0], px[1][1] - px[0][1]),
+            hypot (px[2][0] - px[3][0], px[2][1] - px[3][1]));
+    *too_coarse = horiz > tw || vert > th;
+    return 0;
+}
+
+static void
+_load_request_free (load_request_t *req)
+{
+    free (req->data);
+    g_free (req->fname);
+    g_slice_free (load_request_t, req);
+}
+
+static gboolean
+on_tiles_loaded (void *user_data)
+{
+    RendererTiledImage *self = (RendererTiledImage*) user_data;
+    g_atomic_int_set (&self->redraw_pending, 0);
+    bot_viewer_request_redraw (self->viewer);
+    return FALSE;
+}
+
+// runs on the loader threads
+static void
+load_tile (gpointer data, gpointer user_data)
+{
+    load_request_t *req = (load_request_t*) data;
+    RendererTiledImage *self = (RendererTiledImage*) user_data;
+
+    // skip the tiles that went out of view while queued
+    int frame = g_atomic_int_get (&self->frame);
+    if (g_atomic_int_get (&self->shutdown) ||
+            frame - g_atomic_int_get (&req->tile->last_used) > 1) {
+        req->cancelled = 1;
+    } else {
+        req->data = glmReadImage (req->fname, GL_TRUE, &req->width,
+                &req->height, &req->type);
+    }
+
+    g_async_queue_push (self->loaded, req);
+    if (!g_atomic_int_get (&self->shutdown) &&
+            g_atomic_int_compare_and_exchange (&self->redraw_pending, 0, 1))
+        g_idle_add (on_tiles_loaded, self);
+}
+
+// newest requests first, then coarsest levels first
+static gint
+_compare_requests (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    const load_request_t *ra = (const load_request_t*) a;
+    const load_request_t *rb = (const load_request_t*) b;
+    if (ra->frame != rb->frame)
+        return rb->frame - ra->frame;
+    return rb->tile->level - ra->tile->level;
+}
+
+static void
+_release_texture (RendererTiledImage *self, BotGlTexture *texture)
+{
+    if (bot_gl_texture_get_width (texture) == self->tile_size &&
+            bot_gl_texture_get_height (texture) == self->tile_size &&
+            g_queue_get_length (self->spare_textures) < MAX_SPARE_TEXTURES)
+        g_queue_push_head (self->spare_textures, texture);
+    else
+        bot_gl_texture_free (texture);
+}
+
+static int
+_upload_tile (RendererTiledImage *self, tile_t *tile,
+        const load_request_t *req)
+{
+    int channels;
+    switch (req->type) {
+        case GL_LUMINANCE: channels = 1; break;
+        case GL_LUMINANCE_ALPHA: channels = 2; break;
+        case GL_RGB: channels = 3; break;
+        case GL_RGBA: channels = 4; break;
+        default: return -1;
+    }
+
+    BotGlTexture *texture = NULL;
+    if (req->width == self->tile_size && req->height == self->tile_size)
+        texture = g_queue_pop_head (self->spare_textures);
+    if (!texture) {
+        texture = bot_gl_texture_new (req->width, req->height,
+                req->width * req->height * 4);
+        if (!texture)
+            return -1;
+        // keep the edges of neighboring tiles from bleeding into each other
+        GLenum target = bot_gl_texture_get_target (texture);
+        glBindTexture (target, bot_gl_texture_get_texname (texture));
+        glTexParameteri (target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri (target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture (target, 0);
+    }
+
+    if (bot_gl_texture_upload (texture, req->type, GL_UNSIGNED_BYTE,
+                req->width * channels, req->data) < 0) {
+        bot_gl_texture_free (texture);
+        return -1;
+    }
+
+    tile->texture = texture;
+    tile->state = TILE_LOADED;
+    g_queue_push_head_link (self->lru, &tile->link);
+    return 0;
+}
+
+static void
+_upload_loaded_tiles (RendererTiledImage *self)
+{
+    load_request_t *req;
+    int uploads = 0;
+    while (uploads < MAX_UPLOADS_PER_FRAME &&
+            (req = g_async_queue_try_pop (self->loaded))) {
+        tile_t *tile = req->tile;
+        if (req->cancelled) {
+            tile->state = TILE_EMPTY;
+        } else if (!req->data) {
+            fprintf (stderr, "%s: can't read %s\n", self->name, req->fname);
+            tile->state = TILE_FAILED;
+        } else if (_upload_tile (self, tile, req) < 0) {
+            fprintf (stderr, "%s: can't upload %s\n", self->name, req->fname);
+            tile->state = TILE_FAILED;
+        } else {
+            uploads++;
+        }
+        _load_request_free (req);
+    }
+
+    // upload the rest in the next frames
+    if (g_async_queue_length (self->loaded) > 0)
+        bot_viewer_request_redraw (self->viewer);
+}
+
+// keeps at most cache_size tiles loaded, but never the ones in view
+static void
+_evict_tiles (RendererTiledImage *self)
+{
+    while (g_queue_get_length (self->lru) > self->cache_size) {
+        GList *link = g_queue_peek_tail_link (self->lru);
+        tile_t *tile = (tile_t*) link->data;
+        if (tile->last_used == self->frame)
+            break;
+        g_queue_unlink (self->lru, link);
+        _release_texture (self, tile->texture);
+        tile->texture = NULL;
+        tile->state = TILE_EMPTY;
+    }
+}
+
+// marks a tile as used in the current frame, and loads it if needed
+static tile_t *
+_use_tile (RendererTiledImage *self, int level, int col, int row)
+{
+    guint key = _tile_key (level, col, row);
+    tile_t *tile = g_hash_table_lookup (self->tiles, GUINT_TO_POINTER (key));
+    if (!tile) {
+        tile = g_slice_new0 (tile_t);
+        tile->level = level;
+        tile->col = col;
+        tile->row = row;
+        tile->state = TILE_EMPTY;
+        tile->link.data = tile;
+        g_hash_table_insert (self->tiles, GUINT_TO_POINTER (key), tile);
+    }
+
+    g_atomic_int_set (&tile->last_used, self->frame);
+
+    if (tile->state == TILE_LOADED) {
+        g_queue_unlink (self->lru, &tile->link);
+        g_queue_push_head_link (self->lru, &tile->link);
+    } else if (tile->state == TILE_EMPTY) {
+        load_request_t *req = g_slice_new0 (load_request_t);
+        req->tile = tile;
+        req->frame = self->frame;
+        req->fname = g_strdup_printf ("%s/%d/%d_%d.%s", self->path, level,
+                col, row, self->format);
+        tile->state = TILE_LOADING;
+        g_thread_pool_push (self->loaders, req, NULL);
+    }
+    return tile;
+}
+
+// Appends the tiles to draw for a tile and its children to draw_list,
+// coarser tiles first.  Returns 1 if the tiles appended cover the part of
+// the tile that is in view.
+static int
+_collect_tiles (RendererTiledImage *self, int level, int col, int row,
+        double z)
+{
+    double xy0[2], xy1[2];
+    int tw, th;
+    int too_coarse = 0;
+    _tile_bounds (self, level, col, row, xy0, xy1, &tw, &th);
+    if (_cull_tile (self, xy0, xy1, z, tw, th, &too_coarse))
+        return 1;
+
+    tile_t *tile = _use_tile (self, level, col, row);
+    int loaded = tile->state == TILE_LOADED;
+
+    if (!too_coarse || level == 0) {
+        if (loaded)
+            g_ptr_array_add (self->draw_list, tile);
+        return loaded;
+    }
+
+    // the tile is drawn under its children until they are all loaded
+    int index = self->draw_list->len;
+    g_ptr_array_add (self->draw_list, NULL);
+
+    int cols = _num_tiles (self, self->width, level - 1);
+    int rows = _num_tiles (self, self->height, level - 1);
+    int covered = 1;
+    for (int j = 0; j < 2; j++) {
+        for (int i = 0; i < 2; i++) {
+            int c = 2 * col + i;
+            int r = 2 * row + j;
+            if (c < cols && r < rows)
+                covered &= _collect_tiles (self, level - 1, c, r, z);
+        }
+    }
+
+    if (!covered && loaded)
+        g_ptr_array_index (self->draw_list, index) = tile;
+    return covered || loaded;
+}
+
+static void
+tiled_image_draw (BotViewer *viewer, BotRenderer *renderer)
+{
+    RendererTiledImage *self = (RendererTiledImage*) renderer->user;
+
+    g_atomic_int_inc (&self->frame);
+    _upload_loaded_tiles (self);
+
+    double modelview[16], projection[16];
+    glGetDoublev (GL_MODELVIEW_MATRIX, modelview);
+    glGetDoublev (GL_PROJECTION_MATRIX, projection);
+    glGetIntegerv (GL_VIEWPORT, self->viewport);
+    for (int c = 0; c < 4; c++) {
+        for (int r = 0; r < 4; r++) {
+            double v = 0;
+            for (int k = 0; k < 4; k++)
+                v += projection[k*4+r] * modelview[c*4+k];
+            self->mvp[c*4+r] = v;
+        }
+    }
+
+    double z = bot_gtk_param_widget_get_double (self->pw, PARAM_HEIGHT);
+
+    // walk the pyramid from its coarsest level
+    g_ptr_array_set_size (self->draw_list, 0);
+    int top = self->levels - 1;
+    int cols = _num_tiles (self, self->width, top);
+    int rows = _num_tiles (self, self->height, top);
+    for (int r = 0; r < rows; r++)
+        for (int c = 0; c < cols; c++)
+            _collect_tiles (self, top, c, r, z);
+
+    glPushAttrib (GL_ENABLE_BIT | GL_CURRENT_BIT | GL_DEPTH_BUFFER_BIT);
+    glDisable (GL_LIGHTING);
+    glEnable (GL_BLEND);
+    glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable (GL_DEPTH_TEST);
+    // tiles are drawn over the coarser tiles they overlap
+    glDepthMask (GL_FALSE);
+    glColor4f (1, 1, 1,
+            bot_gtk_param_widget_get_double (self->pw, PARAM_OPACITY));
+
+    for (unsigned int i = 0; i < self->draw_list->len; i++) {
+        tile_t *tile = g_ptr_array_index (self->draw_list, i);
+        if (!tile)
+            continue;
+        double xy0[2], xy1[2];
+        int tw, th;
+        _tile_bounds (self, tile->level, tile->col, tile->row, xy0, xy1,
+                &tw, &th);
+        // the first row of the texture is the bottom row of the tile
+        bot_gl_texture_draw_coords (tile->texture,
+                xy0[0], xy0[1], z,
+                xy0[0], xy1[1], z,
+                xy1[0], xy1[1], z,
+                xy1[0], xy0[1], z);
+    }
+
+    glPopAttrib ();
+
+    _evict_tiles (self);
+}
+
+static void
+_tile_free (tile_t *tile)
+{
+    if (tile->texture)
+        bot_gl_texture_free (tile->texture);
+    g_slice_free (tile_t, tile);
+}
+
+static void
+tiled_image_free (BotRenderer *renderer)
+{
+    RendererTiledImage *self = (RendererTiledImage*) renderer->user;
+
+    // the loaders cancel the queued requests
+    g_atomic_int_set (&self->shutdown, 1);
+    g_thread_pool_free (self->loaders, FALSE, TRUE);
+    g_source_remove_by_user_data (self);
+
+    load_request_t *req;
+    while ((req = g_async_queue_try_pop (self->loaded)))
+        _load_request_free (req);
+    g_async_queue_unref (self->loaded);
+
+    g_hash_table_destroy (self->tiles);
+    g_queue_free (self->lru);
+    BotGlTexture *texture;
+    while ((texture = g_queue_pop_head (self->spare_textures)))
+        bot_gl_texture_free (texture);
+    g_queue_free (self->spare_textures);
+    g_ptr_array_free (self->draw_list, TRUE);
+
+    g_free (self->name);
+    g_free (self->path);
+    g_free (self->format);
+    free (self);
+}
+
+static void
+on_param_widget_changed (BotGtkParamWidget *pw, const char *param,
+        void *user_data)
+{
+    RendererTiledImage *self = (RendererTiledImage*) user_data;
+    bot_viewer_request_redraw (self->viewer);
+}
+
+static void
+on_load_preferences (BotViewer *viewer, GKeyFile *keyfile, void *user_data)
+{
+    RendererTiledImage *self = user_data;
+    bot_gtk_param_widget_load_from_key_file (self->pw, keyfile, self->name);
+}
+
+static void
+on_save_preferences (BotViewer *viewer, GKeyFile *keyfile, void *user_data)
+{
+    RendererTiledImage *self = user_data;
+    bot_gtk_param_widget_save_to_key_file (self->pw, keyfile, self->name);
+}
+
+static int
+_get_int (GKeyFile *kf, const char *fname, const char *key, int *val)
+{
+    GError *gerr = NULL;
+    *val = g_key_file_get_integer (kf, GROUP, key, &gerr);
+    if (gerr) {
+        fprintf (stderr, "%s: %s\n", fname, gerr->message);
+        g_error_free (gerr);
+        return -1;
+    }
+    return 0;
+}
+
+static int
+_get_double (GKeyFile *kf, const char *fname, const char *key, double *val)
+{
+    GError *gerr = NULL;
+    *val = g_key_file_get_double (kf, GROUP, key, &gerr);
+    if (gerr) {
+        fprintf (stderr, "%s: %s\n", fname, gerr->message);
+        g_error_free (gerr);
+        return -1;
+    }
+    return 0;
+}
+
+static int
+_read_description (RendererTiledImage *self, const char *fname)
+{
+    GKeyFile *kf = g_key_file_new ();
+    GError *gerr = NULL;
+    if (!g_key_file_load_from_file (kf, fname, G_KEY_FILE_NONE, &gerr)) {
+        fprintf (stderr, "%s: %s\n", fname, gerr->message);
+        g_error_free (gerr);
+        g_key_file_free (kf);
+        return -1;
+    }
+
+    int status = 0;
+    if (_get_int (kf, fname, "width", &self->width) ||
+            _get_int (kf, fname, "height", &self->height) ||
+            _get_int (kf, fname, "tile_size", &self->tile_size) ||
+            _get_int (kf, fname, "levels", &self->levels) ||
+            _get_double (kf, fname, "resolution", &self->resolution) ||
+            _get_double (kf, fname, "x", &self->x0) ||
+            _get_double (kf, fname, "y", &self->y0)) {
+        status = -1;
+    }
+
+    self->format = g_key_file_get_string (kf, GROUP, "format", NULL);
+    if (!self->format) {
+        fprintf (stderr, "%s: no format\n", fname);
+        status = -1;
+    }
+
+    self->cache_size = DEFAULT_CACHE_SIZE;
+    if (g_key_file_has_key (kf, GROUP, "cache_size", NULL) &&
+            _get_int (kf, fname, "cache_size", &self->cache_size))
+        status = -1;
+
+    g_key_file_free (kf);
+    if (status)
+        return -1;
+
+    if (self->width <= 0 || self->height <= 0 || self->resolution <= 0 ||
+            self->tile_size <= 0 ||
+            (self->tile_size & (self->tile_size - 1)) ||
+            self->levels < 1 || self->levels > MAX_LEVELS ||
+            _num_tiles (self, self->width, 0) > MAX_TILES_PER_SIDE ||
+            _num_tiles (self, self->height, 0) > MAX_TILES_PER_SIDE ||
+            self->cache_size < 1) {
+        fprintf (stderr, "%s: invalid pyramid\n", fname);
+        return -1;
+    }
+    return 0;
+}
+
+int
+bot_tiled_image_add_renderer_to_viewer (BotViewer *viewer,
+        const char *path, const char *name, int priority)
+{
+    RendererTiledImage *self =
+        (RendererTiledImage*) calloc (1, sizeof (RendererTiledImage));
+    self->path = g_strdup (path);
+
+    char *fname = g_build_filename (path, "tiles.ini", NULL);
+    int status = _read_description (self, fname);
+    g_free (fname);
+    if (status < 0) {
+        g_free (self->path);
+        g_free (self->format);
+        free (self);
+        return -1;
+    }
+
+    GError *gerr = NULL;
+    self->loaders = g_thread_pool_new (load_tile, self, NUM_LOADER_THREADS,
+            FALSE, &gerr);
+    if (!self->loaders) {
+        fprintf (stderr, "%s: %s\n", path, gerr->message);
+        g_error_free (gerr);
+        g_free (self->path);
+        g_free (self->format);
+        free (self);
+        return -1;
+    }
+    g_thread_pool_set_sort_function (self->loaders, _compare_requests, NULL);
+    self->loaded = g_async_queue_new ();
+
+    self->tiles = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+            NULL, (GDestroyNotify) _tile_free);
+    self->lru = g_queue_new ();
+    self->spare_textures = g_queue_new ();
+    self->draw_list = g_ptr_array_new ();
+
+    self->viewer = viewer;
+    self->name = g_strdup (name ? name : DEFAULT_NAME);
+    self->renderer.draw = tiled_image_draw;
+    self->renderer.destroy = tiled_image_free;
+    self->renderer.name = self->name;
+    self->renderer.user = self;
+    self->renderer.enabled = 1;
+
+    self->pw = BOT_GTK_PARAM_WIDGET (bot_gtk_param_widget_new ());
+    self->renderer.widget = GTK_WIDGET (self->pw);
+    bot_gtk_param_widget_add_double (self->pw, PARAM_OPACITY,
+            BOT_GTK_PARAM_WIDGET_SLIDER, 0, 1, 0.01, 1);
+    bot_gtk_param_widget_add_double (self->pw, PARAM_HEIGHT,
+            BOT_GTK_PARAM_WIDGET_SPINBOX, -10, 10, 0.01, 0);
+    gtk_widget_show (GTK_WIDGET (self->pw));
+
+    g_signal_connect (G_OBJECT (self->pw), "changed",
+            G_CALLBACK (on_param_widget_changed), self);
+    g_signal_connect (G_OBJECT (viewer), "load-preferences",
+            G_CALLBACK (on_load_preferences), self);
+    g_signal_connect (G_OBJECT (viewer), "save-preferences",
+            G_CALLBACK (on_save_preferences), self);
+
+    bot_viewer_add_renderer (viewer, &self->renderer, priority);
+    return 0;
+}
@@ -0,0 +1,73 @@
+#ifndef __bot_tiled_image_renderer_h__
+#define __bot_tiled_image_renderer_h__
+
+/**
+ * @defgroup BotTiledImageRenderer Tiled image renderer
+ * @ingroup BotViewerGroup
+ * @brief Draws large images, such as aerial maps, from a pyramid of tiles
+ * @include: bot_vis/bot_vis.h
+ *
+ * Images that are too large to fit in a single texture are cut into square
+ * tiles, at several levels of detail.  Only the tiles that are visible at
+ * the current zoom are loaded, by worker threads, and the textures of the
+ * most recently drawn tiles are kept in a cache.  While a tile is loading,
+ * the coarser tile that covers it is drawn instead.
+ *
+ * A pyramid is a directory holding a "tiles.ini" key file, e.g.:
+ *
+ * <pre>
+ * [tiles]
+ * # size of the full resolution image, in pixels
+ * width=40000
+ * height=30000
+ * # size of the tiles, in pixels.  A power of two.
+ * tile_size=256
+ * # number of levels of detail
+ * levels=9
+ * # file name extension of the tiles: ppm, jpg or png
+ * format=jpg
+ * # size of a full resolution pixel, in meters
+ * resolution=0.1
+ * # position of the bottom left corner of the image in the local frame
+ * x=-2000
+ * y=-1500
+ * # optional, maximum number of tile textures to keep.  Defaults to 256.
+ * cache_size=256
+ * </pre>
+ *
+ * The tile in column col and row row of level level is stored in
+ * "level/col_row.format".  Level 0 is the full resolution image, and each
+ * level has half the resolution of the previous one.  Columns are counted
+ * from the left and rows from the top of the image.  The tiles in the last
+ * column and row of a level can be smaller than tile_size.
+ *
+ * Linking: `pkg-config --libs bot2-vis`
+ * @{
+ */
+
+#include "viewer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * bot_tiled_image_add_renderer_to_viewer:
+ * @path: directory of the pyramid.
+ * @name: name of the renderer, or %NULL for "Tiled Image".
+ *
+ * Returns: 0 on success, -1 if the description of the pyramid can't be
+ * read.
+ */
+int bot_tiled_image_add_renderer_to_viewer (BotViewer *viewer,
+        const char *path, const char *name, int priority);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -26,6 +26,7 @@
 #include "gtk_util.h"
 #include "viewer.h"
 #include "default_view_handler.h"
+#include "gl_text.h"
 
 //#define dbg(args...) fprintf (stderr, args)
 #define dbg(args...) 
@@ -72,14 +73,178 @@ struct _BotViewerPriv {
     int num_bookmarks;
 
     GtkAccelGroup* key_accel_group;
+
+    // render thread.  frame_mutex protects the frame_* fields, the
+    // snapshots and the screenshot request.  movie_mutex protects the movie
+    // buffers, and is held while the render thread writes a movie frame.
+    GThread *gtk_thread;
+    GThread *render_thread;
+    BotGtkGlThreadContext *render_ctx;
+    int render_thread_status;
+    int render_thread_quit;
+    GMutex *frame_mutex;
+    GCond *frame_cond;
+    GMutex *movie_mutex;
+    guint frame_idle_id;
+    int frame_requested;
+    int frame_width, frame_height;
+    double frame_modelview[16];
+    double frame_projection[16];
+    float frame_background[4];
+    int frame_prettier;
+    GPtrArray *frame_renderers;
+    char *screenshot_fname;
+
+    // BotRenderer * -> snapshot_t *
+    GHashTable *snapshots;
 };
 #define BOT_VIEWER_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE((o), TYPE_BOT_VIEWER, BotViewerPriv))
 
+typedef struct _snapshot snapshot_t;
+struct _snapshot {
+    volatile gint refcount;
+    void *data;
+    GDestroyNotify free_func;
+};
+
 static guint bot_viewer_signals[LAST_SIGNAL] = { 0 };
 
+// While any viewer has a render thread, the GTK+ thread holds this lock
+// except while the main loop is waiting for events.  The render thread
+// takes it to call renderers that don't draw from snapshots.
+static GMutex *main_loop_mutex = NULL;
+static int main_loop_mutex_users = 0;
+static GPollFunc default_poll_func = NULL;
+
+static gint
+poll_unlocked (GPollFD *ufds, guint nfds, gint timeout)
+{
+    g_mutex_unlock (main_loop_mutex);
+    gint result = default_poll_func (ufds, nfds, timeout);
+    g_mutex_lock (main_loop_mutex);
+    return result;
+}
+
+static void
+snapshot_unref (snapshot_t *snap)
+{
+    if (!g_atomic_int_dec_and_test (&snap->refcount))
+        return;
+    if (snap->free_func)
+        snap->free_func (snap->data);
+    g_slice_free (snapshot_t, snap);
+}
+
+// returns a reference to the last snapshot published for renderer, or NULL
+static snapshot_t *
+get_snapshot (BotViewerPriv *priv, BotRenderer *renderer)
+{
+    snapshot_t *snap = g_hash_table_lookup (priv->snapshots, renderer);
+    if (snap)
+        g_atomic_int_inc (&snap->refcount);
+    return snap;
+}
+
+static void
+request_frame (BotViewerPriv *priv)
+{
+    g_mutex_lock (priv->frame_mutex);
+    priv->frame_requested = 1;
+    g_cond_signal (priv->frame_cond);
+    g_mutex_unlock (priv->frame_mutex);
+}
+
+// Passes the view and the renderers to draw to the render thread.  The view
+// handler sets up the matrices in the context of the GTK+ thread, where
+// they are also used for picking.
+static gboolean
+publish_frame (void *user_data)
+{
+    BotViewer *self = (BotViewer *) user_data;
+    BotViewerPriv *priv = BOT_VIEWER_GET_PRIVATE(self);
+    priv->frame_idle_id = 0;
+
+    if (!priv->render_thread ||
+            bot_gtk_gl_drawing_area_set_context (self->gl_area) < 0)
+        return FALSE;
+
+    if (self->view_handler)
+        self->view_handler->update_gl_matrices(self, self->view_handler);
+
+    g_mutex_lock (priv->frame_mutex);
+    glGetDoublev (GL_MODELVIEW_MATRIX, priv->frame_modelview);
+    glGetDoublev (GL_PROJECTION_MATRIX, priv->frame_projection);
+    priv->frame_width = GTK_WIDGET (self->gl_area)->allocation.width;
+    priv->frame_height = GTK_WIDGET (self->gl_area)->allocation.height;
+    memcpy (priv->frame_background, self->backgroundColor,
+            sizeof (priv->frame_background));
+    priv->frame_prettier = self->prettier_flag;
+    g_ptr_array_set_size (priv->frame_renderers, 0);
+    for (unsigned int ridx = 0; ridx < self->renderers->len; ridx++) {
+        BotRenderer *renderer = g_ptr_array_index(self->renderers, ridx);
+        if (renderer->enabled)
+            g_ptr_array_add (priv->frame_renderers, renderer);
+    }
+    priv->frame_requested = 1;
+    g_cond_signal (priv->frame_cond);
+    g_mutex_unlock (priv->frame_mutex);
+    return FALSE;
+}
+
 void bot_viewer_request_redraw (BotViewer *self)
 {
+    BotViewerPriv *priv = BOT_VIEWER_GET_PRIVATE(self);
+    if (!priv->render_thread) {
+        bot_gtk_gl_drawing_area_invalidate (self->gl_area);
+        return;
+    }
+
+    if (g_thread_self () == priv->gtk_thread) {
+        // the view can only change on the GTK+ thread
+        if (!priv->frame_idle_id)
+            priv->frame_idle_id = g_idle_add (publish_frame, self);
+    } else {
+        request_frame (priv);
+    }
+}
+
+static gboolean
+invalidate_idle (void *user_data)
+{
+    BotViewer *self = (BotViewer *) user_data;
     bot_gtk_gl_drawing_area_invalidate (self->gl_area);
+    return FALSE;
+}
+
+void
+bot_viewer_publish_snapshot (BotViewer *self, BotRenderer *renderer,
+        void *snapshot, GDestroyNotify free_func)
+{
+    BotViewerPriv *priv = BOT_VIEWER_GET_PRIVATE(self);
+    snapshot_t *snap = g_slice_new (snapshot_t);
+    snap->refcount = 1;
+    snap->data = snapshot;
+    snap->free_func = free_func;
+
+    // the old snapshot is freed outside of the lock
+    g_mutex_lock (priv->frame_mutex);
+    snapshot_t *old = g_hash_table_lookup (priv->snapshots, renderer);
+    g_hash_table_steal (priv->snapshots, renderer);
+    g_hash_table_insert (priv->snapshots, renderer, snap);
+    priv->frame_requested = 1;
+    g_cond_signal (priv->frame_cond);
+    g_mutex_unlock (priv->frame_mutex);
+
+    if (old)
+        snapshot_unref (old);
+
+    // without a render thread, the GTK+ thread draws
+    if (!priv->render_thread) {
+        if (g_thread_self () == priv->gtk_thread)
+            bot_gtk_gl_drawing_area_invalidate (self->gl_area);
+        else
+            g_idle_add (invalidate_idle, self);
+    }
 }
 
 static gboolean
@@ -90,7 +255,7 @@ on_render_timer (BotViewer * self)
     // check if we want to render.
     int64_t now = bot_timestamp_now();
     if(priv->next_render_utime < now) {
-        self->movie_draw_pending = 1;
+        g_atomic_int_set (&self->movie_draw_pending, 1);
         bot_viewer_request_redraw(self);
 
         while(priv->next_render_utime < now) 
@@ -164,16 +329,19 @@ abort_recording:
 void 
 bot_viewer_stop_recording (BotViewer *self)
 {
+    BotViewerPriv *priv = BOT_VIEWER_GET_PRIVATE(self);
+    g_mutex_lock (priv->movie_mutex);
     free(self->movie_buffer);
     self->movie_buffer = NULL;
 
-    printf("\nRecording stopped\n");
-    bot_viewer_set_status_bar_message (self, "Recording stopped");
-
     gzclose(self->movie_gzf);
     self->movie_gzf = NULL;
     free(self->movie_path);
-    self->movie_draw_pending = 0;
+    g_atomic_int_set (&self->movie_draw_pending, 0);
+    g_mutex_unlock (priv->movie_mutex);
+
+    printf("\nRecording stopped\n");
+    bot_viewer_set_status_bar_message (self, "Recording stopped");
 
     g_source_remove (self->render_timer_id);
 
@@ -391,16 +559,8 @@ check_gl_errors (const char *label) {
 }
 
 static void
-render_scene (BotViewer *self)
+setup_lights (int prettier)
 {
-//    glClearColor (0.0, 0.0, 0.0, 1.0);
-    glClearColor(self->backgroundColor[0], self->backgroundColor[1], 
-                 self->backgroundColor[2], self->backgroundColor[3]);
-    glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    if (self->view_handler)
-        self->view_handler->update_gl_matrices(self, self->view_handler);
-
     glMatrixMode (GL_MODELVIEW);
 
     /* give the ambient light a blue tint to match the blue sky */
@@ -414,32 +574,103 @@ render_scene (BotViewer *self)
     glLightfv (GL_LIGHT0, GL_POSITION, light0_pos);
     glEnable (GL_LIGHT0);
 
-    if (self->prettier_flag) {
+    if (prettier) {
         glEnable(GL_LINE_STIPPLE);
         glEnable(GL_LINE_SMOOTH);
         glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
         glEnable(GL_POINT_SMOOTH);
         glHint(GL_POINT_SMOOTH_HINT, GL_NICEST);
     }
+}
+
+// draws from snapshot if it isn't NULL
+static void
+draw_renderer (BotViewer *self, BotRenderer *renderer, snapshot_t *snapshot)
+{
+    glPushAttrib(GL_ENABLE_BIT | GL_POINT_BIT | GL_POLYGON_STIPPLE_BIT | 
+                 GL_POLYGON_BIT | GL_LINE_BIT | GL_FOG_BIT | GL_LIGHTING_BIT );
+    glPushMatrix();
+
+    if (snapshot)
+        renderer->draw_snapshot (self, renderer, snapshot->data);
+    else if (renderer->draw)
+        renderer->draw (self, renderer);
+
+    check_gl_errors (renderer->name);
+
+    glPopMatrix();
+    glPopAttrib();
+}
+
+static void
+render_scene (BotViewer *self)
+{
+    BotViewerPriv *priv = BOT_VIEWER_GET_PRIVATE(self);
+
+//    glClearColor (0.0, 0.0, 0.0, 1.0);
+    glClearColor(self->backgroundColor[0], self->backgroundColor[1], 
+                 self->backgroundColor[2], self->backgroundColor[3]);
+    glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    if (self->view_handler)
+        self->view_handler->update_gl_matrices(self, self->view_handler);
+
+    setup_lights (self->prettier_flag);
+
+    // queue up text labels from all renderers, and draw them at the end
+    bot_gl_text_begin_batch();
 
     for (unsigned int ridx = 0; ridx < self->renderers->len; ridx++) {
         BotRenderer *renderer = g_ptr_array_index(self->renderers, ridx);
 
         if (renderer->enabled) {
-            
-            glPushAttrib(GL_ENABLE_BIT | GL_POINT_BIT | GL_POLYGON_STIPPLE_BIT | 
-                         GL_POLYGON_BIT | GL_LINE_BIT | GL_FOG_BIT | GL_LIGHTING_BIT );
-            glPushMatrix();
-
-            if (renderer->draw)
-                renderer->draw (self, renderer);
+            snapshot_t *snap = NULL;
+            if (!renderer->draw && renderer->draw_snapshot) {
+                g_mutex_lock (priv->frame_mutex);
+                snap = get_snapshot (priv, renderer);
+                g_mutex_unlock (priv->frame_mutex);
+                if (!snap)
+                    continue;
+            }
 
-            check_gl_errors (renderer->name);
+            draw_renderer (self, renderer, snap);
 
-            glPopMatrix();
-            glPopAttrib();
+            if (snap)
+                snapshot_unref (snap);
         }
     }
+
+    bot_gl_text_end_batch();
+    check_gl_errors ("text");
+}
+
+static void
+write_movie_frame (BotViewer *self)
+{
+    glReadPixels (0, 0, self->movie_width, self->movie_height, GL_RGB, GL_UNSIGNED_BYTE, self->movie_buffer); 
+    
+    gzprintf(self->movie_gzf, "P6 %d %d %d\n", self->movie_width, self->movie_height, 255);
+    
+    for (int h = self->movie_height - 1; h >= 0; h--) {
+        int offset = self->movie_stride * h;
+        gzwrite(self->movie_gzf, &self->movie_buffer[offset], self->movie_stride);
+    }
+
+    g_atomic_int_set (&self->movie_draw_pending, 0);
+    int64_t now = bot_timestamp_now();
+    double dt;
+    if (self->movie_frame_last_utime == 0)
+        dt = 1.0 / self->movie_desired_fps;
+    else
+        dt = (now - self->movie_frame_last_utime)/1000000.0;
+    double fps = 1.0 / dt;
+    self->movie_frame_last_utime = now;
+    double alpha = 0.8; // higher = lower-pass
+    self->movie_actual_fps = alpha * self->movie_actual_fps + (1 - alpha) * fps;
+    self->movie_frames++;
+
+    printf("%20s %6d (%5.2f fps)\r", self->movie_path, self->movie_frames, self->movie_actual_fps);
+    fflush(NULL);
 }
 
 static gboolean
@@ -447,6 +678,12 @@ on_gl_expose (GtkWidget *widget, GdkEventExpose *event, void *user_data)
 {
     BotViewer * self = (BotViewer *) user_data;
 
+    // the render thread limits its own frame rate
+    if (BOT_VIEWER_GET_PRIVATE(self)->render_thread) {
+        bot_viewer_request_redraw (self);
+        return TRUE;
+    }
+
     // if not enough time has elapsed since our last redraw, we
     // schedule a redraw in the future (if one isn't already pending).
     int64_t now = bot_timestamp_now();
@@ -492,31 +729,7 @@ on_gl_expose (GtkWidget *widget, GdkEventExpose *event, void *user_data)
     // write a movie frame?
     if (self->movie_draw_pending) {
         assert(self->movie_gzf);
-
-        glReadPixels (0, 0, self->movie_width, self->movie_height, GL_RGB, GL_UNSIGNED_BYTE, self->movie_buffer); 
-        
-        gzprintf(self->movie_gzf, "P6 %d %d %d\n", self->movie_width, self->movie_height, 255);
-        
-        for (int h = self->movie_height - 1; h >= 0; h--) {
-            int offset = self->movie_stride * h;
-            gzwrite(self->movie_gzf, &self->movie_buffer[offset], self->movie_stride);
-        }
-
-        self->movie_draw_pending = 0;
-        int64_t now = bot_timestamp_now();
-        double dt;
-        if (self->movie_frame_last_utime == 0)
-            dt = 1.0 / self->movie_desired_fps;
-        else
-            dt = (now - self->movie_frame_last_utime)/1000000.0;
-        double fps = 1.0 / dt;
-        self->movie_frame_last_utime = now;
-        double alpha = 0.8; // higher = lower-pass
-        self->movie_actual_fps = alpha * self->movie_actual_fps + (1 - alpha) * fps;
-        self->movie_frames++;
-
-        printf("%20s %6d (%5.2f fps)\r", self->movie_path, self->movie_frames, self->movie_actual_fps);
-        fflush(NULL);
+        write_movie_frame (self);
     }
 
     return TRUE;
@@ -832,15 +1045,9 @@ _pixel_convert_8u_bgra_to_8u_rgb(uint8_t *dest, int dstride, int dwidth,
     return 0;
 }
 
-static gboolean
-take_screenshot (void *user_data, char *fname)
+static int
+save_screenshot (int w, int h, const char *fname)
 {
- 
-    BotViewer *self = (BotViewer*) user_data;
-    BotViewHandler *vhandler = self->view_handler;
-
-    int w = GTK_WIDGET (self->gl_area)->allocation.width;
-    int h = GTK_WIDGET (self->gl_area)->allocation.height;
     uint8_t *bgra = (uint8_t*)malloc (w*h*4);
     uint8_t *rgb = (uint8_t*)malloc (w*h*3);
     glReadPixels (0, 0, w, h, GL_BGRA, GL_UNSIGNED_BYTE, bgra); 
@@ -850,28 +1057,337 @@ take_screenshot (void *user_data, char *fname)
         err ("couldn't take screenshot\n");
         free (bgra);
         free (rgb);
-        return FALSE;
-    } else {
-        _pixel_convert_8u_bgra_to_8u_rgb (rgb, w*3, w, h, bgra, w*4);
-        bot_ppm_write_bottom_up (fp, rgb, w, h, w*3);
-        fclose (fp);
-
-        dbg ("screenshot saved to %s\n", fname);
-        bot_viewer_set_status_bar_message (self, "screenshot saved to %s", fname);
+        return -1;
     }
+    _pixel_convert_8u_bgra_to_8u_rgb (rgb, w*3, w, h, bgra, w*4);
+    bot_ppm_write_bottom_up (fp, rgb, w, h, w*3);
+    fclose (fp);
     free (bgra);
     free (rgb);
+    dbg ("screenshot saved to %s\n", fname);
+    return 0;
+}
+
+static gboolean
+take_screenshot (void *user_data, char *fname)
+{
+    BotViewer *self = (BotViewer*) user_data;
+
+    int w = GTK_WIDGET (self->gl_area)->allocation.width;
+    int h = GTK_WIDGET (self->gl_area)->allocation.height;
+    if (save_screenshot (w, h, fname) < 0)
+        return FALSE;
+
+    bot_viewer_set_status_bar_message (self, "screenshot saved to %s", fname);
     return TRUE;
 }
 
 static void
 on_screenshot_clicked (GtkToolButton *ssbt, void *user_data)
 {
+    BotViewer *self = (BotViewer*) user_data;
+    BotViewerPriv *priv = BOT_VIEWER_GET_PRIVATE(self);
     char * fname = bot_fileutils_get_unique_filename (NULL, "viewer", 1, "ppm");
+
+    // the render thread saves the next frame it draws
+    if (priv->render_thread) {
+        g_mutex_lock (priv->frame_mutex);
+        free (priv->screenshot_fname);
+        priv->screenshot_fname = fname;
+        g_mutex_unlock (priv->frame_mutex);
+        bot_viewer_request_redraw (self);
+        return;
+    }
+
     take_screenshot (user_data, fname);
     free (fname);
 }
 
+// ============== render thread ===========
+
+typedef struct _screenshot_saved screenshot_saved_t;
+struct _screenshot_saved {
+    BotViewer *viewer;
+    char *fname;
+};
+
+static gboolean
+on_screenshot_saved (void *user_data)
+{
+    screenshot_saved_t *saved = (screenshot_saved_t*) user_data;
+    bot_viewer_set_status_bar_message (saved->viewer, "screenshot saved to %s",
+            saved->fname);
+    free (saved->fname);
+    free (saved);
+    return FALSE;
+}
+
+static void
+render_frame (BotViewer *self, GPtrArray *renderers, GPtrArray *snapshots,
+        const double modelview[16], const double projection[16],
+        const float background[4], int prettier)
+{
+    glClearColor(background[0], background[1], background[2], background[3]);
+    glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glMatrixMode (GL_PROJECTION);
+    glLoadMatrixd (projection);
+    glMatrixMode (GL_MODELVIEW);
+    glLoadMatrixd (modelview);
+
+    setup_lights (prettier);
+
+    // holding main_loop_mutex?
+    int locked = 0;
+
+    if (g_signal_has_handler_pending (self,
+                bot_viewer_signals[RENDER_BEGIN_SIGNAL], 0, TRUE)) {
+        g_mutex_lock (main_loop_mutex);
+        locked = 1;
+        g_signal_emit(G_OBJECT(self), bot_viewer_signals[RENDER_BEGIN_SIGNAL], 0);
+    }
+
+    bot_gl_text_begin_batch();
+
+    for (unsigned int ridx = 0; ridx < renderers->len; ridx++) {
+        BotRenderer *renderer = g_ptr_array_index(renderers, ridx);
+        snapshot_t *snap = g_ptr_array_index(snapshots, ridx);
+
+        // consecutive renderers that don't draw from snapshots are drawn
+        // while holding the lock once
+        if (!snap && !locked) {
+            g_mutex_lock (main_loop_mutex);
+            locked = 1;
+        } else if (snap && locked) {
+            g_mutex_unlock (main_loop_mutex);
+            locked = 0;
+        }
+
+        draw_renderer (self, renderer, snap);
+    }
+
+    bot_gl_text_end_batch();
+    check_gl_errors ("text");
+
+    if (g_signal_has_handler_pending (self,
+                bot_viewer_signals[RENDER_END_SIGNAL], 0, TRUE)) {
+        if (!locked) {
+            g_mutex_lock (main_loop_mutex);
+            locked = 1;
+        }
+        g_signal_emit(G_OBJECT(self), bot_viewer_signals[RENDER_END_SIGNAL], 0);
+    }
+
+    if (locked)
+        g_mutex_unlock (main_loop_mutex);
+}
+
+static gpointer
+render_thread_main (gpointer user_data)
+{
+    BotViewer *self = (BotViewer*) user_data;
+    BotViewerPriv *priv = BOT_VIEWER_GET_PRIVATE(self);
+
+    int status = bot_gtk_gl_thread_context_make_current (priv->render_ctx);
+
+    g_mutex_lock (priv->frame_mutex);
+    priv->render_thread_status = status < 0 ? -1 : 1;
+    g_cond_broadcast (priv->frame_cond);
+    if (status < 0) {
+        g_mutex_unlock (priv->frame_mutex);
+        bot_gtk_gl_thread_context_destroy (priv->render_ctx);
+        return NULL;
+    }
+
+    GPtrArray *renderers = g_ptr_array_new ();
+    GPtrArray *snapshots = g_ptr_array_new ();
+
+    while (!priv->render_thread_quit) {
+        if (!priv->frame_requested || !priv->frame_width) {
+            g_cond_wait (priv->frame_cond, priv->frame_mutex);
+            continue;
+        }
+
+        // don't draw faster than MAX_REDRAW_HZ
+        int64_t now = bot_timestamp_now();
+        int64_t next_utime = self->last_draw_utime + 1000000 / MAX_REDRAW_HZ;
+        if (now < next_utime) {
+            GTimeVal until;
+            g_get_current_time (&until);
+            g_time_val_add (&until, next_utime - now);
+            g_cond_timed_wait (priv->frame_cond, priv->frame_mutex, &until);
+            continue;
+        }
+        self->last_draw_utime = now;
+        priv->frame_requested = 0;
+        g_draws++;
+
+        // take what this frame needs, so that the GTK+ thread and the
+        // renderers can publish the next frame while this one is drawn
+        int width = priv->frame_width;
+        int height = priv->frame_height;
+        double modelview[16], projection[16];
+        float background[4];
+        memcpy (modelview, priv->frame_modelview, sizeof (modelview));
+        memcpy (projection, priv->frame_projection, sizeof (projection));
+        memcpy (background, priv->frame_background, sizeof (background));
+        int prettier = priv->frame_prettier;
+        g_ptr_array_set_size (renderers, 0);
+        g_ptr_array_set_size (snapshots, 0);
+        for (unsigned int ridx = 0; ridx < priv->frame_renderers->len; ridx++) {
+            BotRenderer *renderer = g_ptr_array_index(priv->frame_renderers, ridx);
+            snapshot_t *snap = NULL;
+            if (renderer->draw_snapshot) {
+                snap = get_snapshot (priv, renderer);
+                if (!snap)
+                    continue;
+            }
+            g_ptr_array_add (renderers, renderer);
+            g_ptr_array_add (snapshots, snap);
+        }
+        char *screenshot_fname = priv->screenshot_fname;
+        priv->screenshot_fname = NULL;
+        g_mutex_unlock (priv->frame_mutex);
+
+        glViewport (0, 0, width, height);
+        render_frame (self, renderers, snapshots, modelview, projection,
+                background, prettier);
+
+        for (unsigned int ridx = 0; ridx < snapshots->len; ridx++) {
+            snapshot_t *snap = g_ptr_array_index(snapshots, ridx);
+            if (snap)
+                snapshot_unref (snap);
+        }
+
+        if (screenshot_fname) {
+            if (save_screenshot (width, height, screenshot_fname) == 0) {
+                screenshot_saved_t *saved =
+                    (screenshot_saved_t*) malloc (sizeof (screenshot_saved_t));
+                saved->viewer = self;
+                saved->fname = screenshot_fname;
+                g_idle_add (on_screenshot_saved, saved);
+            } else {
+                free (screenshot_fname);
+            }
+        }
+
+        // read back and compress the movie frame without holding
+        // frame_mutex, so that the GTK+ thread can publish the next frame
+        if (g_atomic_int_get (&self->movie_draw_pending)) {
+            g_mutex_lock (priv->movie_mutex);
+            if (self->movie_gzf)
+                write_movie_frame (self);
+            g_mutex_unlock (priv->movie_mutex);
+        }
+
+        bot_gtk_gl_thread_context_swap_buffers (priv->render_ctx);
+        g_mutex_lock (priv->frame_mutex);
+    }
+    g_mutex_unlock (priv->frame_mutex);
+
+    g_ptr_array_free (renderers, TRUE);
+    g_ptr_array_free (snapshots, TRUE);
+    bot_gtk_gl_thread_context_destroy (priv->render_ctx);
+    return NULL;
+}
+
+static void
+stop_render_thread (BotViewer *self)
+{
+    BotViewerPriv *priv = BOT_VIEWER_GET_PRIVATE(self);
+    if (!priv->render_thread)
+        return;
+
+    g_mutex_lock (priv->frame_mutex);
+    priv->render_thread_quit = 1;
+    g_cond_signal (priv->frame_cond);
+    g_mutex_unlock (priv->frame_mutex);
+
+    // the render thread may be waiting for the main loop
+    g_mutex_unlock (main_loop_mutex);
+    g_thread_join (priv->render_thread);
+    g_mutex_lock (main_loop_mutex);
+
+    priv->render_thread = NULL;
+    priv->render_ctx = NULL;
+    if (priv->frame_idle_id) {
+        g_source_remove (priv->frame_idle_id);
+        priv->frame_idle_id = 0;
+    }
+
+    if (--main_loop_mutex_users == 0) {
+        g_main_context_set_poll_func (NULL, default_poll_func);
+        g_mutex_unlock (main_loop_mutex);
+    }
+
+    // back to drawing on the GTK+ thread
+    bot_gtk_gl_drawing_area_invalidate (self->gl_area);
+}
+
+static void
+on_gl_unrealize (GtkWidget *widget, void *user_data)
+{
+    stop_render_thread ((BotViewer*) user_data);
+}
+
+int
+bot_viewer_set_render_thread (BotViewer *self, gboolean enable)
+{
+    BotViewerPriv *priv = BOT_VIEWER_GET_PRIVATE(self);
+    if (!enable) {
+        stop_render_thread (self);
+        return 0;
+    }
+    if (priv->render_thread)
+        return 0;
+
+    priv->render_ctx = bot_gtk_gl_drawing_area_new_thread_context (self->gl_area);
+    if (!priv->render_ctx) {
+        err ("viewer: can't create an OpenGL context for the render thread\n");
+        bot_viewer_set_status_bar_message (self, "Render thread unavailable, "
+                "drawing on the GTK+ thread");
+        return -1;
+    }
+
+    if (main_loop_mutex_users++ == 0) {
+        if (!main_loop_mutex)
+            main_loop_mutex = g_mutex_new ();
+        g_mutex_lock (main_loop_mutex);
+        default_poll_func = g_main_context_get_poll_func (NULL);
+        g_main_context_set_poll_func (NULL, poll_unlocked);
+    }
+
+    priv->render_thread_status = 0;
+    priv->render_thread_quit = 0;
+    priv->render_thread = g_thread_create (render_thread_main, self, TRUE, NULL);
+    if (priv->render_thread) {
+        g_mutex_lock (priv->frame_mutex);
+        while (!priv->render_thread_status)
+            g_cond_wait (priv->frame_cond, priv->frame_mutex);
+        g_mutex_unlock (priv->frame_mutex);
+    } else {
+        bot_gtk_gl_thread_context_destroy (priv->render_ctx);
+    }
+
+    if (!priv->render_thread || priv->render_thread_status < 0) {
+        if (priv->render_thread)
+            g_thread_join (priv->render_thread);
+        priv->render_thread = NULL;
+        priv->render_ctx = NULL;
+        if (--main_loop_mutex_users == 0) {
+            g_main_context_set_poll_func (NULL, default_poll_func);
+            g_mutex_unlock (main_loop_mutex);
+        }
+        err ("viewer: failed to start the render thread\n");
+        bot_viewer_set_status_bar_message (self, "Render thread unavailable, "
+                "drawing on the GTK+ thread");
+        return -1;
+    }
+
+    bot_viewer_request_redraw (self);
+    return 0;
+}
+
 
 /*
 static gboolean
@@ -1401,6 +1917,14 @@ bot_viewer_finalize (GObject *obj)
     BotViewerPriv* priv = BOT_VIEWER_GET_PRIVATE(self);
     free(priv->bookmarks);
 
+    stop_render_thread (self);
+    g_hash_table_destroy (priv->snapshots);
+    g_ptr_array_free (priv->frame_renderers, TRUE);
+    free (priv->screenshot_fname);
+    g_mutex_free (priv->frame_mutex);
+    g_cond_free (priv->frame_cond);
+    g_mutex_free (priv->movie_mutex);
+
     gtk_widget_destroy (GTK_WIDGET (self->window));
 
     G_OBJECT_CLASS (bot_viewer_parent_class)->finalize(obj);
@@ -1469,6 +1993,16 @@ bot_viewer_init (BotViewer *viewer)
 {
     BotViewerPriv* priv = BOT_VIEWER_GET_PRIVATE(viewer);
 
+    if (!g_thread_supported ())
+        g_thread_init (NULL);
+    priv->gtk_thread = g_thread_self ();
+    priv->frame_mutex = g_mutex_new ();
+    priv->frame_cond = g_cond_new ();
+    priv->movie_mutex = g_mutex_new ();
+    priv->frame_renderers = g_ptr_array_new ();
+    priv->snapshots = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+            NULL, (GDestroyNotify) snapshot_unref);
+
     viewer->renderers = g_ptr_array_new();
     viewer->renderers_sorted = g_ptr_array_new();
     viewer->renderers_sorted_with_controls = g_ptr_array_new();
@@ -1608,6 +2142,8 @@ bot_viewer_init (BotViewer *viewer)
             G_CALLBACK (on_gl_configure), viewer);
     g_signal_connect (G_OBJECT (viewer->gl_area), "expose-event",
             G_CALLBACK (on_gl_expose), viewer);
+    g_signal_connect (G_OBJECT (viewer->gl_area), "unrealize",
+            G_CALLBACK (on_gl_unrealize), viewer);
     g_signal_connect (G_OBJECT (viewer->gl_area), "button-press-event",
             G_CALLBACK (on_button_press), viewer);
     g_signal_connect (G_OBJECT (viewer->gl_area), "button-release-event",
@@ -207,6 +207,9 @@ struct _BotEventHandler
  * @draw: Drawing this renderer.
  * @destroy: Destroy this renderer (when done).
  * @user: User data to be used by the subclass.
+ * @draw_snapshot: Drawing the last snapshot published with
+ * bot_viewer_publish_snapshot().  Used instead of @draw when the viewer has a
+ * render thread, and when @draw is %NULL.
  * @expanded: TRUE when this is expanded in the side pane.
  * @cmi: Enable checkbox.
  * @expander:
@@ -265,6 +268,9 @@ struct _BotRenderer {
     GtkWidget         *cmi;
     GtkWidget         *expander;
     GtkWidget         *control_frame;
+
+    void (*draw_snapshot) (BotViewer *viewer, BotRenderer *renderer,
+                           const void *snapshot);
 };
 
 #define BOT_VIEWER(obj)  (G_TYPE_CHECK_INSTANCE_CAST((obj), bot_viewer_get_type(), BotViewer))
@@ -403,6 +409,51 @@ void bot_viewer_stop_recording (BotViewer *viewer);
  */
 void bot_viewer_request_redraw (BotViewer *viewer);
 
+/**
+ * bot_viewer_set_render_thread:
+ * @viewer: The viewer.
+ * @enable: Whether to render on a dedicated thread.
+ *
+ * By default, the viewer renders on the GTK+ thread, which also handles
+ * input, widgets and usually LCM messages, so that any of these can delay
+ * the others.  With a render thread, the OpenGL context used for rendering
+ * is owned by a separate thread, and the GTK+ thread only passes it the
+ * view and the list of enabled renderers for each frame.
+ *
+ * Renderers with a @draw_snapshot method are drawn on the render thread
+ * from the snapshots they publish with bot_viewer_publish_snapshot(),
+ * without waiting for the GTK+ thread.  Other renderers, and the
+ * render-begin and render-end signal handlers, are also called on the
+ * render thread, but only while the GTK+ main loop is idle, so they can
+ * keep sharing data with the code that runs on the GTK+ thread.  They must
+ * not make any OpenGL calls outside of @draw.
+ *
+ * Must be called on the GTK+ thread, which must run the default GLib main
+ * context, after the viewer's window is realized.  The render thread
+ * shares the GTK+ connection to the X server, so XInitThreads() must be
+ * called before gtk_init().
+ *
+ * Returns: 0 on success, -1 if the render thread could not be started.  The
+ * viewer then keeps rendering on the GTK+ thread, and says so in its
+ * status bar.
+ */
+int bot_viewer_set_render_thread (BotViewer *viewer, gboolean enable);
+
+/**
+ * bot_viewer_publish_snapshot:
+ * @viewer: The viewer.
+ * @renderer: The renderer that draws @snapshot.
+ * @snapshot: An immutable copy of the data that @renderer draws.  The
+ * viewer takes ownership of it.
+ * @free_func: Frees @snapshot once it has been replaced and is no longer
+ * being drawn.  Can be called on any thread.
+ *
+ * Replaces the snapshot drawn by the @draw_snapshot method of @renderer, and
+ * requests a redraw.  Can be called on any thread.
+ */
+void bot_viewer_publish_snapshot (BotViewer *viewer, BotRenderer *renderer,
+        void *snapshot, GDestroyNotify free_func);
+
 
 
 /**
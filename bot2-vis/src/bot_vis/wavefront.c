@@ -86,6 +86,12 @@ bot_wavefront_model_gl_draw (BotWavefrontModel *model)
     //glEnable(GL_LIGHTING);
 }
 
+gboolean
+bot_wavefront_model_textures_pending (BotWavefrontModel *model)
+{
+    return glmTexturesPending (model->glm_model);
+}
+
 void
 bot_wavefront_model_get_extrema (BotWavefrontModel *model,
                                  double minv[3], double maxv[3])
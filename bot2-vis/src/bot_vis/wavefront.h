@@ -52,7 +52,8 @@ bot_wavefront_model_create (const char *filename);
  * bot_wavefront_model_destroy:
  * @model: The %BotWavefrontModel to free
  *
- * Frees the provided %BotWavefrontModel
+ * Frees the provided %BotWavefrontModel.  The OpenGL context it was drawn
+ * in must be current, since the textures no other model uses are deleted.
  *
  */
 void
@@ -79,6 +80,21 @@ bot_wavefront_model_get_extrema (BotWavefrontModel *model,
 void
 bot_wavefront_model_gl_draw (BotWavefrontModel *model);
 
+/**
+ * bot_wavefront_model_textures_pending:
+ * @model: The %BotWavefrontModel
+ *
+ * The textures of a model are decoded on worker threads, and uploaded by
+ * bot_wavefront_model_gl_draw() once decoded.  Until then, the model is
+ * drawn without them.  Textures are shared by all the models that use the
+ * same image files.
+ *
+ * Returns: TRUE while some textures are not uploaded yet.  The model
+ *          should not be compiled into a display list until then.
+ */
+gboolean
+bot_wavefront_model_textures_pending (BotWavefrontModel *model);
+
 
 
 
@@ -50,7 +50,14 @@ draw_wavefront_model (RendererWavefront * self)
     glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glShadeModel (GL_SMOOTH);
     glEnable (GL_LIGHTING);
-    glCallList (self->wavefront_dl);
+    if (self->display_lists_ready) {
+        glCallList (self->wavefront_dl);
+    } else {
+        // draw without a display list until the textures are loaded
+        bot_wavefront_model_gl_draw (self->wavefront_model);
+        glDisable (GL_LIGHTING);
+        bot_viewer_request_redraw (self->viewer);
+    }
     glPopMatrix ();
 }
 
@@ -75,9 +82,9 @@ _renderer_draw (BotViewer *viewer, BotRenderer *super)
 
     glEnable(GL_DEPTH_TEST);
 
-    if (!self->display_lists_ready) {
-        if (self->wavefront_model)
-            self->wavefront_dl = compile_display_list (self, "wavefront", self->wavefront_model);
+    if (!self->display_lists_ready && self->wavefront_model &&
+            !bot_wavefront_model_textures_pending (self->wavefront_model)) {
+        self->wavefront_dl = compile_display_list (self, "wavefront", self->wavefront_model);
         self->display_lists_ready = 1;
     }
 
@@ -98,7 +105,7 @@ _renderer_draw (BotViewer *viewer, BotRenderer *super)
     double dz = bot_gtk_param_widget_get_double(self->pw, PARAM_DZ);
     glTranslated(dx, dy, dz);
 
-    if (self->display_lists_ready && self->wavefront_dl)
+    if (self->wavefront_model)
         draw_wavefront_model (self);
 
     glPopMatrix();